@@ -10,8 +10,14 @@
  * inefficient in that it does many "bureaucratic" things that would normally
  * be done once when an application or device driver is initialized.
  *
+ * AsyncSCSI keeps no state of its own: the SCSI Manager presence test, the
+ * watchdog, and the device policies are in the caller's SCSIEnvironment, so
+ * it may be called with different environments (for example, from several
+ * Thread Manager threads) without interference.
+ *
  * Calling Sequence:
  *		OSErr				AsyncSCSI(
+ *				SCSIEnvironmentPtr		environmentPtr,
  *				DeviceIdent				scsiDevice,
  *				const SCSI_CommandPtr	scsiCommand,
  *				unsigned short			cmdBlockLength,
@@ -27,6 +33,8 @@
  *			);
  * The parameters have the following meaning:
  *
+ *	environmentPtr		The caller's context (see SCSIEnvironment.h). Its idle
+ *						procedure is called while the command is in progress.
  *	scsiDevice			The SCSI host bus, target, lun that we are talking to.
  *	scsiCommand			The SCSI Command Block (6, 10, or 12 bytes).
  *	cmdBlockLength		The length in bytes of the command block.
@@ -65,7 +73,11 @@
  *					to successfully issue Request Sense. There is data in the
  *					Sense Record, but you cannot assume that the original request
  *					succeeded.
+ *	controlErr		Device returned "Busy" or "Queue Full": it did not execute
+ *					the command, which may be retried.
  *	paramErr		Could not determine the command length.
+ *	scsiCommandTimeout	The request did not complete before its deadline and
+ *					was aborted by the watchdog (see SCSIWatchdog.c).
  *	scsi...			Other error
  */
 #include <Gestalt.h>
@@ -73,20 +85,16 @@
 #include <Events.h>
 #include <Errors.h>
 #include "MacSCSICommand.h"
+#include "SCSIEnvironment.h"
 #ifndef TRUE
 #define TRUE		1
 #define FALSE		0
 #endif
 
-/*
- * These globals are defined by SCSISimpleSample.h, and are needed only for
- * testing and debugging.
- */
-extern Boolean					gEnableSelectWithATN;
-extern Boolean					gDoDisconnect;
-extern Boolean					gDontDisconnect;
-
 static void 					NextFunction(void);		/* For HoldMemory size	*/
+static pascal void				AsyncSCSICompletion(	/* Marks request done	*/
+		void					*scsiPB
+	);
 /*
  * This should be specified at application/driver startup, and not the
  * inefficient "call Gestalt each time" shown here.
@@ -116,6 +124,7 @@ static Boolean					IsVirtualMemoryRunning(void);
 #define kHoldParamBlock			0x0010				/* SCSIExecIOPB				*/
 
 OSErr						AsyncSCSI(
+		SCSIEnvironmentPtr		environmentPtr,		/* -> Caller's context		*/
 		DeviceIdent				scsiDevice,			/* -> Bus/target/LUN		*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
@@ -136,6 +145,7 @@ OSErr						AsyncSCSI(
  */
 OSErr
 AsyncSCSI(
+		SCSIEnvironmentPtr		environmentPtr,		/* -> Caller's context		*/
 		DeviceIdent				scsiDevice,			/* -> Bus/target/LUN		*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
@@ -155,20 +165,9 @@ AsyncSCSI(
 		register SCSIExecIOPB	*execIOPBPtr;		/* Used for SCSIAction		*/
 #define PB						(*execIOPBPtr)		/* PB references paramBlock	*/
 		unsigned long			execIOPBSize;		/* SCSIAction pb size		*/
-		Boolean					enableSelectWithATN; /* Ok to select with ATN?	*/
+		Boolean					selectWithATNSafe;	/* Bus can select w/ATN?	*/
+		unsigned long			startTicks;			/* Measures the device		*/
 		register short			i;					/* Move command block index	*/
-		
-		/*
-		 * These two flags are used to record whether the asynchronous SCSI
-		 * Manager is present on this machine (one flag records whether it is
-		 * present, the other whether we've tested for presence). This is
-		 * reasonable for applications. However, this is not sufficient for
-		 * drivers or other code that may be called before the system has been
-		 * completely initialized, as the asynchronous SCSI Manager may be
-		 * installed by a System Extension.
-		 */
-		static Boolean			gHasAsyncSCSIManager;
-		static Boolean			gTestedForAsyncSCSIManager;
 		/*
 		 * The following parameters are used to manage virtual memory.
 		 */
@@ -196,18 +195,11 @@ AsyncSCSI(
 		execIOPBPtr = NULL;
 		/*
 		 * First, make sure that the asynchronous SCSI Manager has been installed.
-		 * In an application, this may be done once when the application starts.
+		 * The environment records the result, so the test is made only once.
 		 * In a driver, this test must be deferred until the Process Manager
 		 * is running.
 		 */
-		if (gTestedForAsyncSCSIManager == FALSE) {
-			gTestedForAsyncSCSIManager = TRUE;
-			gHasAsyncSCSIManager = (
-					NGetTrapAddress(_SCSIAtomic, OSTrap)
-					!= NGetTrapAddress(_Unimplemented, OSTrap)
-				);
-		}
-		if (gHasAsyncSCSIManager == FALSE) {
+		if (SCSIEnvironmentHasAsyncSCSIManager(environmentPtr) == FALSE) {
 			status = unimpErr;
 			goto exit;
 		}
@@ -233,9 +225,8 @@ AsyncSCSI(
 		 * whether the bug was fixed, either by running on later hardware or by
 		 * installing a System Update.
 		 */
-		enableSelectWithATN =
-				gEnableSelectWithATN
-				&& (busInquiryPB.scsiWeirdStuff & scsiTargetDrivenSDTRSafe) != 0; 
+		selectWithATNSafe =
+				(busInquiryPB.scsiWeirdStuff & scsiTargetDrivenSDTRSafe) != 0;
 		/*
 		 * Allocate a parameter block for this request using the size that
 		 * was returned in the busInquiry parameter block.
@@ -302,16 +293,14 @@ AsyncSCSI(
 			PB.scsiFlags |= scsiDisableAutosense;
 		}
 		/*
-		 * Look at the global flags that can be set to configure the asynchronous
-		 * SCSI Manager - these are for testing, and would typically be set
-		 * permanently to a particular (device-specific) state by a real application.
+		 * Ask the device policy whether this device should disconnect and
+		 * whether it may be selected with Attention. The policy is chosen
+		 * for each device (see DevicePolicy.h), and adapts to the latency
+		 * measured below.
 		 */
-		if (enableSelectWithATN == FALSE)	/* Enabled by user and SCSI manager? */
-			PB.scsiIOFlags |= scsiDisableSelectWAtn;
-		if (gDoDisconnect)
-			PB.scsiFlags |= scsiDoDisconnect;
-		if (gDontDisconnect)
-			PB.scsiFlags |= scsiDontDisconnect;
+		DevicePolicyApply(
+			&environmentPtr->policy, scsiDevice, selectWithATNSafe,
+			&PB.scsiFlags, &PB.scsiIOFlags);
 		/*
 		 * We are now ready to perform the operation. If virtual memory is active
 		 * however, we must lock down all memory segments that can be potentially
@@ -392,13 +381,31 @@ AsyncSCSI(
 			}
 		}
 		/*
-		 * Finally, call the asynchronous SCSI Manager. SCSIAction is synchronous
-		 * because we did not specify a completion routine.
+		 * Finally, call the asynchronous SCSI Manager. We specify a completion
+		 * routine, so SCSIAction returns as soon as the request is queued and
+		 * PB.scsiResult remains scsiRequestInProgress until the request
+		 * completes. While we wait, the watchdog checks whether the request
+		 * is late and, if so, aborts it or resets the device or bus. Without
+		 * this, a hung device would stall its bus until the SIM timed out the
+		 * request (which can take a minute and a half for spin-up commands).
+		 * The environment's idle procedure lets other threads run meanwhile.
 		 */
 		if (status == noErr) {
+			PB.scsiCompletion = (CallbackProc) AsyncSCSICompletion;
+			(void) SCSIWatchdogStart(&environmentPtr->watchdog, &PB);
+			startTicks = TickCount();
 			status = SCSIAction((SCSI_PB *) &PB);
-			if (status == noErr)
+			if (status == noErr) {
+				while (PB.scsiResult == scsiRequestInProgress) {
+					SCSIWatchdogPoll(&environmentPtr->watchdog, &PB);
+					SCSIEnvironmentIdle(environmentPtr);
+				}
 				status = PB.scsiResult;
+			}
+			status = SCSIWatchdogFinish(&environmentPtr->watchdog, &PB, status);
+			DevicePolicyRecord(
+				&environmentPtr->policy, scsiDevice,
+				PB.scsiIOFlags, TickCount() - startTicks, status);
 		}
 		/*
 		 * If we held memory, unhold it now.  We ignore UnholdMemory errors:
@@ -450,12 +457,32 @@ exit:	if ((vmHoldMask & kHoldSenseBuffer) != 0)
 			if (status == scsiNonZeroStatus
 			 && (PB.scsiResultFlags & scsiAutosenseValid) != 0)
 			 	status = statusErr;
+			/*
+			 * A target that is busy, or whose command queue is full, did not
+			 * execute the command. Return controlErr, as OriginalSCSI does for
+			 * Busy, so that the caller may retry it (see SCSIEnvironment.h).
+			 */
+			status = SCSIBusyStatus(status, PB.scsiSCSIstatus);
 		 	DisposePtr((Ptr) execIOPBPtr);
 		}
 		return (status);
 #undef PB
 }
 
+/*
+ * The completion routine is called by the SCSI Manager (possibly at interrupt
+ * level) when the request completes. The SCSI Manager has already stored the
+ * final scsiResult, which ends the polling loop in AsyncSCSI, so there is
+ * nothing more to do here. It is placed before NextFunction so that it is
+ * held in physical memory along with AsyncSCSI.
+ */
+static pascal void
+AsyncSCSICompletion(
+		void					*scsiPB
+	)
+{
+}
+
 static void NextFunction(void) { }	/* Dummy function for AsyncSCSI size	*/
 
 static Boolean
@@ -0,0 +1,793 @@
+/*									BusDispatcher.c								*/
+/*
+ * BusDispatcher.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Share one SCSI bus between its devices. See BusDispatcher.h for the policy.
+ * Each in-flight command has a "slot" with its own parameter block and
+ * completion queue entry; these are allocated (and held) once, when the
+ * dispatcher is opened. The parameter block setup follows AsyncSCSI and
+ * DoSCSICommandBatch. Like them, the dispatcher keeps no global state: the
+ * watchdog and the device policies are in the SCSIEnvironment that it was
+ * opened with.
+ */
+#include <Gestalt.h>
+#include "SCSISimpleSample.h"
+
+#define kDefaultQuantum			8192L			/* Bytes per visit			*/
+#define kDefaultChunkBytes		32768L			/* Longest command			*/
+
+static Boolean					StartFairShare(
+		BusDispatcherPtr		dispatcherPtr
+	);
+static Boolean					StartInOrder(
+		BusDispatcherPtr		dispatcherPtr
+	);
+static unsigned long			NextChunk(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr,
+		SCSI_Command			*scsiCommand
+	);
+static void						StartChunk(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+static void						StartSlot(
+		BusDispatcherPtr		dispatcherPtr,
+		BusSlot					*slotPtr,
+		OSErr					status
+	);
+static void						RestartWaitingSlots(
+		BusDispatcherPtr		dispatcherPtr
+	);
+static Boolean					StartQueued(
+		BusDispatcherPtr		dispatcherPtr
+	);
+static void						ReapCommands(
+		BusDispatcherPtr		dispatcherPtr
+	);
+static void						SlotCompleted(
+		CompletionEntryPtr		entryPtr
+	);
+static void						CompleteSlot(
+		BusDispatcherPtr		dispatcherPtr,
+		BusSlot					*slotPtr
+	);
+static void						FinishRequest(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+static void						RemoveHead(
+		BusFlowPtr				flowPtr
+	);
+static pascal void				DispatchCompletion(
+		void					*scsiPB
+	);
+static void 					NextFunction(void);		/* For HoldMemory size	*/
+static Boolean					IsVirtualMemoryRunning(void);
+
+OSErr
+BusDispatcherOpen(
+		BusDispatcherPtr		dispatcherPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		unsigned short			bus
+	)
+{
+		OSErr					status;
+		SCSIBusInquiryPB		busInquiryPB;
+		register short			i;
+#define DISP (*dispatcherPtr)
+
+		CLEAR(DISP);
+		if (SCSIEnvironmentHasAsyncSCSIManager(environmentPtr) == FALSE)
+			return (unimpErr);
+		DISP.environmentPtr = environmentPtr;
+		DISP.bus = bus;
+		DISP.policy = kDispatchPolicyFairShare;
+		DISP.quantum = kDefaultQuantum;
+		DISP.chunkBytes = kDefaultChunkBytes;
+		for (i = 0; i < kDispatchMaxTargets; i++)
+			DISP.flow[i].weight = 1;
+		CLEAR(busInquiryPB);
+		busInquiryPB.scsiPBLength = sizeof busInquiryPB;
+		busInquiryPB.scsiFunctionCode = SCSIBusInquiry;
+		busInquiryPB.scsiDevice.bus = bus;
+		SCSIAction((SCSI_PB *) &busInquiryPB);
+		status = busInquiryPB.scsiResult;
+		if (status != noErr)
+			return (status);
+		DISP.selectWithATNSafe =
+				(busInquiryPB.scsiWeirdStuff & scsiTargetDrivenSDTRSafe) != 0;
+		DISP.execIOPBSize = busInquiryPB.scsiIOpbSize;
+		DISP.slotBytes =
+			((DISP.execIOPBSize + 3) & ~3) + sizeof (CompletionEntry);
+		DISP.execIOPBArray = NewPtrClear(DISP.slotBytes * kDispatchMaxInFlight);
+		if (DISP.execIOPBArray == NULL)
+			return (MemError());
+		for (i = 0; i < kDispatchMaxInFlight; i++) {
+			DISP.slot[i].execIOPBPtr =
+				(SCSIExecIOPB *) (DISP.execIOPBArray + i * DISP.slotBytes);
+			DISP.slot[i].completionPtr = (CompletionEntryPtr)
+				(DISP.execIOPBArray
+					+ (i + 1) * DISP.slotBytes - sizeof (CompletionEntry));
+			DISP.slot[i].completionPtr->queuePtr = &environmentPtr->completions;
+			DISP.slot[i].completionPtr->completionProc = SlotCompleted;
+			DISP.slot[i].completionPtr->refCon = (long) dispatcherPtr;
+		}
+		/*
+		 * The parameter blocks, completion entries, completion queue, and the
+		 * completion routine stay held while the dispatcher is open. Data and
+		 * sense buffers are held for each command.
+		 */
+		status = CompletionQueueHold(&environmentPtr->completions);
+		if (status == noErr && IsVirtualMemoryRunning()) {
+			status = HoldMemory(
+						DISP.execIOPBArray,
+						DISP.slotBytes * kDispatchMaxInFlight);
+			if (status == noErr) {
+				status = HoldMemory(
+							DispatchCompletion,
+							(unsigned long) NextFunction
+								- (unsigned long) DispatchCompletion
+						);
+				if (status != noErr) {
+					(void) UnholdMemory(
+							DISP.execIOPBArray,
+							DISP.slotBytes * kDispatchMaxInFlight);
+				}
+			}
+			if (status != noErr)
+				CompletionQueueUnhold(&environmentPtr->completions);
+			else {
+				DISP.memoryHeld = TRUE;
+			}
+		}
+		if (status != noErr) {
+			DisposePtr(DISP.execIOPBArray);
+			DISP.execIOPBArray = NULL;
+			return (status);
+		}
+		return (noErr);
+#undef DISP
+}
+
+void
+BusDispatcherClose(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		register BusFlowPtr		flowPtr;
+		register BusRequestPtr	requestPtr;
+		register short			i;
+#define DISP (*dispatcherPtr)
+
+		if (DISP.execIOPBArray == NULL)
+			return;
+		/*
+		 * Abandon the queued requests. A request that has commands in flight
+		 * is finished when the last of them completes.
+		 */
+		for (i = 0; i < kDispatchMaxTargets; i++) {
+			flowPtr = &DISP.flow[i];
+			while ((requestPtr = flowPtr->queueHead) != NULL) {
+				RemoveHead(flowPtr);
+				requestPtr->scsiCmdBlock.status = abortErr;
+				if (requestPtr->chunksOutstanding == 0)
+					FinishRequest(dispatcherPtr, requestPtr);
+			}
+		}
+		while (DISP.inFlight != 0) {
+			ReapCommands(dispatcherPtr);
+			if (DISP.inFlight != 0) {
+				RestartWaitingSlots(dispatcherPtr);
+				SCSIWatchdogIdle(&DISP.environmentPtr->watchdog);
+				SCSIEnvironmentIdle(DISP.environmentPtr);
+			}
+		}
+		if (DISP.memoryHeld) {
+			(void) UnholdMemory(
+					DispatchCompletion,
+					(unsigned long) NextFunction
+						- (unsigned long) DispatchCompletion
+				);
+			(void) UnholdMemory(
+					DISP.execIOPBArray, DISP.slotBytes * kDispatchMaxInFlight);
+			DISP.memoryHeld = FALSE;
+		}
+		CompletionQueueUnhold(&DISP.environmentPtr->completions);
+		DisposePtr(DISP.execIOPBArray);
+		DISP.execIOPBArray = NULL;
+#undef DISP
+}
+
+void
+BusDispatcherSetShare(
+		BusDispatcherPtr		dispatcherPtr,
+		unsigned short			targetID,
+		unsigned short			weight,
+		unsigned long			maxOutstandingBytes
+	)
+{
+		if (targetID < kDispatchMaxTargets) {
+			dispatcherPtr->flow[targetID].weight = (weight == 0) ? 1 : weight;
+			dispatcherPtr->flow[targetID].maxOutstandingBytes =
+				maxOutstandingBytes;
+		}
+}
+
+void
+BusDispatcherQueue(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		register BusFlowPtr		flowPtr;
+
+		requestPtr->next = NULL;
+		requestPtr->sequence = dispatcherPtr->sequence++;
+		requestPtr->queuedTicks = TickCount();
+		requestPtr->completedTicks = 0;
+		requestPtr->startedBytes = 0;
+		requestPtr->chunksOutstanding = 0;
+		requestPtr->scsiCmdBlock.status = 1;			/* In progress			*/
+		requestPtr->scsiCmdBlock.statusByte = 0;
+		requestPtr->scsiCmdBlock.actualTransferCount = 0;
+		requestPtr->scsiCmdBlock.sense.errorCode = 0;
+		requestPtr->scsiCmdBlock.busyRetries = 0;
+		if (requestPtr->background == FALSE)
+			++dispatcherPtr->foregroundPending;
+		if (requestPtr->scsiCmdBlock.scsiDevice.bus != dispatcherPtr->bus
+		 || requestPtr->scsiCmdBlock.scsiDevice.targetID
+				>= kDispatchMaxTargets) {
+			requestPtr->scsiCmdBlock.status = scsiTIDInvalid;
+			FinishRequest(dispatcherPtr, requestPtr);
+			return;
+		}
+		flowPtr =
+			&dispatcherPtr->flow[requestPtr->scsiCmdBlock.scsiDevice.targetID];
+		if (flowPtr->queueHead == NULL)
+			flowPtr->queueHead = requestPtr;
+		else {
+			flowPtr->queueTail->next = requestPtr;
+		}
+		flowPtr->queueTail = requestPtr;
+}
+
+Boolean
+BusDispatcherPoll(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		Boolean					queued;
+
+		ReapCommands(dispatcherPtr);
+		RestartWaitingSlots(dispatcherPtr);
+		queued = StartQueued(dispatcherPtr);
+		if (dispatcherPtr->inFlight != 0)
+			SCSIWatchdogIdle(&dispatcherPtr->environmentPtr->watchdog);
+		return (queued || dispatcherPtr->inFlight != 0);
+}
+
+Boolean
+BusDispatcherBusy(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		return (dispatcherPtr->foregroundPending != 0);
+}
+
+/*
+ * Start queued commands with the dispatcher's policy. Returns TRUE if anything
+ * is still queued.
+ */
+static Boolean
+StartQueued(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		if (dispatcherPtr->policy == kDispatchPolicyFIFO)
+			return (StartInOrder(dispatcherPtr));
+		else {
+			return (StartFairShare(dispatcherPtr));
+		}
+}
+
+/*
+ * Deficit round robin. Visit the targets in turn: a target with queued work
+ * receives its quantum once per visit (unless it is at its cap), and starts
+ * commands while its deficit covers them. We stay on a target if we run out
+ * of slots, so that it keeps the rest of its turn. A command may cost more
+ * than one quantum, so we keep going round until every target has been
+ * visited without starting a command or receiving a quantum: each target
+ * then has nothing queued or is at its cap. So if nothing is in flight and
+ * anything is queued, something is started. Returns TRUE if anything is still
+ * queued.
+ */
+static Boolean
+StartFairShare(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		register BusFlowPtr		flowPtr;
+		register BusRequestPtr	requestPtr;
+		SCSI_Command			scsiCommand;
+		unsigned long			chunkBytes;
+		long					cost;
+		short					idleVisits;
+		Boolean					queued;
+		register short			i;
+#define DISP (*dispatcherPtr)
+
+		idleVisits = 0;
+		while (DISP.inFlight < kDispatchMaxInFlight
+		 && idleVisits < kDispatchMaxTargets) {
+			flowPtr = &DISP.flow[DISP.nextFlow];
+			++idleVisits;
+			while (DISP.inFlight < kDispatchMaxInFlight
+			 && (requestPtr = flowPtr->queueHead) != NULL) {
+				chunkBytes = NextChunk(dispatcherPtr, requestPtr, &scsiCommand);
+				if (flowPtr->maxOutstandingBytes != 0
+				 && flowPtr->outstandingBytes != 0
+				 && flowPtr->outstandingBytes + chunkBytes
+						> flowPtr->maxOutstandingBytes)
+					break;							/* At its cap				*/
+				if (DISP.quantumGranted == FALSE) {
+					flowPtr->deficit += DISP.quantum * flowPtr->weight;
+					DISP.quantumGranted = TRUE;
+					idleVisits = 0;
+				}
+				cost = (chunkBytes < kDispatchMinimumCost)
+						? kDispatchMinimumCost : chunkBytes;
+				if (cost > flowPtr->deficit)
+					break;
+				flowPtr->deficit -= cost;
+				StartChunk(dispatcherPtr, requestPtr);
+				idleVisits = 0;
+			}
+			if (DISP.inFlight >= kDispatchMaxInFlight
+			 && flowPtr->queueHead != NULL)
+				break;								/* Resume here next time	*/
+			/*
+			 * An idle target does not accumulate credit.
+			 */
+			if (flowPtr->queueHead == NULL)
+				flowPtr->deficit = 0;
+			DISP.nextFlow = (DISP.nextFlow + 1) % kDispatchMaxTargets;
+			DISP.quantumGranted = FALSE;
+		}
+		queued = FALSE;
+		for (i = 0; i < kDispatchMaxTargets; i++) {
+			if (DISP.flow[i].queueHead != NULL)
+				queued = TRUE;
+		}
+		return (queued);
+#undef DISP
+}
+
+/*
+ * Start requests in order of arrival, whole. Returns TRUE if anything is
+ * still queued.
+ */
+static Boolean
+StartInOrder(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		register BusRequestPtr	requestPtr;
+		BusRequestPtr			oldestPtr;
+		register short			i;
+
+		for (;;) {
+			oldestPtr = NULL;
+			for (i = 0; i < kDispatchMaxTargets; i++) {
+				requestPtr = dispatcherPtr->flow[i].queueHead;
+				if (requestPtr != NULL
+				 && (oldestPtr == NULL
+				  || requestPtr->sequence < oldestPtr->sequence))
+					oldestPtr = requestPtr;
+			}
+			if (oldestPtr == NULL)
+				return (FALSE);
+			if (dispatcherPtr->inFlight >= kDispatchMaxInFlight)
+				return (TRUE);
+			StartChunk(dispatcherPtr, oldestPtr);
+		}
+}
+
+/*
+ * Build the command for the next chunk of this request and return its data
+ * length. Under the fair share policy, a Read(10) or Write(10) longer than
+ * chunkBytes is split at a block boundary; anything else is sent whole.
+ */
+static unsigned long
+NextChunk(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr,
+		SCSI_Command			*scsiCommand
+	)
+{
+		unsigned long			blockCount;
+		unsigned long			blockLength;
+		unsigned long			logicalBlock;
+		unsigned long			chunkBlocks;
+		unsigned long			doneBlocks;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		*scsiCommand = SCB.command;
+		if (dispatcherPtr->policy != kDispatchPolicyFairShare
+		 || SCB.transferSize <= dispatcherPtr->chunkBytes
+		 || (SCB.command.scsi10.opcode != kScsiCmdRead10
+		  && SCB.command.scsi10.opcode != kScsiCmdWrite10))
+			return (SCB.transferSize);
+		blockCount =
+			  (((unsigned long) SCB.command.scsi10.len2) << 8)
+			| SCB.command.scsi10.len1;
+		if (blockCount == 0 || (SCB.transferSize % blockCount) != 0)
+			return (SCB.transferSize);				/* Can't find the blocks	*/
+		blockLength = SCB.transferSize / blockCount;
+		chunkBlocks = dispatcherPtr->chunkBytes / blockLength;
+		if (chunkBlocks == 0)
+			chunkBlocks = 1;
+		doneBlocks = requestPtr->startedBytes / blockLength;
+		if (chunkBlocks > blockCount - doneBlocks)
+			chunkBlocks = blockCount - doneBlocks;
+		logicalBlock =
+			  (((unsigned long) SCB.command.scsi10.lbn4) << 24)
+			| (((unsigned long) SCB.command.scsi10.lbn3) << 16)
+			| (((unsigned long) SCB.command.scsi10.lbn2) << 8)
+			| SCB.command.scsi10.lbn1;
+		logicalBlock += doneBlocks;
+		scsiCommand->scsi10.lbn4 = logicalBlock >> 24;
+		scsiCommand->scsi10.lbn3 = logicalBlock >> 16;
+		scsiCommand->scsi10.lbn2 = logicalBlock >> 8;
+		scsiCommand->scsi10.lbn1 = logicalBlock;
+		scsiCommand->scsi10.len2 = chunkBlocks >> 8;
+		scsiCommand->scsi10.len1 = chunkBlocks;
+		return (chunkBlocks * blockLength);
+#undef SCB
+}
+
+/*
+ * Start the next chunk of a request (which is at the head of its target's
+ * queue) in a free slot. When its last chunk has been started, the request
+ * leaves the queue.
+ */
+static void
+StartChunk(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		register BusSlot		*slotPtr;
+		register SCSIExecIOPB	*execIOPBPtr;
+		BusFlowPtr				flowPtr;
+		SCSI_Command			scsiCommand;
+		unsigned long			chunkBytes;
+		unsigned short			cmdBlockLength;
+		OSErr					status;
+		register char			*ptr;
+		register long			size;
+		register short			i;
+#define SCB	(requestPtr->scsiCmdBlock)
+#define PB	(*execIOPBPtr)
+
+		for (slotPtr = &dispatcherPtr->slot[0];
+				slotPtr->requestPtr != NULL;
+				slotPtr++)
+			;
+		flowPtr = &dispatcherPtr->flow[SCB.scsiDevice.targetID];
+		chunkBytes = NextChunk(dispatcherPtr, requestPtr, &scsiCommand);
+		scsiCommand.scsi[1] &= ~0xE0;
+		scsiCommand.scsi[1] |= (SCB.scsiDevice.LUN & 0x07) << 5;
+		execIOPBPtr = slotPtr->execIOPBPtr;
+		ptr = (char *) execIOPBPtr;
+		for (size = dispatcherPtr->execIOPBSize; size > 0; --size)
+			*ptr++ = 0;
+		PB.scsiPBLength = dispatcherPtr->execIOPBSize;
+		PB.scsiFunctionCode = SCSIExecIO;
+		PB.scsiDriverStorage = (unsigned char *) slotPtr->completionPtr;
+		PB.scsiTimeout = kScsiSpinUpCompletionTime;
+		PB.scsiSelectTimeout = requestPtr->selectTimeout;
+		PB.scsiDevice = SCB.scsiDevice;
+		cmdBlockLength = SCSIGetCommandLength((Ptr) &scsiCommand);
+		PB.scsiCDBLength = cmdBlockLength;
+		for (i = 0; i < cmdBlockLength; i++)
+			PB.scsiCDB.cdbBytes[i] = scsiCommand.scsi[i];
+		PB.scsiFlags = scsiSIMQNoFreeze | SCB.scsiFlags;
+		if (SCB.bufferPtr == NULL || chunkBytes == 0)
+			PB.scsiFlags |= scsiDirectionNone;
+		else {
+			PB.scsiDataPtr =
+				(unsigned char *) SCB.bufferPtr + requestPtr->startedBytes;
+			PB.scsiDataLength = chunkBytes;
+			PB.scsiDataType = scsiDataBuffer;
+			PB.scsiFlags |=
+				(SCB.writeToDevice) ? scsiDirectionOut : scsiDirectionIn;
+			if (SCB.transferQuantum == 1)
+				PB.scsiTransferType = scsiTransferPolled;
+			else {
+				PB.scsiTransferType = scsiTransferBlind;
+				PB.scsiHandshake[0] = SCB.transferQuantum;
+			}
+		}
+		PB.scsiSensePtr = (unsigned char *) &SCB.sense;
+		PB.scsiSenseLength = sizeof SCB.sense;
+		DevicePolicyApply(
+			&dispatcherPtr->environmentPtr->policy,
+			SCB.scsiDevice, dispatcherPtr->selectWithATNSafe,
+			&PB.scsiFlags, &PB.scsiIOFlags);
+		PB.scsiCompletion = (CallbackProc) DispatchCompletion;
+		/*
+		 * Account for the chunk before it is started: it may complete at once.
+		 */
+		slotPtr->requestPtr = requestPtr;
+		slotPtr->targetID = SCB.scsiDevice.targetID;
+		slotPtr->chunkBytes = chunkBytes;
+		slotPtr->bufferHeld = FALSE;
+		slotPtr->senseHeld = FALSE;
+		slotPtr->busyWait = FALSE;
+		SCSIBusyRetryInit(&slotPtr->busyRetry);
+		slotPtr->watchWait = FALSE;
+		++dispatcherPtr->inFlight;
+		flowPtr->outstandingBytes += chunkBytes;
+		requestPtr->startedBytes += chunkBytes;
+		++requestPtr->chunksOutstanding;
+		if (requestPtr->startedBytes >= SCB.transferSize || chunkBytes == 0)
+			RemoveHead(flowPtr);
+		status = noErr;
+		if (dispatcherPtr->memoryHeld) {
+			if (PB.scsiDataPtr != NULL) {
+				status = HoldMemory(PB.scsiDataPtr, PB.scsiDataLength);
+				slotPtr->bufferHeld = (status == noErr);
+			}
+			if (status == noErr) {
+				status = HoldMemory(PB.scsiSensePtr, PB.scsiSenseLength);
+				slotPtr->senseHeld = (status == noErr);
+			}
+		}
+		StartSlot(dispatcherPtr, slotPtr, status);
+#undef SCB
+#undef PB
+}
+
+/*
+ * Start the command in a slot, unless status (from preparing it) is an error.
+ * If the command could not be started, its completion routine won't be
+ * called: post it here, so it completes (with the error) when the queue is
+ * next drained. A command is never started unwatched: if the watchdog table
+ * is full (it is shared by every dispatcher on the environment), the slot
+ * waits, and RestartWaitingSlots tries again.
+ */
+static void
+StartSlot(
+		BusDispatcherPtr		dispatcherPtr,
+		register BusSlot		*slotPtr,
+		OSErr					status
+	)
+{
+		register SCSIExecIOPB	*execIOPBPtr;
+#define PB	(*execIOPBPtr)
+
+		execIOPBPtr = slotPtr->execIOPBPtr;
+		slotPtr->startTicks = TickCount();
+		if (status == noErr) {
+			slotPtr->watchWait = (SCSIWatchdogStart(
+						&dispatcherPtr->environmentPtr->watchdog,
+						&PB) == FALSE);
+			if (slotPtr->watchWait)
+				return;
+			status = SCSIAction((SCSI_PB *) &PB);
+		}
+		if (status != noErr) {
+			PB.scsiResult = status;
+			CompletionQueuePost(slotPtr->completionPtr);
+		}
+#undef PB
+}
+
+/*
+ * Start the commands that found their targets Busy again, once their pauses
+ * are over, and the commands that found the watchdog table full. The
+ * parameter block is reused as it is (its data and sense buffers are still
+ * held), except for the results of the last attempt.
+ */
+static void
+RestartWaitingSlots(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		register BusSlot		*slotPtr;
+		register SCSIExecIOPB	*execIOPBPtr;
+		register short			i;
+#define PB	(*execIOPBPtr)
+
+		for (i = 0; i < kDispatchMaxInFlight; i++) {
+			slotPtr = &dispatcherPtr->slot[i];
+			if (slotPtr->busyWait
+			 && TickCount() >= slotPtr->busyRetry.resumeTicks) {
+				slotPtr->busyWait = FALSE;
+				execIOPBPtr = slotPtr->execIOPBPtr;
+				PB.scsiResultFlags = 0;
+				PB.scsiSCSIstatus = 0;
+				PB.scsiSenseResidual = 0;
+				PB.scsiDataResidual = 0;
+				StartSlot(dispatcherPtr, slotPtr, noErr);
+			}
+			else if (slotPtr->watchWait) {
+				StartSlot(dispatcherPtr, slotPtr, noErr);
+			}
+		}
+#undef PB
+}
+
+/*
+ * Complete every command that has finished. This drains the environment's
+ * completion queue, so it also completes other dispatchers' commands.
+ */
+static void
+ReapCommands(
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		(void) CompletionQueueDrain(
+					&dispatcherPtr->environmentPtr->completions, 0);
+}
+
+/*
+ * A slot's entry was drained from the completion queue (at task level):
+ * complete its command, then start whatever its completion allows (including
+ * requests queued by a done procedure).
+ */
+static void
+SlotCompleted(
+		CompletionEntryPtr		entryPtr
+	)
+{
+		BusDispatcherPtr		dispatcherPtr;
+		register short			i;
+
+		dispatcherPtr = (BusDispatcherPtr) entryPtr->refCon;
+		for (i = 0; i < kDispatchMaxInFlight; i++) {
+			if (dispatcherPtr->slot[i].completionPtr == entryPtr) {
+				if (dispatcherPtr->slot[i].requestPtr != NULL) {
+					CompleteSlot(dispatcherPtr, &dispatcherPtr->slot[i]);
+					(void) StartQueued(dispatcherPtr);
+				}
+				break;
+			}
+		}
+}
+
+/*
+ * Recover the results of one command, as AsyncSCSI does, and merge them into
+ * its request. A command that found its target Busy keeps its slot, to be
+ * started again by RestartWaitingSlots, until its retry time runs out. If a
+ * chunk fails, the rest of the request is abandoned.
+ */
+static void
+CompleteSlot(
+		BusDispatcherPtr		dispatcherPtr,
+		register BusSlot		*slotPtr
+	)
+{
+		register BusRequestPtr	requestPtr;
+		register SCSIExecIOPB	*execIOPBPtr;
+		BusFlowPtr				flowPtr;
+		unsigned long			actualCount;
+		OSErr					status;
+#define SCB	(requestPtr->scsiCmdBlock)
+#define PB	(*execIOPBPtr)
+
+		requestPtr = slotPtr->requestPtr;
+		execIOPBPtr = slotPtr->execIOPBPtr;
+		flowPtr = &dispatcherPtr->flow[slotPtr->targetID];
+		status = SCSIWatchdogFinish(
+					&dispatcherPtr->environmentPtr->watchdog,
+					&PB, PB.scsiResult);
+		actualCount = PB.scsiDataLength - PB.scsiDataResidual;
+		if (status == scsiDataRunError
+		 && SCB.writeToDevice == FALSE
+		 && actualCount <= PB.scsiDataLength
+		 && actualCount > 0)
+			status = noErr;
+		if (status == scsiNonZeroStatus
+		 && (PB.scsiResultFlags & scsiAutosenseValid) != 0)
+			status = statusErr;
+		status = SCSIBusyStatus(status, PB.scsiSCSIstatus);
+		DevicePolicyRecord(
+			&dispatcherPtr->environmentPtr->policy, PB.scsiDevice,
+			PB.scsiIOFlags, TickCount() - slotPtr->startTicks, status);
+		if (status == controlErr
+		 && SCB.status == 1
+		 && SCSIBusyRetryNext(&slotPtr->busyRetry)) {
+			++SCB.busyRetries;
+			slotPtr->busyWait = TRUE;
+			return;
+		}
+		if (slotPtr->senseHeld)
+			(void) UnholdMemory(PB.scsiSensePtr, PB.scsiSenseLength);
+		if (slotPtr->bufferHeld)
+			(void) UnholdMemory(PB.scsiDataPtr, PB.scsiDataLength);
+		SCB.statusByte = PB.scsiSCSIstatus;
+		SCB.actualTransferCount += actualCount;
+		if (status != noErr && SCB.status == 1) {
+			SCB.status = status;
+			if (flowPtr->queueHead == requestPtr)
+				RemoveHead(flowPtr);				/* Abandon the rest		*/
+		}
+		flowPtr->outstandingBytes -= slotPtr->chunkBytes;
+		++flowPtr->commands;
+		flowPtr->bytes += actualCount;
+		slotPtr->requestPtr = NULL;
+		--dispatcherPtr->inFlight;
+		if (--requestPtr->chunksOutstanding == 0
+		 && (SCB.status != 1 || requestPtr->startedBytes >= SCB.transferSize)) {
+			++flowPtr->requests;
+			FinishRequest(dispatcherPtr, requestPtr);
+		}
+#undef SCB
+#undef PB
+}
+
+/*
+ * The request is complete: set its final status and interpret it. The done
+ * procedure is called last, as it may reuse the request.
+ */
+static void
+FinishRequest(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		if (requestPtr->background == FALSE)
+			--dispatcherPtr->foregroundPending;
+		if (requestPtr->scsiCmdBlock.status == 1)
+			requestPtr->scsiCmdBlock.status = noErr;
+		requestPtr->completedTicks = TickCount();
+		CheckSCSICommandStatus(&requestPtr->scsiCmdBlock, FALSE);
+		if (requestPtr->doneProc != NULL)
+			(*requestPtr->doneProc)(dispatcherPtr, requestPtr);
+}
+
+static void
+RemoveHead(
+		register BusFlowPtr		flowPtr
+	)
+{
+		register BusRequestPtr	requestPtr;
+
+		requestPtr = flowPtr->queueHead;
+		flowPtr->queueHead = requestPtr->next;
+		if (flowPtr->queueHead == NULL)
+			flowPtr->queueTail = NULL;
+		requestPtr->next = NULL;
+}
+
+/*
+ * The completion routine is called by the SCSI Manager (possibly at interrupt
+ * level). It posts the slot's entry, which StartChunk stored in the parameter
+ * block, to the completion queue.
+ */
+static pascal void
+DispatchCompletion(
+		void					*scsiPB
+	)
+{
+		CompletionQueuePost(
+			(CompletionEntryPtr) ((SCSIExecIOPB *) scsiPB)->scsiDriverStorage);
+}
+
+static void NextFunction(void) { }	/* Marks the end of DispatchCompletion	*/
+
+static Boolean
+IsVirtualMemoryRunning(void)
+{
+		OSErr						status;
+		long						response;
+
+		status = Gestalt(gestaltVMAttr, &response);
+		/*
+		 * VM is active iff Gestalt succeeded and the response is appropriate.
+		 */
+		return (status == noErr && ((response & (1 << gestaltVMPresent)) != 0));
+}
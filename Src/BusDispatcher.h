@@ -0,0 +1,215 @@
+/*									BusDispatcher.h								*/
+/*
+ * BusDispatcher.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * A fair-share dispatcher for the devices on one SCSI bus. Without it, a
+ * device that is sent a long transfer holds the bus for the whole transfer,
+ * and every other device on the bus waits behind it. The dispatcher keeps a
+ * queue for each target and decides which target's command is started next:
+ *	-- Queues are served by deficit round robin, counting bytes. On each
+ *	   visit, a target's deficit grows by the quantum times its weight, and
+ *	   the target may start commands until the deficit is used up. A command
+ *	   without data costs kDispatchMinimumCost bytes, so even Test Unit Ready
+ *	   is not free.
+ *	-- Read(10) and Write(10) commands longer than chunkBytes are split into
+ *	   several commands of at most chunkBytes each, so that one long transfer
+ *	   cannot hold the bus for more than one chunk at a time.
+ *	-- Each target has a cap on the number of bytes that may be outstanding
+ *	   (started, but not complete). A target that reaches its cap is skipped
+ *	   until some of its commands complete.
+ *	-- A command that finds its target Busy (or its queue full) keeps its
+ *	   slot, and is started again after a pause, as DoSCSICommandWithSense
+ *	   retries it (see SCSIEnvironment.h). Its request fails with controlErr
+ *	   only if the target stays busy for kBusyRetryTicks. The request's
+ *	   busyRetries counts the retries.
+ * Commands are started asynchronously (as DoSCSICommandBatch does), so that
+ * requests for different targets can be outstanding at the same time. The
+ * caller queues requests, then calls BusDispatcherPoll until it returns FALSE.
+ * Each command's completion routine posts it to the environment's completion
+ * queue: when the queue is drained (by BusDispatcherPoll, or by the event
+ * loop), the command is finished and the dispatcher starts the next one.
+ * The dispatcher requires SCSI Manager 4.3. Its watchdog and device policies
+ * are those of the SCSIEnvironment it is opened with. Every dispatcher on an
+ * environment shares its watchdog table, so more commands may be in flight
+ * than the table can watch: a command that finds the table full keeps its
+ * slot, but is not started until an entry is free.
+ */
+#ifndef __BusDispatcher__
+#define __BusDispatcher__
+#include "MacSCSICommand.h"
+#include "SCSIEnvironment.h"
+
+#define kDispatchMaxTargets		8
+#define kDispatchMaxInFlight	8			/* Commands, per dispatcher	*/
+#define kDispatchMinimumCost	512L		/* Bytes charged for a command	*/
+
+/*
+ * Dispatch policies. kDispatchPolicyFIFO starts requests in the order they
+ * were queued, without splitting or per-target caps: it is used to measure
+ * the dispatcher.
+ */
+enum {
+	kDispatchPolicyFairShare = 0,
+	kDispatchPolicyFIFO
+};
+
+/*
+ * The caller fills in the command block (as for DoSCSICommandWithSense). When
+ * the request completes, its status, statusByte, sense data, and actual
+ * transfer count are in the command block, and its status field is no longer
+ * 1 (in progress). Background requests (such as the probes of a bus scan) are
+ * dispatched like any other, but are not counted by BusDispatcherBusy. A
+ * probe that expects no answer may set a selectTimeout shorter than the
+ * SIM's default (250 msec), which is how long a missing target holds the bus.
+ *
+ * If doneProc is not NULL, it is called when the request completes. It is
+ * called at task level, from BusDispatcherPoll (or BusDispatcherClose), and
+ * may queue further requests -- this is how a multi-step sequence (see
+ * DeviceFlow.h) issues its next command as soon as the previous one is done.
+ */
+typedef struct BusDispatcher BusDispatcher, *BusDispatcherPtr;
+typedef struct BusRequest BusRequest, *BusRequestPtr;
+typedef void				(*BusRequestDoneProcPtr)(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+struct BusRequest {
+	BusRequestPtr		next;					/* Queue link (dispatcher use)	*/
+	ScsiCmdBlock		scsiCmdBlock;			/* <> The command				*/
+	Boolean				background;				/* -> Not production I/O		*/
+	unsigned short		selectTimeout;			/* -> Msec, 0 = SIM default		*/
+	BusRequestDoneProcPtr	doneProc;			/* -> Called when complete		*/
+	long				refCon;					/* -> For doneProc				*/
+	unsigned long		sequence;				/* <- Order of arrival			*/
+	unsigned long		queuedTicks;			/* <- When queued				*/
+	unsigned long		completedTicks;			/* <- When completed			*/
+	unsigned long		startedBytes;			/* Bytes in started chunks		*/
+	unsigned short		chunksOutstanding;		/* Started, not complete		*/
+};
+
+typedef struct BusFlow BusFlow, *BusFlowPtr;
+struct BusFlow {
+	unsigned short		weight;					/* Share of the bus (1 .. n)	*/
+	unsigned long		maxOutstandingBytes;	/* Cap, 0 = no cap				*/
+	long				deficit;				/* Bytes we may still start		*/
+	unsigned long		outstandingBytes;		/* Started, not complete		*/
+	BusRequestPtr		queueHead;				/* Waiting or partly started	*/
+	BusRequestPtr		queueTail;
+	unsigned long		requests;				/* Requests completed			*/
+	unsigned long		commands;				/* Commands (chunks) completed	*/
+	unsigned long		bytes;					/* Bytes transferred			*/
+};
+
+/*
+ * One in-flight command.
+ */
+struct BusSlot {
+	SCSIExecIOPB		*execIOPBPtr;			/* Its parameter block			*/
+	CompletionEntryPtr	completionPtr;			/* Posted when it completes		*/
+	BusRequestPtr		requestPtr;				/* NULL if the slot is free		*/
+	unsigned short		targetID;
+	unsigned long		chunkBytes;				/* Data length (0 if none)		*/
+	unsigned long		startTicks;				/* When the command started		*/
+	Boolean				bufferHeld;				/* Data buffer is held			*/
+	Boolean				senseHeld;				/* Sense buffer is held			*/
+	Boolean				busyWait;				/* Target was Busy: pausing		*/
+	SCSIBusyRetry		busyRetry;				/* When to start it again		*/
+	Boolean				watchWait;				/* Watchdog table was full		*/
+};
+typedef struct BusSlot BusSlot;
+
+struct BusDispatcher {
+	SCSIEnvironmentPtr	environmentPtr;			/* Watchdog, policies			*/
+	unsigned short		bus;					/* The bus we dispatch for		*/
+	unsigned short		policy;					/* kDispatchPolicyFairShare...	*/
+	unsigned long		quantum;				/* Bytes per visit, per weight	*/
+	unsigned long		chunkBytes;				/* Longest command we start		*/
+	Boolean				selectWithATNSafe;		/* From the Bus Inquiry			*/
+	Boolean				memoryHeld;				/* VM holds are in place		*/
+	unsigned long		execIOPBSize;			/* From the Bus Inquiry			*/
+	unsigned long		slotBytes;				/* Parameter block and entry	*/
+	Ptr					execIOPBArray;			/* For each slot				*/
+	unsigned short		nextFlow;				/* Round robin position			*/
+	Boolean				quantumGranted;			/* nextFlow had its quantum		*/
+	unsigned long		sequence;				/* Next arrival number			*/
+	unsigned short		inFlight;				/* Slots in use					*/
+	unsigned short		foregroundPending;		/* Queued or in flight			*/
+	BusSlot				slot[kDispatchMaxInFlight];
+	BusFlow				flow[kDispatchMaxTargets];
+};
+
+/*
+ * Usage:
+ *		OSErr						BusDispatcherOpen(
+ *				BusDispatcherPtr		dispatcherPtr,
+ *				SCSIEnvironmentPtr		environmentPtr,
+ *				unsigned short			bus
+ *			);
+ *	Initialize a dispatcher for one bus. Every target starts with weight 1
+ *	and no cap. This performs a Bus Inquiry and allocates (and, if virtual
+ *	memory is running, holds) the parameter blocks. It returns unimpErr if
+ *	SCSI Manager 4.3 is not present.
+ *
+ *		void						BusDispatcherClose(
+ *				BusDispatcherPtr		dispatcherPtr
+ *			);
+ *	Wait for the outstanding commands (including those that are pausing
+ *	after Busy), then dispose of the parameter blocks.
+ *	Any requests that are still queued are completed with abortErr.
+ *
+ *		void						BusDispatcherSetShare(
+ *				BusDispatcherPtr		dispatcherPtr,
+ *				unsigned short			targetID,
+ *				unsigned short			weight,
+ *				unsigned long			maxOutstandingBytes
+ *			);
+ *	Set a target's weight and cap (0 for no cap).
+ *
+ *		void						BusDispatcherQueue(
+ *				BusDispatcherPtr		dispatcherPtr,
+ *				BusRequestPtr			requestPtr
+ *			);
+ *	Add a request to its target's queue. The request must be for the
+ *	dispatcher's bus.
+ *
+ *		Boolean						BusDispatcherPoll(
+ *				BusDispatcherPtr		dispatcherPtr
+ *			);
+ *	Drain the environment's completion queue (finishing the commands of
+ *	every dispatcher that uses it), start as many queued commands as the
+ *	policy allows, and poll the watchdog. Returns FALSE when nothing is
+ *	queued or outstanding.
+ *
+ *		Boolean						BusDispatcherBusy(
+ *				BusDispatcherPtr		dispatcherPtr
+ *			);
+ *	Returns TRUE if any foreground (not background) request is queued or
+ *	in flight.
+ */
+OSErr						BusDispatcherOpen(
+		BusDispatcherPtr		dispatcherPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		unsigned short			bus
+	);
+void						BusDispatcherClose(
+		BusDispatcherPtr		dispatcherPtr
+	);
+void						BusDispatcherSetShare(
+		BusDispatcherPtr		dispatcherPtr,
+		unsigned short			targetID,
+		unsigned short			weight,
+		unsigned long			maxOutstandingBytes
+	);
+void						BusDispatcherQueue(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+Boolean						BusDispatcherPoll(
+		BusDispatcherPtr		dispatcherPtr
+	);
+Boolean						BusDispatcherBusy(
+		BusDispatcherPtr		dispatcherPtr
+	);
+
+#endif /* __BusDispatcher__ */
@@ -0,0 +1,516 @@
+/*									BusSimulator.c								*/
+/*
+ * BusSimulator.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * A discrete-event SCSI bus simulator. See BusSimulator.h.
+ *
+ * Pending events are kept in a binary heap ordered by time. Simultaneous
+ * events are handled in the order they were scheduled, so a run is always
+ * the same for the same workload. There are three kinds of event: a command
+ * arrives in the initiator's queue, a disconnected target is ready to
+ * reselect, and a bus goes free. Arbitration is only needed when a bus goes
+ * free or when a device that wants it appears while it is free.
+ */
+#include <Errors.h>
+#include <Memory.h>
+#include "BusSimulator.h"
+#include "CoreMacros.h"
+
+enum {
+	kSimEventArrive = 0,
+	kSimEventReady,
+	kSimEventBusFree
+};
+
+struct SimEvent {
+	unsigned long		time;
+	unsigned long		sequence;				/* Order of scheduling			*/
+	unsigned short		kind;					/* kSimEventArrive, etc.		*/
+	unsigned short		bus;
+	SimCommandPtr		commandPtr;				/* Arrive and Ready				*/
+};
+
+static void						ScheduleEvent(
+		BusSimulatorPtr			simPtr,
+		unsigned long			time,
+		unsigned short			kind,
+		unsigned short			bus,
+		SimCommandPtr			commandPtr
+	);
+static void						NextEvent(
+		BusSimulatorPtr			simPtr,
+		SimEvent				*eventPtr
+	);
+static Boolean					EventBefore(
+		const SimEvent			*aPtr,
+		const SimEvent			*bPtr
+	);
+static void						Arbitrate(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus
+	);
+static SimCommandPtr			NextQueuedCommand(
+		BusSimulatorPtr			simPtr,
+		SimBusPtr				busPtr
+	);
+static void						StartCommand(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		SimCommandPtr			commandPtr
+	);
+static void						Reselect(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		SimTargetPtr			targetPtr
+	);
+static void						CompleteCommand(
+		BusSimulatorPtr			simPtr,
+		SimBusPtr				busPtr
+	);
+static unsigned long			DataTime(
+		SimBusPtr				busPtr,
+		SimTargetPtr			targetPtr,
+		unsigned long			length
+	);
+
+void
+BusSimInit(
+		BusSimulatorPtr			simPtr,
+		unsigned short			busCount
+	)
+{
+		register short			i;
+
+		CLEAR(*simPtr);
+		if (busCount > kSimMaxBuses)
+			busCount = kSimMaxBuses;
+		simPtr->busCount = busCount;
+		simPtr->disconnectPolicy = kSimDisconnectNever;
+		simPtr->queuePolicy = kSimQueueFIFO;
+		for (i = 0; i < busCount; i++) {
+			simPtr->bus[i].asyncRate = kSimAsyncRate;
+			simPtr->bus[i].selectTimeout = kSimSelectTimeout;
+		}
+}
+
+void
+BusSimSetTarget(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		Boolean					disconnects,
+		unsigned long			syncRate
+	)
+{
+		SimTargetPtr			targetPtr;
+
+		if (bus < simPtr->busCount
+		 && targetID < kSimMaxTargets
+		 && targetID != kSimInitiatorID) {
+			targetPtr = &simPtr->bus[bus].target[targetID];
+			targetPtr->present = TRUE;
+			targetPtr->disconnects = disconnects;
+			targetPtr->syncRate = syncRate;
+		}
+}
+
+OSErr
+BusSimRun(
+		BusSimulatorPtr			simPtr,
+		SimCommand				command[],
+		unsigned long			commandCount
+	)
+{
+		register SimBusPtr		busPtr;
+		register SimTargetPtr	targetPtr;
+		register short			i;
+		short					id;
+		unsigned long			index;
+		SimEvent				event;
+
+		for (index = 0; index < commandCount; index++) {
+			if (command[index].bus >= simPtr->busCount
+			 || command[index].targetID >= kSimMaxTargets)
+				return (paramErr);
+		}
+		/*
+		 * Every arrival is scheduled at once; at most one bus free event per
+		 * bus and one ready event per target may be pending as well.
+		 */
+		simPtr->eventPtr = (SimEventPtr) NewPtr(sizeof (SimEvent)
+					* (commandCount + kSimMaxBuses * (kSimMaxTargets + 1)));
+		if (simPtr->eventPtr == NULL)
+			return (memFullErr);
+		simPtr->eventCount = 0;
+		simPtr->sequence = 0;
+		simPtr->events = 0;
+		simPtr->now = 0;
+		for (i = 0; i < simPtr->busCount; i++) {
+			busPtr = &simPtr->bus[i];
+			busPtr->busyTime = 0;
+			busPtr->tenures = 0;
+			busPtr->reselections = 0;
+			busPtr->selectTimeouts = 0;
+			busPtr->busy = FALSE;
+			busPtr->completingPtr = NULL;
+			busPtr->queueHead = NULL;
+			busPtr->queueTail = NULL;
+			busPtr->lastTarget = kSimInitiatorID;
+			for (id = 0; id < kSimMaxTargets; id++) {
+				targetPtr = &busPtr->target[id];
+				targetPtr->commands = 0;
+				targetPtr->bytes = 0;
+				targetPtr->totalLatency = 0;
+				targetPtr->maxLatency = 0;
+				targetPtr->reselectWait = 0;
+				targetPtr->activePtr = NULL;
+				targetPtr->reselectPending = FALSE;
+			}
+		}
+		for (index = 0; index < commandCount; index++) {
+			command[index].next = NULL;
+			command[index].failed = FALSE;
+			command[index].completion = 0;
+			ScheduleEvent(simPtr, command[index].arrival,
+				kSimEventArrive, command[index].bus, &command[index]);
+		}
+		while (simPtr->eventCount != 0) {
+			NextEvent(simPtr, &event);
+			simPtr->now = event.time;
+			++simPtr->events;
+			busPtr = &simPtr->bus[event.bus];
+			switch (event.kind) {
+			case kSimEventArrive:
+				if (busPtr->queueTail == NULL)
+					busPtr->queueHead = event.commandPtr;
+				else {
+					busPtr->queueTail->next = event.commandPtr;
+				}
+				busPtr->queueTail = event.commandPtr;
+				break;
+			case kSimEventReady:
+				event.commandPtr->readyTime = simPtr->now;
+				targetPtr = &busPtr->target[event.commandPtr->targetID];
+				targetPtr->reselectPending = TRUE;
+				break;
+			case kSimEventBusFree:
+				busPtr->busy = FALSE;
+				busPtr->busyTime += simPtr->now - busPtr->tenureStart;
+				if (busPtr->completingPtr != NULL)
+					CompleteCommand(simPtr, busPtr);
+				break;
+			}
+			Arbitrate(simPtr, event.bus);
+		}
+		DisposePtr((Ptr) simPtr->eventPtr);
+		simPtr->eventPtr = NULL;
+		return (noErr);
+}
+
+unsigned long
+BusSimTransferTime(
+		unsigned long			bytes,
+		unsigned long			rate
+	)
+{
+		if (rate == 0)
+			return (0);
+		/*
+		 * Split the division so that large transfers don't overflow.
+		 */
+		return ((bytes / rate) * kSimUnitsPerMsec
+			+ ((bytes % rate) * kSimUnitsPerMsec) / rate);
+}
+
+/*
+ * If the bus is free, give it to the device that wins arbitration: the
+ * initiator, if it has a command for a free target, otherwise the reselecting
+ * target with the highest ID.
+ */
+static void
+Arbitrate(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus
+	)
+{
+		register SimBusPtr		busPtr;
+		SimCommandPtr			commandPtr;
+		short					id;
+
+		busPtr = &simPtr->bus[bus];
+		if (busPtr->busy)
+			return;
+		commandPtr = NextQueuedCommand(simPtr, busPtr);
+		if (commandPtr != NULL) {
+			StartCommand(simPtr, bus, commandPtr);
+			return;
+		}
+		for (id = kSimMaxTargets - 1; id >= 0; --id) {
+			if (busPtr->target[id].reselectPending) {
+				Reselect(simPtr, bus, &busPtr->target[id]);
+				return;
+			}
+		}
+}
+
+/*
+ * Remove and return the command that the initiator will start next, or NULL
+ * if no queued command is for a free target.
+ */
+static SimCommandPtr
+NextQueuedCommand(
+		BusSimulatorPtr			simPtr,
+		SimBusPtr				busPtr
+	)
+{
+		register SimCommandPtr	commandPtr;
+		SimCommandPtr			previousPtr;
+		short					i;
+		short					id;
+
+		for (i = 1; i <= kSimMaxTargets; i++) {
+			id = (busPtr->lastTarget + i) % kSimMaxTargets;
+			previousPtr = NULL;
+			for (commandPtr = busPtr->queueHead;
+					commandPtr != NULL;
+					commandPtr = commandPtr->next) {
+				if (busPtr->target[commandPtr->targetID].activePtr == NULL
+				 && (simPtr->queuePolicy == kSimQueueFIFO
+				  || commandPtr->targetID == id))
+					break;
+				previousPtr = commandPtr;
+			}
+			if (commandPtr != NULL) {
+				if (previousPtr == NULL)
+					busPtr->queueHead = commandPtr->next;
+				else {
+					previousPtr->next = commandPtr->next;
+				}
+				if (busPtr->queueTail == commandPtr)
+					busPtr->queueTail = previousPtr;
+				commandPtr->next = NULL;
+				busPtr->lastTarget = commandPtr->targetID;
+				return (commandPtr);
+			}
+			if (simPtr->queuePolicy == kSimQueueFIFO)
+				break;							/* One pass is enough	*/
+		}
+		return (NULL);
+}
+
+/*
+ * The initiator won arbitration: select the target and send the command.
+ */
+static void
+StartCommand(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		SimCommandPtr			commandPtr
+	)
+{
+		register SimBusPtr		busPtr;
+		register SimTargetPtr	targetPtr;
+		unsigned long			time;
+		Boolean					disconnect;
+
+		busPtr = &simPtr->bus[bus];
+		targetPtr = &busPtr->target[commandPtr->targetID];
+		targetPtr->activePtr = commandPtr;
+		busPtr->busy = TRUE;
+		busPtr->tenureStart = simPtr->now;
+		++busPtr->tenures;
+		time = simPtr->now + kSimArbitrationTime;
+		if (targetPtr->present == FALSE) {
+			commandPtr->failed = TRUE;
+			++busPtr->selectTimeouts;
+			busPtr->completingPtr = commandPtr;
+			ScheduleEvent(simPtr, time + busPtr->selectTimeout,
+				kSimEventBusFree, bus, NULL);
+			return;
+		}
+		time += kSimSelectionTime;
+		time += BusSimTransferTime(1 + kSimCommandBytes, busPtr->asyncRate);
+		if (commandPtr->write)
+			time += DataTime(busPtr, targetPtr, commandPtr->length);
+		switch (simPtr->disconnectPolicy) {
+		case kSimDisconnectAlways:
+			disconnect = targetPtr->disconnects;
+			break;
+		case kSimDisconnectAdaptive:
+			disconnect = (targetPtr->disconnects
+					&& commandPtr->service >= simPtr->disconnectThreshold);
+			break;
+		default:
+			disconnect = FALSE;
+			break;
+		}
+		if (disconnect) {
+			/*
+			 * Disconnect (after Save Data Pointers for a write) and work
+			 * with the bus free.
+			 */
+			time += BusSimTransferTime(
+						(commandPtr->write) ? 2 : 1, busPtr->asyncRate);
+			busPtr->completingPtr = NULL;
+			ScheduleEvent(simPtr, time, kSimEventBusFree, bus, NULL);
+			ScheduleEvent(simPtr, time + commandPtr->service,
+				kSimEventReady, bus, commandPtr);
+		}
+		else {
+			time += commandPtr->service;
+			if (commandPtr->write == FALSE)
+				time += DataTime(busPtr, targetPtr, commandPtr->length);
+			time += BusSimTransferTime(2, busPtr->asyncRate);	/* Status, msg	*/
+			busPtr->completingPtr = commandPtr;
+			ScheduleEvent(simPtr, time, kSimEventBusFree, bus, NULL);
+		}
+}
+
+/*
+ * A disconnected target won arbitration: it reselects the initiator and
+ * finishes its command.
+ */
+static void
+Reselect(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		SimTargetPtr			targetPtr
+	)
+{
+		register SimBusPtr		busPtr;
+		SimCommandPtr			commandPtr;
+		unsigned long			time;
+
+		busPtr = &simPtr->bus[bus];
+		commandPtr = targetPtr->activePtr;
+		targetPtr->reselectPending = FALSE;
+		targetPtr->reselectWait += simPtr->now - commandPtr->readyTime;
+		busPtr->busy = TRUE;
+		busPtr->tenureStart = simPtr->now;
+		++busPtr->tenures;
+		++busPtr->reselections;
+		time = simPtr->now + kSimArbitrationTime + kSimSelectionTime;
+		time += BusSimTransferTime(1, busPtr->asyncRate);	/* Identify			*/
+		if (commandPtr->write == FALSE)
+			time += DataTime(busPtr, targetPtr, commandPtr->length);
+		time += BusSimTransferTime(2, busPtr->asyncRate);	/* Status, message	*/
+		busPtr->completingPtr = commandPtr;
+		ScheduleEvent(simPtr, time, kSimEventBusFree, bus, NULL);
+}
+
+/*
+ * The bus went free after Command Complete (or a selection timeout).
+ */
+static void
+CompleteCommand(
+		BusSimulatorPtr			simPtr,
+		SimBusPtr				busPtr
+	)
+{
+		register SimCommandPtr	commandPtr;
+		register SimTargetPtr	targetPtr;
+		unsigned long			latency;
+
+		commandPtr = busPtr->completingPtr;
+		busPtr->completingPtr = NULL;
+		targetPtr = &busPtr->target[commandPtr->targetID];
+		targetPtr->activePtr = NULL;
+		commandPtr->completion = simPtr->now;
+		latency = (commandPtr->completion - commandPtr->arrival)
+				/ kSimUnitsPerUsec;
+		++targetPtr->commands;
+		if (commandPtr->failed == FALSE)
+			targetPtr->bytes += commandPtr->length;
+		targetPtr->totalLatency += latency;
+		if (latency > targetPtr->maxLatency)
+			targetPtr->maxLatency = latency;
+}
+
+static unsigned long
+DataTime(
+		SimBusPtr				busPtr,
+		SimTargetPtr			targetPtr,
+		unsigned long			length
+	)
+{
+		return (BusSimTransferTime(length,
+				(targetPtr->syncRate != 0)
+					? targetPtr->syncRate
+					: busPtr->asyncRate));
+}
+
+/*
+ * Add an event to the heap: put it at the bottom and move it up past the
+ * events that are due after it.
+ */
+static void
+ScheduleEvent(
+		BusSimulatorPtr			simPtr,
+		unsigned long			time,
+		unsigned short			kind,
+		unsigned short			bus,
+		SimCommandPtr			commandPtr
+	)
+{
+		register SimEventPtr	heapPtr;
+		register unsigned long	child;
+		unsigned long			parent;
+		SimEvent				event;
+
+		event.time = time;
+		event.sequence = simPtr->sequence++;
+		event.kind = kind;
+		event.bus = bus;
+		event.commandPtr = commandPtr;
+		heapPtr = simPtr->eventPtr;
+		for (child = simPtr->eventCount++; child > 0; child = parent) {
+			parent = (child - 1) / 2;
+			if (EventBefore(&heapPtr[parent], &event))
+				break;
+			heapPtr[child] = heapPtr[parent];
+		}
+		heapPtr[child] = event;
+}
+
+/*
+ * Remove the earliest event from the heap: move the last event down from the
+ * top past the events that are due before it.
+ */
+static void
+NextEvent(
+		BusSimulatorPtr			simPtr,
+		SimEvent				*eventPtr
+	)
+{
+		register SimEventPtr	heapPtr;
+		register unsigned long	parent;
+		unsigned long			child;
+		unsigned long			count;
+		SimEvent				last;
+
+		heapPtr = simPtr->eventPtr;
+		*eventPtr = heapPtr[0];
+		count = --simPtr->eventCount;
+		last = heapPtr[count];
+		for (parent = 0; (child = parent * 2 + 1) < count; parent = child) {
+			if (child + 1 < count
+					 && EventBefore(&heapPtr[child + 1], &heapPtr[child]))
+				++child;
+			if (EventBefore(&last, &heapPtr[child]))
+				break;
+			heapPtr[parent] = heapPtr[child];
+		}
+		heapPtr[parent] = last;
+}
+
+static Boolean
+EventBefore(
+		const SimEvent			*aPtr,
+		const SimEvent			*bPtr
+	)
+{
+		if (aPtr->time != bPtr->time)
+			return (aPtr->time < bPtr->time);
+		return (aPtr->sequence < bPtr->sequence);
+}
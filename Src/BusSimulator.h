@@ -0,0 +1,213 @@
+/*									BusSimulator.h								*/
+/*
+ * BusSimulator.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * A discrete-event model of the time that commands spend on one or more SCSI
+ * buses. Unlike the virtual SIM, which executes real requests in real time,
+ * the simulator advances a simulated clock from one event to the next, so a
+ * workload of thousands of commands runs in a fraction of a second and the
+ * results don't depend on the Macintosh it runs on. It is used to compare
+ * disconnect and queueing policies before trying them on real devices.
+ *
+ * Each command's bus tenure is built from the phases that OriginalSCSI walks
+ * through, with the timing of the SCSI-2 specification:
+ *	-- Arbitration. When the bus goes free, every device that wants it
+ *	   arbitrates, and the highest SCSI ID wins. The Macintosh (ID 7) always
+ *	   wins, so a target that is ready to reselect waits until the initiator
+ *	   has no more commands to start.
+ *	-- Selection, with an Identify message, then the command bytes. Selecting
+ *	   a missing target holds the bus for the selection timeout.
+ *	-- If the target disconnects, it sends Disconnect and releases the bus
+ *	   while it works (seeks, and so on), then arbitrates and reselects the
+ *	   initiator for the data, status, and Command Complete phases. Otherwise
+ *	   it holds the bus throughout.
+ *	-- Command, message, and status bytes are transferred at the bus's
+ *	   asynchronous rate. Data is transferred at the target's synchronous
+ *	   rate, if it has one: this is also how a slow device (a CD-ROM player
+ *	   that delivers data at 300K/sec) is modelled.
+ *	-- Writes transfer their data before the target disconnects.
+ * Targets are untagged: each has at most one command at a time. Commands
+ * wait in the initiator's queue (one per bus) until their target is free.
+ *
+ * Times are in units of 100 nsec (kSimUnitsPerUsec per microsecond), so a
+ * simulation may last about seven minutes of simulated time. This module is
+ * self-contained: it does not use the SCSI Manager or the application log.
+ */
+#ifndef __BusSimulator__
+#define __BusSimulator__
+#include <Types.h>
+
+#define kSimMaxBuses			4
+#define kSimMaxTargets			8
+#define kSimInitiatorID			7
+#define kSimUnitsPerUsec		10L
+#define kSimUnitsPerMsec		10000L
+/*
+ * SCSI-2 timing. Arbitration includes the bus free, arbitration, and bus
+ * settle delays; selection and reselection include the bus clear delay and
+ * the deskew delays.
+ */
+#define kSimArbitrationTime		40L				/* 4.0 usec						*/
+#define kSimSelectionTime		20L				/* 2.0 usec						*/
+#define kSimSelectTimeout		(250L * kSimUnitsPerMsec)
+#define kSimAsyncRate			1500L			/* Bytes per msec				*/
+#define kSimCommandBytes		10				/* Read(10), Write(10)			*/
+
+/*
+ * Disconnect policies. kSimDisconnectAdaptive lets a target disconnect only
+ * if the command's service time is at least the simulator's threshold (the
+ * decision that DevicePolicy makes from measured latency).
+ */
+enum {
+	kSimDisconnectNever = 0,
+	kSimDisconnectAlways,
+	kSimDisconnectAdaptive
+};
+/*
+ * Queueing policies for the initiator's queue. kSimQueueFIFO starts the
+ * oldest command whose target is free. kSimQueueRoundRobin visits the
+ * targets in turn, starting the oldest command of the next target that has
+ * one, so that one busy device can't fill the queue ahead of the others.
+ */
+enum {
+	kSimQueueFIFO = 0,
+	kSimQueueRoundRobin
+};
+
+typedef struct SimCommand SimCommand, *SimCommandPtr;
+/*
+ * A command. The caller fills in the fields marked ->; the simulator sets
+ * the fields marked <-.
+ */
+struct SimCommand {
+	SimCommandPtr		next;					/* Initiator queue				*/
+	unsigned char		bus;					/* ->							*/
+	unsigned char		targetID;				/* ->							*/
+	Boolean				write;					/* -> Data out					*/
+	Boolean				failed;					/* <- Selection timed out		*/
+	unsigned long		arrival;				/* -> When it is issued			*/
+	unsigned long		length;					/* -> Data bytes				*/
+	unsigned long		service;				/* -> Target's own work			*/
+	unsigned long		readyTime;				/* Used by the simulator		*/
+	unsigned long		completion;				/* <- Command Complete			*/
+};
+
+struct SimTarget {
+	Boolean				present;
+	Boolean				disconnects;			/* Can disconnect				*/
+	unsigned long		syncRate;				/* Bytes per msec, 0 = async	*/
+	/*
+	 * Statistics.
+	 */
+	unsigned long		commands;
+	unsigned long		bytes;
+	unsigned long		totalLatency;			/* Microseconds					*/
+	unsigned long		maxLatency;				/* Microseconds					*/
+	unsigned long		reselectWait;			/* Ready, waiting for the bus	*/
+	/*
+	 * State.
+	 */
+	SimCommandPtr		activePtr;				/* Its command, if any			*/
+	Boolean				reselectPending;		/* Waiting to reselect			*/
+};
+typedef struct SimTarget SimTarget, *SimTargetPtr;
+
+struct SimBus {
+	unsigned long		asyncRate;				/* Bytes per msec				*/
+	unsigned long		selectTimeout;
+	SimTarget			target[kSimMaxTargets];
+	/*
+	 * Statistics.
+	 */
+	unsigned long		busyTime;				/* Bus not free					*/
+	unsigned long		tenures;				/* Arbitrations won				*/
+	unsigned long		reselections;
+	unsigned long		selectTimeouts;
+	/*
+	 * State.
+	 */
+	Boolean				busy;
+	unsigned long		tenureStart;
+	SimCommandPtr		completingPtr;			/* Completes when bus is free	*/
+	SimCommandPtr		queueHead;				/* Initiator queue				*/
+	SimCommandPtr		queueTail;
+	unsigned short		lastTarget;				/* kSimQueueRoundRobin			*/
+};
+typedef struct SimBus SimBus, *SimBusPtr;
+
+typedef struct SimEvent SimEvent, *SimEventPtr;
+struct BusSimulator {
+	unsigned short		busCount;
+	unsigned short		disconnectPolicy;		/* kSimDisconnectNever, etc.	*/
+	unsigned long		disconnectThreshold;	/* kSimDisconnectAdaptive		*/
+	unsigned short		queuePolicy;			/* kSimQueueFIFO, etc.			*/
+	SimBus				bus[kSimMaxBuses];
+	/*
+	 * Simulation state and statistics.
+	 */
+	unsigned long		now;					/* The simulated clock			*/
+	unsigned long		events;					/* Events handled				*/
+	unsigned long		sequence;				/* Orders simultaneous events	*/
+	SimEventPtr			eventPtr;				/* The event heap				*/
+	unsigned long		eventCount;
+};
+typedef struct BusSimulator BusSimulator, *BusSimulatorPtr;
+
+/*
+ * Usage:
+ *		void						BusSimInit(
+ *				BusSimulatorPtr			simPtr,
+ *				unsigned short			busCount
+ *			);
+ *	Clear the simulator: the buses have no targets, the asynchronous rate is
+ *	kSimAsyncRate, and the selection timeout is kSimSelectTimeout. Targets
+ *	never disconnect, and the initiator's queue is FIFO.
+ *
+ *		void						BusSimSetTarget(
+ *				BusSimulatorPtr			simPtr,
+ *				unsigned short			bus,
+ *				unsigned short			targetID,
+ *				Boolean					disconnects,
+ *				unsigned long			syncRate
+ *			);
+ *	Add a target to a bus.
+ *
+ *		OSErr						BusSimRun(
+ *				BusSimulatorPtr			simPtr,
+ *				SimCommand				command[],
+ *				unsigned long			commandCount
+ *			);
+ *	Run the commands (in any order of arrival) to completion. The statistics
+ *	are cleared first, so the same simulator may be run several times with
+ *	different policies. Returns memFullErr if the event heap could not be
+ *	allocated, paramErr if a command is for a bus that does not exist.
+ *
+ *		unsigned long				BusSimTransferTime(
+ *				unsigned long			bytes,
+ *				unsigned long			rate
+ *			);
+ *	Return the time to transfer bytes at rate bytes per msec.
+ */
+void						BusSimInit(
+		BusSimulatorPtr			simPtr,
+		unsigned short			busCount
+	);
+void						BusSimSetTarget(
+		BusSimulatorPtr			simPtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		Boolean					disconnects,
+		unsigned long			syncRate
+	);
+OSErr						BusSimRun(
+		BusSimulatorPtr			simPtr,
+		SimCommand				command[],
+		unsigned long			commandCount
+	);
+unsigned long				BusSimTransferTime(
+		unsigned long			bytes,
+		unsigned long			rate
+	);
+
+#endif /* __BusSimulator__ */
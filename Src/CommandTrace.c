@@ -0,0 +1,692 @@
+/*									CommandTrace.c								*/
+/*
+ * CommandTrace.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Capture and read command traces. See CommandTrace.h for the file format.
+ * If a write fails, the error is remembered, and the records that follow are
+ * discarded: the trace ends at the last complete buffer, and has no index.
+ */
+#include "SCSISimpleSample.h"
+
+#define kReadToEndOfFile		0xFFFFFFFF
+#define kInquiryStringLength	36				/* Through the revision		*/
+#define TestBucket(map, bucket)											\
+		(((map)[(bucket) >> 3] & (1 << ((bucket) & 7))) != 0)
+#define SetBucket(map, bucket)											\
+		((map)[(bucket) >> 3] |= (1 << ((bucket) & 7)))
+
+static OSErr					FlushTrace(
+		CommandTracePtr			tracePtr
+	);
+static void						IndexRecord(
+		CommandTracePtr			tracePtr,
+		const TraceRecord		*recordPtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr
+	);
+static void						MergeBuckets(
+		TraceIndexPtr			indexPtr
+	);
+static void						AddInquiryString(
+		TraceIndexPtr			indexPtr,
+		TraceDevicePtr			devicePtr,
+		const SCSI_Inquiry_Data	*inquiryPtr
+	);
+static void						AppendInquiryField(
+		StringPtr				result,
+		const unsigned char		*field,
+		short					length
+	);
+static OSErr					SeekRecord(
+		TraceReaderPtr			readerPtr,
+		unsigned long			recordNumber
+	);
+static OSErr					SkipBuckets(
+		TraceReaderPtr			readerPtr
+	);
+static unsigned long			MsecBetween(
+		const UnsignedWide		*startTime,
+		const UnsignedWide		*endTime
+	);
+
+OSErr
+CommandTraceStart(
+		CommandTracePtr			tracePtr,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		OSType					creator
+	)
+{
+		TraceFileHeader			header;
+		long					count;
+		OSErr					status;
+
+		CLEAR(*tracePtr);
+		status = Create(fileName, vRefNum, creator, kTraceFileType);
+		if (status == dupFNErr)						/* Replace it			*/
+			status = noErr;
+		if (status == noErr)
+			status = FSOpen(fileName, vRefNum, &tracePtr->refNum);
+		if (status != noErr)
+			return (status);
+		tracePtr->bufferPtr = (TraceRecordPtr)
+					NewPtr(sizeof (TraceRecord) * kTraceBufferRecords);
+		tracePtr->indexPtr = (TraceIndexPtr) NewPtrClear(sizeof (TraceIndex));
+		if (tracePtr->bufferPtr == NULL || tracePtr->indexPtr == NULL)
+			status = memFullErr;
+		if (status == noErr)
+			status = SetEOF(tracePtr->refNum, 0L);
+		if (status == noErr) {
+			CLEAR(header);
+			header.fileType = kTraceFileType;
+			header.version = kTraceVersion;
+			header.recordSize = sizeof (TraceRecord);
+			count = sizeof header;
+			status = FSWrite(tracePtr->refNum, &count, (Ptr) &header);
+		}
+		if (status != noErr) {
+			(void) FSClose(tracePtr->refNum);
+			if (tracePtr->bufferPtr != NULL)
+				DisposePtr((Ptr) tracePtr->bufferPtr);
+			if (tracePtr->indexPtr != NULL)
+				DisposePtr((Ptr) tracePtr->indexPtr);
+			CLEAR(*tracePtr);
+			return (status);
+		}
+		tracePtr->indexPtr->bucketMsec = kTraceBucketMsec;
+		Microseconds(&tracePtr->startTime);
+		tracePtr->active = TRUE;
+		return (noErr);
+}
+
+void
+CommandTraceRecord(
+		CommandTracePtr			tracePtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		Boolean					enableAsynchSCSI,
+		const UnsignedWide		*issuedTime
+	)
+{
+		register TraceRecordPtr	recordPtr;
+		register short			i;
+		UnsignedWide			now;
+#define SCB	(*scsiCmdBlockPtr)
+
+		if (tracePtr->active == FALSE || tracePtr->status != noErr)
+			return;
+		Microseconds(&now);
+		recordPtr = &tracePtr->bufferPtr[tracePtr->bufferCount];
+		CLEAR(*recordPtr);
+		recordPtr->issuedMsec = MsecBetween(&tracePtr->startTime, issuedTime);
+		recordPtr->latency = now.lo - issuedTime->lo;
+		recordPtr->transferSize = SCB.transferSize;
+		recordPtr->transferQuantum = SCB.transferQuantum;
+		recordPtr->actualTransferCount = SCB.actualTransferCount;
+		recordPtr->status = SCB.status;
+		recordPtr->bus = SCB.scsiDevice.bus;
+		recordPtr->targetID = SCB.scsiDevice.targetID;
+		recordPtr->LUN = SCB.scsiDevice.LUN;
+		if (SCB.writeToDevice)
+			recordPtr->flags |= kTraceWrite;
+		if (enableAsynchSCSI)
+			recordPtr->flags |= kTraceAsync;
+		recordPtr->statusByte = SCB.statusByte;
+		if (SCB.status == statusErr) {
+			recordPtr->senseKey = SCB.sense.senseKey & kScsiSenseKeyMask;
+			recordPtr->senseCode = SCB.sense.additionalSenseCode;
+			recordPtr->senseQualifier = SCB.sense.additionalSenseQualifier;
+		}
+		recordPtr->busyRetries =
+			(SCB.busyRetries > 0xFF) ? 0xFF : SCB.busyRetries;
+		recordPtr->cdbLength = SCSIGetCommandLength((Ptr) &SCB.command);
+		if (recordPtr->cdbLength == 0
+				 || recordPtr->cdbLength > kTraceMaxCDBLength)
+			recordPtr->cdbLength = kTraceMaxCDBLength;
+		for (i = 0; i < recordPtr->cdbLength; i++)
+			recordPtr->cdb[i] = SCB.command.scsi[i];
+		IndexRecord(tracePtr, recordPtr, scsiCmdBlockPtr);
+		++tracePtr->records;
+		if (++tracePtr->bufferCount == kTraceBufferRecords)
+			tracePtr->status = FlushTrace(tracePtr);
+#undef SCB
+}
+
+OSErr
+CommandTraceStop(
+		CommandTracePtr			tracePtr
+	)
+{
+		TraceFileHeader			header;
+		long					count;
+		long					offset;
+		OSErr					status;
+
+		if (tracePtr->active == FALSE)
+			return (noErr);
+		if (tracePtr->status == noErr)
+			tracePtr->status = FlushTrace(tracePtr);
+		/*
+		 * Append the index, then rewrite the header to point to it.
+		 */
+		if (tracePtr->status == noErr)
+			tracePtr->status = GetFPos(tracePtr->refNum, &offset);
+		if (tracePtr->status == noErr) {
+			count = sizeof (TraceIndex);
+			tracePtr->status = FSWrite(
+						tracePtr->refNum, &count, (Ptr) tracePtr->indexPtr);
+		}
+		if (tracePtr->status == noErr)
+			tracePtr->status = SetFPos(tracePtr->refNum, fsFromStart, 0L);
+		if (tracePtr->status == noErr) {
+			CLEAR(header);
+			header.fileType = kTraceFileType;
+			header.version = kTraceVersion;
+			header.recordSize = sizeof (TraceRecord);
+			header.recordCount = tracePtr->records;
+			header.indexOffset = offset;
+			count = sizeof header;
+			tracePtr->status = FSWrite(tracePtr->refNum, &count, (Ptr) &header);
+		}
+		status = FSClose(tracePtr->refNum);
+		if (tracePtr->status == noErr)
+			tracePtr->status = status;
+		DisposePtr((Ptr) tracePtr->bufferPtr);
+		DisposePtr((Ptr) tracePtr->indexPtr);
+		tracePtr->bufferPtr = NULL;
+		tracePtr->indexPtr = NULL;
+		tracePtr->active = FALSE;
+		return (tracePtr->status);
+}
+
+OSErr
+CommandTraceOpen(
+		TraceReaderPtr			readerPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum
+	)
+{
+		TraceFileHeader			header;
+		long					count;
+		OSErr					status;
+
+		CLEAR(*readerPtr);
+		status = FSOpen(fileName, vRefNum, &readerPtr->refNum);
+		if (status != noErr)
+			return (status);
+		CLEAR(header);
+		count = kTraceVersion1HeaderSize;
+		status = FSRead(readerPtr->refNum, &count, (Ptr) &header);
+		if (status == eofErr
+		 || (status == noErr
+		  && (header.fileType != kTraceFileType
+		   || (header.version != kTraceVersion
+				&& header.version != kTraceVersion1)
+		   || header.recordSize != sizeof (TraceRecord))))
+			status = paramErr;
+		readerPtr->headerSize = kTraceVersion1HeaderSize;
+		if (status == noErr && header.version != kTraceVersion1) {
+			count = sizeof header - kTraceVersion1HeaderSize;
+			status = FSRead(readerPtr->refNum, &count,
+						(Ptr) &header + kTraceVersion1HeaderSize);
+			if (status == eofErr)
+				status = paramErr;
+			readerPtr->headerSize = sizeof header;
+		}
+		if (status == noErr) {
+			readerPtr->bufferPtr = (TraceRecordPtr)
+						NewPtr(sizeof (TraceRecord) * kTraceBufferRecords);
+			if (readerPtr->bufferPtr == NULL)
+				status = memFullErr;
+		}
+		/*
+		 * Without an index, the records run to the end of the file.
+		 */
+		readerPtr->recordCount = kReadToEndOfFile;
+		if (status == noErr
+		 && header.version != kTraceVersion1
+		 && header.indexOffset != 0) {
+			readerPtr->indexPtr = (TraceIndexPtr) NewPtr(sizeof (TraceIndex));
+			if (readerPtr->indexPtr == NULL)
+				status = memFullErr;
+			if (status == noErr)
+				status = SetFPos(
+							readerPtr->refNum, fsFromStart, header.indexOffset);
+			if (status == noErr) {
+				count = sizeof (TraceIndex);
+				status = FSRead(readerPtr->refNum,
+							&count, (Ptr) readerPtr->indexPtr);
+				if (status == eofErr)
+					status = paramErr;
+			}
+			readerPtr->recordCount = header.recordCount;
+		}
+		if (status == noErr)
+			status = CommandTraceQuery(readerPtr, NULL, 0L, 0xFFFFFFFF);
+		if (status != noErr) {
+			(void) FSClose(readerPtr->refNum);
+			if (readerPtr->bufferPtr != NULL)
+				DisposePtr((Ptr) readerPtr->bufferPtr);
+			if (readerPtr->indexPtr != NULL)
+				DisposePtr((Ptr) readerPtr->indexPtr);
+			CLEAR(*readerPtr);
+		}
+		return (status);
+}
+
+OSErr
+CommandTraceNext(
+		TraceReaderPtr			readerPtr,
+		TraceRecordPtr			*recordPtr
+	)
+{
+		register TraceRecordPtr	thisRecordPtr;
+		unsigned long			msec;
+		long					count;
+		OSErr					status;
+
+		for (;;) {
+			if (readerPtr->deviceIndex >= 0) {
+				status = SkipBuckets(readerPtr);
+				if (status != noErr)
+					return (status);
+			}
+			if (readerPtr->recordNumber >= readerPtr->endRecord)
+				return (eofErr);
+			if (readerPtr->next >= readerPtr->count) {
+				count = kTraceBufferRecords;
+				if (readerPtr->endRecord - readerPtr->recordNumber < count)
+					count = readerPtr->endRecord - readerPtr->recordNumber;
+				count *= sizeof (TraceRecord);
+				status = FSRead(readerPtr->refNum,
+							&count, (Ptr) readerPtr->bufferPtr);
+				if (status == eofErr && count >= sizeof (TraceRecord))
+					status = noErr;						/* The last buffer		*/
+				if (status != noErr)
+					return (status);
+				/*
+				 * A partial record at the end of the file is ignored.
+				 */
+				readerPtr->count = count / sizeof (TraceRecord);
+				readerPtr->next = 0;
+				readerPtr->recordsRead += readerPtr->count;
+				if (readerPtr->count == 0)
+					return (eofErr);
+			}
+			thisRecordPtr = &readerPtr->bufferPtr[readerPtr->next++];
+			++readerPtr->recordNumber;
+			msec = TraceCompletedMsec(thisRecordPtr);
+			if (msec >= readerPtr->startMsec
+			 && msec <= readerPtr->endMsec
+			 && (readerPtr->anyDevice
+			  || (thisRecordPtr->bus == readerPtr->bus
+			   && thisRecordPtr->targetID == readerPtr->targetID
+			   && thisRecordPtr->LUN == readerPtr->LUN))) {
+				*recordPtr = thisRecordPtr;
+				return (noErr);
+			}
+		}
+}
+
+OSErr
+CommandTraceQuery(
+		TraceReaderPtr			readerPtr,
+		const DeviceIdent		*scsiDevicePtr,
+		unsigned long			startMsec,
+		unsigned long			endMsec
+	)
+{
+		register TraceIndexPtr	indexPtr;
+		register TraceDevicePtr	devicePtr;
+		register short			i;
+		unsigned long			startRecord;
+		unsigned long			endRecord;
+		unsigned long			bucket;
+
+		readerPtr->anyDevice = (scsiDevicePtr == NULL);
+		if (scsiDevicePtr != NULL) {
+			readerPtr->bus = scsiDevicePtr->bus;
+			readerPtr->targetID = scsiDevicePtr->targetID;
+			readerPtr->LUN = scsiDevicePtr->LUN;
+		}
+		readerPtr->startMsec = startMsec;
+		readerPtr->endMsec = endMsec;
+		readerPtr->deviceIndex = -1;
+		readerPtr->bucket = 0;
+		readerPtr->recordsRead = 0;
+		startRecord = 0;
+		endRecord = readerPtr->recordCount;
+		indexPtr = readerPtr->indexPtr;
+		if (indexPtr != NULL && indexPtr->bucketCount != 0) {
+			if (scsiDevicePtr != NULL) {
+				for (i = 0; i < indexPtr->deviceCount; i++) {
+					devicePtr = &indexPtr->device[i];
+					if (devicePtr->bus == readerPtr->bus
+					 && devicePtr->targetID == readerPtr->targetID
+					 && devicePtr->LUN == readerPtr->LUN) {
+						readerPtr->deviceIndex = i;
+						startRecord = devicePtr->firstRecord;
+						endRecord = devicePtr->lastRecord + 1;
+						break;
+					}
+				}
+				if (readerPtr->deviceIndex < 0
+				 && (indexPtr->flags & kTraceIndexDeviceOverflow) == 0)
+					endRecord = 0;						/* Not in the trace		*/
+			}
+			bucket = startMsec / indexPtr->bucketMsec;
+			if (bucket >= indexPtr->bucketCount)
+				startRecord = endRecord;
+			else {
+				readerPtr->bucket = bucket;
+				if (indexPtr->bucketFirst[bucket] > startRecord)
+					startRecord = indexPtr->bucketFirst[bucket];
+			}
+			/*
+			 * A record may be filed one bucket late (completion times are
+			 * rounded to the msec), so one more bucket is read.
+			 */
+			bucket = endMsec / indexPtr->bucketMsec + 2;
+			if (bucket < indexPtr->bucketCount
+					 && indexPtr->bucketFirst[bucket] < endRecord)
+				endRecord = indexPtr->bucketFirst[bucket];
+		}
+		if (startRecord > endRecord)
+			startRecord = endRecord;
+		readerPtr->endRecord = endRecord;
+		return (SeekRecord(readerPtr, startRecord));
+}
+
+void
+CommandTraceClose(
+		TraceReaderPtr			readerPtr
+	)
+{
+		if (readerPtr->bufferPtr != NULL) {
+			(void) FSClose(readerPtr->refNum);
+			DisposePtr((Ptr) readerPtr->bufferPtr);
+		}
+		if (readerPtr->indexPtr != NULL)
+			DisposePtr((Ptr) readerPtr->indexPtr);
+		CLEAR(*readerPtr);
+}
+
+unsigned long
+CommandTraceElapsed(
+		const UnsignedWide		*startTime
+	)
+{
+		UnsignedWide			now;
+
+		Microseconds(&now);
+		return (now.lo - startTime->lo);
+}
+
+unsigned long
+CommandTraceElapsedMsec(
+		const UnsignedWide		*startTime
+	)
+{
+		UnsignedWide			now;
+
+		Microseconds(&now);
+		return (MsecBetween(startTime, &now));
+}
+
+/*
+ * Return the milliseconds between two Microseconds times. A capture may be
+ * longer than 32 bits of microseconds (71 minutes), so the high word is used
+ * here. 2^32 microseconds is 4294967.296 msec; the fraction is ignored (as
+ * in VirtualSIM.c).
+ */
+static unsigned long
+MsecBetween(
+		const UnsignedWide		*startTime,
+		const UnsignedWide		*endTime
+	)
+{
+		unsigned long			hi;
+		unsigned long			lo;
+
+		hi = endTime->hi - startTime->hi;
+		lo = endTime->lo - startTime->lo;
+		if (endTime->lo < startTime->lo)			/* Borrow				*/
+			--hi;
+		return (hi * 4294967L + lo / 1000L);
+}
+
+/*
+ * Write the buffered records.
+ */
+static OSErr
+FlushTrace(
+		CommandTracePtr			tracePtr
+	)
+{
+		long					count;
+		OSErr					status;
+
+		status = noErr;
+		if (tracePtr->bufferCount != 0) {
+			count = sizeof (TraceRecord) * tracePtr->bufferCount;
+			status = FSWrite(
+						tracePtr->refNum, &count, (Ptr) tracePtr->bufferPtr);
+			tracePtr->bufferCount = 0;
+		}
+		return (status);
+}
+
+/*
+ * Add a record to the capture's index. Its number is tracePtr->records.
+ */
+static void
+IndexRecord(
+		CommandTracePtr			tracePtr,
+		const TraceRecord		*recordPtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr
+	)
+{
+		register TraceIndexPtr	indexPtr;
+		register TraceDevicePtr	devicePtr;
+		register short			i;
+		unsigned long			msec;
+		unsigned long			bucket;
+#define SCB	(*scsiCmdBlockPtr)
+
+		indexPtr = tracePtr->indexPtr;
+		/*
+		 * Records are written as commands complete, but the completion time
+		 * is rounded, so it may run backwards by a millisecond. Keep the
+		 * buckets in record order.
+		 */
+		msec = TraceCompletedMsec(recordPtr);
+		if (msec < tracePtr->lastMsec)
+			msec = tracePtr->lastMsec;
+		tracePtr->lastMsec = msec;
+		while (msec / indexPtr->bucketMsec >= kTraceMaxBuckets)
+			MergeBuckets(indexPtr);
+		bucket = msec / indexPtr->bucketMsec;
+		while (indexPtr->bucketCount <= bucket)
+			indexPtr->bucketFirst[indexPtr->bucketCount++] = tracePtr->records;
+		devicePtr = NULL;
+		for (i = 0; i < indexPtr->deviceCount; i++) {
+			if (indexPtr->device[i].bus == recordPtr->bus
+			 && indexPtr->device[i].targetID == recordPtr->targetID
+			 && indexPtr->device[i].LUN == recordPtr->LUN) {
+				devicePtr = &indexPtr->device[i];
+				break;
+			}
+		}
+		if (devicePtr == NULL) {
+			if (indexPtr->deviceCount >= kTraceMaxDevices) {
+				indexPtr->flags |= kTraceIndexDeviceOverflow;
+				return;
+			}
+			devicePtr = &indexPtr->device[indexPtr->deviceCount++];
+			devicePtr->bus = recordPtr->bus;
+			devicePtr->targetID = recordPtr->targetID;
+			devicePtr->LUN = recordPtr->LUN;
+			devicePtr->stringOffset = kTraceNoString;
+			devicePtr->firstRecord = tracePtr->records;
+			devicePtr->firstMsec = msec;
+		}
+		++devicePtr->records;
+		devicePtr->lastRecord = tracePtr->records;
+		devicePtr->lastMsec = msec;
+		SetBucket(devicePtr->bucketMap, bucket);
+		if (devicePtr->stringOffset == kTraceNoString
+		 && SCB.command.scsi[0] == kScsiCmdInquiry
+		 && (SCB.command.scsi[1] & 0x01) == 0	/* Not vital product data		*/
+		 && SCB.status == noErr
+		 && SCB.bufferPtr != NULL
+		 && SCB.actualTransferCount >= kInquiryStringLength)
+			AddInquiryString(
+				indexPtr, devicePtr, (SCSI_Inquiry_Data *) SCB.bufferPtr);
+#undef SCB
+}
+
+/*
+ * Double the width of the buckets, combining each pair.
+ */
+static void
+MergeBuckets(
+		TraceIndexPtr			indexPtr
+	)
+{
+		register TraceDevicePtr	devicePtr;
+		register short			i;
+		short					bucket;
+		unsigned char			bucketMap[kTraceMaxBuckets / 8];
+
+		indexPtr->bucketMsec *= 2;
+		indexPtr->bucketCount = (indexPtr->bucketCount + 1) / 2;
+		for (bucket = 0; bucket < indexPtr->bucketCount; bucket++)
+			indexPtr->bucketFirst[bucket] = indexPtr->bucketFirst[bucket * 2];
+		for (i = 0; i < indexPtr->deviceCount; i++) {
+			devicePtr = &indexPtr->device[i];
+			CLEAR(bucketMap);
+			for (bucket = 0; bucket < kTraceMaxBuckets / 2; bucket++) {
+				if (TestBucket(devicePtr->bucketMap, bucket * 2)
+				 || TestBucket(devicePtr->bucketMap, bucket * 2 + 1))
+					SetBucket(bucketMap, bucket);
+			}
+			BlockMove(bucketMap, devicePtr->bucketMap, sizeof bucketMap);
+		}
+}
+
+/*
+ * Store the device's vendor, product, and revision in the string table. Two
+ * devices of the same model share a string.
+ */
+static void
+AddInquiryString(
+		TraceIndexPtr			indexPtr,
+		TraceDevicePtr			devicePtr,
+		const SCSI_Inquiry_Data	*inquiryPtr
+	)
+{
+		unsigned short			offset;
+		Str255					work;
+
+		work[0] = 0;
+		AppendInquiryField(
+			work, inquiryPtr->vendor, sizeof inquiryPtr->vendor);
+		AppendInquiryField(
+			work, inquiryPtr->product, sizeof inquiryPtr->product);
+		AppendInquiryField(
+			work, inquiryPtr->revision, sizeof inquiryPtr->revision);
+		if (work[0] == 0)
+			return;
+		for (offset = 0;
+				offset < indexPtr->stringTableSize;
+				offset += indexPtr->stringTable[offset] + 1) {
+			if (EqualString(work, &indexPtr->stringTable[offset], TRUE, TRUE)) {
+				devicePtr->stringOffset = offset;
+				return;
+			}
+		}
+		if (indexPtr->stringTableSize + work[0] + 1 <= kTraceStringTableSize) {
+			BlockMove(work, &indexPtr->stringTable[offset], work[0] + 1);
+			indexPtr->stringTableSize += work[0] + 1;
+			devicePtr->stringOffset = offset;
+		}
+}
+
+/*
+ * Append an Inquiry field without its trailing blanks, separated from what
+ * precedes it by a space. Unprintable characters are replaced by '?'.
+ */
+static void
+AppendInquiryField(
+		StringPtr				result,
+		const unsigned char		*field,
+		short					length
+	)
+{
+		register short			i;
+
+		while (length > 0
+				 && (field[length - 1] == ' ' || field[length - 1] == 0))
+			--length;
+		if (length == 0)
+			return;
+		if (result[0] != 0)
+			AppendChar(result, ' ');
+		for (i = 0; i < length; i++)
+			AppendChar(result,
+				(field[i] >= ' ' && field[i] < 0x7F) ? field[i] : '?');
+}
+
+/*
+ * Position the reader before a record, discarding the buffer.
+ */
+static OSErr
+SeekRecord(
+		TraceReaderPtr			readerPtr,
+		unsigned long			recordNumber
+	)
+{
+		readerPtr->recordNumber = recordNumber;
+		readerPtr->count = 0;
+		readerPtr->next = 0;
+		return (SetFPos(readerPtr->refNum, fsFromStart,
+				readerPtr->headerSize + recordNumber * sizeof (TraceRecord)));
+}
+
+/*
+ * When a query selects one device, skip the buckets that hold none of its
+ * records.
+ */
+static OSErr
+SkipBuckets(
+		TraceReaderPtr			readerPtr
+	)
+{
+		register TraceIndexPtr	indexPtr;
+		const unsigned char		*bucketMap;
+		unsigned short			bucket;
+		unsigned long			recordNumber;
+
+		indexPtr = readerPtr->indexPtr;
+		bucketMap = indexPtr->device[readerPtr->deviceIndex].bucketMap;
+		bucket = readerPtr->bucket;
+		while (bucket + 1 < indexPtr->bucketCount
+		 && readerPtr->recordNumber >= indexPtr->bucketFirst[bucket + 1])
+			++bucket;
+		readerPtr->bucket = bucket;
+		if (TestBucket(bucketMap, bucket))
+			return (noErr);
+		while (++bucket < indexPtr->bucketCount
+				 && TestBucket(bucketMap, bucket) == FALSE)
+			;
+		if (bucket >= indexPtr->bucketCount)
+			recordNumber = readerPtr->endRecord;
+		else {
+			recordNumber = indexPtr->bucketFirst[bucket];
+			readerPtr->bucket = bucket;
+		}
+		if (recordNumber >= readerPtr->endRecord) {
+			readerPtr->recordNumber = readerPtr->endRecord;
+			return (noErr);
+		}
+		return (SeekRecord(readerPtr, recordNumber));
+}
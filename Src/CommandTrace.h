@@ -0,0 +1,257 @@
+/*									CommandTrace.h								*/
+/*
+ * CommandTrace.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Command traces. While a trace is being captured, DoSCSICommandWithSense
+ * records every command it executes (the device, the command bytes, the
+ * transfer, when it was issued and how long it took, and its outcome) in a
+ * binary trace file. DoTraceReplay re-issues a trace's commands and compares
+ * their latency with the recorded latency, so that a workload captured on
+ * one system can be run again, on the same devices or on the virtual bus.
+ *
+ * A trace file holds a TraceFileHeader followed by fixed-size TraceRecords,
+ * in the order in which the commands completed, and (from version 2) a
+ * TraceIndex footer. Records are collected in memory and written
+ * kTraceBufferRecords at a time, so that capturing a trace disturbs the timing
+ * of the commands it records as little as possible. Times are measured with
+ * the Microseconds clock.
+ *
+ * The index is built while the trace is captured, and written when it stops.
+ * It divides the capture into at most kTraceMaxBuckets time buckets (by when
+ * each command completed), and holds the first record of each bucket. When
+ * the capture outgrows the buckets, their width is doubled, so the index has
+ * a fixed size however long the capture runs. For each device, it holds the
+ * number of records, the buckets that contain its records, and the device's
+ * Inquiry string (from the first successful Inquiry command in the trace) in
+ * a string table. CommandTraceQuery uses the index to read only the buckets
+ * that may hold the records it selects, so finding one device's commands in a
+ * long trace reads a small part of the file. The header is rewritten when the
+ * capture stops: if it does not stop (the Macintosh crashes), the trace can
+ * still be read, without an index. Version 1 traces are read the same way.
+ *
+ * These functions use the File Manager, and are called at task level only.
+ */
+#ifndef __CommandTrace__
+#define __CommandTrace__
+#include <Files.h>
+#include <Timer.h>
+#include "MacSCSICommand.h"
+
+#define kTraceFileType			'SCTr'
+#define kTraceVersion			2
+#define kTraceVersion1			1				/* No index						*/
+#define kTraceBufferRecords		256
+#define kTraceMaxCDBLength		12
+#define kTraceMaxBuckets		256
+#define kTraceBucketMsec		1000L			/* Before the first doubling	*/
+#define kTraceMaxDevices		32
+#define kTraceStringTableSize	1024
+#define kTraceNoString			0xFFFF
+
+struct TraceFileHeader {
+	OSType				fileType;				/* kTraceFileType				*/
+	short				version;				/* kTraceVersion				*/
+	short				recordSize;				/* sizeof (TraceRecord)			*/
+	/*
+	 * Version 2. Both are zero until the capture stops.
+	 */
+	unsigned long		recordCount;
+	unsigned long		indexOffset;			/* The TraceIndex				*/
+};
+typedef struct TraceFileHeader TraceFileHeader;
+#define kTraceVersion1HeaderSize	8
+
+/*
+ * TraceRecord flags.
+ */
+enum {
+	kTraceWrite			= 0x01,					/* Data out						*/
+	kTraceAsync			= 0x02					/* Async SCSI Manager allowed	*/
+};
+
+struct TraceRecord {
+	unsigned long		issuedMsec;				/* Since the capture started	*/
+	unsigned long		latency;				/* Microseconds					*/
+	unsigned long		transferSize;
+	unsigned long		transferQuantum;
+	unsigned long		actualTransferCount;
+	OSErr				status;					/* DoSCSICommandWithSense		*/
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		LUN;
+	unsigned char		flags;					/* kTraceWrite, kTraceAsync		*/
+	unsigned char		statusByte;				/* Status phase					*/
+	unsigned char		senseKey;				/* If status is statusErr		*/
+	unsigned char		senseCode;
+	unsigned char		senseQualifier;
+	unsigned char		busyRetries;
+	unsigned char		cdbLength;
+	unsigned char		cdb[kTraceMaxCDBLength];
+};
+typedef struct TraceRecord TraceRecord, *TraceRecordPtr;
+/*
+ * When the command completed, in milliseconds since the capture started.
+ * The index uses this time.
+ */
+#define TraceCompletedMsec(recordPtr)									\
+		((recordPtr)->issuedMsec + (recordPtr)->latency / 1000L)
+
+/*
+ * The index. Bucket b holds records bucketFirst[b] through bucketFirst[b + 1]
+ * - 1 (or the last record, for the last bucket): the commands that completed
+ * from b * bucketMsec to (b + 1) * bucketMsec - 1.
+ */
+enum {
+	kTraceIndexDeviceOverflow	= 0x0001		/* Some devices are not indexed	*/
+};
+struct TraceDevice {
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		LUN;
+	unsigned char		reserved;
+	unsigned short		stringOffset;			/* Or kTraceNoString			*/
+	unsigned long		records;
+	unsigned long		firstRecord;
+	unsigned long		lastRecord;
+	unsigned long		firstMsec;				/* Completion times				*/
+	unsigned long		lastMsec;
+	unsigned char		bucketMap[kTraceMaxBuckets / 8];	/* Has records		*/
+};
+typedef struct TraceDevice TraceDevice, *TraceDevicePtr;
+
+struct TraceIndex {
+	unsigned long		bucketMsec;				/* Width of a bucket			*/
+	unsigned short		bucketCount;
+	unsigned short		deviceCount;
+	unsigned short		stringTableSize;		/* Bytes used					*/
+	unsigned short		flags;					/* kTraceIndexDeviceOverflow	*/
+	unsigned long		bucketFirst[kTraceMaxBuckets];
+	TraceDevice			device[kTraceMaxDevices];
+	unsigned char		stringTable[kTraceStringTableSize];	/* Pascal strings	*/
+};
+typedef struct TraceIndex TraceIndex, *TraceIndexPtr;
+
+/*
+ * A trace being captured.
+ */
+struct CommandTrace {
+	Boolean				active;					/* Recording commands			*/
+	short				refNum;					/* The trace file				*/
+	OSErr				status;					/* First write error			*/
+	UnsignedWide		startTime;				/* When the capture started		*/
+	unsigned long		records;				/* Records captured				*/
+	unsigned short		bufferCount;			/* Records not yet written		*/
+	TraceRecordPtr		bufferPtr;				/* kTraceBufferRecords			*/
+	TraceIndexPtr		indexPtr;
+	unsigned long		lastMsec;				/* Latest completion			*/
+};
+typedef struct CommandTrace CommandTrace, *CommandTracePtr;
+
+/*
+ * A trace being read. indexPtr is NULL if the trace has no index; otherwise,
+ * a caller may use it to list the trace's devices.
+ */
+struct TraceReader {
+	short				refNum;
+	short				headerSize;				/* Offset of the first record	*/
+	unsigned long		recordCount;			/* 0xFFFFFFFF: to end of file	*/
+	unsigned long		recordNumber;			/* Of the next record read		*/
+	unsigned short		count;					/* Records in the buffer		*/
+	unsigned short		next;					/* Next record in the buffer	*/
+	TraceRecordPtr		bufferPtr;				/* kTraceBufferRecords			*/
+	TraceIndexPtr		indexPtr;
+	/*
+	 * The query (see CommandTraceQuery).
+	 */
+	Boolean				anyDevice;
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		LUN;
+	short				deviceIndex;			/* In the index, or -1			*/
+	unsigned long		startMsec;
+	unsigned long		endMsec;
+	unsigned long		endRecord;				/* Stop before this record		*/
+	unsigned short		bucket;					/* Of recordNumber				*/
+	unsigned long		recordsRead;			/* From the file				*/
+};
+typedef struct TraceReader TraceReader, *TraceReaderPtr;
+
+/*
+ * Create (or replace) the trace file and start capturing. The trace must not
+ * be active.
+ */
+OSErr						CommandTraceStart(
+		CommandTracePtr			tracePtr,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		OSType					creator
+	);
+/*
+ * Record one command executed by DoSCSICommandWithSense. issuedTime is the
+ * Microseconds clock when the command was issued; the latency is measured
+ * from then to now. This does nothing if the trace is not active.
+ */
+void						CommandTraceRecord(
+		CommandTracePtr			tracePtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		Boolean					enableAsynchSCSI,
+		const UnsignedWide		*issuedTime
+	);
+/*
+ * Write the remaining records and close the file. Returns the first error
+ * that occurred while the trace was captured.
+ */
+OSErr						CommandTraceStop(
+		CommandTracePtr			tracePtr
+	);
+/*
+ * Open a trace file for reading, and load its index, if it has one. Returns
+ * paramErr if it is not a trace, or if it was written by an unknown version.
+ * CommandTraceNext returns every record until CommandTraceQuery is called.
+ */
+OSErr						CommandTraceOpen(
+		TraceReaderPtr			readerPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum
+	);
+/*
+ * Return the next record (which remains valid until the next call), or
+ * eofErr after the last record.
+ */
+OSErr						CommandTraceNext(
+		TraceReaderPtr			readerPtr,
+		TraceRecordPtr			*recordPtr
+	);
+/*
+ * Restart the reader, selecting only the commands for one device (or for any
+ * device if scsiDevicePtr is NULL) that completed from startMsec through
+ * endMsec. The index, if there is one, is used to skip the parts of the file
+ * that hold none of them; readerPtr->recordsRead counts the records that were
+ * actually read.
+ */
+OSErr						CommandTraceQuery(
+		TraceReaderPtr			readerPtr,
+		const DeviceIdent		*scsiDevicePtr,
+		unsigned long			startMsec,
+		unsigned long			endMsec
+	);
+void						CommandTraceClose(
+		TraceReaderPtr			readerPtr
+	);
+/*
+ * Return the microseconds from startTime to now (which must be less than
+ * about 71 minutes).
+ */
+unsigned long				CommandTraceElapsed(
+		const UnsignedWide		*startTime
+	);
+/*
+ * Return the milliseconds from startTime to now. This may be used for long
+ * intervals, such as the time since a capture started.
+ */
+unsigned long				CommandTraceElapsedMsec(
+		const UnsignedWide		*startTime
+	);
+
+#endif /* __CommandTrace__ */
@@ -0,0 +1,161 @@
+/*									CompletionQueue.c							*/
+/*
+ * CompletionQueue.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Queue SCSI completions for task-level handling. See CompletionQueue.h.
+ * The queue is an Operating System queue: Enqueue and Dequeue disable
+ * interrupts while they change it, so entries may be posted at interrupt
+ * level while the queue is being drained.
+ */
+#include <Gestalt.h>
+#include <LowMem.h>
+#include "CompletionQueue.h"
+#include "CoreMacros.h"
+
+static void 					NextFunction(void);		/* For HoldMemory size	*/
+static Boolean					IsVirtualMemoryRunning(void);
+
+void
+CompletionQueueInit(
+		CompletionQueuePtr		queuePtr
+	)
+{
+		CLEAR(*queuePtr);
+}
+
+void
+CompletionQueueSetWakeProcess(
+		CompletionQueuePtr		queuePtr,
+		Boolean					wakeProcess
+	)
+{
+		if (wakeProcess && GetCurrentProcess(&queuePtr->process) != noErr)
+			wakeProcess = FALSE;
+		queuePtr->wakeProcess = wakeProcess;
+}
+
+/*
+ * This may be called at interrupt level: it must not move memory, and reads
+ * the tick count from low memory rather than calling TickCount.
+ */
+void
+CompletionQueuePost(
+		CompletionEntryPtr		entryPtr
+	)
+{
+		register CompletionQueuePtr	queuePtr;
+
+		queuePtr = entryPtr->queuePtr;
+		entryPtr->postedTicks = LMGetTicks();
+		Enqueue((QElemPtr) entryPtr, &queuePtr->queue);
+		if (queuePtr->wakeProcess)
+			(void) WakeUpProcess(&queuePtr->process);
+}
+
+static void NextFunction(void) { }	/* Marks the end of CompletionQueuePost	*/
+
+Boolean
+CompletionQueuePending(
+		CompletionQueuePtr		queuePtr
+	)
+{
+		return (queuePtr->queue.qHead != NULL);
+}
+
+unsigned short
+CompletionQueueDrain(
+		CompletionQueuePtr		queuePtr,
+		unsigned short			maxEntries
+	)
+{
+		register CompletionEntryPtr	entryPtr;
+		unsigned short			handled;
+		unsigned long			latency;
+
+		for (handled = 0; maxEntries == 0 || handled < maxEntries; handled++) {
+			entryPtr = (CompletionEntryPtr) queuePtr->queue.qHead;
+			if (entryPtr == NULL
+			 || Dequeue((QElemPtr) entryPtr, &queuePtr->queue) != noErr)
+				break;
+			latency = TickCount() - entryPtr->postedTicks;
+			++queuePtr->statistics.handled;
+			queuePtr->statistics.totalLatencyTicks += latency;
+			if (latency > queuePtr->statistics.maxLatencyTicks)
+				queuePtr->statistics.maxLatencyTicks = latency;
+			(*entryPtr->completionProc)(entryPtr);
+		}
+		return (handled);
+}
+
+OSErr
+CompletionQueueHold(
+		CompletionQueuePtr		queuePtr
+	)
+{
+		OSErr					status;
+
+		status = noErr;
+		if (queuePtr->holdCount == 0 && IsVirtualMemoryRunning()) {
+			status = HoldMemory(queuePtr, sizeof (CompletionQueue));
+			if (status == noErr) {
+				status = HoldMemory(
+							CompletionQueuePost,
+							(unsigned long) NextFunction
+								- (unsigned long) CompletionQueuePost
+						);
+				if (status != noErr)
+					(void) UnholdMemory(queuePtr, sizeof (CompletionQueue));
+			}
+		}
+		if (status == noErr)
+			++queuePtr->holdCount;
+		return (status);
+}
+
+void
+CompletionQueueUnhold(
+		CompletionQueuePtr		queuePtr
+	)
+{
+		if (queuePtr->holdCount != 0
+		 && --queuePtr->holdCount == 0
+		 && IsVirtualMemoryRunning()) {
+			(void) UnholdMemory(
+					CompletionQueuePost,
+					(unsigned long) NextFunction
+						- (unsigned long) CompletionQueuePost
+				);
+			(void) UnholdMemory(queuePtr, sizeof (CompletionQueue));
+		}
+}
+
+void
+CompletionQueueGetStatistics(
+		CompletionQueuePtr			queuePtr,
+		CompletionQueueStatistics	*statistics
+	)
+{
+		*statistics = queuePtr->statistics;
+}
+
+void
+CompletionQueueResetStatistics(
+		CompletionQueuePtr		queuePtr
+	)
+{
+		CLEAR(queuePtr->statistics);
+}
+
+static Boolean
+IsVirtualMemoryRunning(void)
+{
+		OSErr						status;
+		long						response;
+
+		status = Gestalt(gestaltVMAttr, &response);
+		/*
+		 * VM is active iff Gestalt succeeded and the response is appropriate.
+		 */
+		return (status == noErr && ((response & (1 << gestaltVMPresent)) != 0));
+}
@@ -0,0 +1,148 @@
+/*									CompletionQueue.h							*/
+/*
+ * CompletionQueue.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * A queue of completed SCSI commands. SCSI completion routines may run at
+ * interrupt level, where they can do almost nothing: instead of waiting for
+ * the application to poll every outstanding parameter block, a completion
+ * routine posts an entry (with Enqueue, which is safe at interrupt level),
+ * and task-level code drains the queue, calling each entry's completion
+ * procedure. The application's event loop drains its environment's queue
+ * once per event, a few entries at a time, so that a burst of completions
+ * can't freeze the user interface.
+ *
+ * If wakeProcess is set, posting an entry also calls WakeUpProcess, so that
+ * WaitNextEvent returns at once even if the application asked to sleep. The
+ * queue also measures the latency from posting to handling.
+ *
+ * This module is self-contained (like AsyncSCSI.c) and does not use the
+ * application log.
+ */
+#ifndef __CompletionQueue__
+#define __CompletionQueue__
+#include <OSUtils.h>
+#include <Processes.h>
+#include "MacSCSICommand.h"
+
+typedef struct CompletionQueue CompletionQueue, *CompletionQueuePtr;
+typedef struct CompletionEntry CompletionEntry, *CompletionEntryPtr;
+/*
+ * The completion procedure is called at task level, from CompletionQueueDrain.
+ * The entry may be posted again from the procedure.
+ */
+typedef void				(*CompletionProcPtr)(
+		CompletionEntryPtr		entryPtr
+	);
+/*
+ * The entry must not be moved (and, if virtual memory is running, must be
+ * held) while it may be posted.
+ */
+struct CompletionEntry {
+	QElemPtr			qLink;					/* Queue link (Enqueue)			*/
+	short				qType;
+	CompletionQueuePtr	queuePtr;				/* -> Where it is posted		*/
+	CompletionProcPtr	completionProc;			/* -> Handles it				*/
+	long				refCon;					/* -> For completionProc		*/
+	unsigned long		postedTicks;			/* <- When it was posted		*/
+};
+
+/*
+ * Statistics. These are cleared by CompletionQueueResetStatistics.
+ */
+struct CompletionQueueStatistics {
+	unsigned long		handled;				/* Entries drained				*/
+	unsigned long		totalLatencyTicks;		/* Posting to handling			*/
+	unsigned long		maxLatencyTicks;
+};
+typedef struct CompletionQueueStatistics CompletionQueueStatistics;
+
+struct CompletionQueue {
+	QHdr				queue;					/* Posted entries				*/
+	Boolean				wakeProcess;			/* WakeUpProcess when posting	*/
+	ProcessSerialNumber	process;				/* The process to wake			*/
+	unsigned short		holdCount;				/* CompletionQueueHold calls	*/
+	CompletionQueueStatistics	statistics;
+};
+
+/*
+ * Usage:
+ *		void						CompletionQueueInit(
+ *				CompletionQueuePtr		queuePtr
+ *			);
+ *	Clear the queue. The process is not woken.
+ *
+ *		void						CompletionQueueSetWakeProcess(
+ *				CompletionQueuePtr		queuePtr,
+ *				Boolean					wakeProcess
+ *			);
+ *	Wake (or stop waking) the current process when an entry is posted.
+ *
+ *		void						CompletionQueuePost(
+ *				CompletionEntryPtr		entryPtr
+ *			);
+ *	Post an entry to its queue. This may be called at interrupt level.
+ *
+ *		Boolean						CompletionQueuePending(
+ *				CompletionQueuePtr		queuePtr
+ *			);
+ *	Returns TRUE if any entry is waiting to be drained.
+ *
+ *		unsigned short				CompletionQueueDrain(
+ *				CompletionQueuePtr		queuePtr,
+ *				unsigned short			maxEntries
+ *			);
+ *	Remove up to maxEntries entries (0 for no limit) and call their
+ *	completion procedures, in the order they were posted. Returns the number
+ *	of entries handled.
+ *
+ *		OSErr						CompletionQueueHold(
+ *				CompletionQueuePtr		queuePtr
+ *			);
+ *		void						CompletionQueueUnhold(
+ *				CompletionQueuePtr		queuePtr
+ *			);
+ *	If virtual memory is running, the queue header and CompletionQueuePost
+ *	must be held while entries may be posted at interrupt level. The calls
+ *	are counted: the memory is released by the last CompletionQueueUnhold.
+ *
+ *		void						CompletionQueueGetStatistics(
+ *				CompletionQueuePtr			queuePtr,
+ *				CompletionQueueStatistics	*statistics
+ *			);
+ *		void						CompletionQueueResetStatistics(
+ *				CompletionQueuePtr		queuePtr
+ *			);
+ */
+void						CompletionQueueInit(
+		CompletionQueuePtr		queuePtr
+	);
+void						CompletionQueueSetWakeProcess(
+		CompletionQueuePtr		queuePtr,
+		Boolean					wakeProcess
+	);
+void						CompletionQueuePost(
+		CompletionEntryPtr		entryPtr
+	);
+Boolean						CompletionQueuePending(
+		CompletionQueuePtr		queuePtr
+	);
+unsigned short				CompletionQueueDrain(
+		CompletionQueuePtr		queuePtr,
+		unsigned short			maxEntries
+	);
+OSErr						CompletionQueueHold(
+		CompletionQueuePtr		queuePtr
+	);
+void						CompletionQueueUnhold(
+		CompletionQueuePtr		queuePtr
+	);
+void						CompletionQueueGetStatistics(
+		CompletionQueuePtr			queuePtr,
+		CompletionQueueStatistics	*statistics
+	);
+void						CompletionQueueResetStatistics(
+		CompletionQueuePtr		queuePtr
+	);
+
+#endif /* __CompletionQueue__ */
@@ -0,0 +1,30 @@
+/*									CoreMacros.h								*/
+/*
+ * CoreMacros.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * TRUE, FALSE, and CLEAR for the modules that stand on their own and do not
+ * include SCSISimpleSample.h (which has its own definitions).
+ */
+#ifndef __CoreMacros__
+#define __CoreMacros__
+
+#ifndef TRUE
+#define TRUE		1
+#define FALSE		0
+#endif
+
+#ifndef CLEAR
+/*
+ * Cheap 'n dirty memory clear routine.
+ */
+#define CLEAR(record) do {								\
+		register char	*ptr = (char *) &record;		\
+		register long	size;							\
+		for (size = sizeof record; size > 0; --size)	\
+			*ptr++ = 0;									\
+	} while (0)
+
+#endif
+
+#endif /* __CoreMacros__ */
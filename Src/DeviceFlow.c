@@ -0,0 +1,232 @@
+/*									DeviceFlow.c								*/
+/*
+ * DeviceFlow.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * The device flow state machine. See DeviceFlow.h. FlowStep is the request's
+ * done procedure: it examines the result of the command that just completed
+ * and either issues the next one or ends the flow. Block zero and the
+ * partition map entries are interpreted with the Block0 and Partition
+ * records from SCSI.h.
+ */
+#include "SCSISimpleSample.h"
+
+static void						IssueCommand(
+		DeviceFlowPtr			flowPtr,
+		BusDispatcherPtr		dispatcherPtr,
+		unsigned short			state
+	);
+static void						FlowStep(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+static void						FinishFlow(
+		DeviceFlowPtr			flowPtr,
+		OSErr					status
+	);
+static Boolean					IsHFSPartition(
+		const Partition			*partitionPtr
+	);
+
+void
+DeviceFlowStart(
+		DeviceFlowPtr			flowPtr,
+		BusDispatcherPtr		dispatcherPtr,
+		DeviceIdent				scsiDevice
+	)
+{
+		DeviceFlowDoneProcPtr	doneProc;
+		long					refCon;
+
+		doneProc = flowPtr->doneProc;
+		refCon = flowPtr->refCon;
+		CLEAR(*flowPtr);
+		flowPtr->doneProc = doneProc;
+		flowPtr->refCon = refCon;
+		flowPtr->request.scsiCmdBlock.scsiDevice = scsiDevice;
+		IssueCommand(flowPtr, dispatcherPtr, kFlowTestUnitReady);
+}
+
+/*
+ * Build the command for this state and queue it. The request is reused for
+ * every command: only the device is kept.
+ */
+static void
+IssueCommand(
+		DeviceFlowPtr			flowPtr,
+		BusDispatcherPtr		dispatcherPtr,
+		unsigned short			state
+	)
+{
+		DeviceIdent				scsiDevice;
+		unsigned long			logicalBlock;
+#define SCB	(flowPtr->request.scsiCmdBlock)
+
+		scsiDevice = SCB.scsiDevice;
+		CLEAR(flowPtr->request);
+		SCB.scsiDevice = scsiDevice;
+		SCB.transferQuantum = 1;
+		SCB.bufferPtr = (Ptr) flowPtr->buffer;
+		flowPtr->request.doneProc = FlowStep;
+		flowPtr->request.refCon = (long) flowPtr;
+		flowPtr->state = state;
+		switch (state) {
+		case kFlowTestUnitReady:
+			SCB.command.scsi6.opcode = kScsiCmdTestUnitReady;
+			SCB.bufferPtr = NULL;
+			break;
+		case kFlowInquiry:
+			SCB.command.scsi6.opcode = kScsiCmdInquiry;
+			SCB.command.scsi6.len = sizeof (SCSI_Inquiry_Data);
+			SCB.transferSize = sizeof (SCSI_Inquiry_Data);
+			break;
+		case kFlowReadCapacity:
+			SCB.command.scsi10.opcode = kScsiCmdReadCapacity;
+			SCB.transferSize = sizeof (SCSI_Capacity_Data);
+			break;
+		case kFlowReadBlockZero:
+		case kFlowReadMapEntry:
+			logicalBlock =
+				(state == kFlowReadBlockZero) ? 0 : flowPtr->nextEntry;
+			SCB.command.scsi6.opcode = kScsiCmdRead6;
+			SCB.command.scsi6.lbn3 = (logicalBlock >> 16) & 0x1F;
+			SCB.command.scsi6.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi6.lbn1 = logicalBlock;
+			SCB.command.scsi6.len = 1;
+			SCB.transferSize = kFlowBlockSize;
+			SCB.transferQuantum = kFlowBlockSize;
+			break;
+		}
+		++flowPtr->commands;
+		BusDispatcherQueue(dispatcherPtr, &flowPtr->request);
+#undef SCB
+}
+
+/*
+ * A command has completed. Decide what to do next.
+ */
+static void
+FlowStep(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		register DeviceFlowPtr	flowPtr;
+		SCSI_Capacity_Data		*capacityPtr;
+		Partition				*partitionPtr;
+		unsigned long			mapEntries;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		flowPtr = (DeviceFlowPtr) requestPtr->refCon;
+		if (SCB.status != noErr) {
+			if (flowPtr->state == kFlowTestUnitReady
+			 && SCB.status == statusErr
+			 && (SCB.sense.senseKey & kScsiSenseKeyMask) == kScsiSenseUnitAtn
+			 && flowPtr->retries == 0) {
+				++flowPtr->retries;
+				IssueCommand(flowPtr, dispatcherPtr, kFlowTestUnitReady);
+			}
+			else {
+				FinishFlow(flowPtr, SCB.status);
+			}
+			return;
+		}
+		switch (flowPtr->state) {
+		case kFlowTestUnitReady:
+			IssueCommand(flowPtr, dispatcherPtr, kFlowInquiry);
+			break;
+		case kFlowInquiry:
+			flowPtr->deviceType = flowPtr->buffer[0] & 0x1F;
+			if (flowPtr->deviceType != kScsiDevTypeDirect)
+				FinishFlow(flowPtr, noErr);
+			else {
+				IssueCommand(flowPtr, dispatcherPtr, kFlowReadCapacity);
+			}
+			break;
+		case kFlowReadCapacity:
+			capacityPtr = (SCSI_Capacity_Data *) flowPtr->buffer;
+			flowPtr->blockCount = 1 + (
+					  (((unsigned long) capacityPtr->lbn4) << 24)
+					| (((unsigned long) capacityPtr->lbn3) << 16)
+					| (((unsigned long) capacityPtr->lbn2) << 8)
+					| capacityPtr->lbn1
+				);
+			flowPtr->blockLength =
+					  (((unsigned long) capacityPtr->len4) << 24)
+					| (((unsigned long) capacityPtr->len3) << 16)
+					| (((unsigned long) capacityPtr->len2) << 8)
+					| capacityPtr->len1;
+			if (flowPtr->blockLength != kFlowBlockSize)
+				FinishFlow(flowPtr, noErr);
+			else {
+				IssueCommand(flowPtr, dispatcherPtr, kFlowReadBlockZero);
+			}
+			break;
+		case kFlowReadBlockZero:
+			if (((Block0 *) flowPtr->buffer)->sbSig != sbSIGWord)
+				FinishFlow(flowPtr, noErr);				/* Not partitioned		*/
+			else {
+				flowPtr->hasDriverMap = TRUE;
+				flowPtr->nextEntry = 1;
+				IssueCommand(flowPtr, dispatcherPtr, kFlowReadMapEntry);
+			}
+			break;
+		case kFlowReadMapEntry:
+			/*
+			 * Every entry records the size of the map: we take it from the
+			 * first one, and stop early if an entry is not valid.
+			 */
+			partitionPtr = (Partition *) flowPtr->buffer;
+			if (partitionPtr->pmSig != pMapSIG) {
+				FinishFlow(flowPtr, noErr);
+				break;
+			}
+			if (flowPtr->nextEntry == 1) {
+				mapEntries = partitionPtr->pmMapBlkCnt;
+				if (mapEntries > kFlowMaxMapEntries)
+					mapEntries = kFlowMaxMapEntries;
+				flowPtr->mapEntries = mapEntries;
+			}
+			if (IsHFSPartition(partitionPtr))
+				++flowPtr->hfsPartitions;
+			if (flowPtr->nextEntry >= flowPtr->mapEntries
+			 || flowPtr->nextEntry + 1 >= flowPtr->blockCount)
+				FinishFlow(flowPtr, noErr);
+			else {
+				++flowPtr->nextEntry;
+				IssueCommand(flowPtr, dispatcherPtr, kFlowReadMapEntry);
+			}
+			break;
+		}
+#undef SCB
+}
+
+static void
+FinishFlow(
+		DeviceFlowPtr			flowPtr,
+		OSErr					status
+	)
+{
+		flowPtr->state = kFlowDone;
+		flowPtr->status = status;
+		if (flowPtr->doneProc != NULL)
+			(*flowPtr->doneProc)(flowPtr);
+}
+
+/*
+ * The partition type is a C string: "Apple_HFS" for a Macintosh volume.
+ */
+static Boolean
+IsHFSPartition(
+		const Partition			*partitionPtr
+	)
+{
+		static const char		hfsType[] = "Apple_HFS";
+		register short			i;
+
+		for (i = 0; i < sizeof hfsType; i++) {
+			if (partitionPtr->pmParType[i] != (unsigned char) hfsType[i])
+				return (FALSE);
+		}
+		return (TRUE);
+}
@@ -0,0 +1,80 @@
+/*									DeviceFlow.h								*/
+/*
+ * DeviceFlow.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * A device flow is the "what is on this device" sequence -- Test Unit Ready,
+ * Inquiry, Read Capacity, block zero, then the partition map -- written as
+ * a state machine instead of straight-line code. DoGetDriveInfo and
+ * DoReadBlockZero wait for each command before building the next, so one
+ * device is examined at a time and the caller's stack is tied up until the
+ * last command completes. A flow keeps everything it needs (including its
+ * data buffer) in its DeviceFlow record, and issues its next command from
+ * the completion of the previous one (through the request's doneProc), so
+ * any number of flows can be in progress at once, on any number of devices,
+ * from one polling loop and without a stack for each.
+ *
+ * The steps are:
+ *	kFlowTestUnitReady		Is the device there? A Unit Attention (for
+ *							example, after a reset) is retried once.
+ *	kFlowInquiry			Device type. The flow ends here unless the
+ *							device is a direct-access device.
+ *	kFlowReadCapacity		Size. The flow ends here unless the blocks
+ *							are kFlowBlockSize bytes long.
+ *	kFlowReadBlockZero		The driver descriptor map. The flow ends here
+ *							if the signature is wrong.
+ *	kFlowReadMapEntry		The partition map entries, one per command,
+ *							starting with block 1.
+ * When the flow is done, state is kFlowDone, status holds the error (if
+ * any) that ended it, and the done procedure is called.
+ */
+#ifndef __DeviceFlow__
+#define __DeviceFlow__
+#include "MacSCSICommand.h"
+
+#define kFlowBlockSize			512
+#define kFlowMaxMapEntries		64				/* Entries examined			*/
+
+enum {
+	kFlowTestUnitReady = 0,
+	kFlowInquiry,
+	kFlowReadCapacity,
+	kFlowReadBlockZero,
+	kFlowReadMapEntry,
+	kFlowDone
+};
+
+typedef struct DeviceFlow DeviceFlow, *DeviceFlowPtr;
+typedef void				(*DeviceFlowDoneProcPtr)(
+		DeviceFlowPtr			flowPtr
+	);
+struct DeviceFlow {
+	BusRequest			request;				/* The current command			*/
+	DeviceFlowDoneProcPtr	doneProc;			/* -> Called when done			*/
+	long				refCon;					/* -> For doneProc				*/
+	unsigned short		state;					/* <- kFlowTestUnitReady, etc.	*/
+	OSErr				status;					/* <- Error that ended the flow	*/
+	unsigned short		commands;				/* <- Commands issued			*/
+	unsigned short		retries;				/* Unit Attention retries		*/
+	unsigned char		deviceType;				/* <- From Inquiry				*/
+	unsigned long		blockCount;				/* <- From Read Capacity		*/
+	unsigned long		blockLength;			/* <- From Read Capacity		*/
+	Boolean				hasDriverMap;			/* <- Block zero is valid		*/
+	unsigned short		mapEntries;				/* <- Partition map entries		*/
+	unsigned short		hfsPartitions;			/* <- Apple_HFS partitions		*/
+	unsigned short		nextEntry;				/* Next map block to read		*/
+	unsigned char		buffer[kFlowBlockSize];	/* Data for the current command	*/
+};
+
+/*
+ * Start a flow on this device. The flow's commands are queued to the
+ * dispatcher, which must be open on the device's bus: the caller polls the
+ * dispatcher until the flow is done. Set doneProc and refCon first.
+ */
+void						DeviceFlowStart(
+		DeviceFlowPtr			flowPtr,
+		BusDispatcherPtr		dispatcherPtr,
+		DeviceIdent				scsiDevice
+	);
+
+#endif /* __DeviceFlow__ */
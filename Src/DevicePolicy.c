@@ -0,0 +1,361 @@
+/*									DevicePolicy.c								*/
+/*
+ * DevicePolicy.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Per-device disconnect and Select with Attention policy. See DevicePolicy.h
+ * for the rules. The policy table is searched linearly: there are only a few
+ * devices on a Macintosh. These functions are called at task level only (the
+ * commands are measured after they complete), so they may use the File
+ * Manager. They keep no state of their own: everything is in the caller's
+ * table.
+ */
+#include "SCSISimpleSample.h"
+#include <Files.h>
+#include <Folders.h>
+
+#define kPolicyPrefsVersion		1
+#define kPolicyPrefsType		'pref'
+#define kPolicyPrefsName		"\pSCSISimpleSample Prefs"
+
+/*
+ * The preferences file holds a header followed by one record for each
+ * device with an override.
+ */
+struct PolicyPrefsHeader {
+	long				version;				/* kPolicyPrefsVersion			*/
+	short				count;					/* Records that follow			*/
+};
+typedef struct PolicyPrefsHeader PolicyPrefsHeader;
+struct PolicyPrefsRecord {
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		disconnectOverride;
+	unsigned char		selectWithATNOverride;
+};
+typedef struct PolicyPrefsRecord PolicyPrefsRecord;
+
+static DevicePolicyPtr			FindPolicy(
+		DevicePolicyTablePtr	tablePtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		Boolean					create
+	);
+static OSErr					OpenPrefsFile(
+		Boolean					create,
+		short					*refNum
+	);
+
+void
+DevicePolicyApply(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		Boolean					selectWithATNSafe,
+		unsigned long			*scsiFlags,
+		unsigned short			*scsiIOFlags
+	)
+{
+		register DevicePolicyPtr	policyPtr;
+		Boolean					selectWithATN;
+
+		policyPtr = FindPolicy(
+					tablePtr, scsiDevice.bus, scsiDevice.targetID, FALSE);
+		/*
+		 * Disconnect.
+		 */
+		if (policyPtr != NULL
+		 && policyPtr->disconnectOverride == kPolicyAlways)
+			*scsiFlags |= scsiDoDisconnect;
+		else if (policyPtr != NULL
+		 && policyPtr->disconnectOverride == kPolicyNever)
+			*scsiFlags |= scsiDontDisconnect;
+		else if (tablePtr->doDisconnect || tablePtr->dontDisconnect) {
+			if (tablePtr->doDisconnect)
+				*scsiFlags |= scsiDoDisconnect;
+			if (tablePtr->dontDisconnect)
+				*scsiFlags |= scsiDontDisconnect;
+		}
+		else if (policyPtr != NULL && policyPtr->samples >= kPolicyMinSamples) {
+			*scsiFlags |= (policyPtr->disconnect)
+						? scsiDoDisconnect
+						: scsiDontDisconnect;
+		}
+		/*
+		 * Select with Attention. This is never used if the bus can't support
+		 * it. (Note that a target that is selected without Attention can't be
+		 * sent an Identify message, and so can't disconnect.)
+		 */
+		if (policyPtr != NULL
+		 && policyPtr->selectWithATNOverride == kPolicyAlways)
+			selectWithATN = selectWithATNSafe;
+		else if (policyPtr != NULL
+		 && policyPtr->selectWithATNOverride == kPolicyNever)
+			selectWithATN = FALSE;
+		else {
+			selectWithATN =
+					tablePtr->enableSelectWithATN
+					&& selectWithATNSafe
+					&& (policyPtr == NULL || policyPtr->rejectsATN == FALSE);
+		}
+		if (selectWithATN == FALSE)
+			*scsiIOFlags |= scsiDisableSelectWAtn;
+}
+
+void
+DevicePolicyRecord(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			scsiIOFlags,
+		unsigned long			elapsedTicks,
+		OSErr					status
+	)
+{
+		register DevicePolicyPtr	policyPtr;
+		unsigned long			sample;
+		unsigned long			average;
+
+		policyPtr = FindPolicy(
+					tablePtr, scsiDevice.bus, scsiDevice.targetID, TRUE);
+		if (policyPtr == NULL)
+			return;
+		if ((status == scsiIdentifyMessageRejected
+		  || status == scsiSequenceFailed)
+		 && (scsiIOFlags & scsiDisableSelectWAtn) == 0) {
+			policyPtr->rejectsATN = TRUE;
+			return;
+		}
+		if (status != noErr)
+			return;							/* Errors don't measure the device	*/
+		/*
+		 * Ticks are coarse compared to a fast device's latency, but the
+		 * average of many samples converges on the true value.
+		 */
+		sample = (elapsedTicks * 50L) / 3L;			/* Ticks to msec		*/
+		if (policyPtr->samples == 0)
+			policyPtr->averageLatency = sample << kPolicyLatencyShift;
+		else {
+			policyPtr->averageLatency +=
+				sample - (policyPtr->averageLatency >> kPolicyLatencyShift);
+		}
+		++policyPtr->samples;
+		average = policyPtr->averageLatency >> kPolicyLatencyShift;
+		if (average >= kPolicySlowMsec)
+			policyPtr->disconnect = TRUE;
+		else if (average < kPolicyFastMsec)
+			policyPtr->disconnect = FALSE;
+}
+
+DevicePolicyPtr
+DevicePolicyGet(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice
+	)
+{
+		return (FindPolicy(
+					tablePtr, scsiDevice.bus, scsiDevice.targetID, TRUE));
+}
+
+OSErr
+DevicePolicySetOverride(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			disconnectOverride,
+		unsigned short			selectWithATNOverride
+	)
+{
+		register DevicePolicyPtr	policyPtr;
+
+		policyPtr = FindPolicy(
+					tablePtr, scsiDevice.bus, scsiDevice.targetID, TRUE);
+		if (policyPtr == NULL)
+			return (memFullErr);
+		policyPtr->disconnectOverride = disconnectOverride;
+		policyPtr->selectWithATNOverride = selectWithATNOverride;
+		return (DevicePolicySave(tablePtr));
+}
+
+void
+DevicePolicyForget(
+		DevicePolicyTablePtr	tablePtr,
+		unsigned short			bus
+	)
+{
+		register short			i;
+		register DevicePolicyPtr	policyPtr;
+
+		for (i = 0; i < kPolicyMaxDevices; i++) {
+			policyPtr = &tablePtr->device[i];
+			if (policyPtr->inUse && policyPtr->bus == bus) {
+				policyPtr->samples = 0;
+				policyPtr->averageLatency = 0;
+				policyPtr->disconnect = FALSE;
+				policyPtr->rejectsATN = FALSE;
+			}
+		}
+}
+
+/*
+ * Read the overrides from the preferences file. A missing file is not an
+ * error: every device starts with the automatic policy.
+ */
+OSErr
+DevicePolicyLoad(
+		DevicePolicyTablePtr	tablePtr
+	)
+{
+		OSErr					status;
+		short					refNum;
+		long					count;
+		PolicyPrefsHeader		header;
+		PolicyPrefsRecord		record;
+		register short			i;
+		register DevicePolicyPtr	policyPtr;
+
+		status = OpenPrefsFile(FALSE, &refNum);
+		if (status == fnfErr)
+			return (noErr);
+		if (status != noErr)
+			return (status);
+		count = sizeof header;
+		status = FSRead(refNum, &count, (Ptr) &header);
+		/*
+		 * A file from another version is ignored.
+		 */
+		if (status == noErr && header.version == kPolicyPrefsVersion) {
+			for (i = 0; status == noErr && i < header.count; i++) {
+				count = sizeof record;
+				status = FSRead(refNum, &count, (Ptr) &record);
+				if (status == noErr) {
+					policyPtr = FindPolicy(
+								tablePtr, record.bus, record.targetID, TRUE);
+					if (policyPtr != NULL) {
+						policyPtr->disconnectOverride =
+							record.disconnectOverride;
+						policyPtr->selectWithATNOverride =
+							record.selectWithATNOverride;
+					}
+				}
+			}
+		}
+		(void) FSClose(refNum);
+		return ((status == eofErr) ? noErr : status);
+}
+
+/*
+ * Write the overrides (only) to the preferences file, replacing its contents.
+ */
+OSErr
+DevicePolicySave(
+		DevicePolicyTablePtr	tablePtr
+	)
+{
+		OSErr					status;
+		short					refNum;
+		long					count;
+		PolicyPrefsHeader		header;
+		PolicyPrefsRecord		record;
+		register short			i;
+		register DevicePolicyPtr	policyPtr;
+
+		status = OpenPrefsFile(TRUE, &refNum);
+		if (status != noErr)
+			return (status);
+		header.version = kPolicyPrefsVersion;
+		header.count = 0;
+		for (i = 0; i < kPolicyMaxDevices; i++) {
+			policyPtr = &tablePtr->device[i];
+			if (policyPtr->inUse
+			 && (policyPtr->disconnectOverride != kPolicyAuto
+			  || policyPtr->selectWithATNOverride != kPolicyAuto))
+				++header.count;
+		}
+		count = sizeof header;
+		status = FSWrite(refNum, &count, (Ptr) &header);
+		for (i = 0; status == noErr && i < kPolicyMaxDevices; i++) {
+			policyPtr = &tablePtr->device[i];
+			if (policyPtr->inUse
+			 && (policyPtr->disconnectOverride != kPolicyAuto
+			  || policyPtr->selectWithATNOverride != kPolicyAuto)) {
+				record.bus = policyPtr->bus;
+				record.targetID = policyPtr->targetID;
+				record.disconnectOverride = policyPtr->disconnectOverride;
+				record.selectWithATNOverride = policyPtr->selectWithATNOverride;
+				count = sizeof record;
+				status = FSWrite(refNum, &count, (Ptr) &record);
+			}
+		}
+		if (status == noErr)
+			status = SetEOF(
+						refNum, sizeof header + header.count * sizeof record);
+		if (status == noErr)
+			status = FSClose(refNum);
+		else {
+			(void) FSClose(refNum);
+		}
+		return (status);
+}
+
+/*
+ * Return the policy record for this target. If there is none and create is
+ * TRUE, a free record is initialized with the automatic policy.
+ */
+static DevicePolicyPtr
+FindPolicy(
+		DevicePolicyTablePtr	tablePtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		Boolean					create
+	)
+{
+		register short			i;
+		register DevicePolicyPtr	policyPtr;
+		DevicePolicyPtr			freePtr;
+
+		freePtr = NULL;
+		for (i = 0; i < kPolicyMaxDevices; i++) {
+			policyPtr = &tablePtr->device[i];
+			if (policyPtr->inUse == FALSE) {
+				if (freePtr == NULL)
+					freePtr = policyPtr;
+			}
+			else if (policyPtr->bus == bus && policyPtr->targetID == targetID)
+				return (policyPtr);
+		}
+		if (create && freePtr != NULL) {
+			CLEAR(*freePtr);
+			freePtr->inUse = TRUE;
+			freePtr->bus = bus;
+			freePtr->targetID = targetID;
+		}
+		return ((create) ? freePtr : NULL);
+}
+
+/*
+ * Open the preferences file (in the Preferences folder of the System disk)
+ * at its beginning. If create is TRUE, create it if necessary.
+ */
+static OSErr
+OpenPrefsFile(
+		Boolean					create,
+		short					*refNum
+	)
+{
+		OSErr					status;
+		short					vRefNum;
+		long					dirID;
+
+		status = FindFolder(
+					kOnSystemDisk, kPreferencesFolderType, create,
+					&vRefNum, &dirID);
+		if (status == noErr && create) {
+			status = HCreate(
+						vRefNum, dirID, kPolicyPrefsName,
+						kApplicationCreator, kPolicyPrefsType);
+			if (status == dupFNErr)					/* Exists already?		*/
+				status = noErr;
+		}
+		if (status == noErr)
+			status = HOpen(
+						vRefNum, dirID, kPolicyPrefsName, fsRdWrPerm, refNum);
+		return (status);
+}
@@ -0,0 +1,130 @@
+/*									DevicePolicy.h								*/
+/*
+ * DevicePolicy.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Per-device disconnect and Select with Attention policy. Whether a target
+ * should disconnect depends on the target: a slow disk that seeks should
+ * release the bus while it works, but for a fast device the reselection
+ * overhead costs more than it saves. The policy for each target is chosen,
+ * in order, from:
+ *	-- A per-device override (Always or Never), which is saved in the
+ *	   preferences file.
+ *	-- The Test menu's "Explicitly Do/Do Not Disconnect" and "Enable Select
+ *	   with Attention" settings, which apply to every device (for testing).
+ *	-- The adaptive policy: the latency of each command is measured, and
+ *	   a target whose average latency reaches kPolicySlowMsec is allowed to
+ *	   disconnect, while one whose average is below kPolicyFastMsec is not.
+ *	   Between the two, the previous decision stands. A target that rejects
+ *	   Select with Attention (Identify message rejected, or a phase sequence
+ *	   failure) is selected without it from then on.
+ * Devices are identified by bus and target: all logical units of a target
+ * share its policy. AsyncSCSI, DoSCSICommandBatch, and the bus dispatcher
+ * call DevicePolicyApply for each command and DevicePolicyRecord when it
+ * completes. The policies are kept in a DevicePolicyTable (normally, the one
+ * in the caller's SCSIEnvironment), which also holds the settings that apply
+ * to every device.
+ */
+#ifndef __DevicePolicy__
+#define __DevicePolicy__
+#include "MacSCSICommand.h"
+
+#define kPolicyMaxDevices		32
+#define kPolicyMinSamples		4				/* Before adapting				*/
+#define kPolicySlowMsec			16				/* Disconnect at or above		*/
+#define kPolicyFastMsec			8				/* Stay connected below			*/
+/*
+ * Latencies are averaged with weight 1/8 (an exponentially-weighted moving
+ * average). The average is stored in msec times 8 to keep the fraction.
+ */
+#define kPolicyLatencyShift		3
+
+/*
+ * Override settings, for both disconnect and Select with Attention.
+ */
+enum {
+	kPolicyAuto = 0,
+	kPolicyAlways,
+	kPolicyNever
+};
+
+typedef struct DevicePolicy DevicePolicy, *DevicePolicyPtr;
+struct DevicePolicy {
+	Boolean				inUse;
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		disconnectOverride;		/* kPolicyAuto, etc.			*/
+	unsigned char		selectWithATNOverride;	/* kPolicyAuto, etc.			*/
+	Boolean				disconnect;				/* Adaptive decision			*/
+	Boolean				rejectsATN;				/* Select with ATN failed		*/
+	unsigned long		samples;				/* Commands measured			*/
+	unsigned long		averageLatency;			/* Msec times 8					*/
+};
+
+typedef struct DevicePolicyTable DevicePolicyTable, *DevicePolicyTablePtr;
+struct DevicePolicyTable {
+	Boolean				enableSelectWithATN;	/* Unless the device rejects it	*/
+	Boolean				doDisconnect;			/* Force for every device		*/
+	Boolean				dontDisconnect;			/* Force for every device		*/
+	DevicePolicy		device[kPolicyMaxDevices];
+};
+
+/*
+ * Set scsiDoDisconnect or scsiDontDisconnect in *scsiFlags, and
+ * scsiDisableSelectWAtn in *scsiIOFlags, as the policy for this device
+ * requires. selectWithATNSafe is FALSE if the bus (from its Bus Inquiry)
+ * does not support Select with Attention.
+ */
+void						DevicePolicyApply(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		Boolean					selectWithATNSafe,
+		unsigned long			*scsiFlags,
+		unsigned short			*scsiIOFlags
+	);
+/*
+ * Record a completed command: elapsedTicks is the time from SCSIAction to
+ * completion, and scsiIOFlags are the flags it was sent with.
+ */
+void						DevicePolicyRecord(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			scsiIOFlags,
+		unsigned long			elapsedTicks,
+		OSErr					status
+	);
+/*
+ * Return this device's policy record, creating it if necessary. Returns NULL
+ * if the table is full.
+ */
+DevicePolicyPtr				DevicePolicyGet(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice
+	);
+/*
+ * Change a device's overrides and save them in the preferences file.
+ */
+OSErr						DevicePolicySetOverride(
+		DevicePolicyTablePtr	tablePtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			disconnectOverride,
+		unsigned short			selectWithATNOverride
+	);
+/*
+ * Forget the measurements (but not the overrides) for every device on a bus.
+ */
+void						DevicePolicyForget(
+		DevicePolicyTablePtr	tablePtr,
+		unsigned short			bus
+	);
+/*
+ * Read the overrides from the preferences file (at startup), or write them.
+ */
+OSErr						DevicePolicyLoad(
+		DevicePolicyTablePtr	tablePtr
+	);
+OSErr						DevicePolicySave(
+		DevicePolicyTablePtr	tablePtr
+	);
+
+#endif /* __DevicePolicy__ */
@@ -0,0 +1,257 @@
+/*									DeviceSweep.c								*/
+/*
+ * DeviceSweep.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Run one command on many devices, on all of their buses at once. See
+ * DeviceSweep.h. The jobs for each bus are queued in the order of the device
+ * list. Each bus remembers the first job that it has not queued, so that
+ * feeding a bus does not rescan the jobs it has already started.
+ */
+#include "SCSISimpleSample.h"
+
+static void						BuildCommand(
+		DeviceSweepPtr			sweepPtr,
+		unsigned short			index,
+		DeviceIdent				scsiDevice
+	);
+static void						FeedBus(
+		DeviceSweepPtr			sweepPtr,
+		unsigned short			busIndex
+	);
+static void						ReportJob(
+		DeviceSweepPtr			sweepPtr,
+		SweepJob				*jobPtr
+	);
+static void						DisposeSweep(
+		DeviceSweepPtr			sweepPtr
+	);
+
+OSErr
+DeviceSweepOpen(
+		DeviceSweepPtr			sweepPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		unsigned short			operation,
+		unsigned short			maxPerBus
+	)
+{
+		unsigned short			busID[kSweepMaxBuses];
+		register unsigned short	i;
+		register unsigned short	busIndex;
+#define SWEEP (*sweepPtr)
+
+		CLEAR(SWEEP);
+		if (operation > kSweepReadBlockZero)
+			return (paramErr);
+		if (maxPerBus == 0)
+			maxPerBus = kSweepDefaultPerBus;
+		if (maxPerBus > kDispatchMaxInFlight)
+			maxPerBus = kDispatchMaxInFlight;
+		SWEEP.operation = operation;
+		SWEEP.maxPerBus = maxPerBus;
+		SWEEP.statistics.devices = deviceCount;
+		SWEEP.statistics.startTicks = TickCount();
+		if (deviceCount == 0)
+			return (noErr);
+		/*
+		 * Find the buses.
+		 */
+		for (i = 0; i < deviceCount; i++) {
+			for (busIndex = 0; busIndex < SWEEP.busCount; busIndex++) {
+				if (busID[busIndex] == deviceList[i].bus)
+					break;
+			}
+			if (busIndex == SWEEP.busCount) {
+				if (SWEEP.busCount == kSweepMaxBuses)
+					return (paramErr);
+				busID[SWEEP.busCount++] = deviceList[i].bus;
+			}
+		}
+		SWEEP.job = (SweepJob *) NewPtrClear(sizeof (SweepJob) * deviceCount);
+		SWEEP.bus =
+			(SweepBus *) NewPtrClear(sizeof (SweepBus) * SWEEP.busCount);
+		if (operation != kSweepTestUnitReady) {
+			SWEEP.bufferArray =
+				NewPtrClear(kSweepBufferSize * (long) deviceCount);
+		}
+		if (SWEEP.job == NULL
+		 || SWEEP.bus == NULL
+		 || (operation != kSweepTestUnitReady && SWEEP.bufferArray == NULL)) {
+			DisposeSweep(sweepPtr);
+			return (memFullErr);
+		}
+		SWEEP.jobCount = deviceCount;
+		for (i = 0; i < deviceCount; i++)
+			BuildCommand(sweepPtr, i, deviceList[i]);
+		for (i = 0; i < deviceCount; i++) {
+			for (busIndex = 0; busID[busIndex] != deviceList[i].bus; busIndex++)
+				;
+			SWEEP.job[i].busIndex = busIndex;
+		}
+		/*
+		 * Open a dispatcher for each bus. If one can't be opened, its jobs
+		 * are completed (with the error) by the first poll.
+		 */
+		for (busIndex = 0; busIndex < SWEEP.busCount; busIndex++) {
+			SWEEP.bus[busIndex].busID = busID[busIndex];
+			SWEEP.bus[busIndex].openStatus = BusDispatcherOpen(
+						&SWEEP.bus[busIndex].dispatcher,
+						environmentPtr, busID[busIndex]);
+		}
+		return (noErr);
+#undef SWEEP
+}
+
+Boolean
+DeviceSweepPoll(
+		DeviceSweepPtr			sweepPtr
+	)
+{
+		register unsigned short	i;
+		register SweepJob		*jobPtr;
+		register SweepBus		*busPtr;
+
+		/*
+		 * Start (and complete) the commands on every bus, then report the
+		 * results that have arrived and give each bus more work.
+		 */
+		for (i = 0; i < sweepPtr->busCount; i++) {
+			busPtr = &sweepPtr->bus[i];
+			if (busPtr->openStatus == noErr && busPtr->queued != 0)
+				(void) BusDispatcherPoll(&busPtr->dispatcher);
+		}
+		for (i = 0; i < sweepPtr->jobCount; i++) {
+			jobPtr = &sweepPtr->job[i];
+			if (jobPtr->queued
+			 && jobPtr->done == FALSE
+			 && jobPtr->request.scsiCmdBlock.status != 1) {	/* Not in progress	*/
+				--sweepPtr->bus[jobPtr->busIndex].queued;
+				ReportJob(sweepPtr, jobPtr);
+			}
+		}
+		for (i = 0; i < sweepPtr->busCount; i++)
+			FeedBus(sweepPtr, i);
+		return (sweepPtr->statistics.completed < sweepPtr->jobCount);
+}
+
+void
+DeviceSweepClose(
+		DeviceSweepPtr			sweepPtr
+	)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < sweepPtr->busCount; i++) {
+			if (sweepPtr->bus[i].openStatus == noErr)
+				BusDispatcherClose(&sweepPtr->bus[i].dispatcher);
+		}
+		DisposeSweep(sweepPtr);
+}
+
+/*
+ * Queue jobs for this bus until it has maxPerBus of them outstanding. If the
+ * bus has no dispatcher, its jobs are completed with the open error.
+ */
+static void
+FeedBus(
+		DeviceSweepPtr			sweepPtr,
+		unsigned short			busIndex
+	)
+{
+		register SweepBus		*busPtr;
+		register SweepJob		*jobPtr;
+
+		busPtr = &sweepPtr->bus[busIndex];
+		while (busPtr->nextJob < sweepPtr->jobCount
+			&& (busPtr->openStatus != noErr
+			 || busPtr->queued < sweepPtr->maxPerBus)) {
+			jobPtr = &sweepPtr->job[busPtr->nextJob++];
+			if (jobPtr->busIndex != busIndex)
+				continue;
+			jobPtr->queued = TRUE;
+			if (busPtr->openStatus != noErr) {
+				jobPtr->request.scsiCmdBlock.status = busPtr->openStatus;
+				ReportJob(sweepPtr, jobPtr);
+			}
+			else {
+				++busPtr->queued;
+				BusDispatcherQueue(&busPtr->dispatcher, &jobPtr->request);
+			}
+		}
+}
+
+/*
+ * Count a completed job and pass it to the result procedure.
+ */
+static void
+ReportJob(
+		DeviceSweepPtr			sweepPtr,
+		SweepJob				*jobPtr
+	)
+{
+		jobPtr->done = TRUE;
+		++sweepPtr->statistics.completed;
+		if (jobPtr->request.scsiCmdBlock.status != noErr)
+			++sweepPtr->statistics.failed;
+		sweepPtr->statistics.elapsedTicks =
+			TickCount() - sweepPtr->statistics.startTicks;
+		if (sweepPtr->resultProc != NULL)
+			(*sweepPtr->resultProc)(sweepPtr, &jobPtr->request);
+}
+
+/*
+ * Setup one device's command. Read Block Zero presumes 512-byte blocks, as
+ * DoReadBlockZero does.
+ */
+static void
+BuildCommand(
+		DeviceSweepPtr			sweepPtr,
+		unsigned short			index,
+		DeviceIdent				scsiDevice
+	)
+{
+#define SCB	(sweepPtr->job[index].request.scsiCmdBlock)
+
+		SCB.scsiDevice = scsiDevice;
+		SCB.transferQuantum = 1;
+		switch (sweepPtr->operation) {
+		case kSweepTestUnitReady:
+			SCB.command.scsi6.opcode = kScsiCmdTestUnitReady;
+			break;
+		case kSweepInquiry:
+			SCB.command.scsi6.opcode = kScsiCmdInquiry;
+			SCB.command.scsi6.len = sizeof (SCSI_Inquiry_Data);
+			SCB.transferSize = sizeof (SCSI_Inquiry_Data);
+			break;
+		case kSweepReadBlockZero:
+			SCB.command.scsi6.opcode = kScsiCmdRead6;
+			SCB.command.scsi6.len = 1;
+			SCB.transferSize = kSweepBufferSize;
+			SCB.transferQuantum = kSweepBufferSize;
+			break;
+		}
+		if (SCB.transferSize != 0)
+			SCB.bufferPtr =
+				sweepPtr->bufferArray + kSweepBufferSize * (long) index;
+#undef SCB
+}
+
+static void
+DisposeSweep(
+		DeviceSweepPtr			sweepPtr
+	)
+{
+		if (sweepPtr->job != NULL)
+			DisposePtr((Ptr) sweepPtr->job);
+		if (sweepPtr->bus != NULL)
+			DisposePtr((Ptr) sweepPtr->bus);
+		if (sweepPtr->bufferArray != NULL)
+			DisposePtr(sweepPtr->bufferArray);
+		sweepPtr->job = NULL;
+		sweepPtr->bus = NULL;
+		sweepPtr->bufferArray = NULL;
+		sweepPtr->jobCount = 0;
+		sweepPtr->busCount = 0;
+}
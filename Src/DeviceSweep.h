@@ -0,0 +1,133 @@
+/*									DeviceSweep.h								*/
+/*
+ * DeviceSweep.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Run one command (Test Unit Ready, Inquiry, or Read Block Zero) on every
+ * device in a list -- normally, every device that List SCSI Devices found --
+ * instead of on one device at a time. Each bus gets its own bus dispatcher,
+ * so the commands for different buses are in progress at the same time, and
+ * a sweep takes about as long as its slowest bus rather than the sum of all
+ * of them. Within a bus, at most maxPerBus commands are queued to the
+ * dispatcher at a time (which serves their targets fairly). The rest wait in
+ * the sweep, so that a sweep does not flood a bus that is also doing other
+ * work, and a slow device delays only its own bus. The results are reported,
+ * one device at a time, as the commands complete, and are also counted in the
+ * sweep's statistics. The caller opens the sweep, then calls DeviceSweepPoll
+ * until it returns FALSE.
+ *
+ * A bus that the asynchronous SCSI Manager does not support can't be swept:
+ * its devices are completed with the error from BusDispatcherOpen.
+ */
+#ifndef __DeviceSweep__
+#define __DeviceSweep__
+#include "MacSCSICommand.h"
+#include "SCSIEnvironment.h"
+
+#define kSweepMaxBuses			8
+#define kSweepBufferSize		512				/* Read Block Zero			*/
+#define kSweepDefaultPerBus		4
+
+enum {
+	kSweepTestUnitReady = 0,
+	kSweepInquiry,
+	kSweepReadBlockZero
+};
+
+typedef struct DeviceSweep DeviceSweep, *DeviceSweepPtr;
+/*
+ * The result procedure is called (at task level, from DeviceSweepPoll) once
+ * for each device when its command completes. The device, status, sense
+ * data, and data (in SCB.bufferPtr) are in the request's command block.
+ */
+typedef void				(*SweepResultProcPtr)(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	);
+
+/*
+ * One device's command.
+ */
+struct SweepJob {
+	BusRequest			request;
+	unsigned short		busIndex;				/* Index into sweepPtr->bus		*/
+	Boolean				queued;					/* Given to the dispatcher		*/
+	Boolean				done;					/* Result reported				*/
+};
+typedef struct SweepJob SweepJob;
+
+struct SweepBus {
+	BusDispatcher		dispatcher;
+	unsigned short		busID;
+	OSErr				openStatus;				/* From BusDispatcherOpen		*/
+	unsigned short		queued;					/* Queued, not complete			*/
+	unsigned short		nextJob;				/* First job not yet queued		*/
+};
+typedef struct SweepBus SweepBus;
+
+struct SweepStatistics {
+	unsigned long		devices;				/* Devices in the sweep			*/
+	unsigned long		completed;				/* Results reported				*/
+	unsigned long		failed;					/* Completed with an error		*/
+	unsigned long		startTicks;				/* When the sweep was opened	*/
+	unsigned long		elapsedTicks;			/* Until the last result		*/
+};
+typedef struct SweepStatistics SweepStatistics;
+
+struct DeviceSweep {
+	unsigned short		operation;				/* kSweepTestUnitReady, etc.	*/
+	unsigned short		maxPerBus;				/* Commands queued per bus		*/
+	SweepResultProcPtr	resultProc;				/* NULL: just count				*/
+	long				refCon;					/* For the result procedure		*/
+	unsigned short		jobCount;
+	SweepJob			*job;					/* One per device				*/
+	Ptr					bufferArray;			/* kSweepBufferSize per device	*/
+	unsigned short		busCount;
+	SweepBus			*bus;					/* One per bus in the list		*/
+	SweepStatistics		statistics;
+};
+
+/*
+ * Usage:
+ *		OSErr						DeviceSweepOpen(
+ *				DeviceSweepPtr			sweepPtr,
+ *				SCSIEnvironmentPtr		environmentPtr,
+ *				const DeviceIdent		deviceList[],
+ *				unsigned short			deviceCount,
+ *				unsigned short			operation,
+ *				unsigned short			maxPerBus
+ *			);
+ *	Build a command for each device in deviceList and open a dispatcher for
+ *	each bus. maxPerBus zero means kSweepDefaultPerBus. The devices may be
+ *	in any order, and on at most kSweepMaxBuses buses. Returns memFullErr or
+ *	paramErr if the sweep could not be built. Set resultProc and refCon
+ *	before the first call to DeviceSweepPoll.
+ *
+ *		Boolean						DeviceSweepPoll(
+ *				DeviceSweepPtr			sweepPtr
+ *			);
+ *	Poll every bus, report the commands that have completed, and queue more.
+ *	Returns FALSE when every result has been reported.
+ *
+ *		void						DeviceSweepClose(
+ *				DeviceSweepPtr			sweepPtr
+ *			);
+ *	Close the dispatchers (completing any outstanding commands) and dispose
+ *	of the sweep's memory. Results that have not yet been reported are lost.
+ */
+OSErr						DeviceSweepOpen(
+		DeviceSweepPtr			sweepPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		unsigned short			operation,
+		unsigned short			maxPerBus
+	);
+Boolean						DeviceSweepPoll(
+		DeviceSweepPtr			sweepPtr
+	);
+void						DeviceSweepClose(
+		DeviceSweepPtr			sweepPtr
+	);
+
+#endif /* __DeviceSweep__ */
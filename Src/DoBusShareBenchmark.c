@@ -0,0 +1,227 @@
+/*								DoBusShareBenchmark.c							*/
+/*
+ * DoBusShareBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure the bus dispatcher with a mixed workload on the virtual SCSI bus:
+ * a "bulk" stream of long reads from the slow disk (target 3) competes with
+ * an "interactive" stream of single-block reads from the RAM disk (target 0).
+ * The workload is executed twice, once in arrival order and once with fair
+ * sharing, and the throughput and latency of each target are displayed. With
+ * fair sharing, the interactive latency should no longer depend on the
+ * length of the bulk transfers.
+ */
+#include "SCSISimpleSample.h"
+
+#define kBulkTarget				3
+#define kBulkRequests			8
+#define kBulkBlocks				512				/* 256K per request			*/
+#define kBulkMaxOutstanding		65536L
+#define kInteractiveTarget		0
+#define kInteractiveRequests	32
+#define kInteractiveEvery		4				/* Per bulk request			*/
+#define kShareRequests			(kBulkRequests + kInteractiveRequests)
+#define kShareSeed				1994L
+
+static unsigned long			gShareSeed;
+
+static void						RunShareWorkload(
+		unsigned short			bus,
+		unsigned short			policy,
+		BusRequest				request[kShareRequests],
+		Ptr						bulkBufferPtr,
+		Ptr						interactiveBufferPtr,
+		ConstStr255Param		policyName
+	);
+static void						ShowTarget(
+		ConstStr255Param		label,
+		unsigned short			targetID,
+		unsigned long			startTicks,
+		BusRequest				request[kShareRequests]
+	);
+static unsigned long			ShareRandom(void);
+
+void
+DoBusShareBenchmark(void)
+{
+		unsigned short			bus;
+		BusRequest				*request;
+		Ptr						bulkBufferPtr;
+		Ptr						interactiveBufferPtr;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pBus Share Benchmark (virtual bus)");
+		request =
+			(BusRequest *) NewPtrClear(sizeof (BusRequest) * kShareRequests);
+		bulkBufferPtr = NewPtr(kBulkBlocks * kVirtualBlockLength);
+		interactiveBufferPtr = NewPtr(kVirtualBlockLength);
+		if (request == NULL
+		 || bulkBufferPtr == NULL
+		 || interactiveBufferPtr == NULL)
+			LOG("\pNo memory for benchmark buffers");
+		else {
+			RunShareWorkload(bus, kDispatchPolicyFIFO,
+				request, bulkBufferPtr, interactiveBufferPtr,
+				"\pArrival order");
+			RunShareWorkload(bus, kDispatchPolicyFairShare,
+				request, bulkBufferPtr, interactiveBufferPtr,
+				"\pFair share");
+		}
+		if (interactiveBufferPtr != NULL)
+			DisposePtr(interactiveBufferPtr);
+		if (bulkBufferPtr != NULL)
+			DisposePtr(bulkBufferPtr);
+		if (request != NULL)
+			DisposePtr((Ptr) request);
+}
+
+/*
+ * Build the workload (one bulk request, then kInteractiveEvery interactive
+ * requests, and so on), queue all of it, and run the dispatcher until it is
+ * done. All requests of a stream read into the same buffer: only the timing
+ * matters here.
+ */
+static void
+RunShareWorkload(
+		unsigned short			bus,
+		unsigned short			policy,
+		BusRequest				request[kShareRequests],
+		Ptr						bulkBufferPtr,
+		Ptr						interactiveBufferPtr,
+		ConstStr255Param		policyName
+	)
+{
+		BusDispatcher			dispatcher;
+		register short			i;
+		unsigned long			logicalBlock;
+		unsigned long			blockCount;
+		unsigned long			bulkBlock;
+		unsigned long			startTicks;
+		OSErr					status;
+		Str255					work;
+#define SCB	(request[i].scsiCmdBlock)
+
+		status = BusDispatcherOpen(&dispatcher, &gSCSIEnvironment, bus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't open bus dispatcher");
+			return;
+		}
+		dispatcher.policy = policy;
+		BusDispatcherSetShare(&dispatcher, kBulkTarget, 1, kBulkMaxOutstanding);
+		BusDispatcherSetShare(&dispatcher, kInteractiveTarget, 1, 0L);
+		gShareSeed = kShareSeed;
+		bulkBlock = 0;
+		for (i = 0; i < kShareRequests; i++) {
+			CLEAR(request[i]);
+			SCB.scsiDevice.bus = bus;
+			SCB.transferQuantum = kVirtualBlockLength;
+			if ((i % (kInteractiveEvery + 1)) == 0) {
+				SCB.scsiDevice.targetID = kBulkTarget;
+				SCB.bufferPtr = bulkBufferPtr;
+				logicalBlock = bulkBlock;
+				blockCount = kBulkBlocks;
+				bulkBlock += kBulkBlocks;
+			}
+			else {
+				SCB.scsiDevice.targetID = kInteractiveTarget;
+				SCB.bufferPtr = interactiveBufferPtr;
+				logicalBlock = ShareRandom() % 512L;	/* The RAM disk's size	*/
+				blockCount = 1;
+			}
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn4 = logicalBlock >> 24;
+			SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len2 = blockCount >> 8;
+			SCB.command.scsi10.len1 = blockCount;
+			SCB.transferSize = blockCount * kVirtualBlockLength;
+		}
+		startTicks = TickCount();
+		for (i = 0; i < kShareRequests; i++)
+			BusDispatcherQueue(&dispatcher, &request[i]);
+		while (BusDispatcherPoll(&dispatcher))
+			;
+		pstrcpy(work, policyName);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, TickCount() - startTicks);
+		pstrcat(work, "\p ticks, ");
+		AppendUnsigned(work, dispatcher.flow[kBulkTarget].commands
+						   + dispatcher.flow[kInteractiveTarget].commands);
+		pstrcat(work, "\p commands");
+		LOG(work);
+		ShowTarget("\p  Bulk", kBulkTarget, startTicks, request);
+		ShowTarget("\p  Interactive", kInteractiveTarget, startTicks, request);
+		BusDispatcherClose(&dispatcher);
+		for (i = 0; i < kShareRequests; i++) {
+			if (SCB.status != noErr) {
+				DisplaySCSIErrorMessage(
+					SCB.status, "\pBenchmark request failed");
+				break;
+			}
+		}
+#undef SCB
+}
+
+/*
+ * Display one target's throughput (up to its last completion) and its median
+ * and 99th percentile latency. The latencies are sorted with an insertion
+ * sort: there are only a few of them.
+ */
+static void
+ShowTarget(
+		ConstStr255Param		label,
+		unsigned short			targetID,
+		unsigned long			startTicks,
+		BusRequest				request[kShareRequests]
+	)
+{
+		unsigned long			latency[kShareRequests];
+		unsigned long			value;
+		unsigned long			bytes;
+		unsigned long			lastTicks;
+		register short			count;
+		register short			i;
+		register short			j;
+		Str255					work;
+
+		count = 0;
+		bytes = 0;
+		lastTicks = startTicks + 1;
+		for (i = 0; i < kShareRequests; i++) {
+			if (request[i].scsiCmdBlock.scsiDevice.targetID != targetID)
+				continue;
+			bytes += request[i].scsiCmdBlock.actualTransferCount;
+			if (request[i].completedTicks > lastTicks)
+				lastTicks = request[i].completedTicks;
+			value = request[i].completedTicks - request[i].queuedTicks;
+			for (j = count; j > 0 && latency[j - 1] > value; --j)
+				latency[j] = latency[j - 1];
+			latency[j] = value;
+			++count;
+		}
+		if (count == 0)
+			return;
+		pstrcpy(work, label);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, (bytes / 1024L) * 60L / (lastTicks - startTicks));
+		pstrcat(work, "\p K/sec, latency (ticks) median ");
+		AppendUnsigned(work, latency[count / 2]);
+		pstrcat(work, "\p, 99% ");
+		AppendUnsigned(work, latency[(count * 99) / 100]);
+		LOG(work);
+}
+
+/*
+ * The same generator as DoSchedulerBenchmark: every run replays the same
+ * workload.
+ */
+static unsigned long
+ShareRandom(void)
+{
+		gShareSeed = gShareSeed * 1103515245L + 12345L;
+		return ((gShareSeed >> 16) & 0x7FFF);
+}
@@ -0,0 +1,233 @@
+/*								DoBusSimBenchmark.c								*/
+/*
+ * DoBusSimBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Compare disconnect and queueing policies with the bus simulator (see
+ * BusSimulator.h). The same workload is run with each policy: several
+ * thousand commands, generated from a fixed seed, for a fast disk (target 0),
+ * two slower disks that seek (targets 2 and 3), and a CD-ROM player that
+ * delivers its data at 300K/sec (target 4). A few commands are sent to target
+ * 5, which is missing, as a device scan would. For each policy, the simulated
+ * time, the host time that the simulation took, the bus utilization, and the
+ * average and worst latency of each target are displayed.
+ *
+ * The last run gives the CD-ROM player a bus of its own, as on a Macintosh
+ * with an internal and an external SCSI bus.
+ */
+#include "SCSISimpleSample.h"
+
+#define kBusSimCommands			4000
+#define kBusSimMeanArrival		10000L			/* usec						*/
+#define kBusSimThreshold		(5L * kSimUnitsPerMsec)
+#define kBusSimSeed				1994L
+#define kBusSimCDROM			4
+#define kBusSimMissing			5
+
+struct BusSimScenario {
+	StringPtr			name;
+	unsigned short		disconnectPolicy;
+	unsigned short		queuePolicy;
+	unsigned short		busCount;				/* 2: CD-ROM on bus 1		*/
+};
+typedef struct BusSimScenario BusSimScenario;
+
+static const BusSimScenario		gBusSimScenario[] = {
+	{ "\pNever disconnect, FIFO",
+		kSimDisconnectNever,	kSimQueueFIFO,			1 },
+	{ "\pAlways disconnect, FIFO",
+		kSimDisconnectAlways,	kSimQueueFIFO,			1 },
+	{ "\pAdaptive disconnect, FIFO",
+		kSimDisconnectAdaptive,	kSimQueueFIFO,			1 },
+	{ "\pAdaptive, round robin",
+		kSimDisconnectAdaptive,	kSimQueueRoundRobin,	1 },
+	{ "\pAdaptive, CD-ROM on bus 1",
+		kSimDisconnectAdaptive,	kSimQueueRoundRobin,	2 }
+};
+#define kBusSimScenarios	(sizeof gBusSimScenario / sizeof gBusSimScenario[0])
+
+static unsigned long			gBusSimSeed;
+
+static void						RunBusSimScenario(
+		const BusSimScenario	*scenarioPtr,
+		SimCommand				command[]
+	);
+static void						MakeWorkload(
+		SimCommand				command[],
+		unsigned short			cdromBus
+	);
+static unsigned long			BusSimRandom(void);
+
+void
+DoBusSimBenchmark(void)
+{
+		SimCommandPtr			commandPtr;
+		register short			i;
+
+		LOG("\pBus Timing Simulator");
+		commandPtr = (SimCommandPtr) NewPtr(
+					sizeof (SimCommand) * kBusSimCommands);
+		if (commandPtr == NULL) {
+			LOG("\pNo memory for the simulated workload");
+			return;
+		}
+		for (i = 0; i < kBusSimScenarios; i++)
+			RunBusSimScenario(&gBusSimScenario[i], commandPtr);
+		DisposePtr((Ptr) commandPtr);
+}
+
+static void
+RunBusSimScenario(
+		const BusSimScenario	*scenarioPtr,
+		SimCommand				command[]
+	)
+{
+		BusSimulator			simulator;
+		SimTargetPtr			targetPtr;
+		unsigned short			bus;
+		unsigned short			cdromBus;
+		short					id;
+		unsigned long			startTicks;
+		unsigned long			reselectWait;
+		unsigned long			reselections;
+		unsigned long			selectTimeouts;
+		OSErr					status;
+		Str255					work;
+
+		BusSimInit(&simulator, scenarioPtr->busCount);
+		simulator.disconnectPolicy = scenarioPtr->disconnectPolicy;
+		simulator.disconnectThreshold = kBusSimThreshold;
+		simulator.queuePolicy = scenarioPtr->queuePolicy;
+		cdromBus = scenarioPtr->busCount - 1;
+		BusSimSetTarget(&simulator, 0, 0, TRUE, 10000L);	/* Fast SCSI		*/
+		BusSimSetTarget(&simulator, 0, 2, TRUE, 5000L);
+		BusSimSetTarget(&simulator, 0, 3, TRUE, 5000L);
+		BusSimSetTarget(&simulator, cdromBus, kBusSimCDROM, TRUE, 300L);
+		MakeWorkload(command, cdromBus);
+		startTicks = TickCount();
+		status = BusSimRun(&simulator, command, kBusSimCommands);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't run the bus simulator");
+			return;
+		}
+		pstrcpy(work, scenarioPtr->name);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, simulator.now / kSimUnitsPerMsec);
+		pstrcat(work, "\p msec simulated (");
+		AppendUnsigned(work, TickCount() - startTicks);
+		pstrcat(work, "\p ticks, ");
+		AppendUnsigned(work, simulator.events);
+		pstrcat(work, "\p events), bus busy ");
+		reselections = 0;
+		selectTimeouts = 0;
+		for (bus = 0; bus < simulator.busCount; bus++) {
+			if (bus != 0)
+				pstrcat(work, "\p/");
+			/*
+			 * Divide the elapsed time, not multiply the busy time, to avoid
+			 * overflow.
+			 */
+			AppendUnsigned(work,
+				simulator.bus[bus].busyTime / (simulator.now / 100L + 1L));
+			pstrcat(work, "\p%");
+			reselections += simulator.bus[bus].reselections;
+			selectTimeouts += simulator.bus[bus].selectTimeouts;
+		}
+		LOG(work);
+		pstrcpy(work, "\p  Average/worst msec:");
+		reselectWait = 0;
+		for (bus = 0; bus < simulator.busCount; bus++) {
+			for (id = 0; id < kSimMaxTargets; id++) {
+				targetPtr = &simulator.bus[bus].target[id];
+				if (targetPtr->present == FALSE || targetPtr->commands == 0)
+					continue;
+				pstrcat(work, "\p ID ");
+				AppendUnsigned(work, id);
+				pstrcat(work, "\p ");
+				AppendUnsigned(work,
+					targetPtr->totalLatency / targetPtr->commands / 1000L);
+				pstrcat(work, "\p/");
+				AppendUnsigned(work, targetPtr->maxLatency / 1000L);
+				reselectWait += targetPtr->reselectWait;
+			}
+		}
+		LOG(work);
+		pstrcpy(work, "\p  Reselections ");
+		AppendUnsigned(work, reselections);
+		if (reselections != 0) {
+			pstrcat(work, "\p (average wait ");
+			AppendUnsigned(
+				work, reselectWait / reselections / kSimUnitsPerUsec);
+			pstrcat(work, "\p usec)");
+		}
+		pstrcat(work, "\p, selection timeouts ");
+		AppendUnsigned(work, selectTimeouts);
+		LOG(work);
+}
+
+/*
+ * Generate the workload. Commands arrive at random intervals averaging
+ * kBusSimMeanArrival usec. Of every 400 commands, about 160 are for the fast
+ * disk, 110 for each of the other disks, and 20 for the CD-ROM player. Every
+ * thousandth command is for the missing target.
+ */
+static void
+MakeWorkload(
+		SimCommand				command[],
+		unsigned short			cdromBus
+	)
+{
+		register SimCommandPtr	commandPtr;
+		register short			i;
+		unsigned long			arrival;
+		unsigned long			choice;
+
+		gBusSimSeed = kBusSimSeed;
+		arrival = 0;
+		for (i = 0; i < kBusSimCommands; i++) {
+			commandPtr = &command[i];
+			CLEAR(*commandPtr);
+			arrival +=
+				(BusSimRandom() % (2 * kBusSimMeanArrival)) * kSimUnitsPerUsec;
+			commandPtr->arrival = arrival;
+			commandPtr->write = ((BusSimRandom() & 3) == 0);
+			choice = BusSimRandom() % 400;
+			if ((i % 1000) == 999) {
+				commandPtr->targetID = kBusSimMissing;
+				commandPtr->write = FALSE;
+			}
+			else if (choice < 160) {
+				/*
+				 * Mostly from the drive's cache.
+				 */
+				commandPtr->targetID = 0;
+				commandPtr->length = 512L * (1 + BusSimRandom() % 16);
+				commandPtr->service =
+					(5L + BusSimRandom() % 20) * 100L * kSimUnitsPerUsec;
+			}
+			else if (choice < 380) {
+				/*
+				 * A seek of up to 20 msec and half a rotation on average.
+				 */
+				commandPtr->targetID = (choice < 270) ? 2 : 3;
+				commandPtr->length = 512L * (1 + BusSimRandom() % 16);
+				commandPtr->service = (BusSimRandom() % 20000L
+							+ BusSimRandom() % 11000L) * kSimUnitsPerUsec;
+			}
+			else {
+				commandPtr->bus = cdromBus;
+				commandPtr->targetID = kBusSimCDROM;
+				commandPtr->write = FALSE;
+				commandPtr->length = 2048L * (1 + BusSimRandom() % 8);
+				commandPtr->service =
+					(20L + BusSimRandom() % 100) * kSimUnitsPerMsec;
+			}
+		}
+}
+
+static unsigned long
+BusSimRandom(void)
+{
+		gBusSimSeed = gBusSimSeed * 1103515245L + 12345L;
+		return ((gBusSimSeed >> 16) & 0x7FFF);
+}
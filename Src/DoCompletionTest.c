@@ -0,0 +1,222 @@
+/*								DoCompletionTest.c								*/
+/*
+ * DoCompletionTest.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure how quickly the event loop finishes SCSI commands. A RAM disk with
+ * a short latency is added to the virtual bus, and kTestRequests reads are
+ * kept in flight for kTestRunTicks: each read is queued again when it is
+ * done. Nothing polls the bus dispatcher: its completions are drained from
+ * gSCSIEnvironment's completion queue by the event loop, and the application
+ * stays responsive while the test runs. The test is run twice:
+ *	-- With the fixed WaitNextEvent sleep (10 ticks in the foreground), as
+ *	   the event loop did before there was a completion queue.
+ *	-- With the adaptive sleep, where a completion wakes the application.
+ * For each run, the reads per second, the average and worst latency from
+ * completion to handling, and the share of the time that was spent in
+ * WaitNextEvent (given to other applications, or idle) are displayed.
+ */
+#include "SCSISimpleSample.h"
+
+#define kTestTarget				6
+#define kTestLatency			5L				/* msec						*/
+#define kTestBlocks				16L
+#define kTestRequests			4
+#define kTestRunTicks			300L			/* 5 seconds per run		*/
+
+enum {
+	kTestRunFixed = 1,
+	kTestRunAdaptive
+};
+
+struct CompletionTest {
+	unsigned short		run;					/* 0 if not running				*/
+	Boolean				saveAdaptiveSleep;
+	unsigned long		startTicks;
+	unsigned long		endTicks;				/* Stop requeueing				*/
+	unsigned short		outstanding;			/* Requests not yet done		*/
+	unsigned long		reads;					/* Completed in this run		*/
+	EventLoopStatistics	startStatistics;
+	BusDispatcher		dispatcher;
+	BusRequest			request[kTestRequests];
+	char				buffer[kVirtualBlockLength];
+};
+typedef struct CompletionTest CompletionTest;
+
+static CompletionTest			gCompletionTest;
+
+static void						StartTestRun(
+		unsigned short			run
+	);
+static void						TestReadDone(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	);
+static void						ShowTestRun(void);
+static void						FinishTest(void);
+
+void
+DoCompletionTest(void)
+{
+		unsigned short			bus;
+		OSErr					status;
+
+		if (gCompletionTest.run != 0) {
+			LOG("\pThe completion test is running");
+			return;
+		}
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pEvent Loop Completion Test (virtual bus)");
+		if (VirtualSIMGetTarget(kTestTarget)->commandProc != NULL) {
+			LOG("\pVirtual target 6 must be free");
+			return;
+		}
+		status = VirtualSIMSetTarget(
+					kTestTarget, VirtualDiskCommand, kScsiDevTypeDirect,
+					kTestBlocks, kTestLatency, TRUE);
+		if (status == noErr)
+			status = BusDispatcherOpen(
+						&gCompletionTest.dispatcher, &gSCSIEnvironment, bus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(
+				status, "\pCan't setup the completion test");
+			(void) VirtualSIMSetTarget(kTestTarget, NULL, 0, 0L, 0L, FALSE);
+			return;
+		}
+		gCompletionTest.saveAdaptiveSleep = gAdaptiveEventSleep;
+		StartTestRun(kTestRunFixed);
+}
+
+/*
+ * Called from the event loop on null events. When every read of a run is
+ * done, display the run and start the next one. The dispatcher isn't polled,
+ * so the watchdog is idled here.
+ */
+void
+ContinueCompletionTest(void)
+{
+		if (gCompletionTest.run == 0)
+			return;
+		SCSIWatchdogIdle(&gSCSIEnvironment.watchdog);
+		if (gCompletionTest.outstanding != 0)
+			return;
+		ShowTestRun();
+		if (gCompletionTest.run == kTestRunFixed)
+			StartTestRun(kTestRunAdaptive);
+		else {
+			FinishTest();
+		}
+}
+
+static void
+StartTestRun(
+		unsigned short			run
+	)
+{
+		register short			i;
+		BusRequestPtr			requestPtr;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		gCompletionTest.run = run;
+		gAdaptiveEventSleep = (run == kTestRunAdaptive);
+		CompletionQueueSetWakeProcess(
+			&gSCSIEnvironment.completions, gAdaptiveEventSleep);
+		CompletionQueueResetStatistics(&gSCSIEnvironment.completions);
+		gCompletionTest.startStatistics = gEventLoopStatistics;
+		gCompletionTest.reads = 0;
+		gCompletionTest.outstanding = kTestRequests;
+		gCompletionTest.startTicks = TickCount();
+		gCompletionTest.endTicks = gCompletionTest.startTicks + kTestRunTicks;
+		for (i = 0; i < kTestRequests; i++) {
+			requestPtr = &gCompletionTest.request[i];
+			CLEAR(*requestPtr);
+			SCB.scsiDevice.bus = gCompletionTest.dispatcher.bus;
+			SCB.scsiDevice.targetID = kTestTarget;
+			SCB.command.scsi6.opcode = kScsiCmdRead6;
+			SCB.command.scsi6.lbn1 = i;
+			SCB.command.scsi6.len = 1;
+			SCB.bufferPtr = gCompletionTest.buffer;
+			SCB.transferSize = kVirtualBlockLength;
+			SCB.transferQuantum = kVirtualBlockLength;
+			requestPtr->doneProc = TestReadDone;
+			BusDispatcherQueue(&gCompletionTest.dispatcher, requestPtr);
+		}
+		(void) BusDispatcherPoll(&gCompletionTest.dispatcher);	/* Start them	*/
+#undef SCB
+}
+
+/*
+ * A read is done (this is called from the event loop's drain). Queue it
+ * again until the run ends: the dispatcher starts it when this returns.
+ */
+static void
+TestReadDone(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		++gCompletionTest.reads;
+		if (requestPtr->scsiCmdBlock.status == noErr
+		 && TickCount() < gCompletionTest.endTicks)
+			BusDispatcherQueue(dispatcherPtr, requestPtr);
+		else {
+			--gCompletionTest.outstanding;
+		}
+}
+
+static void
+ShowTestRun(void)
+{
+		CompletionQueueStatistics	statistics;
+		unsigned long			elapsedTicks;
+		unsigned long			events;
+		unsigned long			yieldedTicks;
+		Str255					work;
+
+		CompletionQueueGetStatistics(
+			&gSCSIEnvironment.completions, &statistics);
+		elapsedTicks = TickCount() - gCompletionTest.startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		events = gEventLoopStatistics.events
+			   - gCompletionTest.startStatistics.events;
+		yieldedTicks = gEventLoopStatistics.yieldedTicks
+					 - gCompletionTest.startStatistics.yieldedTicks;
+		LOG((gCompletionTest.run == kTestRunFixed)
+			? "\pFixed sleep" : "\pAdaptive sleep");
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, (gCompletionTest.reads * 60L) / elapsedTicks);
+		pstrcat(work, "\p reads/sec, ");
+		AppendUnsigned(work, events);
+		pstrcat(work, "\p events, ");
+		AppendUnsigned(work, (yieldedTicks * 100L) / elapsedTicks);
+		pstrcat(work, "\p% of the time in WaitNextEvent");
+		LOG(work);
+		if (statistics.handled != 0) {
+			pstrcpy(work, "\p  Completion latency: average ");
+			AppendUnsigned(work, (statistics.totalLatencyTicks * 50L)
+				/ (statistics.handled * 3L));
+			pstrcat(work, "\p msec, worst ");
+			AppendUnsigned(work, (statistics.maxLatencyTicks * 50L) / 3L);
+			pstrcat(work, "\p msec");
+			LOG(work);
+		}
+		if (gCompletionTest.request[0].scsiCmdBlock.status != noErr)
+			DisplaySCSIErrorMessage(
+				gCompletionTest.request[0].scsiCmdBlock.status,
+				"\pTest read failed");
+}
+
+static void
+FinishTest(void)
+{
+		BusDispatcherClose(&gCompletionTest.dispatcher);
+		(void) VirtualSIMSetTarget(kTestTarget, NULL, 0, 0L, 0L, FALSE);
+		gAdaptiveEventSleep = gCompletionTest.saveAdaptiveSleep;
+		CompletionQueueSetWakeProcess(
+			&gSCSIEnvironment.completions, gAdaptiveEventSleep);
+		gCompletionTest.run = 0;
+}
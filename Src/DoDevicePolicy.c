@@ -0,0 +1,82 @@
+/*								DoDevicePolicy.c								*/
+/*
+ * DoDevicePolicy.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Change the disconnect or Select with Attention override for the current
+ * device (Automatic, then Always, then Never, then back to Automatic) and
+ * display the device's policy. The overrides are saved in the preferences
+ * file. See DevicePolicy.h.
+ */
+#include "SCSISimpleSample.h"
+
+static void						AppendOverride(
+		Str255					work,
+		unsigned short			override
+	);
+
+void
+DoDevicePolicy(
+		DeviceIdent				scsiDevice,				/* -> Bus/target/LUN	*/
+		Boolean					changeSelectWithATN
+	)
+{
+		DevicePolicyPtr			policyPtr;
+		unsigned short			disconnectOverride;
+		unsigned short			selectWithATNOverride;
+		OSErr					status;
+		Str255					work;
+
+		ShowSCSIBusID(scsiDevice, "\pDevice Policy");
+		policyPtr = DevicePolicyGet(&gSCSIEnvironment.policy, scsiDevice);
+		if (policyPtr == NULL) {
+			LOG("\pThe device policy table is full");
+			return;
+		}
+		disconnectOverride = policyPtr->disconnectOverride;
+		selectWithATNOverride = policyPtr->selectWithATNOverride;
+		if (changeSelectWithATN)
+			selectWithATNOverride =
+				(selectWithATNOverride + 1) % (kPolicyNever + 1);
+		else {
+			disconnectOverride = (disconnectOverride + 1) % (kPolicyNever + 1);
+		}
+		status = DevicePolicySetOverride(
+					&gSCSIEnvironment.policy, scsiDevice,
+					disconnectOverride, selectWithATNOverride);
+		if (status != noErr)
+			DisplaySCSIErrorMessage(status, "\pCan't save the device policy");
+		pstrcpy(work, "\pDisconnect: ");
+		AppendOverride(work, policyPtr->disconnectOverride);
+		pstrcat(work, "\p, Select with ATN: ");
+		AppendOverride(work, policyPtr->selectWithATNOverride);
+		LOG(work);
+		pstrcpy(work, "\pMeasured ");
+		AppendUnsigned(work, policyPtr->samples);
+		pstrcat(work, "\p commands, average latency ");
+		AppendUnsigned(work, policyPtr->averageLatency >> kPolicyLatencyShift);
+		pstrcat(work, "\p msec, adaptive policy: ");
+		if (policyPtr->samples < kPolicyMinSamples)
+			pstrcat(work, "\pnot yet chosen");
+		else if (policyPtr->disconnect)
+			pstrcat(work, "\pdisconnect");
+		else {
+			pstrcat(work, "\pstay connected");
+		}
+		LOG(work);
+		if (policyPtr->rejectsATN)
+			LOG("\pThis device rejected Select with ATN");
+}
+
+static void
+AppendOverride(
+		Str255					work,
+		unsigned short			override
+	)
+{
+		switch (override) {
+		case kPolicyAlways:		pstrcat(work, "\pAlways");		break;
+		case kPolicyNever:		pstrcat(work, "\pNever");		break;
+		default:				pstrcat(work, "\pAutomatic");	break;
+		}
+}
@@ -0,0 +1,89 @@
+/*									DoDeviceSummary.c							*/
+/*
+ * DoDeviceSummary.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Execute the usual "what is this device" sequence -- Test Unit Ready,
+ * Inquiry, Read Capacity, and Mode Sense -- as one batch, and display the
+ * results and the elapsed time.
+ */
+#include "SCSISimpleSample.h"
+
+enum {
+	kSummaryTestUnitReady = 0,
+	kSummaryInquiry,
+	kSummaryReadCapacity,
+	kSummaryModeSense,
+	kSummaryCommands
+};
+
+void
+DoDeviceSummary(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	)
+{
+		ScsiCmdBlock				scsiCmdBlock[kSummaryCommands];
+		SCSI_Inquiry_Data			inquiry;
+		SCSI_Capacity_Data			capacity;
+		unsigned char				modeSense[12];
+		unsigned long				startTicks;
+		register short				i;
+		Str255						work;
+#define SCB(i)	(scsiCmdBlock[i])
+
+		ShowSCSIBusID(scsiDevice, "\pDevice Summary");
+		for (i = 0; i < kSummaryCommands; i++) {
+			CLEAR(SCB(i));
+			SCB(i).scsiDevice = scsiDevice;
+			SCB(i).transferQuantum = 1;					/* Force handshake		*/
+		}
+		SCB(kSummaryTestUnitReady).command.scsi6.opcode = kScsiCmdTestUnitReady;
+		SCB(kSummaryInquiry).command.scsi6.opcode = kScsiCmdInquiry;
+		SCB(kSummaryInquiry).command.scsi6.len = sizeof inquiry;
+		SCB(kSummaryInquiry).bufferPtr = (Ptr) &inquiry;
+		SCB(kSummaryInquiry).transferSize = sizeof inquiry;
+		SCB(kSummaryReadCapacity).command.scsi10.opcode = kScsiCmdReadCapacity;
+		SCB(kSummaryReadCapacity).bufferPtr = (Ptr) &capacity;
+		SCB(kSummaryReadCapacity).transferSize = sizeof capacity;
+		SCB(kSummaryModeSense).command.scsi6.opcode = kScsiCmdModeSense6;
+		SCB(kSummaryModeSense).command.scsi6.len = sizeof modeSense;
+		SCB(kSummaryModeSense).bufferPtr = (Ptr) modeSense;
+		SCB(kSummaryModeSense).transferSize = sizeof modeSense;
+		startTicks = TickCount();
+		(void) DoSCSICommandBatch(scsiCmdBlock, kSummaryCommands, TRUE, TRUE);
+		pstrcpy(work, "\pBatch completed in ");
+		AppendUnsigned(work, TickCount() - startTicks);
+		pstrcat(work, "\p ticks");
+		LOG(work);
+		if (SCB(kSummaryTestUnitReady).status == noErr)
+			LOG("\pDevice is ready");
+		if (SCB(kSummaryInquiry).status == noErr)
+			DoShowInquiry(scsiDevice, &inquiry);
+		if (SCB(kSummaryReadCapacity).status == noErr) {
+			pstrcpy(work, "\pCapacity: ");
+			AppendUnsigned(work,
+				  (((unsigned long) capacity.lbn4) << 24)
+				| (((unsigned long) capacity.lbn3) << 16)
+				| (((unsigned long) capacity.lbn2) << 8)
+				| capacity.lbn1
+			);
+			pstrcat(work, "\p blocks of ");
+			AppendUnsigned(work,
+				  (((unsigned long) capacity.len4) << 24)
+				| (((unsigned long) capacity.len3) << 16)
+				| (((unsigned long) capacity.len2) << 8)
+				| capacity.len1
+			);
+			pstrcat(work, "\p bytes");
+			LOG(work);
+		}
+		if (SCB(kSummaryModeSense).status == noErr) {
+			pstrcpy(work, "\pMode Sense: ");
+			AppendUnsigned(work, SCB(kSummaryModeSense).actualTransferCount);
+			pstrcat(work, "\p bytes");
+			if ((modeSense[2] & 0x80) != 0)
+				pstrcat(work, "\p, write protected");
+			LOG(work);
+		}
+#undef SCB
+}
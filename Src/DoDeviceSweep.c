@@ -0,0 +1,104 @@
+/*									DoDeviceSweep.c								*/
+/*
+ * DoDeviceSweep.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Run Test Unit Ready, Inquiry, or Read Block Zero on every device that List
+ * SCSI Devices found, on all buses at once (see DeviceSweep.h). Each device's
+ * result is displayed as it arrives, followed by a summary. Errors are shown
+ * in one line per device: use the single-device commands for the details.
+ */
+#include "SCSISimpleSample.h"
+
+static void						ShowSweepResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	);
+
+void
+DoDeviceSweep(
+		unsigned short			operation			/* kSweepTestUnitReady...	*/
+	)
+{
+		DeviceSweep				sweep;
+		OSErr					status;
+		Str255					work;
+
+		switch (operation) {
+		case kSweepTestUnitReady:	LOG("\pSweep: Test Unit Ready");	break;
+		case kSweepInquiry:			LOG("\pSweep: Inquiry");			break;
+		case kSweepReadBlockZero:	LOG("\pSweep: Read Block Zero");	break;
+		}
+		if (gMaxDevice == 0) {
+			LOG("\pNo devices: List All SCSI Devices first");
+			return;
+		}
+		status = DeviceSweepOpen(
+					&sweep, &gSCSIEnvironment, gDeviceList, gMaxDevice,
+					operation, kSweepDefaultPerBus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't start the sweep");
+			return;
+		}
+		sweep.resultProc = ShowSweepResult;
+		while (DeviceSweepPoll(&sweep))
+			;
+		pstrcpy(work, "\p");
+		AppendUnsigned(work, sweep.statistics.completed);
+		pstrcat(work, "\p devices on ");
+		AppendUnsigned(work, sweep.busCount);
+		pstrcat(work, "\p buses, ");
+		AppendUnsigned(work, sweep.statistics.failed);
+		pstrcat(work, "\p failed, ");
+		AppendUnsigned(work, sweep.statistics.elapsedTicks);
+		pstrcat(work, "\p ticks");
+		LOG(work);
+		DeviceSweepClose(&sweep);
+}
+
+/*
+ * Display one device's result.
+ */
+static void
+ShowSweepResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		SCSI_Inquiry_Data		*inquiryPtr;
+		Str255					work;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		pstrcpy(work, "\p  ");
+		AppendDeviceID(work, SCB.scsiDevice);
+		pstrcat(work, "\p: ");
+		if (SCB.status == statusErr) {
+			pstrcat(work, "\pCheck Condition, sense key ");
+			AppendUnsigned(work, SCB.sense.senseKey & kScsiSenseKeyMask);
+		}
+		else if (SCB.status != noErr) {
+			pstrcat(work, "\perror ");
+			AppendSigned(work, SCB.status);
+		}
+		else {
+			switch (sweepPtr->operation) {
+			case kSweepTestUnitReady:
+				pstrcat(work, "\pready");
+				break;
+			case kSweepInquiry:
+				inquiryPtr = (SCSI_Inquiry_Data *) SCB.bufferPtr;
+				AppendBytes(work,
+					(Ptr) inquiryPtr->vendor, sizeof inquiryPtr->vendor);
+				AppendChar(work, ' ');
+				AppendBytes(work,
+					(Ptr) inquiryPtr->product, sizeof inquiryPtr->product);
+				break;
+			case kSweepReadBlockZero:
+				AppendUnsigned(work, SCB.actualTransferCount);
+				pstrcat(work, "\p bytes read");
+				break;
+			}
+		}
+		LOG(work);
+#undef SCB
+}
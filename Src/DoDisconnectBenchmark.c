@@ -0,0 +1,279 @@
+/*								DoDisconnectBenchmark.c							*/
+/*
+ * DoDisconnectBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Compare the disconnect policies on the virtual SCSI bus. Random 4K reads
+ * from the slow, seeking, disk (target 3) run alongside random single-block
+ * reads from the fast RAM disk (target 0), with one command outstanding per
+ * target. The workload is run with every device told to disconnect, with
+ * every device told not to, and with the adaptive per-device policy, and
+ * the throughput of each target (while it was busy) and their sum are
+ * displayed:
+ *	-- If nothing disconnects, the RAM disk waits while the slow disk seeks.
+ *	-- If everything disconnects, the RAM disk pays for a reselection on
+ *	   every command, which costs more than its own latency.
+ *	-- The adaptive policy should let the slow disk disconnect and keep the
+ *	   RAM disk connected.
+ * Devices with a per-device override keep it in all three runs.
+ */
+#include "SCSISimpleSample.h"
+
+#define kSeekTarget				3
+#define kSeekRequests			48
+#define kSeekBlocks				8				/* 4K per request			*/
+#define kFastTarget				0
+#define kFastEvery				8				/* Per seek request			*/
+#define kFastRequests			(kSeekRequests * kFastEvery)
+#define kPolicyRequests			(kSeekRequests + kFastRequests)
+#define kPolicySeed				1994L
+
+enum {
+	kRunDoDisconnect = 0,
+	kRunDontDisconnect,
+	kRunAdaptive
+};
+
+static unsigned long			gPolicySeed;
+
+static void						RunPolicyWorkload(
+		unsigned short			bus,
+		unsigned short			run,
+		BusRequest				request[kPolicyRequests],
+		Ptr						bufferPtr,
+		ConstStr255Param		runName
+	);
+static unsigned long			ShowTarget(
+		ConstStr255Param		label,
+		unsigned short			targetID,
+		unsigned long			startTicks,
+		BusRequest				request[kPolicyRequests],
+		unsigned long			*commandsPerSecond
+	);
+static void						ShowPolicy(
+		unsigned short			bus,
+		unsigned short			targetID
+	);
+static unsigned long			PolicyRandom(void);
+
+void
+DoDisconnectBenchmark(void)
+{
+		unsigned short			bus;
+		BusRequest				*request;
+		Ptr						bufferPtr;
+		Boolean					saveDoDisconnect;
+		Boolean					saveDontDisconnect;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pDisconnect Policy Benchmark (virtual bus)");
+		request =
+			(BusRequest *) NewPtrClear(sizeof (BusRequest) * kPolicyRequests);
+		bufferPtr = NewPtr(kSeekBlocks * kVirtualBlockLength);
+		saveDoDisconnect = gSCSIEnvironment.policy.doDisconnect;
+		saveDontDisconnect = gSCSIEnvironment.policy.dontDisconnect;
+		if (request == NULL || bufferPtr == NULL)
+			LOG("\pNo memory for benchmark buffers");
+		else {
+			RunPolicyWorkload(bus, kRunDoDisconnect,
+				request, bufferPtr, "\pDo disconnect");
+			RunPolicyWorkload(bus, kRunDontDisconnect,
+				request, bufferPtr, "\pDo not disconnect");
+			RunPolicyWorkload(bus, kRunAdaptive,
+				request, bufferPtr, "\pAdaptive");
+		}
+		gSCSIEnvironment.policy.doDisconnect = saveDoDisconnect;
+		gSCSIEnvironment.policy.dontDisconnect = saveDontDisconnect;
+		gUpdateMenusNeeded = TRUE;
+		if (bufferPtr != NULL)
+			DisposePtr(bufferPtr);
+		if (request != NULL)
+			DisposePtr((Ptr) request);
+}
+
+/*
+ * Build the workload (one seek request, then kFastEvery fast requests, and
+ * so on), queue all of it, and run the dispatcher until it is done. Each
+ * target's cap is one request, so each has one command outstanding. All
+ * requests read into the same buffer: only the timing matters here.
+ */
+static void
+RunPolicyWorkload(
+		unsigned short			bus,
+		unsigned short			run,
+		BusRequest				request[kPolicyRequests],
+		Ptr						bufferPtr,
+		ConstStr255Param		runName
+	)
+{
+		BusDispatcher			dispatcher;
+		register short			i;
+		unsigned long			logicalBlock;
+		unsigned long			blockCount;
+		unsigned long			startTicks;
+		unsigned long			bytesPerSecond;
+		unsigned long			commandsPerSecond;
+		unsigned long			targetCommandsPerSecond;
+		OSErr					status;
+		Str255					work;
+#define SCB	(request[i].scsiCmdBlock)
+
+		gSCSIEnvironment.policy.doDisconnect = (run == kRunDoDisconnect);
+		gSCSIEnvironment.policy.dontDisconnect = (run == kRunDontDisconnect);
+		if (run == kRunAdaptive)					/* Start from scratch	*/
+			DevicePolicyForget(&gSCSIEnvironment.policy, bus);
+		status = BusDispatcherOpen(&dispatcher, &gSCSIEnvironment, bus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't open bus dispatcher");
+			return;
+		}
+		BusDispatcherSetShare(
+			&dispatcher, kSeekTarget, 1, kSeekBlocks * kVirtualBlockLength);
+		BusDispatcherSetShare(&dispatcher, kFastTarget, 1, kVirtualBlockLength);
+		gPolicySeed = kPolicySeed;
+		for (i = 0; i < kPolicyRequests; i++) {
+			CLEAR(request[i]);
+			SCB.scsiDevice.bus = bus;
+			SCB.transferQuantum = kVirtualBlockLength;
+			SCB.bufferPtr = bufferPtr;
+			if ((i % (kFastEvery + 1)) == 0) {
+				SCB.scsiDevice.targetID = kSeekTarget;
+				logicalBlock = PolicyRandom() * 2L;		/* Most of the disk		*/
+				blockCount = kSeekBlocks;
+			}
+			else {
+				SCB.scsiDevice.targetID = kFastTarget;
+				logicalBlock = PolicyRandom() % 512L;	/* The RAM disk's size	*/
+				blockCount = 1;
+			}
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn4 = logicalBlock >> 24;
+			SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len2 = blockCount >> 8;
+			SCB.command.scsi10.len1 = blockCount;
+			SCB.transferSize = blockCount * kVirtualBlockLength;
+		}
+		startTicks = TickCount();
+		for (i = 0; i < kPolicyRequests; i++)
+			BusDispatcherQueue(&dispatcher, &request[i]);
+		while (BusDispatcherPoll(&dispatcher))
+			;
+		BusDispatcherClose(&dispatcher);
+		LOG(runName);
+		bytesPerSecond = ShowTarget(
+					"\p  Seeking disk", kSeekTarget,
+					startTicks, request, &commandsPerSecond);
+		bytesPerSecond += ShowTarget(
+					"\p  RAM disk", kFastTarget,
+					startTicks, request, &targetCommandsPerSecond);
+		commandsPerSecond += targetCommandsPerSecond;
+		pstrcpy(work, "\p  Aggregate: ");
+		AppendUnsigned(work, bytesPerSecond / 1024L);
+		pstrcat(work, "\p K/sec, ");
+		AppendUnsigned(work, commandsPerSecond);
+		pstrcat(work, "\p commands/sec");
+		LOG(work);
+		if (run == kRunAdaptive) {
+			ShowPolicy(bus, kSeekTarget);
+			ShowPolicy(bus, kFastTarget);
+		}
+		for (i = 0; i < kPolicyRequests; i++) {
+			if (SCB.status != noErr) {
+				DisplaySCSIErrorMessage(
+					SCB.status, "\pBenchmark request failed");
+				break;
+			}
+		}
+#undef SCB
+}
+
+/*
+ * Display one target's throughput, up to its last completion. Returns the
+ * bytes per second, and stores the commands per second.
+ */
+static unsigned long
+ShowTarget(
+		ConstStr255Param		label,
+		unsigned short			targetID,
+		unsigned long			startTicks,
+		BusRequest				request[kPolicyRequests],
+		unsigned long			*commandsPerSecond
+	)
+{
+		unsigned long			bytes;
+		unsigned long			commands;
+		unsigned long			lastTicks;
+		unsigned long			bytesPerSecond;
+		register short			i;
+		Str255					work;
+
+		bytes = 0;
+		commands = 0;
+		lastTicks = startTicks + 1;
+		for (i = 0; i < kPolicyRequests; i++) {
+			if (request[i].scsiCmdBlock.scsiDevice.targetID != targetID)
+				continue;
+			bytes += request[i].scsiCmdBlock.actualTransferCount;
+			++commands;
+			if (request[i].completedTicks > lastTicks)
+				lastTicks = request[i].completedTicks;
+		}
+		bytesPerSecond = (bytes * 60L) / (lastTicks - startTicks);
+		*commandsPerSecond = (commands * 60L) / (lastTicks - startTicks);
+		pstrcpy(work, label);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, bytesPerSecond / 1024L);
+		pstrcat(work, "\p K/sec, ");
+		AppendUnsigned(work, *commandsPerSecond);
+		pstrcat(work, "\p commands/sec");
+		LOG(work);
+		return (bytesPerSecond);
+}
+
+/*
+ * Display the latency that the adaptive policy measured for a target, and
+ * its decision.
+ */
+static void
+ShowPolicy(
+		unsigned short			bus,
+		unsigned short			targetID
+	)
+{
+		DeviceIdent				scsiDevice;
+		DevicePolicyPtr			policyPtr;
+		Str255					work;
+
+		CLEAR(scsiDevice);
+		scsiDevice.bus = bus;
+		scsiDevice.targetID = targetID;
+		policyPtr = DevicePolicyGet(&gSCSIEnvironment.policy, scsiDevice);
+		if (policyPtr == NULL || policyPtr->samples < kPolicyMinSamples)
+			return;
+		pstrcpy(work, "\p  Target ");
+		AppendUnsigned(work, targetID);
+		pstrcat(work, "\p: average latency ");
+		AppendUnsigned(work, policyPtr->averageLatency >> kPolicyLatencyShift);
+		if (policyPtr->disconnect)
+			pstrcat(work, "\p msec, disconnects");
+		else {
+			pstrcat(work, "\p msec, stays connected");
+		}
+		LOG(work);
+}
+
+/*
+ * The same generator as DoSchedulerBenchmark: every run replays the same
+ * workload.
+ */
+static unsigned long
+PolicyRandom(void)
+{
+		gPolicySeed = gPolicySeed * 1103515245L + 12345L;
+		return ((gPolicySeed >> 16) & 0x7FFF);
+}
@@ -0,0 +1,119 @@
+/*									DoDiskImage.c								*/
+/*
+ * DoDiskImage.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Attach a disk image file to the virtual SCSI bus (see VirtualImage.h), or,
+ * if one is attached, detach it. The image becomes the first free virtual
+ * target from 1 up, and is made the current device, so that Read Block Zero,
+ * Test Unit Ready, and the other commands can be run on it at once. It uses
+ * the RAM disk latency model, or, if the Option key is held down when the
+ * command is chosen, the seeking disk model.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+#define kFirstImageTarget		1
+
+static void						DetachImages(void);
+
+void
+DoDiskImage(void)
+{
+		unsigned short			bus;
+		unsigned short			targetID;
+		VirtualTargetPtr		targetPtr;
+		unsigned short			latencyModel;
+		Point					where;
+		SFReply					reply;
+		OSErr					status;
+		Str255					work;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		for (targetID = 0; targetID < kVirtualMaxTarget; targetID++) {
+			if (VirtualImageAttached(targetID)) {
+				DetachImages();
+				return;
+			}
+		}
+		latencyModel = ((EVENT.modifiers & optionKey) != 0)
+				? kImageModelHardDisk
+				: kImageModelRAMDisk;
+		for (targetID = kFirstImageTarget;
+				targetID < kVirtualMaxTarget;
+				targetID++) {
+			targetPtr = VirtualSIMGetTarget(targetID);
+			if (targetPtr != NULL && targetPtr->commandProc == NULL)
+				break;
+		}
+		if (targetID >= kVirtualMaxTarget) {
+			LOG("\pNo virtual target is free for the disk image");
+			return;
+		}
+		SetPt(&where, 80, 80);
+		SFGetFile(where, "\p", NULL, -1, NULL, NULL, &reply);
+		if (reply.good == FALSE)
+			return;
+		SetCursor(*GetCursor(watchCursor));
+		status = VirtualImageAttach(
+					targetID, reply.fName, reply.vRefNum, latencyModel);
+		InitCursor();
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't attach the disk image");
+			return;
+		}
+		targetPtr = VirtualSIMGetTarget(targetID);
+		pstrcpy(work, "\pDisk image \"");
+		pstrcat(work, reply.fName);
+		pstrcat(work, "\p\" is target ");
+		AppendUnsigned(work, targetID);
+		pstrcat(work, "\p on bus ");
+		AppendUnsigned(work, bus);
+		pstrcat(work, "\p, ");
+		AppendUnsigned(work, targetPtr->blockCount);
+		pstrcat(work, "\p blocks");
+		if (targetPtr->readOnly)
+			pstrcat(work, "\p, write-protected");
+		LOG(work);
+		gCurrentDevice.bus = bus;
+		gCurrentDevice.targetID = targetID;
+		gCurrentDevice.LUN = 0;
+		gUpdateMenusNeeded = TRUE;
+}
+
+/*
+ * Write back and detach every image, and display what was done with each.
+ */
+static void
+DetachImages(void)
+{
+		unsigned short			targetID;
+		VirtualTargetPtr		targetPtr;
+		OSErr					status;
+		Str255					work;
+
+		for (targetID = 0; targetID < kVirtualMaxTarget; targetID++) {
+			if (VirtualImageAttached(targetID) == FALSE)
+				continue;
+			targetPtr = VirtualSIMGetTarget(targetID);
+			pstrcpy(work, "\pDisk image target ");
+			AppendUnsigned(work, targetID);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, targetPtr->commands);
+			pstrcat(work, "\p commands, ");
+			AppendUnsigned(work, targetPtr->bytesTransferred);
+			pstrcat(work, (targetPtr->modified)
+					? "\p bytes, written back"
+					: "\p bytes, not changed");
+			status = VirtualImageDetach(targetID);
+			if (status != noErr)
+				DisplaySCSIErrorMessage(status, "\pCan't write the disk image");
+			else {
+				LOG(work);
+			}
+		}
+		gUpdateMenusNeeded = TRUE;
+}
@@ -0,0 +1,218 @@
+/*								DoFaultBenchmark.c								*/
+/*
+ * DoFaultBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure how throughput and latency degrade when a device misbehaves. A
+ * disk is added on the first free virtual target, and the same random read
+ * workload is run through DoSCSICommandWithSense with each kind of fault
+ * injected by the virtual SIM (see VirtualFault in VirtualSIM.h). For each
+ * run, the commands per second, the average and worst command latency, and
+ * the number of faults, failed commands, short reads, and Busy retries are
+ * displayed.
+ *	-- Busy and Queue Full are retried by DoSCSICommandWithSense: the
+ *	   commands succeed, and the cost of the retries is the difference from
+ *	   the run without faults. A Busy storm shows the backoff.
+ *	-- Unit Attention and Medium Error are reported to the caller, as are
+ *	   phase errors and timeouts.
+ *	-- Under-runs succeed, with half the data (AsyncSCSI accepts short reads).
+ * Each run starts from the same seed, so the runs are repeatable. A phase
+ * error makes the adaptive device policy stop selecting the disk with
+ * Attention: the policy is reset for the virtual bus before each run.
+ */
+#include "SCSISimpleSample.h"
+
+#define kFaultCommands			200
+#define kFaultLatency			2L				/* msec, as the RAM disk	*/
+#define kFaultTransferRate		5000L			/* 5 MB/sec					*/
+#define kFaultBlocks			80000L
+#define kFaultSeed				1994L
+
+struct FaultScenario {
+	StringPtr			name;
+	unsigned short		kind;
+	unsigned short		probability;			/* Per 1000					*/
+	unsigned short		period;
+	unsigned short		burst;
+	unsigned long		delay;					/* msec						*/
+};
+typedef struct FaultScenario FaultScenario;
+
+static const FaultScenario		gFaultScenario[] = {
+	{ "\pNo faults",				kVirtualFaultNone,			0, 0, 0, 0L },
+	{ "\pBusy, 10%",				kVirtualFaultBusy,			100, 0, 0, 0L },
+	{ "\pQueue Full, 10%",			kVirtualFaultQueueFull,		100, 0, 0, 0L },
+	{ "\pBusy storm, 8 of 64",		kVirtualFaultBusy,			0, 64, 8, 0L },
+	{ "\pUnit Attention, 5%",		kVirtualFaultUnitAttention,	50, 0, 0, 0L },
+	{ "\pMedium Error, 5%",			kVirtualFaultMediumError,	50, 0, 0, 30L },
+	{ "\pUnder-run, 10%",			kVirtualFaultUnderrun,		100, 0, 0, 0L },
+	{ "\pPhase error, 2%",			kVirtualFaultPhaseError,	20, 0, 0, 0L },
+	{ "\pSelect timeout, 2%",		kVirtualFaultSelectTimeout,	20, 0, 0, 0L },
+	{ "\pTimeout (250 msec), 1%",	kVirtualFaultTimeout,		10, 0, 0, 250L }
+};
+#define kFaultScenarios	(sizeof gFaultScenario / sizeof gFaultScenario[0])
+
+static unsigned long			gFaultSeed;
+
+static void						RunFaultScenario(
+		DeviceIdent				scsiDevice,
+		const FaultScenario		*scenarioPtr,
+		Ptr						bufferPtr
+	);
+static unsigned long			FaultRandom(void);
+
+void
+DoFaultBenchmark(void)
+{
+		unsigned short			bus;
+		unsigned short			faultTarget;
+		DeviceIdent				scsiDevice;
+		Ptr						bufferPtr;
+		register VirtualTargetPtr	targetPtr;
+		register short			i;
+		OSErr					status;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pFault Injection Benchmark (virtual bus)");
+		for (faultTarget = 0; faultTarget < kVirtualMaxTarget; faultTarget++) {
+			if (VirtualSIMGetTarget(faultTarget)->commandProc == NULL)
+				break;
+		}
+		if (faultTarget >= kVirtualMaxTarget) {
+			LOG("\pA virtual target must be free");
+			return;
+		}
+		bufferPtr = NewPtr(kVirtualBlockLength);
+		if (bufferPtr == NULL) {
+			LOG("\pNo memory for benchmark buffers");
+			return;
+		}
+		/*
+		 * The disk has no storage: reads return zeros.
+		 */
+		status = VirtualSIMSetTarget(
+					faultTarget, VirtualDiskCommand, kScsiDevTypeDirect,
+					0L, kFaultLatency, TRUE);
+		if (status != noErr)
+			DisplaySCSIErrorMessage(
+				status, "\pCan't setup the fault benchmark");
+		else {
+			targetPtr = VirtualSIMGetTarget(faultTarget);
+			targetPtr->blockCount = kFaultBlocks;
+			targetPtr->transferRate = kFaultTransferRate;
+			CLEAR(scsiDevice);
+			scsiDevice.bus = bus;
+			scsiDevice.targetID = faultTarget;
+			for (i = 0; i < kFaultScenarios; i++)
+				RunFaultScenario(scsiDevice, &gFaultScenario[i], bufferPtr);
+		}
+		(void) VirtualSIMSetTarget(faultTarget, NULL, 0, 0L, 0L, FALSE);
+		DevicePolicyForget(&gSCSIEnvironment.policy, bus);
+		DisposePtr(bufferPtr);
+}
+
+/*
+ * Run the workload with one fault rule, and display the results. Latency is
+ * measured in Ticks, which are coarse compared to a command, but the worst
+ * case shows the retries and timeouts.
+ */
+static void
+RunFaultScenario(
+		DeviceIdent				scsiDevice,
+		const FaultScenario		*scenarioPtr,
+		Ptr						bufferPtr
+	)
+{
+		ScsiCmdBlock			scsiCmdBlock;
+		VirtualFault			fault;
+		register short			i;
+		unsigned long			logicalBlock;
+		unsigned long			startTicks;
+		unsigned long			commandTicks;
+		unsigned long			elapsedTicks;
+		unsigned long			worstTicks;
+		unsigned long			errors;
+		unsigned long			shortReads;
+		unsigned long			retries;
+		Str255					work;
+#define SCB	(scsiCmdBlock)
+
+		VirtualSIMClearFaults(scsiDevice.targetID, kFaultSeed);
+		if (scenarioPtr->kind != kVirtualFaultNone) {
+			CLEAR(fault);
+			fault.kind = scenarioPtr->kind;
+			fault.probability = scenarioPtr->probability;
+			fault.period = scenarioPtr->period;
+			fault.burst = scenarioPtr->burst;
+			fault.delay = scenarioPtr->delay;
+			(void) VirtualSIMAddFault(scsiDevice.targetID, &fault);
+		}
+		DevicePolicyForget(&gSCSIEnvironment.policy, scsiDevice.bus);
+		gFaultSeed = kFaultSeed;
+		worstTicks = 0;
+		errors = 0;
+		shortReads = 0;
+		retries = 0;
+		startTicks = TickCount();
+		for (i = 0; i < kFaultCommands; i++) {
+			logicalBlock = FaultRandom() * 2L;
+			CLEAR(SCB);
+			SCB.scsiDevice = scsiDevice;
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn4 = logicalBlock >> 24;
+			SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len1 = 1;
+			SCB.bufferPtr = bufferPtr;
+			SCB.transferSize = kVirtualBlockLength;
+			SCB.transferQuantum = kVirtualBlockLength;
+			commandTicks = TickCount();
+			DoSCSICommandWithSense(&scsiCmdBlock, FALSE, TRUE);
+			commandTicks = TickCount() - commandTicks;
+			if (commandTicks > worstTicks)
+				worstTicks = commandTicks;
+			if (SCB.status != noErr)
+				++errors;
+			else if (SCB.actualTransferCount < SCB.transferSize)
+				++shortReads;
+			retries += SCB.busyRetries;
+		}
+		elapsedTicks = TickCount() - startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, scenarioPtr->name);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, (kFaultCommands * 60L) / elapsedTicks);
+		pstrcat(work, "\p commands/sec, average ");
+		AppendUnsigned(work, (elapsedTicks * 50L) / (3L * kFaultCommands));
+		pstrcat(work, "\p msec, worst ");
+		AppendUnsigned(work, (worstTicks * 50L) / 3L);
+		pstrcat(work, "\p msec");
+		LOG(work);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, VirtualSIMGetTarget(scsiDevice.targetID)->faults);
+		pstrcat(work, "\p faults, ");
+		AppendUnsigned(work, errors);
+		pstrcat(work, "\p failed, ");
+		AppendUnsigned(work, shortReads);
+		pstrcat(work, "\p short reads, ");
+		AppendUnsigned(work, retries);
+		pstrcat(work, "\p Busy retries");
+		LOG(work);
+#undef SCB
+}
+
+/*
+ * The same generator as DoSchedulerBenchmark: every run reads the same
+ * blocks.
+ */
+static unsigned long
+FaultRandom(void)
+{
+		gFaultSeed = gFaultSeed * 1103515245L + 12345L;
+		return ((gFaultSeed >> 16) & 0x7FFF);
+}
@@ -0,0 +1,233 @@
+/*									DoFlowBenchmark.c							*/
+/*
+ * DoFlowBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure device flows (see DeviceFlow.h) on the virtual SCSI bus. Four
+ * small RAM disks, each with a two-entry partition map, are added to the
+ * bus. The full flow (Test Unit Ready through the partition map) is then run:
+ *	-- One flow at a time, as straight-line code would run it.
+ *	-- kFlowCount flows at once, all started before the first completes.
+ * For each run, the flows and commands per second are displayed, with the
+ * memory that the flows used. Every flow should find one HFS partition.
+ * The RAM disks are removed when the benchmark ends.
+ */
+#include "SCSISimpleSample.h"
+
+#define kFlowCount				1000
+#define kSequentialFlows		100
+#define kFlowDiskBlocks			64L
+#define kFlowDiskLatency		2L				/* msec						*/
+
+static const unsigned short		gFlowTarget[] = { 1, 2, 4, 5 };
+#define kFlowTargets			(sizeof gFlowTarget / sizeof gFlowTarget[0])
+
+static OSErr					AddFlowDisks(void);
+static void						RemoveFlowDisks(void);
+static void						FlowDone(
+		DeviceFlowPtr			flowPtr
+	);
+static void						ShowFlowRun(
+		ConstStr255Param		runName,
+		DeviceFlow				flow[],
+		unsigned short			flowCount,
+		unsigned long			elapsedTicks,
+		unsigned long			memoryBytes
+	);
+static void						CopyCString(
+		unsigned char			*dst,
+		const char				*src
+	);
+
+void
+DoFlowBenchmark(void)
+{
+		unsigned short			bus;
+		DeviceFlow				*flow;
+		BusDispatcher			dispatcher;
+		DeviceIdent				scsiDevice;
+		unsigned long			doneCount;
+		unsigned long			startTicks;
+		register unsigned short	i;
+		OSErr					status;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pDevice Flow Benchmark (virtual bus)");
+		for (i = 0; i < kFlowTargets; i++) {
+			if (VirtualSIMGetTarget(gFlowTarget[i])->commandProc != NULL) {
+				LOG("\pVirtual targets 1, 2, 4, and 5 must be free");
+				return;
+			}
+		}
+		flow = (DeviceFlow *) NewPtrClear(sizeof (DeviceFlow) * kFlowCount);
+		if (flow == NULL) {
+			LOG("\pNo memory for the device flows");
+			return;
+		}
+		status = AddFlowDisks();
+		if (status == noErr)
+			status = BusDispatcherOpen(&dispatcher, &gSCSIEnvironment, bus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't setup the flow benchmark");
+			RemoveFlowDisks();
+			DisposePtr((Ptr) flow);
+			return;
+		}
+		CLEAR(scsiDevice);
+		scsiDevice.bus = bus;
+		for (i = 0; i < kFlowCount; i++) {
+			flow[i].doneProc = FlowDone;
+			flow[i].refCon = (long) &doneCount;
+		}
+		/*
+		 * One at a time: each flow starts when the previous one is done.
+		 */
+		doneCount = 0;
+		startTicks = TickCount();
+		for (i = 0; i < kSequentialFlows; i++) {
+			scsiDevice.targetID = gFlowTarget[i % kFlowTargets];
+			DeviceFlowStart(&flow[i], &dispatcher, scsiDevice);
+			while (doneCount <= i)
+				(void) BusDispatcherPoll(&dispatcher);
+		}
+		ShowFlowRun("\pOne flow at a time", flow, kSequentialFlows,
+			TickCount() - startTicks, sizeof (DeviceFlow));
+		/*
+		 * All at once: the flows advance as their commands complete.
+		 */
+		doneCount = 0;
+		startTicks = TickCount();
+		for (i = 0; i < kFlowCount; i++) {
+			scsiDevice.targetID = gFlowTarget[i % kFlowTargets];
+			DeviceFlowStart(&flow[i], &dispatcher, scsiDevice);
+		}
+		while (doneCount < kFlowCount)
+			(void) BusDispatcherPoll(&dispatcher);
+		ShowFlowRun("\pAll flows at once", flow, kFlowCount,
+			TickCount() - startTicks,
+			sizeof (DeviceFlow) * (unsigned long) kFlowCount);
+		BusDispatcherClose(&dispatcher);
+		RemoveFlowDisks();
+		DisposePtr((Ptr) flow);
+}
+
+static void
+FlowDone(
+		DeviceFlowPtr			flowPtr
+	)
+{
+		++*((unsigned long *) flowPtr->refCon);
+}
+
+/*
+ * Display the rates for one run, and check that every flow read the map.
+ */
+static void
+ShowFlowRun(
+		ConstStr255Param		runName,
+		DeviceFlow				flow[],
+		unsigned short			flowCount,
+		unsigned long			elapsedTicks,
+		unsigned long			memoryBytes
+	)
+{
+		unsigned long			commands;
+		unsigned short			failed;
+		register unsigned short	i;
+		Str255					work;
+
+		commands = 0;
+		failed = 0;
+		for (i = 0; i < flowCount; i++) {
+			commands += flow[i].commands;
+			if (flow[i].status != noErr
+			 || flow[i].mapEntries != 2
+			 || flow[i].hfsPartitions != 1)
+				++failed;
+		}
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		LOG(runName);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, flowCount);
+		pstrcat(work, "\p flows, ");
+		AppendUnsigned(work, (flowCount * 60L) / elapsedTicks);
+		pstrcat(work, "\p flows/sec, ");
+		AppendUnsigned(work, (commands * 60L) / elapsedTicks);
+		pstrcat(work, "\p commands/sec");
+		LOG(work);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, memoryBytes);
+		pstrcat(work, "\p bytes of flow records (");
+		AppendUnsigned(work, sizeof (DeviceFlow));
+		pstrcat(work, "\p per flow), ");
+		AppendUnsigned(work, failed);
+		pstrcat(work, "\p flows failed");
+		LOG(work);
+}
+
+/*
+ * Add the RAM disks and write a driver descriptor map and a partition map
+ * (itself, and one HFS partition) on each. The media is in memory, so the
+ * maps are stored directly.
+ */
+static OSErr
+AddFlowDisks(void)
+{
+		VirtualTargetPtr		targetPtr;
+		Block0					*block0Ptr;
+		Partition				*partitionPtr;
+		register unsigned short	i;
+		OSErr					status;
+
+		for (i = 0; i < kFlowTargets; i++) {
+			status = VirtualSIMSetTarget(
+						gFlowTarget[i], VirtualDiskCommand, kScsiDevTypeDirect,
+						kFlowDiskBlocks, kFlowDiskLatency, TRUE);
+			if (status != noErr)
+				return (status);
+			targetPtr = VirtualSIMGetTarget(gFlowTarget[i]);
+			block0Ptr = (Block0 *) targetPtr->storage;
+			block0Ptr->sbSig = sbSIGWord;
+			block0Ptr->sbBlkSize = kVirtualBlockLength;
+			block0Ptr->sbBlkCount = kFlowDiskBlocks;
+			partitionPtr =
+				(Partition *) (targetPtr->storage + kVirtualBlockLength);
+			partitionPtr->pmSig = pMapSIG;
+			partitionPtr->pmMapBlkCnt = 2;
+			partitionPtr->pmPyPartStart = 1;
+			partitionPtr->pmPartBlkCnt = 2;
+			CopyCString(partitionPtr->pmPartName, "Apple");
+			CopyCString(partitionPtr->pmParType, "Apple_partition_map");
+			++partitionPtr;
+			partitionPtr->pmSig = pMapSIG;
+			partitionPtr->pmMapBlkCnt = 2;
+			partitionPtr->pmPyPartStart = 3;
+			partitionPtr->pmPartBlkCnt = kFlowDiskBlocks - 3;
+			CopyCString(partitionPtr->pmPartName, "Flow Test");
+			CopyCString(partitionPtr->pmParType, "Apple_HFS");
+		}
+		return (noErr);
+}
+
+static void
+RemoveFlowDisks(void)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < kFlowTargets; i++)
+			(void) VirtualSIMSetTarget(gFlowTarget[i], NULL, 0, 0L, 0L, FALSE);
+}
+
+static void
+CopyCString(
+		unsigned char			*dst,
+		const char				*src
+	)
+{
+		while ((*dst++ = *src++) != 0)
+			;
+}
@@ -0,0 +1,185 @@
+/*									DoHealthMonitor.c							*/
+/*
+ * DoHealthMonitor.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Start watching the devices that List SCSI Devices found (see
+ * HealthMonitor.h) or, if the monitor is running, stop it and display the
+ * load that it put on each bus. While it runs, the event loop drives it, and
+ * each change of state or Unit Attention is logged as it is found. A reset
+ * makes the presence watcher (if it is running) probe that bus's empty IDs
+ * soon; the watcher stops with the monitor, as it relies on it.
+ */
+#include "SCSISimpleSample.h"
+
+static void						ShowHealthEvent(
+		HealthMonitorPtr		monitorPtr,
+		HealthDevicePtr			devicePtr,
+		unsigned short			event,
+		unsigned short			oldState
+	);
+static void						ShowBusLoad(
+		HealthMonitorPtr		monitorPtr
+	);
+static StringPtr				GetHealthStateText(
+		unsigned short			state
+	);
+
+void
+DoHealthMonitor(void)
+{
+		unsigned short			deviceCount;
+		OSErr					status;
+		Str255					work;
+
+		if (gHealthMonitor.active) {
+			if (gPresenceWatcher.active) {
+				PresenceWatcherStop(&gPresenceWatcher);
+				LOG("\pPresence watcher stopped");
+			}
+			HealthMonitorStop(&gHealthMonitor);
+			LOG("\pHealth monitor stopped");
+			ShowBusLoad(&gHealthMonitor);
+			gUpdateMenusNeeded = TRUE;
+			return;
+		}
+		if (gMaxDevice == 0) {
+			LOG("\pNo devices: List All SCSI Devices first");
+			return;
+		}
+		deviceCount = gMaxDevice;
+		if (deviceCount > kHealthMaxDevices)
+			deviceCount = kHealthMaxDevices;
+		status = HealthMonitorStart(
+					&gHealthMonitor, &gSCSIEnvironment,
+					gDeviceList, deviceCount,
+					ShowHealthEvent, 0L);
+		if (status != noErr)
+			DisplaySCSIErrorMessage(status, "\pCan't start the health monitor");
+		else {
+			pstrcpy(work, "\pHealth monitor watching ");
+			AppendUnsigned(work, deviceCount);
+			pstrcat(work, "\p devices");
+			if (deviceCount < gMaxDevice) {
+				pstrcat(work, "\p (of ");
+				AppendUnsigned(work, gMaxDevice);
+				pstrcat(work, "\p)");
+			}
+			LOG(work);
+		}
+		gUpdateMenusNeeded = TRUE;
+}
+
+/*
+ * Log one event: the device, what happened, and the sense data (decoded as
+ * DoShowRequestSense decodes it).
+ */
+static void
+ShowHealthEvent(
+		HealthMonitorPtr		monitorPtr,
+		HealthDevicePtr			devicePtr,
+		unsigned short			event,
+		unsigned short			oldState
+	)
+{
+		Str255					senseMessage;
+		Str255					work;
+
+		pstrcpy(work, "\pHealth: ");
+		AppendDeviceID(work, devicePtr->scsiDevice);
+		pstrcat(work, "\p: ");
+		switch (event) {
+		case kHealthStateChange:
+			pstrcat(work, GetHealthStateText(oldState));
+			pstrcat(work, "\p -> ");
+			pstrcat(work, GetHealthStateText(devicePtr->state));
+			break;
+		case kHealthMediaChange:
+			pstrcat(work, "\pmedium changed");
+			break;
+		case kHealthReset:
+			pstrcat(work, "\preset");
+			if (gPresenceWatcher.active)
+				PresenceWatcherKick(
+					&gPresenceWatcher, devicePtr->scsiDevice.bus);
+			break;
+		default:
+			pstrcat(work, "\pUnit Attention");
+			break;
+		}
+		if (devicePtr->status == statusErr) {
+			pstrcat(work, "\p (");
+			pstrcat(work, GetSenseKeyText(devicePtr->senseKey));
+			if (GetSenseCodeText(senseMessage,
+						devicePtr->senseCode, devicePtr->senseQualifier)) {
+				pstrcat(work, "\p: ");
+				pstrcat(work, senseMessage);
+			}
+			pstrcat(work, "\p)");
+		}
+		else if (devicePtr->status != noErr) {
+			pstrcat(work, "\p (error ");
+			AppendSigned(work, devicePtr->status);
+			pstrcat(work, "\p)");
+		}
+		LOG(work);
+}
+
+/*
+ * For each bus: the polls, and the part of the time that a round was in
+ * progress on it.
+ */
+static void
+ShowBusLoad(
+		HealthMonitorPtr		monitorPtr
+	)
+{
+		register HealthBus		*busPtr;
+		register unsigned short	i;
+		unsigned long			elapsedTicks;
+		Str255					work;
+
+		elapsedTicks = TickCount() - monitorPtr->startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, monitorPtr->rounds);
+		pstrcat(work, "\p rounds, ");
+		AppendUnsigned(work, monitorPtr->polls);
+		pstrcat(work, "\p polls, ");
+		AppendUnsigned(work, monitorPtr->events);
+		pstrcat(work, "\p events in ");
+		AppendUnsigned(work, elapsedTicks / 60L);
+		pstrcat(work, "\p seconds");
+		LOG(work);
+		for (i = 0; i < monitorPtr->busCount; i++) {
+			busPtr = &monitorPtr->bus[i];
+			pstrcpy(work, "\p  Bus ");
+			AppendUnsigned(work, busPtr->busID);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, busPtr->polls);
+			pstrcat(work, "\p polls (");
+			AppendUnsigned(work, (busPtr->polls * 3600L) / elapsedTicks);
+			pstrcat(work, "\p per minute), busy ");
+			AppendUnsigned(work, busPtr->busyTicks);
+			pstrcat(work, "\p ticks (");
+			AppendUnsigned(work, (busPtr->busyTicks * 100L) / elapsedTicks);
+			pstrcat(work, "\p%)");
+			LOG(work);
+		}
+}
+
+static StringPtr
+GetHealthStateText(
+		unsigned short			state
+	)
+{
+		switch (state) {
+		case kHealthReady:		return ((StringPtr) "\pready");
+		case kHealthNotReady:	return ((StringPtr) "\pnot ready");
+		case kHealthNoMedium:	return ((StringPtr) "\pno medium");
+		case kHealthMissing:	return ((StringPtr) "\pmissing");
+		case kHealthFailed:		return ((StringPtr) "\pfailed");
+		default:				return ((StringPtr) "\punknown");
+		}
+}
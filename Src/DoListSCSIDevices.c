@@ -10,27 +10,97 @@
  * be available on a third-party bus interface, for example. Because of this,
  * we must always scan the bus using the original SCSI Manager even if the
  * asynchronous manager is present.
+ *
+ * The scan does not run to completion when it is chosen: DoListSCSIDevices
+ * only starts it. The event loop calls ContinueListSCSIDevices on each null
+ * event, and the scan runs for a slice of kScanSliceTicks, then returns so
+ * that the application can handle the user's events. The devices are logged
+ * as they are found, the window title shows the bus and target being probed,
+ * and Command-period cancels the scan. A probe can't be interrupted, so a
+ * slice may overrun by one selection timeout.
+ *
+ * The devices that the asynchronous SCSI Manager can reach are remembered in
+ * gDeviceList for the sweep commands. If statistics are being exported, the
+ * time taken to scan each bus is counted. The presence watcher adds devices
+ * to gDeviceList, and removes them, as they are connected and disconnected.
  */
 #include "SCSISimpleSample.h"
 
+#define kDeviceListIncrement	16
+#define kScanSliceTicks			6L				/* Per null event			*/
+#define kLastHardWiredTarget	6
+
+/*
+ * The scan states. Each step of the scan does at most one probe.
+ */
+enum {
+	kScanIdle = 0,
+	kScanNextBus,						/* Set up the bus in scsiDevice.bus	*/
+	kScanBusTargets,					/* Probe the next target or LUN		*/
+	kScanHardWiredTargets,				/* Probe through the old manager	*/
+	kScanDone
+};
+
+struct ListScan {
+	unsigned short		state;					/* kScanIdle, etc.				*/
+	unsigned short		lastHostBus;
+	unsigned short		initiatorID;
+	unsigned short		maxTarget;
+	Boolean				useAsynchManager;		/* For this bus					*/
+	DeviceIdent			scsiDevice;				/* Next device to probe			*/
+	short				deviceCount;			/* Found so far					*/
+	unsigned short		shownProgress;			/* Bus and target in the title	*/
+	unsigned long		busStartTicks;			/* When this bus's scan began	*/
+	ScanLimiter			limiter;
+	Str255				windowTitle;			/* Restored when done			*/
+};
+typedef struct ListScan ListScan;
+
+static ListScan					gListScan;
+
+static Boolean					ScanStep(void);
+static void						ProbeDevice(
+		Boolean					useAsynchManager
+	);
+static void						ShowScanProgress(void);
+static void						FinishScan(
+		ConstStr255Param		reason
+	);
+static unsigned short			FindDevice(
+		DeviceIdent				scsiDevice
+	);
+
+/*
+ * Start a scan. If one is running already, it is started over.
+ */
 void
 DoListSCSIDevices(void)
 {
 		OSErr							status;
-		unsigned short					lastHostBus;
-		unsigned short					initiatorID;
-		unsigned short					bus;
-		unsigned short					targetID;
-		unsigned short					LUN;
-		DeviceIdent						scsiDevice;
-		SCSIGetVirtualIDInfoPB			scsiGetVirtualIDInfo;
-		short							deviceCount;
-		unsigned short					maxTarget;
-		Boolean							useAsynchManager;
-		Str255							work;
 		
 		LOG("\pList all SCSI Devices");
-		deviceCount = 0;
+		if (gScanInProgress)
+			FinishScan("\pScan restarted");
+		CLEAR(gListScan);
+		gMaxDevice = 0;
+		/*
+		 * Each probe of a missing target holds the bus until the selection
+		 * times out. If scans are throttled, the limiter spaces the probes
+		 * out so that other I/O on the bus can proceed between them. The
+		 * unthrottled limiter never waits.
+		 */
+		if (gThrottleScan)
+			ScanLimiterInit(&gListScan.limiter,
+				kScanProbesPerSecond, kScanConcurrentProbes, NULL);
+		else {
+			ScanLimiterInit(&gListScan.limiter, 0, 0, NULL);
+		}
+		/*
+		 * Devices may have been added or replaced since the last scan, so
+		 * the original SCSI Manager must re-learn which targets can handle
+		 * blind transfers.
+		 */
+		OriginalSCSIForgetTransferModes();
 		/*
 		 * If we have the asynchronous SCSI Manager, find out how many busses
 		 * are present on this system. If not, force a "single bus" scan, since 
@@ -38,125 +108,338 @@ DoListSCSIDevices(void)
 		 * forced into "old-style" calls.
 		 */
 		if (gEnableNewSCSIManager)
-			status = SCSIGetHighHostBusAdaptor(&lastHostBus);
+			status = SCSIGetHighHostBusAdaptor(&gListScan.lastHostBus);
 		else {
 			status = noErr;
-			lastHostBus = 0;					/* Force one bus only			*/
+			gListScan.lastHostBus = 0;			/* Force one bus only			*/
 		}
-		if (status == noErr) {
-			for (bus = 0; bus <= lastHostBus; bus++) {
-				/*
-				 * Look at this SCSI bus. This would be a good place to allocate
-				 * the SCSIExecIO command block. In this sample, however, it's
-				 * allocated on each call to AsyncSCSI, though this is inefficient.
-				 * Note that it is possible to have busses with no devices. This
-				 * is true for Apple Macintosh models with two busses (such as
-				 * the Quadra 950 and PowerMac 8100). Also, if you install a
-				 * third-party bus adaptor that supports the asynchronous SCSI
-				 * Manager on a machine with two busses, it would be assigned
-				 * bus 2 (with busses 0 and 1 referencing the internal system
-				 * busses). In this case, a system could have no devices on bus
-				 * 0 or 1.
-				 */
-				*((long *) &scsiDevice) = 0;
-				scsiDevice.bus = bus;
+		gListScan.state = (status == noErr) ? kScanNextBus : kScanDone;
+		gListScan.shownProgress = 0xFFFF;
+		GetWTitle(gMainWindow, gListScan.windowTitle);
+		gScanInProgress = TRUE;
+		gUpdateMenusNeeded = TRUE;
+}
+
+/*
+ * Run the scan for one slice. Returns TRUE if it is still in progress.
+ */
+Boolean
+ContinueListSCSIDevices(void)
+{
+		unsigned long					startTicks;
+
+		if (gScanInProgress == FALSE)
+			return (FALSE);
+		startTicks = TickCount();
+		while (gListScan.state != kScanIdle
+			&& ScanStep()
+			&& (TickCount() - startTicks) < kScanSliceTicks)
+			;
+		if (gListScan.state != kScanIdle)
+			ShowScanProgress();
+		return (gScanInProgress);
+}
+
+void
+CancelListSCSIDevices(void)
+{
+		if (gScanInProgress)
+			FinishScan("\pScan cancelled");
+}
+
+/*
+ * Do one step of the scan. Returns FALSE if the scan must wait for the scan
+ * limiter: the rest of the slice is given back to the event loop.
+ */
+static Boolean
+ScanStep(void)
+{
+		OSErr							status;
+		SCSIGetVirtualIDInfoPB			scsiGetVirtualIDInfo;
+#define SCAN	(gListScan)
+
+		switch (SCAN.state) {
+		case kScanNextBus:
+			if (SCAN.scsiDevice.bus > SCAN.lastHostBus) {
 				/*
-				 * Check whether we can access this scsi device. SCSIBusAPI will
-				 * return an error status if this bus is inaccessable (i.e. no bus
-				 * or other trouble). If it returns noErr, useAsyncManager will
-				 * be TRUE if the asynchronous SCSI Manager is supported for this
-				 * bus, and FALSE if it can only be accessed through the original
-				 * SCSI Manager. This would indicate that a third-party bus
-				 * interface patched the original SCSI Manager traps (i.e.,
-				 * patched SCSIGet, SCSISelect, etc).
+				 * Now, we need to look at the hard-wired SCSI drive addresses
+				 * and check whether a third-party hardware interface that does
+				 * not use the asynchronous SCSI Manager recognizes this
+				 * address. If gEnableNewSCSIManager is FALSE, the bus scan
+				 * called the original SCSI Manager, so we don't have to try it
+				 * again. In this sequence, we hard-wire the initiator ID to
+				 * seven, as there is no supported way to determine it from the
+				 * SCSI Manager or operating system.
 				 */
-				status = SCSIBusAPI(scsiDevice, &useAsynchManager);
-				if (status == noErr) {
-					if (useAsynchManager)
-						status = SCSIGetInitiatorID(scsiDevice, &initiatorID);
-					else {
-						initiatorID = 7;	/* Asynch manager is disabled		*/
-					}
+				SCAN.state = (gEnableNewSCSIManager)
+						? kScanHardWiredTargets
+						: kScanDone;
+				SCAN.scsiDevice.bus = 0;
+				SCAN.scsiDevice.targetID = 0;
+				SCAN.scsiDevice.LUN = 0;
+				break;
+			}
+			/*
+			 * Look at this SCSI bus. This would be a good place to allocate
+			 * the SCSIExecIO command block. In this sample, however, it's
+			 * allocated on each call to AsyncSCSI, though this is inefficient.
+			 * Note that it is possible to have busses with no devices. This
+			 * is true for Apple Macintosh models with two busses (such as
+			 * the Quadra 950 and PowerMac 8100). Also, if you install a
+			 * third-party bus adaptor that supports the asynchronous SCSI
+			 * Manager on a machine with two busses, it would be assigned
+			 * bus 2 (with busses 0 and 1 referencing the internal system
+			 * busses). In this case, a system could have no devices on bus
+			 * 0 or 1.
+			 *
+			 * Check whether we can access this scsi device. SCSIBusAPI will
+			 * return an error status if this bus is inaccessable (i.e. no bus
+			 * or other trouble). If it returns noErr, useAsyncManager will
+			 * be TRUE if the asynchronous SCSI Manager is supported for this
+			 * bus, and FALSE if it can only be accessed through the original
+			 * SCSI Manager. This would indicate that a third-party bus
+			 * interface patched the original SCSI Manager traps (i.e.,
+			 * patched SCSIGet, SCSISelect, etc).
+			 */
+			SCAN.scsiDevice.targetID = 0;
+			SCAN.scsiDevice.LUN = 0;
+			status = SCSIBusAPI(SCAN.scsiDevice, &SCAN.useAsynchManager);
+			if (status == noErr) {
+				if (SCAN.useAsynchManager)
+					status = SCSIGetInitiatorID(
+								SCAN.scsiDevice, &SCAN.initiatorID);
+				else {
+					SCAN.initiatorID = 7;	/* Asynch manager is disabled		*/
 				}
-				if (status != noErr)
-					continue;
-				/*
-				 * SCSIGetInitiatorID returned the bus ID of the Macintosh. This
-				 * is almost always seven, but only the SCSI Manager knows for
-				 * sure. Note that, by getting the Macintosh bus ID dynamically,
-				 * we prepare the code for a future system that permitted more
-				 * than one Macintosh on the same SCSI bus.
-				 */
-				status = SCSIGetMaxTargetID(scsiDevice, &maxTarget);
-				for (targetID = 0; targetID <= maxTarget; targetID++) {
-					if (targetID != initiatorID) {
-						scsiDevice.targetID = targetID;
-						for (LUN = 0; LUN <= gMaxLogicalUnit; LUN++) {
-							/*
-							 * Try to send a command to this LUN. If it fails,
-							 * don't try for higher-valued LUNs.
-							 * SCSICheckForDevicePresent looks, carefully, at the
-							 * returned error to distinguish between missing
-							 * devices and devices that are present, but unable to
-							 * respond, such as CD-ROM players with no disk
-							 * inserted. This call to SCSICheckForDevicePresent
-							 * will use the asynchronous SCSI Manager if it can.
-							 *
-							 * Note that, if the asynchronous manager is not
-							 * available, we can still check for non-zero LUNs by
-							 * using the old method of stuffing the LUN into the
-							 * command block, however this is not supported in
-							 * this example.
-							 */
-							scsiDevice.LUN = LUN;
-							if (SCSICheckForDevicePresent(
-										scsiDevice, useAsynchManager) == FALSE)
-								break;					/* Don't look for LUNs	*/
-							else {
-								++deviceCount;			/* Found a device		*/
-								DoGetDriveInfo(scsiDevice, TRUE, useAsynchManager);
-							}							/* Check status			*/
-						}								/* LUN loop				*/
-					}									/* Not the initiator id	*/
-				}										/* Target loop			*/
-			}											/* Bus loop				*/
+			}
 			/*
-			 * Now, we need to look at the hard-wired SCSI drive addresses and
-			 * check whether a third-party hardware interface that does not use
-			 * the asynchronous SCSI Manager recognizes this address. If
-			 * gEnableNewSCSIManager is FALSE, the above loop called the original
-			 * SCSI Manager, so we don't have to try it again. In this sequence,
-			 * we hard-wire the initiator ID to seven, as there is no supported
-			 * way to determine it from the SCSI Manager or operating system.
+			 * SCSIGetInitiatorID returned the bus ID of the Macintosh. This
+			 * is almost always seven, but only the SCSI Manager knows for
+			 * sure. Note that, by getting the Macintosh bus ID dynamically,
+			 * we prepare the code for a future system that permitted more
+			 * than one Macintosh on the same SCSI bus.
 			 */
-			if (gEnableNewSCSIManager) {
-				scsiDevice.bus = 0;
-				for (targetID = 0; targetID <= 6; targetID++) {
-					 CLEAR(scsiGetVirtualIDInfo);
-					 scsiGetVirtualIDInfo.scsiPBLength = sizeof scsiGetVirtualIDInfo;
-					 scsiGetVirtualIDInfo.scsiOldCallID = targetID;
-					 status = SCSIAction((SCSI_PB *) &scsiGetVirtualIDInfo);
-					 if (status != noErr) {
-					 	/*
-					 	 * The asynchronous SCSI Manager does not know about this
-					 	 * target ID. Check whether it exists (forcing the request
-					 	 * to use the original SCSI Manager).
-					 	 */
-					 	scsiDevice.targetID = targetID;
-					 	for (LUN = 0; LUN <= gMaxLogicalUnit; LUN++) {
-					 		scsiDevice.LUN = LUN;
-							if (SCSICheckForDevicePresent(scsiDevice, FALSE) == FALSE)
-								break;					/* Don't look for LUNs	*/
-							else {
-								++deviceCount;			/* Found a device		*/
-								DoGetDriveInfo(scsiDevice, TRUE, FALSE);
-							}							/* Check status			*/
-						}
-					}
+			if (status == noErr)
+				status = SCSIGetMaxTargetID(SCAN.scsiDevice, &SCAN.maxTarget);
+			if (status == noErr) {
+				SCAN.state = kScanBusTargets;
+				SCAN.busStartTicks = TickCount();
+			}
+			else {
+				++SCAN.scsiDevice.bus;
+			}
+			break;
+		case kScanBusTargets:
+			if (SCAN.scsiDevice.targetID > SCAN.maxTarget) {
+				StatsExportScan(&gStatsExport, SCAN.scsiDevice.bus,
+					TickCount() - SCAN.busStartTicks);
+				++SCAN.scsiDevice.bus;
+				SCAN.state = kScanNextBus;
+			}
+			else if (SCAN.scsiDevice.targetID == SCAN.initiatorID)
+				++SCAN.scsiDevice.targetID;
+			else if (ScanLimiterTryStart(&SCAN.limiter) == FALSE)
+				return (FALSE);
+			else {
+				ProbeDevice(SCAN.useAsynchManager);
+			}
+			break;
+		case kScanHardWiredTargets:
+			if (SCAN.scsiDevice.targetID > kLastHardWiredTarget) {
+				SCAN.state = kScanDone;
+				break;
+			}
+			if (SCAN.scsiDevice.LUN == 0) {
+				CLEAR(scsiGetVirtualIDInfo);
+				scsiGetVirtualIDInfo.scsiPBLength = sizeof scsiGetVirtualIDInfo;
+				scsiGetVirtualIDInfo.scsiOldCallID = SCAN.scsiDevice.targetID;
+				status = SCSIAction((SCSI_PB *) &scsiGetVirtualIDInfo);
+				if (status == noErr) {
+					/*
+					 * The asynchronous SCSI Manager knows about this target
+					 * ID: the bus scan has already looked at it.
+					 */
+					++SCAN.scsiDevice.targetID;
+					break;
 				}
 			}
-		}												/* Found a host adaptor	*/
-		NumToString(deviceCount, work);
+			/*
+			 * The asynchronous SCSI Manager does not know about this target
+			 * ID. Check whether it exists (forcing the request to use the
+			 * original SCSI Manager).
+			 */
+			if (ScanLimiterTryStart(&SCAN.limiter) == FALSE)
+				return (FALSE);
+			ProbeDevice(FALSE);
+			break;
+		case kScanDone:
+			FinishScan(NULL);
+			break;
+		}
+		return (TRUE);
+#undef SCAN
+}
+
+/*
+ * Probe the device in gListScan.scsiDevice, then advance to the next LUN, or
+ * to the next target if there is no device (don't look for higher LUNs).
+ *
+ * SCSICheckForDevicePresent looks, carefully, at the returned error to
+ * distinguish between missing devices and devices that are present, but
+ * unable to respond, such as CD-ROM players with no disk inserted. It will
+ * use the asynchronous SCSI Manager if useAsynchManager is TRUE.
+ *
+ * Note that, if the asynchronous manager is not available, non-zero LUNs are
+ * reached by storing the LUN into the command block (OriginalSCSI does this
+ * for every command, including Request Sense). Missing logical units are
+ * recognized from the Inquiry peripheral qualifier or from an Illegal Request
+ * sense key.
+ */
+static void
+ProbeDevice(
+		Boolean					useAsynchManager
+	)
+{
+		Boolean					present;
+#define SCAN	(gListScan)
+
+		present = SCSICheckForDevicePresent(SCAN.scsiDevice, useAsynchManager);
+		ScanLimiterProbeDone(&SCAN.limiter);
+		if (present) {
+			++SCAN.deviceCount;
+			if (gEnableNewSCSIManager && useAsynchManager)
+				RememberDevice(SCAN.scsiDevice);
+			DoGetDriveInfo(SCAN.scsiDevice, TRUE, useAsynchManager);
+		}
+		if (present == FALSE || SCAN.scsiDevice.LUN >= gMaxLogicalUnit) {
+			++SCAN.scsiDevice.targetID;
+			SCAN.scsiDevice.LUN = 0;
+		}
+		else {
+			++SCAN.scsiDevice.LUN;
+		}
+#undef SCAN
+}
+
+/*
+ * Show the bus and target being probed in the window title. It is only
+ * redrawn when they change.
+ */
+static void
+ShowScanProgress(void)
+{
+		unsigned short			progress;
+		Str255					work;
+
+		progress = (gListScan.scsiDevice.bus << 8)
+				 | gListScan.scsiDevice.targetID;
+		if (progress == gListScan.shownProgress)
+			return;
+		gListScan.shownProgress = progress;
+		pstrcpy(work, "\pScanning bus ");
+		AppendUnsigned(work, gListScan.scsiDevice.bus);
+		pstrcat(work, "\p, target ");
+		AppendUnsigned(work, gListScan.scsiDevice.targetID);
+		pstrcat(work, "\p (Command-. to cancel)");
+		SetWTitle(gMainWindow, work);
+}
+
+/*
+ * End the scan: display the reason (if it didn't finish) and the devices
+ * found, and restore the window title.
+ */
+static void
+FinishScan(
+		ConstStr255Param		reason
+	)
+{
+		Str255					work;
+
+		if (reason != NULL)
+			LOG(reason);
+		NumToString(gListScan.deviceCount, work);
 		AppendPascalString(work, "\p SCSI Devices");
 		LOG(work);
-}		
+		if (gThrottleScan) {
+			pstrcpy(work, "\pThrottled scan: ");
+			AppendUnsigned(work, gListScan.limiter.statistics.probes);
+			pstrcat(work, "\p probes, waited ");
+			AppendUnsigned(work, gListScan.limiter.statistics.waitTicks);
+			pstrcat(work, "\p ticks");
+			LOG(work);
+		}
+		SetWTitle(gMainWindow, gListScan.windowTitle);
+		gListScan.state = kScanIdle;
+		gScanInProgress = FALSE;
+		gUpdateMenusNeeded = TRUE;
+}
+
+/*
+ * Add a device to gDeviceList, unless it is there already. The list grows
+ * kDeviceListIncrement entries at a time. If it can't grow, the device is
+ * left out (the scan continues).
+ */
+void
+RememberDevice(
+		DeviceIdent				scsiDevice
+	)
+{
+		static unsigned short	gDeviceListSize;	/* Entries allocated		*/
+		DeviceIdent				*newList;
+		register unsigned short	i;
+
+		if (FindDevice(scsiDevice) < gMaxDevice)
+			return;
+		if (gMaxDevice == gDeviceListSize) {
+			newList = (DeviceIdent *) NewPtr(
+					sizeof (DeviceIdent)
+					* (gDeviceListSize + kDeviceListIncrement));
+			if (newList == NULL)
+				return;
+			for (i = 0; i < gMaxDevice; i++)
+				newList[i] = gDeviceList[i];
+			if (gDeviceList != NULL)
+				DisposePtr((Ptr) gDeviceList);
+			gDeviceList = newList;
+			gDeviceListSize += kDeviceListIncrement;
+		}
+		gDeviceList[gMaxDevice++] = scsiDevice;
+}
+
+/*
+ * Remove a device from gDeviceList. The devices after it move down, so the
+ * list stays in the order they were found.
+ */
+void
+ForgetDevice(
+		DeviceIdent				scsiDevice
+	)
+{
+		register unsigned short	i;
+
+		i = FindDevice(scsiDevice);
+		if (i == gMaxDevice)
+			return;
+		--gMaxDevice;
+		for (; i < gMaxDevice; i++)
+			gDeviceList[i] = gDeviceList[i + 1];
+}
+
+/*
+ * Return the index of a device in gDeviceList, or gMaxDevice if it isn't there.
+ */
+static unsigned short
+FindDevice(
+		DeviceIdent				scsiDevice
+	)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < gMaxDevice; i++) {
+			if (gDeviceList[i].bus == scsiDevice.bus
+			 && gDeviceList[i].targetID == scsiDevice.targetID
+			 && gDeviceList[i].LUN == scsiDevice.LUN)
+				break;
+		}
+		return (i);
+}
@@ -0,0 +1,623 @@
+/*								DoMediaBenchmark.c								*/
+/*
+ * DoMediaBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure discovery and media I/O for removable media devices on the virtual
+ * SCSI bus. A CD-ROM player and a tape drive are added on the first two
+ * free virtual targets, and removed when the benchmark ends.
+ *	-- Discovery: SCSICheckForDevicePresent is timed with the CD-ROM player
+ *	   empty and with a disc, and with the tape drive. A disc is inserted in
+ *	   a player that reports Unit Attention even to Inquiry (as some older
+ *	   players do), which must still be found, and the time until the player
+ *	   is ready is measured by polling Test Unit Ready.
+ *	-- CD-ROM: the table of contents is read, and sequential reads are
+ *	   compared with random reads (which seek). The eject button is tried
+ *	   while removal is prevented, then the disc is ejected by command.
+ *	-- Tape: two files are written, then the first is read back, at once
+ *	   and with the host pausing between records (the drive can no longer
+ *	   stream, and must reposition for each record). Reads stop at the
+ *	   filemark, and at the end of data.
+ */
+#include "SCSISimpleSample.h"
+
+#define kProbeCount				20
+#define kReadyPollTicks			15L				/* Between Test Unit Ready	*/
+#define kReadyTimeoutTicks		(60L * 10L)
+#define kCDLatency				2L				/* msec						*/
+#define kCDSectors				250000L			/* About 500 MB				*/
+#define kCDFullStrokeSeek		200L			/* msec						*/
+#define kCDTransferRate			300L			/* 300 K/sec (double speed)	*/
+#define kCDLoadTime				1500L			/* Spin up (msec)			*/
+#define kCDReadSectors			16				/* 32K sequential reads		*/
+#define kCDSequentialReads		8
+#define kCDRandomReads			32
+#define kTapeLatency			1L				/* msec						*/
+#define kTapeBlocks				40000L			/* 20 MB					*/
+#define kTapeWindTime			60000L			/* End to end (msec)		*/
+#define kTapeTransferRate		500L			/* 500 K/sec				*/
+#define kTapeLoadTime			500L			/* msec						*/
+#define kTapeRecordBlocks		32				/* 16K records				*/
+#define kTapeFileRecords		48				/* 768K in the first file	*/
+#define kTapeFile2Records		8
+#define kTapePauseRecords		16
+#define kTapePauseTicks			3L				/* 50 msec					*/
+#define kMediaBufferSize		(kCDReadSectors * kVirtualCDBlockLength)
+#define kMediaSeed				1994L
+
+static unsigned long			gMediaSeed;
+
+static void						MediaCDROM(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr
+	);
+static void						MediaTape(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr
+	);
+static void						TimeProbes(
+		DeviceIdent				scsiDevice,
+		short					probeCount,
+		ConstStr255Param		label
+	);
+static Boolean					WaitForReady(
+		DeviceIdent				scsiDevice,
+		ConstStr255Param		label
+	);
+static unsigned long			ReadTapeRecords(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr,
+		unsigned long			maxRecords,
+		unsigned long			pauseTicks,
+		ScsiCmdBlockPtr			scsiCmdBlockPtr
+	);
+static OSErr					MediaCommand(
+		ScsiCmdBlockPtr			scsiCmdBlockPtr,
+		DeviceIdent				scsiDevice,
+		unsigned char			opcode,
+		unsigned char			flags,
+		unsigned long			count,
+		Ptr						bufferPtr,
+		unsigned long			transferSize,
+		Boolean					writeToDevice
+	);
+static void						ShowRate(
+		ConstStr255Param		label,
+		unsigned long			bytes,
+		unsigned long			elapsedTicks,
+		unsigned long			repositions
+	);
+static unsigned long			MediaRandom(void);
+
+void
+DoMediaBenchmark(void)
+{
+		unsigned short			bus;
+		unsigned short			cdTarget;
+		unsigned short			tapeTarget;
+		register VirtualTargetPtr	targetPtr;
+		DeviceIdent				scsiDevice;
+		Ptr						bufferPtr;
+		OSErr					status;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pRemovable Media Benchmark (virtual bus)");
+		for (cdTarget = 0; cdTarget < kVirtualMaxTarget; cdTarget++) {
+			if (VirtualSIMGetTarget(cdTarget)->commandProc == NULL)
+				break;
+		}
+		for (tapeTarget = cdTarget + 1;
+				tapeTarget < kVirtualMaxTarget;
+				tapeTarget++) {
+			if (VirtualSIMGetTarget(tapeTarget)->commandProc == NULL)
+				break;
+		}
+		if (tapeTarget >= kVirtualMaxTarget) {
+			LOG("\pTwo virtual targets must be free");
+			return;
+		}
+		bufferPtr = NewPtr(kMediaBufferSize);
+		if (bufferPtr == NULL) {
+			LOG("\pNo memory for benchmark buffers");
+			return;
+		}
+		/*
+		 * Neither device has storage: the CD-ROM player reads zeros, and the
+		 * tape drive discards what is written (but remembers its structure).
+		 */
+		status = VirtualSIMSetTarget(
+					cdTarget, VirtualCDROMCommand, kScsiDevTypeCDROM,
+					0L, kCDLatency, TRUE);
+		if (status == noErr)
+			status = VirtualSIMSetTarget(
+					tapeTarget, VirtualTapeCommand, kScsiDevTypeSequential,
+					0L, kTapeLatency, TRUE);
+		if (status != noErr)
+			DisplaySCSIErrorMessage(
+				status, "\pCan't setup the media benchmark");
+		else {
+			targetPtr = VirtualSIMGetTarget(cdTarget);
+			targetPtr->blockCount =
+				(kCDSectors * kVirtualCDBlockLength) / kVirtualBlockLength;
+			targetPtr->fullStrokeSeek = kCDFullStrokeSeek;
+			targetPtr->transferRate = kCDTransferRate;
+			targetPtr->loadTime = kCDLoadTime;
+			targetPtr = VirtualSIMGetTarget(tapeTarget);
+			targetPtr->blockCount = kTapeBlocks;
+			targetPtr->fullStrokeSeek = kTapeWindTime;
+			targetPtr->transferRate = kTapeTransferRate;
+			targetPtr->loadTime = kTapeLoadTime;
+			CLEAR(scsiDevice);
+			scsiDevice.bus = bus;
+			scsiDevice.targetID = cdTarget;
+			MediaCDROM(scsiDevice, bufferPtr);
+			scsiDevice.targetID = tapeTarget;
+			MediaTape(scsiDevice, bufferPtr);
+		}
+		(void) VirtualSIMSetTarget(cdTarget, NULL, 0, 0L, 0L, FALSE);
+		(void) VirtualSIMSetTarget(tapeTarget, NULL, 0, 0L, 0L, FALSE);
+		DisposePtr(bufferPtr);
+}
+
+/*
+ * Discovery and reads for the CD-ROM player, which starts empty.
+ */
+static void
+MediaCDROM(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		ScsiCmdBlock			scsiCmdBlock;
+		register short			i;
+		unsigned long			logicalBlock;
+		unsigned long			startTicks;
+		unsigned long			elapsedTicks;
+		Str255					work;
+#define SCB	(scsiCmdBlock)
+
+		targetPtr = VirtualSIMGetTarget(scsiDevice.targetID);
+		pstrcpy(work, "\pCD-ROM player (target ");
+		AppendUnsigned(work, scsiDevice.targetID);
+		pstrcat(work, "\p)");
+		LOG(work);
+		TimeProbes(scsiDevice, kProbeCount, "\p  Probe, no disc");
+		/*
+		 * SCSICheckForDevicePresent sees Check Condition (Unit Attention)
+		 * for its Inquiry: the player must still be found.
+		 */
+		targetPtr->inquiryAttention = TRUE;
+		(void) VirtualSIMSetMedia(scsiDevice.targetID, TRUE);
+		TimeProbes(scsiDevice, 1, "\p  Probe, disc just inserted");
+		targetPtr->inquiryAttention = FALSE;
+		if (WaitForReady(scsiDevice, "\p  Disc ready") == FALSE)
+			return;
+		TimeProbes(scsiDevice, kProbeCount, "\p  Probe, disc ready");
+		/*
+		 * Table of contents.
+		 */
+		CLEAR(SCB);
+		SCB.scsiDevice = scsiDevice;
+		SCB.command.scsi10.opcode = kScsiCmdReadCDTableOfContents;
+		SCB.command.scsi10.len1 = 20;
+		SCB.bufferPtr = bufferPtr;
+		SCB.transferSize = 20;
+		SCB.transferQuantum = 1;
+		DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+		if (SCB.status == noErr) {
+			logicalBlock =
+				  ((unsigned long) ((unsigned char *) bufferPtr)[16] << 24)
+				| ((unsigned long) ((unsigned char *) bufferPtr)[17] << 16)
+				| ((unsigned long) ((unsigned char *) bufferPtr)[18] << 8)
+				| ((unsigned char *) bufferPtr)[19];
+			pstrcpy(work, "\p  Table of contents: ");
+			AppendUnsigned(work, ((unsigned char *) bufferPtr)[3]);
+			pstrcat(work, "\p track, lead-out at sector ");
+			AppendUnsigned(work, logicalBlock);
+			LOG(work);
+		}
+		/*
+		 * Sequential, then random, reads.
+		 */
+		startTicks = TickCount();
+		for (i = 0; i < kCDSequentialReads; i++) {
+			CLEAR(SCB);
+			SCB.scsiDevice = scsiDevice;
+			logicalBlock = (unsigned long) i * kCDReadSectors;
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len1 = kCDReadSectors;
+			SCB.bufferPtr = bufferPtr;
+			SCB.transferSize = kCDReadSectors * kVirtualCDBlockLength;
+			SCB.transferQuantum = kVirtualCDBlockLength;
+			DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+			if (SCB.status != noErr)
+				return;
+		}
+		ShowRate(
+			"\p  Sequential reads (32K)",
+			(unsigned long) kCDSequentialReads
+				* kCDReadSectors * kVirtualCDBlockLength,
+			TickCount() - startTicks, 0L);
+		gMediaSeed = kMediaSeed;
+		startTicks = TickCount();
+		for (i = 0; i < kCDRandomReads; i++) {
+			CLEAR(SCB);
+			SCB.scsiDevice = scsiDevice;
+			logicalBlock = (MediaRandom() * 8L) % kCDSectors;
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len1 = 1;
+			SCB.bufferPtr = bufferPtr;
+			SCB.transferSize = kVirtualCDBlockLength;
+			SCB.transferQuantum = kVirtualCDBlockLength;
+			DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+			if (SCB.status != noErr)
+				return;
+		}
+		elapsedTicks = TickCount() - startTicks;
+		ShowRate(
+			"\p  Random reads (2K)",
+			(unsigned long) kCDRandomReads * kVirtualCDBlockLength,
+			elapsedTicks, 0L);
+		pstrcpy(work, "\p  Average random read: ");
+		AppendUnsigned(work, (elapsedTicks * 50L) / (3L * kCDRandomReads));
+		pstrcat(work, "\p msec");
+		LOG(work);
+		/*
+		 * The eject button does nothing while removal is prevented. Then
+		 * eject the disc by command, and check that the player notices.
+		 */
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdPreventAllowRemoval,
+				0, 1L, NULL, 0L, FALSE);
+		if (VirtualSIMSetMedia(scsiDevice.targetID, FALSE) == fBsyErr)
+			LOG("\p  Eject button ignored while removal is prevented");
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdPreventAllowRemoval,
+				0, 0L, NULL, 0L, FALSE);
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdStartStopUnit,
+				0, 0x02L, NULL, 0L, FALSE);				/* LoEj, Stop		*/
+		if (MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdTestUnitReady,
+				0, 0L, NULL, 0L, FALSE) == statusErr
+		 && (SCB.sense.senseKey & kScsiSenseKeyMask) == kScsiSenseNotReady
+		 && SCB.sense.additionalSenseCode == 0x3A)
+			LOG("\p  Disc ejected: Not Ready, medium not present");
+#undef SCB
+}
+
+/*
+ * Write two files to the tape, then read the first back: streaming, and with
+ * the host pausing between records.
+ */
+static void
+MediaTape(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		ScsiCmdBlock			scsiCmdBlock;
+		register short			i;
+		unsigned long			records;
+		unsigned long			repositions;
+		unsigned long			startTicks;
+		OSErr					status;
+		Str255					work;
+#define SCB	(scsiCmdBlock)
+
+		targetPtr = VirtualSIMGetTarget(scsiDevice.targetID);
+		pstrcpy(work, "\pTape drive (target ");
+		AppendUnsigned(work, scsiDevice.targetID);
+		pstrcat(work, "\p)");
+		LOG(work);
+		TimeProbes(scsiDevice, kProbeCount, "\p  Probe, no tape");
+		(void) VirtualSIMSetMedia(scsiDevice.targetID, TRUE);
+		if (WaitForReady(scsiDevice, "\p  Tape ready") == FALSE)
+			return;
+		/*
+		 * The first file, then a filemark, the second file, and a filemark.
+		 */
+		repositions = targetPtr->repositions;
+		startTicks = TickCount();
+		status = noErr;
+		for (i = 0; status == noErr && i < kTapeFileRecords; i++) {
+			status = MediaCommand(
+						&scsiCmdBlock, scsiDevice, kScsiCmdWrite6,
+						0x01, kTapeRecordBlocks,
+						bufferPtr,
+						kTapeRecordBlocks * kVirtualBlockLength, TRUE);
+		}
+		if (status == noErr)
+			ShowRate(
+				"\p  Write (streaming)",
+				(unsigned long) kTapeFileRecords
+					* kTapeRecordBlocks * kVirtualBlockLength,
+				TickCount() - startTicks, targetPtr->repositions - repositions);
+		if (status == noErr)
+			status = MediaCommand(
+						&scsiCmdBlock, scsiDevice, kScsiCmdWriteFilemarks,
+						0, 1L, NULL, 0L, FALSE);
+		for (i = 0; status == noErr && i < kTapeFile2Records; i++) {
+			status = MediaCommand(
+						&scsiCmdBlock, scsiDevice, kScsiCmdWrite6,
+						0x01, kTapeRecordBlocks,
+						bufferPtr,
+						kTapeRecordBlocks * kVirtualBlockLength, TRUE);
+		}
+		if (status == noErr)
+			status = MediaCommand(
+						&scsiCmdBlock, scsiDevice, kScsiCmdWriteFilemarks,
+						0, 1L, NULL, 0L, FALSE);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't write the tape");
+			return;
+		}
+		startTicks = TickCount();
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdRewind,
+				0, 0L, NULL, 0L, FALSE);
+		pstrcpy(work, "\p  Rewind: ");
+		AppendUnsigned(work, ((TickCount() - startTicks) * 50L) / 3L);
+		pstrcat(work, "\p msec");
+		LOG(work);
+		/*
+		 * Read the first file to its filemark, as fast as we can.
+		 */
+		repositions = targetPtr->repositions;
+		startTicks = TickCount();
+		records = ReadTapeRecords(scsiDevice, bufferPtr, 0L, 0L, &scsiCmdBlock);
+		ShowRate(
+			"\p  Read (streaming)",
+			records * kTapeRecordBlocks * kVirtualBlockLength,
+			TickCount() - startTicks, targetPtr->repositions - repositions);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, records);
+		if (SCB.status == statusErr
+		 && (SCB.sense.senseKey & kScsiSenseFileMark) != 0)
+			pstrcat(work, "\p records, then a filemark");
+		else {
+			pstrcat(work, "\p records, no filemark");
+		}
+		LOG(work);
+		/*
+		 * Read part of it again, pausing between records.
+		 */
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdRewind,
+				0, 0L, NULL, 0L, FALSE);
+		repositions = targetPtr->repositions;
+		startTicks = TickCount();
+		records = ReadTapeRecords(
+					scsiDevice, bufferPtr,
+					kTapePauseRecords, kTapePauseTicks, &scsiCmdBlock);
+		ShowRate(
+			"\p  Read (host pauses 50 msec)",
+			records * kTapeRecordBlocks * kVirtualBlockLength,
+			TickCount() - startTicks, targetPtr->repositions - repositions);
+		/*
+		 * Space over the rest of the first file and the second: a read must
+		 * then find the end of data.
+		 */
+		startTicks = TickCount();
+		status = MediaCommand(
+					&scsiCmdBlock, scsiDevice, kScsiCmdSpace,
+					0x01, 2L, NULL, 0L, FALSE);
+		pstrcpy(work, "\p  Space 2 filemarks: ");
+		AppendUnsigned(work, ((TickCount() - startTicks) * 50L) / 3L);
+		pstrcat(work, "\p msec");
+		LOG(work);
+		if (status == noErr) {
+			(void) ReadTapeRecords(
+							scsiDevice, bufferPtr, 1L, 0L, &scsiCmdBlock);
+			if (SCB.status == statusErr
+			 && (SCB.sense.senseKey & kScsiSenseKeyMask)
+					== kScsiSenseBlankCheck)
+				LOG("\p  Read at the end of data: Blank Check");
+		}
+		(void) MediaCommand(
+				&scsiCmdBlock, scsiDevice, kScsiCmdLoadUnload,
+				0, 0L, NULL, 0L, FALSE);
+#undef SCB
+}
+
+/*
+ * Time probeCount calls of SCSICheckForDevicePresent, stopping at the first
+ * that doesn't find the device.
+ */
+static void
+TimeProbes(
+		DeviceIdent				scsiDevice,
+		short					probeCount,
+		ConstStr255Param		label
+	)
+{
+		register short			i;
+		Boolean					present;
+		unsigned long			startTicks;
+		Str255					work;
+
+		present = FALSE;
+		startTicks = TickCount();
+		for (i = 0; i < probeCount; i++) {
+			present = SCSICheckForDevicePresent(scsiDevice, TRUE);
+			if (present == FALSE) {
+				++i;
+				break;
+			}
+		}
+		pstrcpy(work, label);
+		pstrcat(work, (present) ? "\p: found, " : "\p: not found, ");
+		AppendUnsigned(work, ((TickCount() - startTicks) * 50L) / (3L * i));
+		pstrcat(work, "\p msec per probe");
+		LOG(work);
+}
+
+/*
+ * Poll with Test Unit Ready until the device is ready, as a driver would
+ * after the media is inserted. Display the time this took, and the
+ * responses. Returns FALSE if the device did not become ready.
+ */
+static Boolean
+WaitForReady(
+		DeviceIdent				scsiDevice,
+		ConstStr255Param		label
+	)
+{
+		ScsiCmdBlock			scsiCmdBlock;
+		unsigned long			startTicks;
+		unsigned long			pollTicks;
+		unsigned short			attentions;
+		unsigned short			notReady;
+		OSErr					status;
+		Str255					work;
+#define SCB	(scsiCmdBlock)
+
+		attentions = 0;
+		notReady = 0;
+		startTicks = TickCount();
+		for (;;) {
+			status = MediaCommand(
+						&scsiCmdBlock, scsiDevice, kScsiCmdTestUnitReady,
+						0, 0L, NULL, 0L, FALSE);
+			if (status != statusErr)
+				break;
+			if ((SCB.sense.senseKey & kScsiSenseKeyMask) == kScsiSenseUnitAtn)
+				++attentions;
+			else if ((SCB.sense.senseKey & kScsiSenseKeyMask)
+					== kScsiSenseNotReady)
+				++notReady;
+			else {
+				break;
+			}
+			if (TickCount() - startTicks >= kReadyTimeoutTicks)
+				break;
+			pollTicks = TickCount();
+			while (TickCount() - pollTicks < kReadyPollTicks)
+				SystemTask();
+		}
+		if (status != noErr) {
+			ShowRequestSense(&scsiCmdBlock);
+			return (FALSE);
+		}
+		pstrcpy(work, label);
+		pstrcat(work, "\p after ");
+		AppendUnsigned(work, ((TickCount() - startTicks) * 50L) / 3L);
+		pstrcat(work, "\p msec: ");
+		AppendUnsigned(work, attentions);
+		pstrcat(work, "\p Unit Attention, ");
+		AppendUnsigned(work, notReady);
+		pstrcat(work, "\p Not Ready");
+		LOG(work);
+		return (TRUE);
+#undef SCB
+}
+
+/*
+ * Read records (fixed-length, kTapeRecordBlocks each) until a read fails,
+ * or maxRecords (if it is not zero) have been read, pausing pauseTicks
+ * before each. Returns the number of records read: the failed command (if
+ * any) is left in *scsiCmdBlockPtr.
+ */
+static unsigned long
+ReadTapeRecords(
+		DeviceIdent				scsiDevice,
+		Ptr						bufferPtr,
+		unsigned long			maxRecords,
+		unsigned long			pauseTicks,
+		ScsiCmdBlockPtr			scsiCmdBlockPtr
+	)
+{
+		unsigned long			records;
+		unsigned long			startTicks;
+
+		for (records = 0; maxRecords == 0 || records < maxRecords; records++) {
+			startTicks = TickCount();
+			while (TickCount() - startTicks < pauseTicks)
+				SystemTask();
+			if (MediaCommand(
+					scsiCmdBlockPtr, scsiDevice, kScsiCmdRead6,
+					0x01, kTapeRecordBlocks,
+					bufferPtr,
+					kTapeRecordBlocks * kVirtualBlockLength, FALSE) != noErr)
+				break;
+		}
+		return (records);
+}
+
+/*
+ * Issue a six-byte command, with flags in its second byte and a count in
+ * the last three, without displaying errors. Returns its status.
+ */
+static OSErr
+MediaCommand(
+		ScsiCmdBlockPtr			scsiCmdBlockPtr,
+		DeviceIdent				scsiDevice,
+		unsigned char			opcode,
+		unsigned char			flags,
+		unsigned long			count,
+		Ptr						bufferPtr,
+		unsigned long			transferSize,
+		Boolean					writeToDevice
+	)
+{
+#define SCB	(*scsiCmdBlockPtr)
+		CLEAR(SCB);
+		SCB.scsiDevice = scsiDevice;
+		SCB.command.scsi[0] = opcode;
+		SCB.command.scsi[1] = flags;
+		SCB.command.scsi[2] = count >> 16;
+		SCB.command.scsi[3] = count >> 8;
+		SCB.command.scsi[4] = count;
+		SCB.bufferPtr = bufferPtr;
+		SCB.transferSize = transferSize;
+		SCB.transferQuantum = kVirtualBlockLength;
+		SCB.writeToDevice = writeToDevice;
+		DoSCSICommandWithSense(scsiCmdBlockPtr, FALSE, TRUE);
+		return (SCB.status);
+#undef SCB
+}
+
+static void
+ShowRate(
+		ConstStr255Param		label,
+		unsigned long			bytes,
+		unsigned long			elapsedTicks,
+		unsigned long			repositions
+	)
+{
+		Str255					work;
+
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, label);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, ((bytes / 1024L) * 60L) / elapsedTicks);
+		pstrcat(work, "\p K/sec");
+		if (repositions != 0) {
+			pstrcat(work, "\p, ");
+			AppendUnsigned(work, repositions);
+			pstrcat(work, "\p repositions");
+		}
+		LOG(work);
+}
+
+/*
+ * The same generator as DoSchedulerBenchmark: every run reads the same
+ * sectors.
+ */
+static unsigned long
+MediaRandom(void)
+{
+		gMediaSeed = gMediaSeed * 1103515245L + 12345L;
+		return ((gMediaSeed >> 16) & 0x7FFF);
+}
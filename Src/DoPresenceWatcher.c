@@ -0,0 +1,138 @@
+/*									DoPresenceWatcher.c							*/
+/*
+ * DoPresenceWatcher.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Start watching for devices that are connected and disconnected (see
+ * PresenceWatcher.h) or, if the watcher is running, stop it and display the
+ * load that its probes put on each bus. The watcher relies on the health
+ * monitor to poll the devices that are present, so the monitor must be
+ * running. Each device that is added or removed is logged, and gDeviceList
+ * is updated, so that the sweep commands see the current devices.
+ */
+#include "SCSISimpleSample.h"
+
+static void						ShowPresenceEvent(
+		PresenceWatcherPtr		watcherPtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			event
+	);
+static void						ShowProbeLoad(
+		PresenceWatcherPtr		watcherPtr
+	);
+
+void
+DoPresenceWatcher(void)
+{
+		register unsigned short	i;
+		unsigned short			emptyCount;
+		OSErr					status;
+		Str255					work;
+
+		if (gPresenceWatcher.active) {
+			PresenceWatcherStop(&gPresenceWatcher);
+			LOG("\pPresence watcher stopped");
+			ShowProbeLoad(&gPresenceWatcher);
+			gUpdateMenusNeeded = TRUE;
+			return;
+		}
+		if (gHealthMonitor.active == FALSE) {
+			LOG("\pNo health monitor: start the Health Monitor first");
+			return;
+		}
+		status = PresenceWatcherStart(
+					&gPresenceWatcher, &gSCSIEnvironment, &gHealthMonitor,
+					gDeviceList, gMaxDevice, ShowPresenceEvent, 0L);
+		if (status != noErr)
+			DisplaySCSIErrorMessage(
+				status, "\pCan't start the presence watcher");
+		else {
+			emptyCount = 0;
+			for (i = 0; i < gPresenceWatcher.targetCount; i++) {
+				if (gPresenceWatcher.target[i].populated == FALSE)
+					++emptyCount;
+			}
+			pstrcpy(work, "\pPresence watcher probing ");
+			AppendUnsigned(work, emptyCount);
+			pstrcat(work, "\p empty target IDs (of ");
+			AppendUnsigned(work, gPresenceWatcher.targetCount);
+			pstrcat(work, "\p) on ");
+			AppendUnsigned(work, gPresenceWatcher.busCount);
+			pstrcat(work, "\p buses");
+			LOG(work);
+		}
+		gUpdateMenusNeeded = TRUE;
+}
+
+/*
+ * Log a device that was added or removed, and update gDeviceList.
+ */
+static void
+ShowPresenceEvent(
+		PresenceWatcherPtr		watcherPtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			event
+	)
+{
+		Str255					work;
+
+		pstrcpy(work, "\pPresence: ");
+		AppendDeviceID(work, scsiDevice);
+		if (event == kPresenceAdd) {
+			RememberDevice(scsiDevice);
+			pstrcat(work, "\p: connected");
+		}
+		else {
+			ForgetDevice(scsiDevice);
+			pstrcat(work, "\p: disconnected");
+		}
+		LOG(work);
+}
+
+/*
+ * For each bus: the probes, and the part of the time that a round was in
+ * progress on it.
+ */
+static void
+ShowProbeLoad(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		register PresenceBus	*busPtr;
+		register unsigned short	i;
+		unsigned long			elapsedTicks;
+		Str255					work;
+
+		elapsedTicks = TickCount() - watcherPtr->startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, watcherPtr->rounds);
+		pstrcat(work, "\p rounds, ");
+		AppendUnsigned(work, watcherPtr->probes);
+		pstrcat(work, "\p probes (");
+		AppendUnsigned(work, watcherPtr->errors);
+		pstrcat(work, "\p inconclusive), ");
+		AppendUnsigned(work, watcherPtr->added);
+		pstrcat(work, "\p added, ");
+		AppendUnsigned(work, watcherPtr->removed);
+		pstrcat(work, "\p removed in ");
+		AppendUnsigned(work, elapsedTicks / 60L);
+		pstrcat(work, "\p seconds");
+		LOG(work);
+		for (i = 0; i < watcherPtr->busCount; i++) {
+			busPtr = &watcherPtr->bus[i];
+			pstrcpy(work, "\p  Bus ");
+			AppendUnsigned(work, busPtr->busID);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, busPtr->probes);
+			pstrcat(work, "\p probes (");
+			AppendUnsigned(work, (busPtr->probes * 3600L) / elapsedTicks);
+			pstrcat(work, "\p per minute), busy ");
+			AppendUnsigned(work, busPtr->busyTicks);
+			pstrcat(work, "\p ticks (");
+			AppendUnsigned(work, (busPtr->busyTicks * 100L) / elapsedTicks);
+			pstrcat(work, "\p%)");
+			LOG(work);
+		}
+}
@@ -0,0 +1,443 @@
+/*								DoSCSICommandBatch.c							*/
+/*
+ * DoSCSICommandBatch.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Execute a sequence of commands for one device in a single submission. Each
+ * call to DoSCSICommandWithSense pays for a Bus Inquiry, a parameter block
+ * allocation, and a set of virtual memory holds. Here, these are done once
+ * for the entire sequence, and the commands are submitted together:
+ *	-- If the bus supports linked commands (scsiBusLinkedCDB), the Link bit is
+ *	   set in each command's control byte, the parameter blocks are chained
+ *	   through scsiCommandLink, and the chain is passed to SCSIAction as one
+ *	   request. The target stays connected from one command to the next. If a
+ *	   command fails, the link is broken and the SIM does not execute the
+ *	   commands that follow it.
+ *	-- Otherwise, all parameter blocks are queued before we wait for the first
+ *	   to complete, so the SIM starts each command as soon as the previous one
+ *	   finishes.
+ *	-- If the asynchronous SCSI Manager is not available, the commands are
+ *	   executed one at a time by DoSCSICommandWithSense.
+ * In all cases, each command block receives its own status, sense data, and
+ * transfer count, exactly as if it had been passed to DoSCSICommandWithSense.
+ *
+ * A target that does not support linked commands rejects a command with the
+ * Link bit set (Check Condition, Illegal Request). If the first command of a
+ * linked chain is rejected this way, the batch is resubmitted without links.
+ *
+ * A command that finds the target Busy (or its queue full) is retried as
+ * DoSCSICommandWithSense retries it (see SCSIEnvironment.h). After a pause,
+ * the batch is resubmitted from the first such command to the end, so the
+ * commands still reach the device in order (and those after it that had
+ * completed are executed again). Each command's busyRetries counts the
+ * resubmissions that it was Busy for.
+ */
+#include <Gestalt.h>
+#include "SCSISimpleSample.h"
+
+/*
+ * The watchdog table has room for eight requests: a larger batch is executed
+ * one command at a time.
+ */
+#define kMaxBatchCommands		8
+
+/*
+ * These are bitmasks for the vmHoldMask variable. A bit is set if its
+ * associated memory element has been held in protected (non-paged) memory.
+ * The user data and sense buffers are recorded separately for each command.
+ */
+#define kHoldFunction			0x0001				/* SubmitBatch function code	*/
+#define kHoldStack				0x0002				/* Local variables			*/
+#define kHoldParamBlock			0x0010				/* SCSIExecIOPB array		*/
+
+static OSErr					SubmitBatch(
+		SCSIEnvironmentPtr		environmentPtr,
+		ScsiCmdBlockPtr			scsiCmdBlockArray,
+		unsigned short			cmdCount,
+		const SCSIBusInquiryPB	*busInquiryPBPtr,
+		Boolean					linkCommands
+	);
+static pascal void				BatchCompletion(
+		void					*scsiPB
+	);
+static void 					NextFunction(void);		/* For HoldMemory size	*/
+static Boolean					IsVirtualMemoryRunning(void);
+
+/*
+ * Execute cmdCount commands from scsiCmdBlockArray. All commands must be for
+ * the same device. Returns the status of the first command that failed (or
+ * noErr if all succeeded): the individual results are in each SCB.status.
+ */
+OSErr
+DoSCSICommandBatch(
+		ScsiCmdBlockPtr			scsiCmdBlockArray,		/* -> Commands, in order	*/
+		unsigned short			cmdCount,				/* -> Number of commands	*/
+		Boolean					displayError,
+		Boolean					enableAsynchSCSI
+	)
+{
+		OSErr					status;
+		SCSIBusInquiryPB		busInquiryPB;
+		Boolean					linkCommands;
+		SCSIBusyRetry			busyRetry;
+		unsigned short			first;
+		register short			i;
+#define SCB	(scsiCmdBlockArray[i])
+
+		if (cmdCount == 0)
+			return (noErr);
+		for (i = 0; i < cmdCount; i++)
+			SCB.busyRetries = 0;
+		status = noErr;
+		if (enableAsynchSCSI == FALSE
+		 || gEnableNewSCSIManager == FALSE
+		 || cmdCount > kMaxBatchCommands)
+			status = unimpErr;
+		else {
+			/*
+			 * One Bus Inquiry serves the entire batch.
+			 */
+			CLEAR(busInquiryPB);
+			busInquiryPB.scsiPBLength = sizeof busInquiryPB;
+			busInquiryPB.scsiFunctionCode = SCSIBusInquiry;
+			busInquiryPB.scsiDevice = scsiCmdBlockArray[0].scsiDevice;
+			SCSIAction((SCSI_PB *) &busInquiryPB);
+			status = busInquiryPB.scsiResult;
+		}
+		if (status == noErr) {
+			linkCommands = (cmdCount > 1
+					&& (busInquiryPB.scsiHBAInquiry & scsiBusLinkedCDB) != 0);
+			SCSIBusyRetryInit(&busyRetry);
+			status = SubmitBatch(
+						&gSCSIEnvironment,
+						scsiCmdBlockArray, cmdCount,
+						&busInquiryPB, linkCommands);
+			if (status == noErr
+			 && linkCommands
+			 && scsiCmdBlockArray[0].status == statusErr
+			 && (scsiCmdBlockArray[0].sense.senseKey & kScsiSenseKeyMask)
+					== kScsiSenseIllegalReq) {
+				/*
+				 * The device does not support linked commands.
+				 */
+				VERBOSE("\pLinked commands rejected, resubmitting batch");
+				linkCommands = FALSE;
+				status = SubmitBatch(
+							&gSCSIEnvironment,
+							scsiCmdBlockArray, cmdCount, &busInquiryPB, FALSE);
+			}
+			while (status == noErr) {
+				for (first = 0; first < cmdCount; first++) {
+					if (scsiCmdBlockArray[first].status == controlErr)
+						break;
+				}
+				if (first >= cmdCount || SCSIBusyRetryNext(&busyRetry) == FALSE)
+					break;
+				/*
+				 * The device did not execute this command: pause, and
+				 * resubmit the rest of the batch.
+				 */
+				for (i = first; i < cmdCount; i++) {
+					if (SCB.status == controlErr)
+						++SCB.busyRetries;
+				}
+				while (TickCount() < busyRetry.resumeTicks)
+					SCSIEnvironmentIdle(&gSCSIEnvironment);
+				status = SubmitBatch(
+							&gSCSIEnvironment,
+							&scsiCmdBlockArray[first], cmdCount - first,
+							&busInquiryPB,
+							linkCommands && (cmdCount - first) > 1);
+			}
+		}
+		if (status == unimpErr) {
+			/*
+			 * Call the original SCSI Manager (or do one command at a time).
+			 */
+			for (i = 0; i < cmdCount; i++)
+				DoSCSICommandWithSense(&SCB, displayError, enableAsynchSCSI);
+		}
+		else {
+			for (i = 0; i < cmdCount; i++) {
+				if (status != noErr)
+					SCB.status = status;				/* Setup failed		*/
+				CheckSCSICommandStatus(&SCB, displayError);
+			}
+		}
+		/*
+		 * Return the status of the first command that failed.
+		 */
+		for (i = 0; i < cmdCount; i++) {
+			if (SCB.status != noErr)
+				return (SCB.status);
+		}
+		return (noErr);
+#undef SCB
+}
+
+/*
+ * Build, hold, and submit the parameter blocks, then wait for all of them to
+ * complete. Returns noErr if the batch was submitted: the results of the
+ * individual commands are then in SCB.status. Otherwise, returns the error.
+ * Like AsyncSCSI, this uses only the state in its SCSIEnvironment.
+ */
+static OSErr
+SubmitBatch(
+		SCSIEnvironmentPtr		environmentPtr,
+		ScsiCmdBlockPtr			scsiCmdBlockArray,
+		unsigned short			cmdCount,
+		const SCSIBusInquiryPB	*busInquiryPBPtr,
+		Boolean					linkCommands
+	)
+{
+		OSErr					status;				/* Result code				*/
+		Ptr						execIOPBArray;		/* All parameter blocks		*/
+		register SCSIExecIOPB	*execIOPBPtr;		/* Current parameter block	*/
+		unsigned long			execIOPBSize;		/* SCSIAction pb size		*/
+		register ScsiCmdBlockPtr	scsiCmdBlockPtr;	/* Current command block	*/
+		unsigned short			cmdBlockLength;		/* Current CDB length		*/
+		Boolean					selectWithATNSafe;	/* Bus can select w/ATN?	*/
+		Boolean					inProgress;			/* TRUE while waiting		*/
+		register short			i;					/* Command index			*/
+		short					j;					/* Move command block index	*/
+		Boolean					bufferHeld[kMaxBatchCommands];
+		Boolean					senseHeld[kMaxBatchCommands];
+		unsigned short			vmHoldMask;
+		unsigned long			vmFunctionSize;
+		void					*vmProtectedStackBase;	/* Last local var	*/
+#define SCB						(*scsiCmdBlockPtr)
+#define PB						(*execIOPBPtr)
+#define BatchPB(i)														\
+		((SCSIExecIOPB *) (execIOPBArray + (i) * execIOPBSize))
+/*
+ * These values are used to compute the size of the stack that we must hold in
+ * protected (non-virtual) memory. kSCSIManagerStackEstimate is an estimate.
+ */
+#define kSCSILocalVariableSize	( \
+		(unsigned long) (((Ptr) &status) - ((Ptr) &vmProtectedStackBase))	\
+	)
+#define kSCSIManagerStackEstimate 512
+#define kSCSIProtectedStackSize (kSCSIManagerStackEstimate + kSCSILocalVariableSize)
+
+		status = noErr;
+		vmHoldMask = 0;
+		for (i = 0; i < kMaxBatchCommands; i++) {
+			bufferHeld[i] = FALSE;
+			senseHeld[i] = FALSE;
+		}
+		/*
+		 * Allocate all of the parameter blocks in one block, using the size
+		 * that was returned in the busInquiry parameter block.
+		 */
+		execIOPBSize = busInquiryPBPtr->scsiIOpbSize;
+		execIOPBArray = NewPtrClear(execIOPBSize * cmdCount);
+		if (execIOPBArray == NULL)
+			return (MemError());
+		selectWithATNSafe =
+			(busInquiryPBPtr->scsiWeirdStuff & scsiTargetDrivenSDTRSafe) != 0;
+		/*
+		 * Setup a parameter block for each command. This follows AsyncSCSI,
+		 * except that the command block's scsiFlags are passed to the SIM.
+		 */
+		for (i = 0; i < cmdCount && status == noErr; i++) {
+			scsiCmdBlockPtr = &scsiCmdBlockArray[i];
+			execIOPBPtr = BatchPB(i);
+			SCB.command.scsi[1] &= ~0xE0;
+			SCB.command.scsi[1] |= (SCB.scsiDevice.LUN & 0x07) << 5;
+			cmdBlockLength = SCSIGetCommandLength((Ptr) &SCB.command);
+			if (cmdBlockLength == 0) {
+				status = paramErr;
+				break;
+			}
+			SCB.status = noErr;
+			SCB.statusByte = 0;
+			SCB.actualTransferCount = 0;
+			PB.scsiPBLength = execIOPBSize;
+			PB.scsiFunctionCode = SCSIExecIO;
+			PB.scsiTimeout = kScsiSpinUpCompletionTime;
+			PB.scsiDevice = SCB.scsiDevice;
+			PB.scsiCDBLength = cmdBlockLength;
+			for (j = 0; j < cmdBlockLength; j++)
+				PB.scsiCDB.cdbBytes[j] = SCB.command.scsi[j];
+			PB.scsiFlags = scsiSIMQNoFreeze | SCB.scsiFlags;
+			if (SCB.bufferPtr == NULL || SCB.transferSize == 0)
+				PB.scsiFlags |= scsiDirectionNone;
+			else {
+				PB.scsiDataPtr = (unsigned char *) SCB.bufferPtr;
+				PB.scsiDataLength = SCB.transferSize;
+				PB.scsiDataType = scsiDataBuffer;
+				PB.scsiFlags |=
+					(SCB.writeToDevice) ? scsiDirectionOut : scsiDirectionIn;
+				if (SCB.transferQuantum == 1)
+					PB.scsiTransferType = scsiTransferPolled;
+				else {
+					PB.scsiTransferType = scsiTransferBlind;
+					PB.scsiHandshake[0] = SCB.transferQuantum;
+				}
+			}
+			SCB.sense.errorCode = 0;
+			PB.scsiSensePtr = (unsigned char *) &SCB.sense;
+			PB.scsiSenseLength = sizeof SCB.sense;
+			DevicePolicyApply(
+				&environmentPtr->policy, SCB.scsiDevice,
+				selectWithATNSafe, &PB.scsiFlags, &PB.scsiIOFlags);
+			PB.scsiCompletion = (CallbackProc) BatchCompletion;
+			if (linkCommands && i < cmdCount - 1) {
+				/*
+				 * Link this command to the next one. The SIM will set its
+				 * scsiResult when it starts the command.
+				 */
+				PB.scsiCDB.cdbBytes[cmdBlockLength - 1] |= kScsiControlLink;
+				PB.scsiFlags |= scsiCDBLinked;
+				PB.scsiCommandLink = (SCSI_IO *) BatchPB(i + 1);
+				BatchPB(i + 1)->scsiResult = scsiRequestInProgress;
+			}
+		}
+		/*
+		 * Hold everything that the SCSI Manager may touch while the batch
+		 * is in progress. See AsyncSCSI.c for a detailed explanation.
+		 */
+		if (status == noErr && IsVirtualMemoryRunning()) {
+			vmFunctionSize =
+				(unsigned long) NextFunction - (unsigned long) SubmitBatch;
+			status = HoldMemory(SubmitBatch, vmFunctionSize);
+			if (status == noErr) {
+				vmHoldMask |= kHoldFunction;
+				vmProtectedStackBase =
+					(char *) &vmProtectedStackBase - kSCSIManagerStackEstimate;
+				status = HoldMemory(
+							vmProtectedStackBase, kSCSIProtectedStackSize);
+				if (status == noErr)
+					vmHoldMask |= kHoldStack;
+			}
+			if (status == noErr) {
+				status = HoldMemory(execIOPBArray, execIOPBSize * cmdCount);
+				if (status == noErr)
+					vmHoldMask |= kHoldParamBlock;
+			}
+			for (i = 0; i < cmdCount && status == noErr; i++) {
+				execIOPBPtr = BatchPB(i);
+				if (PB.scsiDataPtr != NULL) {
+					status = HoldMemory(PB.scsiDataPtr, PB.scsiDataLength);
+					bufferHeld[i] = (status == noErr);
+				}
+				if (status == noErr) {
+					status = HoldMemory(PB.scsiSensePtr, PB.scsiSenseLength);
+					senseHeld[i] = (status == noErr);
+				}
+			}
+		}
+		/*
+		 * Submit the batch. If the commands are linked, only the first
+		 * parameter block is passed to SCSIAction. Otherwise, all parameter
+		 * blocks are queued before we wait for any of them. The watchdog
+		 * recovers any request that does not complete.
+		 */
+		if (status == noErr) {
+			for (i = 0; i < cmdCount; i++) {
+				scsiCmdBlockPtr = &scsiCmdBlockArray[i];
+				execIOPBPtr = BatchPB(i);
+				(void) SCSIWatchdogStart(&environmentPtr->watchdog, &PB);
+				if (linkCommands == FALSE || i == 0)
+					SCB.status = SCSIAction((SCSI_PB *) &PB);
+				else {
+					/*
+					 * If the chain could not be submitted, its linked
+					 * commands will never start.
+					 */
+					SCB.status = scsiCmdBlockArray[0].status;
+				}
+			}
+			do {
+				inProgress = FALSE;
+				for (i = 0; i < cmdCount; i++) {
+					if (scsiCmdBlockArray[i].status == noErr
+					 && BatchPB(i)->scsiResult == scsiRequestInProgress)
+						inProgress = TRUE;
+				}
+				if (inProgress) {
+					SCSIWatchdogIdle(&environmentPtr->watchdog);
+					SCSIEnvironmentIdle(environmentPtr);
+				}
+			} while (inProgress);
+			for (i = 0; i < cmdCount; i++) {
+				scsiCmdBlockPtr = &scsiCmdBlockArray[i];
+				execIOPBPtr = BatchPB(i);
+				if (SCB.status == noErr)
+					SCB.status = PB.scsiResult;
+				SCB.status = SCSIWatchdogFinish(
+							&environmentPtr->watchdog, &PB, SCB.status);
+			}
+		}
+		/*
+		 * Unhold memory, ignoring UnholdMemory errors.
+		 */
+		for (i = 0; i < cmdCount; i++) {
+			execIOPBPtr = BatchPB(i);
+			if (senseHeld[i])
+				(void) UnholdMemory(PB.scsiSensePtr, PB.scsiSenseLength);
+			if (bufferHeld[i])
+				(void) UnholdMemory(PB.scsiDataPtr, PB.scsiDataLength);
+		}
+		if ((vmHoldMask & kHoldParamBlock) != 0)
+			(void) UnholdMemory(execIOPBArray, execIOPBSize * cmdCount);
+		if ((vmHoldMask & kHoldStack) != 0)
+			(void) UnholdMemory(vmProtectedStackBase, kSCSIProtectedStackSize);
+		if ((vmHoldMask & kHoldFunction) != 0)
+			(void) UnholdMemory(SubmitBatch, vmFunctionSize);
+		/*
+		 * Recover the results, as AsyncSCSI does: ignore short reads, convert
+		 * a Check Condition with valid sense data to statusErr, and Busy or
+		 * Queue Full to controlErr.
+		 */
+		if (status == noErr) {
+			for (i = 0; i < cmdCount; i++) {
+				scsiCmdBlockPtr = &scsiCmdBlockArray[i];
+				execIOPBPtr = BatchPB(i);
+				SCB.statusByte = PB.scsiSCSIstatus;
+				SCB.actualTransferCount =
+					PB.scsiDataLength - PB.scsiDataResidual;
+				if (SCB.status == scsiDataRunError
+				 && SCB.writeToDevice == FALSE
+				 && SCB.actualTransferCount <= SCB.transferSize
+				 && SCB.actualTransferCount > 0)
+					SCB.status = noErr;
+				if (SCB.status == scsiNonZeroStatus
+				 && (PB.scsiResultFlags & scsiAutosenseValid) != 0)
+					SCB.status = statusErr;
+				SCB.status = SCSIBusyStatus(SCB.status, PB.scsiSCSIstatus);
+			}
+		}
+		DisposePtr(execIOPBArray);
+		return (status);
+#undef SCB
+#undef PB
+#undef BatchPB
+}
+
+/*
+ * The completion routine is called by the SCSI Manager (possibly at interrupt
+ * level) when each request completes. As in AsyncSCSI, the final scsiResult
+ * ends the polling loop, so there is nothing to do here.
+ */
+static pascal void
+BatchCompletion(
+		void					*scsiPB
+	)
+{
+}
+
+static void NextFunction(void) { }	/* Dummy function for SubmitBatch size	*/
+
+static Boolean
+IsVirtualMemoryRunning(void)
+{
+		OSErr						status;
+		long						response;
+
+		status = Gestalt(gestaltVMAttr, &response);
+		/*
+		 * VM is active iff Gestalt succeeded and the response is appropriate.
+		 */
+		return (status == noErr && ((response & (1 << gestaltVMPresent)) != 0));
+}
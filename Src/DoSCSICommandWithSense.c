@@ -5,21 +5,22 @@
  *
  * This is the common entry to the original and asynchronous SCSI Manager calls:
  * if the asynchronous SCSI Manager is present, it calls it. If not present, it
- * calls the original SCSI Manager and executes Request Sense if necessary.
+ * calls the original SCSI Manager, which executes Request Sense if necessary.
  */
 #include "SCSISimpleSample.h"
 
-void							IssueRequestSense(
-		register ScsiCmdBlockPtr	scsiCmdBlockPtr
-	);
-
-
 /*
- * Do one SCSI Command. If the device returns Check Condition, issue Request Sense
- * (original SCSI Manager only) and interpret the sense data. The original SCSI
- * command status is in SCB.status. If it is statusErr or scsiNonZeroStatus,
- * the sense data is in SCB.sense and the Request Sense status is in
- * SCB.requestSenseStatus.
+ * Do one SCSI Command. If the device returns Check Condition, the SCSI Manager
+ * (or OriginalSCSI) issues Request Sense and we interpret the sense data. The
+ * original SCSI command status is in SCB.status. If it is statusErr, the sense
+ * data is in SCB.sense. If it is scsiNonZeroStatus and SCB.statusByte is Check
+ * Condition, Request Sense failed and SCB.requestSenseStatus is
+ * scsiAutosenseFailed; otherwise, SCB.statusByte is the device's status.
+ * A target that is Busy (or whose queue is full) is retried as described in
+ * SCSIEnvironment.h, and SCB.busyRetries counts the asynchronous SCSI
+ * Manager's Busy retries. If a command trace is being captured
+ * (gCommandTrace), the command is recorded; if statistics are being exported
+ * (gStatsExport), it is counted.
  */
 void
 DoSCSICommandWithSense(
@@ -30,6 +31,8 @@ DoSCSICommandWithSense(
 {
 		unsigned short			cmdBlockLength;
 		unsigned short			scsiHandshake[handshakeDataLength];
+		SCSIBusyRetry			busyRetry;
+		UnsignedWide			issuedTime;
 		
 #define SCB	(*scsiCmdBlockPtr)
 		
@@ -40,7 +43,7 @@ DoSCSICommandWithSense(
 		 * LUN in the identify message).
 		 */
 		SCB.command.scsi[1] &= ~0xE0;
-		SCB.command.scsi[1] |= (SCB.scsiDevice.LUN & 0x03) << 5;
+		SCB.command.scsi[1] |= (SCB.scsiDevice.LUN & 0x07) << 5;
 		cmdBlockLength = SCSIGetCommandLength((Ptr) &SCB.command);
 		/*
 		 * Try to call SCSI Manager 4.3, if it fails with unimpErr, call
@@ -48,6 +51,9 @@ DoSCSICommandWithSense(
 		 * is synchronous. Real-world applications would use an asynchronous
 		 * variant.
 		 */
+		SCB.busyRetries = 0;
+		if (gCommandTrace.active || gStatsExport.active)
+			Microseconds(&issuedTime);
 		if (enableAsynchSCSI == FALSE || gEnableNewSCSIManager == FALSE)
 			SCB.status = unimpErr;					/* Always original SCSI	*/
 		else {
@@ -59,114 +65,124 @@ DoSCSICommandWithSense(
 				CLEAR(scsiHandshake);
 				scsiHandshake[0] = SCB.transferQuantum;
 			}
-			SCB.status = AsyncSCSI(
-						SCB.scsiDevice,				/* Bus/target/LUN		*/
-						&SCB.command,				/* The command			*/
-						cmdBlockLength,				/* Command length		*/
-						SCB.writeToDevice,			/* TRUE if writing		*/
-						SCB.bufferPtr,				/* Data buffer, if any	*/
-						SCB.transferSize,			/* Data transfer length	*/
-						(SCB.transferQuantum == 1) ? NULL : scsiHandshake,
-						&SCB.sense,					/* For sense result		*/
-						sizeof SCB.sense,			/* Sense buffer size	*/
-						kScsiSpinUpCompletionTime,	/* Watchdog timeout		*/
-						&SCB.statusByte,			/* Gets STS Phase byte	*/
-						&SCB.actualTransferCount	/* Bytes actually done	*/
-					);
-		}
-		if (SCB.status != unimpErr) {
-			/*
-			 * The asynchronous SCSI Manager did something interesting.
-			 */
-			switch (SCB.status) {
-			case noErr:
-				break;
-			case scsiDeviceNotThere:
-			case scsiSelectTimeout:
-			case scsiBusInvalid:
-			case scsiTIDInvalid:
-				/* These all mean "no such device" */
-				break;
-			case statusErr:
+			SCSIBusyRetryInit(&busyRetry);
+			for (;;) {
+				SCB.status = AsyncSCSI(
+							&gSCSIEnvironment,			/* Core state			*/
+							SCB.scsiDevice,				/* Bus/target/LUN		*/
+							&SCB.command,				/* The command			*/
+							cmdBlockLength,				/* Command length		*/
+							SCB.writeToDevice,			/* TRUE if writing		*/
+							SCB.bufferPtr,				/* Data buffer, if any	*/
+							SCB.transferSize,			/* Data transfer length	*/
+							(SCB.transferQuantum == 1) ? NULL : scsiHandshake,
+							&SCB.sense,					/* For sense result		*/
+							sizeof SCB.sense,			/* Sense buffer size	*/
+							kScsiSpinUpCompletionTime,	/* Watchdog timeout		*/
+							&SCB.statusByte,			/* Gets STS Phase byte	*/
+							&SCB.actualTransferCount	/* Bytes actually done	*/
+						);
+				if (SCB.status != controlErr
+				 || SCSIBusyRetryNext(&busyRetry) == FALSE)
+					break;
 				/*
-				 * Hmm. If the error is statusErr, the device returned
-				 * "Check Condition" and the SCSI Manager successfully
-				 * issued a Request Sense. We'll display the result of the
-				 * sense and update the spinUpState.
+				 * The device did not execute the command: pause, and retry.
 				 */
-				SCB.requestSenseStatus = noErr;
-				if (displayError)
-					ShowRequestSense(scsiCmdBlockPtr);
-				break;
-			default:
-				if (displayError)
-					ShowStatusError(SCB.scsiDevice, SCB.status, &SCB.command);
-				break;
+				++SCB.busyRetries;
+				while (TickCount() < busyRetry.resumeTicks)
+					SCSIEnvironmentIdle(&gSCSIEnvironment);
 			}
 		}
-		else {
+		if (SCB.status == unimpErr) {
 			/*
-			 * Call the original SCSI Manager.
+			 * Call the original SCSI Manager. If the device returns Check
+			 * Condition, OriginalSCSI issues Request Sense before it returns
+			 * (while its memory is still held), so the result is handled in
+			 * the same way as the asynchronous SCSI Manager's autosense.
 			 */
 			SCB.status = OriginalSCSI(
-						SCB.scsiDevice.targetID,
+						SCB.scsiDevice,
 						&SCB.command,
 						cmdBlockLength,
 						SCB.writeToDevice,
 						SCB.bufferPtr,
 						SCB.transferSize,
 						SCB.transferQuantum,
+						&SCB.sense,
+						sizeof SCB.sense,
 						kScsiSpinUpCompletionTime,
 						&SCB.statusByte,
 						&SCB.actualTransferCount
 					);
-			if (SCB.status != noErr) {
-				if (displayError)
-					ShowStatusError(SCB.scsiDevice, SCB.status, &SCB.command);
-				if (SCB.status == statusErr) {
-					/*
-					 * Device returned "Check Condition."
-					 */
-					IssueRequestSense(scsiCmdBlockPtr);
-					if (displayError)
-						ShowRequestSense(scsiCmdBlockPtr);
-				}
-			}
 		}
+		if (gCommandTrace.active)
+			CommandTraceRecord(
+						&gCommandTrace,
+						scsiCmdBlockPtr,
+						enableAsynchSCSI,
+						&issuedTime
+					);
+		if (gStatsExport.active)
+			StatsExportRecord(&gStatsExport, scsiCmdBlockPtr, &issuedTime);
+		CheckSCSICommandStatus(scsiCmdBlockPtr, displayError);
+#undef SCB
 }
 
 /*
- * Execute "Get Extended Sense." This should not fail. This is only called by
- * "old" SCSI Manager calls: the new SCSI Manager always enables "autosense."
+ * Interpret the final status of a command executed by DoSCSICommandWithSense
+ * or DoSCSICommandBatch: set SCB.requestSenseStatus and, if requested,
+ * display the error.
  */
 void
-IssueRequestSense(
-		register ScsiCmdBlockPtr	scsiCmdBlockPtr
+CheckSCSICommandStatus(
+		register ScsiCmdBlockPtr	scsiCmdBlockPtr,
+		Boolean					displayError
 	)
 {
-		SCSI_6_Byte_Command		requestSense;
-		unsigned short			statusByte;				/* <- From Status Phase	*/
-		unsigned long			actualTransferCount;
-		
-		CLEAR(requestSense);
-		requestSense.opcode = kScsiCmdRequestSense;
-		requestSense.len = sizeof SCB.sense;
-		/*
-		 * Stuff the logical unit number into the command block.
-		 */
-		requestSense.lbn3 &= 0xE0;
-		requestSense.lbn3 |= (SCB.scsiDevice.targetID & 0x03) << 5;
-		SCB.requestSenseStatus = OriginalSCSI(
-					SCB.scsiDevice.targetID,
-					(SCSI_CommandPtr) &requestSense,
-					sizeof requestSense,
-					FALSE,								/* No write				*/
-					(Ptr) &SCB.sense,
-					sizeof SCB.sense,
-					1,
-					kScsiSpinUpCompletionTime,
-					&statusByte,
-					&actualTransferCount
-				);
-}
+#define SCB	(*scsiCmdBlockPtr)
 
+		switch (SCB.status) {
+		case noErr:
+			break;
+		case scsiDeviceNotThere:
+		case scsiSelectTimeout:
+		case scsiBusInvalid:
+		case scsiTIDInvalid:
+			/* These all mean "no such device" */
+			break;
+		case statusErr:
+			/*
+			 * Hmm. If the error is statusErr, the device returned
+			 * "Check Condition" and the SCSI Manager successfully
+			 * issued a Request Sense. We'll display the result of the
+			 * sense and update the spinUpState.
+			 */
+			SCB.requestSenseStatus = noErr;
+			if (displayError)
+				ShowRequestSense(scsiCmdBlockPtr);
+			break;
+		case scsiNonZeroStatus:
+			/*
+			 * If the device returned "Check Condition", Request Sense
+			 * failed: there is no sense data. Otherwise, this is some
+			 * other status (such as Reservation Conflict, or Busy or
+			 * Queue Full after the retries): there was no sense to
+			 * request, so SCB.requestSenseStatus is not changed.
+			 */
+			if (SCB.statusByte == kScsiStatusCheckCondition) {
+				SCB.requestSenseStatus = scsiAutosenseFailed;
+				if (displayError)
+					ShowStatusError(SCB.scsiDevice, SCB.status, &SCB.command);
+			}
+			else if (displayError) {
+				ShowStatusByteError(
+					SCB.scsiDevice, SCB.statusByte, &SCB.command);
+			}
+			break;
+		default:
+			if (displayError)
+				ShowStatusError(SCB.scsiDevice, SCB.status, &SCB.command);
+			break;
+		}
+#undef SCB
+}
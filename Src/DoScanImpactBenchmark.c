@@ -0,0 +1,239 @@
+/*								DoScanImpactBenchmark.c							*/
+/*
+ * DoScanImpactBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure what a bus scan costs the other devices on the bus. A streaming
+ * read from the slow disk on the virtual bus (target 3) runs while the bus
+ * is scanned over and over: each scan probes every target with an Inquiry,
+ * and the probes of missing targets hold the bus until their selection
+ * times out. The stream is run three times -- alone, with an unrestrained
+ * scan, and with a scan paced by the scan limiter (which also yields to the
+ * stream) -- and its throughput and latency are displayed, together with
+ * the number of probes that the scan managed to send.
+ */
+#include "SCSISimpleSample.h"
+
+#define kStreamTarget			3
+#define kStreamRequests			48
+#define kStreamBlocks			128				/* 64K per request			*/
+#define kStreamWindow			2				/* Requests outstanding		*/
+#define kProbeRecords			4				/* Concurrent probes, max	*/
+
+enum {
+	kScanNone = 0,
+	kScanUnlimited,
+	kScanThrottled
+};
+
+static void						RunStream(
+		unsigned short			bus,
+		unsigned short			scanMode,
+		BusRequest				stream[kStreamRequests],
+		Ptr						streamBufferPtr,
+		ConstStr255Param		label
+	);
+static void						StartProbe(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			probePtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		SCSI_Inquiry_Data		*inquiryPtr
+	);
+
+void
+DoScanImpactBenchmark(void)
+{
+		unsigned short			bus;
+		BusRequest				*stream;
+		Ptr						streamBufferPtr;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		LOG("\pScan Impact Benchmark (virtual bus)");
+		stream =
+			(BusRequest *) NewPtrClear(sizeof (BusRequest) * kStreamRequests);
+		streamBufferPtr = NewPtr(kStreamBlocks * kVirtualBlockLength);
+		if (stream == NULL || streamBufferPtr == NULL)
+			LOG("\pNo memory for benchmark buffers");
+		else {
+			RunStream(bus, kScanNone, stream, streamBufferPtr, "\pNo scan");
+			RunStream(bus, kScanUnlimited,
+				stream, streamBufferPtr, "\pUnlimited scan");
+			RunStream(bus, kScanThrottled,
+				stream, streamBufferPtr, "\pThrottled scan");
+		}
+		if (streamBufferPtr != NULL)
+			DisposePtr(streamBufferPtr);
+		if (stream != NULL)
+			DisposePtr((Ptr) stream);
+}
+
+/*
+ * Read kStreamRequests sequential chunks, keeping kStreamWindow of them
+ * outstanding, while (optionally) scanning the bus. All stream requests read
+ * into the same buffer: only the timing matters here.
+ */
+static void
+RunStream(
+		unsigned short			bus,
+		unsigned short			scanMode,
+		BusRequest				stream[kStreamRequests],
+		Ptr						streamBufferPtr,
+		ConstStr255Param		label
+	)
+{
+		BusDispatcher			dispatcher;
+		ScanLimiter				limiter;
+		BusRequest				probe[kProbeRecords];
+		SCSI_Inquiry_Data		inquiry[kProbeRecords];
+		Boolean					probeActive[kProbeRecords];
+		unsigned long			latency[kStreamRequests];
+		unsigned long			value;
+		unsigned long			logicalBlock;
+		unsigned long			startTicks;
+		unsigned long			elapsedTicks;
+		unsigned long			bytes;
+		unsigned short			nextStream;
+		unsigned short			streamDone;
+		unsigned short			nextProbeTarget;
+		register short			i;
+		register short			j;
+		OSErr					status;
+		Str255					work;
+#define SCB	(stream[i].scsiCmdBlock)
+
+		status = BusDispatcherOpen(&dispatcher, &gSCSIEnvironment, bus);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't open bus dispatcher");
+			return;
+		}
+		if (scanMode == kScanThrottled)
+			ScanLimiterInit(&limiter,
+				kScanProbesPerSecond, kScanConcurrentProbes, &dispatcher);
+		else {
+			ScanLimiterInit(&limiter, 0, kProbeRecords, NULL);
+		}
+		for (i = 0; i < kProbeRecords; i++)
+			probeActive[i] = FALSE;
+		for (i = 0; i < kStreamRequests; i++) {
+			CLEAR(stream[i]);
+			logicalBlock = (unsigned long) i * kStreamBlocks;
+			SCB.scsiDevice.bus = bus;
+			SCB.scsiDevice.targetID = kStreamTarget;
+			SCB.command.scsi10.opcode = kScsiCmdRead10;
+			SCB.command.scsi10.lbn4 = logicalBlock >> 24;
+			SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+			SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+			SCB.command.scsi10.lbn1 = logicalBlock;
+			SCB.command.scsi10.len2 = kStreamBlocks >> 8;
+			SCB.command.scsi10.len1 = kStreamBlocks & 0xFF;
+			SCB.bufferPtr = streamBufferPtr;
+			SCB.transferSize = kStreamBlocks * kVirtualBlockLength;
+			SCB.transferQuantum = kVirtualBlockLength;
+		}
+		nextStream = 0;
+		streamDone = 0;
+		nextProbeTarget = 0;
+		startTicks = TickCount();
+		while (streamDone < kStreamRequests) {
+			/*
+			 * Keep the stream's window full.
+			 */
+			while (nextStream < kStreamRequests
+			 && nextStream - streamDone < kStreamWindow)
+				BusDispatcherQueue(&dispatcher, &stream[nextStream++]);
+			(void) BusDispatcherPoll(&dispatcher);
+			while (streamDone < nextStream
+			 && stream[streamDone].scsiCmdBlock.status != 1)
+				++streamDone;
+			/*
+			 * Retire completed probes and start new ones (the next target
+			 * in turn) as the limiter allows.
+			 */
+			for (i = 0; i < kProbeRecords; i++) {
+				if (probeActive[i] && probe[i].scsiCmdBlock.status != 1) {
+					probeActive[i] = FALSE;
+					ScanLimiterProbeDone(&limiter);
+				}
+				if (scanMode != kScanNone
+				 && probeActive[i] == FALSE
+				 && ScanLimiterTryStart(&limiter)) {
+					StartProbe(&dispatcher,
+						&probe[i], bus, nextProbeTarget, &inquiry[i]);
+					probeActive[i] = TRUE;
+					nextProbeTarget =
+						(nextProbeTarget + 1) % kVirtualInitiatorID;
+				}
+			}
+		}
+		elapsedTicks = TickCount() - startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		BusDispatcherClose(&dispatcher);			/* Waits for the probes	*/
+		/*
+		 * Sort the stream latencies (insertion sort: there are only a few).
+		 */
+		bytes = 0;
+		for (i = 0; i < kStreamRequests; i++) {
+			bytes += SCB.actualTransferCount;
+			value = stream[i].completedTicks - stream[i].queuedTicks;
+			for (j = i; j > 0 && latency[j - 1] > value; --j)
+				latency[j] = latency[j - 1];
+			latency[j] = value;
+		}
+		pstrcpy(work, label);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, (bytes / 1024L) * 60L / elapsedTicks);
+		pstrcat(work, "\p K/sec, latency (ticks) median ");
+		AppendUnsigned(work, latency[kStreamRequests / 2]);
+		pstrcat(work, "\p, 99% ");
+		AppendUnsigned(work, latency[(kStreamRequests * 99) / 100]);
+		LOG(work);
+		if (scanMode != kScanNone) {
+			pstrcpy(work, "\p  Probes ");
+			AppendUnsigned(work, limiter.statistics.probes);
+			pstrcat(work, "\p (");
+			AppendUnsigned(work,
+				(limiter.statistics.probes * 60L) / elapsedTicks);
+			pstrcat(work, "\p/sec), forced ");
+			AppendUnsigned(work, limiter.statistics.forcedProbes);
+			LOG(work);
+		}
+		for (i = 0; i < kStreamRequests; i++) {
+			if (SCB.status != noErr) {
+				DisplaySCSIErrorMessage(SCB.status, "\pStream request failed");
+				break;
+			}
+		}
+#undef SCB
+}
+
+/*
+ * Queue an Inquiry probe for LUN 0 of this target as a background request.
+ */
+static void
+StartProbe(
+		BusDispatcherPtr		dispatcherPtr,
+		BusRequestPtr			probePtr,
+		unsigned short			bus,
+		unsigned short			targetID,
+		SCSI_Inquiry_Data		*inquiryPtr
+	)
+{
+#define SCB	(probePtr->scsiCmdBlock)
+
+		CLEAR(*probePtr);
+		probePtr->background = TRUE;
+		SCB.scsiDevice.bus = bus;
+		SCB.scsiDevice.targetID = targetID;
+		SCB.command.scsi6.opcode = kScsiCmdInquiry;
+		SCB.command.scsi6.len = sizeof (SCSI_Inquiry_Data);
+		SCB.bufferPtr = (Ptr) inquiryPtr;
+		SCB.transferSize = sizeof (SCSI_Inquiry_Data);
+		SCB.transferQuantum = 1;
+		BusDispatcherQueue(dispatcherPtr, probePtr);
+#undef SCB
+}
@@ -0,0 +1,210 @@
+/*								DoSchedulerBenchmark.c							*/
+/*
+ * DoSchedulerBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Measure the I/O scheduler. A random read workload (with some sequential
+ * runs) is generated from a fixed seed, so every run replays the same
+ * requests. The workload is executed twice, once in arrival order and once
+ * by the elevator scheduler, and the elapsed time, throughput, and latency
+ * percentiles are displayed for each. The workload only reads, so it may be
+ * run against any disk. On the virtual SCSI bus, target 3 models seek time.
+ */
+#include "SCSISimpleSample.h"
+
+#define kBenchRequests			64
+#define kBenchMaxBlocks			8
+#define kBenchMergeBlocks		64
+#define kBenchSeed				1994L
+
+static unsigned long			gBenchSeed;
+
+static unsigned long			BenchRandom(void);
+static void						RunWorkload(
+		DeviceIdent				scsiDevice,
+		unsigned short			policy,
+		unsigned long			capacity,
+		unsigned long			blockLength,
+		Ptr						bufferPtr,
+		ConstStr255Param		policyName
+	);
+static void						ShowLatency(
+		ConstStr255Param		label,
+		IORequest				request[kBenchRequests]
+	);
+
+void
+DoSchedulerBenchmark(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	)
+{
+		ScsiCmdBlock				scsiCmdBlock;
+		SCSI_Capacity_Data			capacity;
+		unsigned long				blockCount;
+		unsigned long				blockLength;
+		Ptr							bufferPtr;
+#define SCB	(scsiCmdBlock)
+
+		ShowSCSIBusID(scsiDevice, "\pI/O Scheduler Benchmark");
+		CLEAR(SCB);
+		SCB.scsiDevice = scsiDevice;
+		SCB.command.scsi10.opcode = kScsiCmdReadCapacity;
+		SCB.bufferPtr = (Ptr) &capacity;
+		SCB.transferSize = sizeof capacity;
+		SCB.transferQuantum = 1;
+		DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+		if (SCB.status != noErr)
+			return;
+		blockCount =
+			  (((unsigned long) capacity.lbn4) << 24)
+			| (((unsigned long) capacity.lbn3) << 16)
+			| (((unsigned long) capacity.lbn2) << 8)
+			| capacity.lbn1;
+		blockLength =
+			  (((unsigned long) capacity.len4) << 24)
+			| (((unsigned long) capacity.len3) << 16)
+			| (((unsigned long) capacity.len2) << 8)
+			| capacity.len1;
+		if (blockCount <= kBenchMaxBlocks || blockLength == 0) {
+			LOG("\pDevice is too small for this benchmark");
+			return;
+		}
+		bufferPtr = NewPtr(kBenchMaxBlocks * blockLength);
+		if (bufferPtr == NULL) {
+			LOG("\pNo memory for benchmark buffer");
+			return;
+		}
+		RunWorkload(scsiDevice, kIOPolicyFIFO,
+			blockCount, blockLength, bufferPtr, "\pArrival order");
+		RunWorkload(scsiDevice, kIOPolicyElevator,
+			blockCount, blockLength, bufferPtr, "\pElevator");
+		DisposePtr(bufferPtr);
+#undef SCB
+}
+
+/*
+ * Queue the whole workload, then dispatch it. All requests read into the
+ * same buffer: only the timing matters here.
+ */
+static void
+RunWorkload(
+		DeviceIdent				scsiDevice,
+		unsigned short			policy,
+		unsigned long			capacity,
+		unsigned long			blockLength,
+		Ptr						bufferPtr,
+		ConstStr255Param		policyName
+	)
+{
+		IOScheduler				scheduler;
+		IORequest				request[kBenchRequests];
+		register short			i;
+		unsigned long			nextBlock;
+		unsigned long			startTicks;
+		unsigned long			elapsedTicks;
+		OSErr					status;
+		Str255					work;
+
+		status = IOSchedulerOpen(
+					&scheduler, scsiDevice, blockLength, kBenchMergeBlocks);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't open I/O scheduler");
+			return;
+		}
+		scheduler.policy = policy;
+		gBenchSeed = kBenchSeed;
+		nextBlock = 0;
+		for (i = 0; i < kBenchRequests; i++) {
+			CLEAR(request[i]);
+			request[i].requestClass = kIOClassRead;
+			request[i].bufferPtr = bufferPtr;
+			request[i].blockCount = 1 + BenchRandom() % kBenchMaxBlocks;
+			/*
+			 * One request in four continues the previous one.
+			 */
+			if ((BenchRandom() & 3) != 0
+			 || nextBlock + kBenchMaxBlocks >= capacity) {
+				nextBlock = (BenchRandom() * 32768L + BenchRandom())
+						  % (capacity - kBenchMaxBlocks);
+			}
+			request[i].logicalBlock = nextBlock;
+			nextBlock += request[i].blockCount;
+		}
+		startTicks = TickCount();
+		for (i = 0; i < kBenchRequests; i++)
+			IOSchedulerQueue(&scheduler, &request[i]);
+		while (IOSchedulerDispatch(&scheduler))
+			;
+		elapsedTicks = TickCount() - startTicks;
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, policyName);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, elapsedTicks);
+		pstrcat(work, "\p ticks, ");
+		AppendUnsigned(work,
+			(scheduler.statistics.blocks * 60L) / elapsedTicks);
+		pstrcat(work, "\p blocks/sec, ");
+		AppendUnsigned(work, scheduler.statistics.commands);
+		pstrcat(work, "\p commands");
+		LOG(work);
+		pstrcpy(work, "\p  Merged ");
+		AppendUnsigned(work, scheduler.statistics.mergedRequests);
+		pstrcat(work, "\p, deadline ");
+		AppendUnsigned(work, scheduler.statistics.deadlineDispatches);
+		pstrcat(work, "\p, seek distance ");
+		AppendUnsigned(work, scheduler.statistics.seekDistance);
+		LOG(work);
+		ShowLatency("\p  Latency (ticks)", request);
+		for (i = 0; i < kBenchRequests; i++) {
+			if (request[i].status != noErr) {
+				DisplaySCSIErrorMessage(
+					request[i].status, "\pBenchmark request failed");
+				break;
+			}
+		}
+		IOSchedulerClose(&scheduler);
+}
+
+/*
+ * Display the median, 95th percentile, and maximum latency. The latencies
+ * are sorted with an insertion sort: there are only a few of them.
+ */
+static void
+ShowLatency(
+		ConstStr255Param		label,
+		IORequest				request[kBenchRequests]
+	)
+{
+		unsigned long			latency[kBenchRequests];
+		unsigned long			value;
+		register short			i;
+		register short			j;
+		Str255					work;
+
+		for (i = 0; i < kBenchRequests; i++) {
+			value = request[i].completedTicks - request[i].queuedTicks;
+			for (j = i; j > 0 && latency[j - 1] > value; --j)
+				latency[j] = latency[j - 1];
+			latency[j] = value;
+		}
+		pstrcpy(work, label);
+		pstrcat(work, "\p: median ");
+		AppendUnsigned(work, latency[kBenchRequests / 2]);
+		pstrcat(work, "\p, 95% ");
+		AppendUnsigned(work, latency[(kBenchRequests * 95) / 100]);
+		pstrcat(work, "\p, max ");
+		AppendUnsigned(work, latency[kBenchRequests - 1]);
+		LOG(work);
+}
+
+/*
+ * A linear congruential generator: we need the same sequence on every run,
+ * which the Toolbox Random() does not guarantee.
+ */
+static unsigned long
+BenchRandom(void)
+{
+		gBenchSeed = gBenchSeed * 1103515245L + 12345L;
+		return ((gBenchSeed >> 16) & 0x7FFF);
+}
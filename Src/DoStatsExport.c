@@ -0,0 +1,57 @@
+/*									DoStatsExport.c								*/
+/*
+ * DoStatsExport.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Start exporting statistics (see StatsExport.h) to a file that the user
+ * names or, if an export is running, write the files a last time and stop.
+ * The user names the Prometheus file; the CSV file is written beside it.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+void
+DoStatsExport(void)
+{
+		Point					where;
+		SFReply					reply;
+		OSErr					status;
+		Str255					work;
+
+		if (gStatsExport.active) {
+			status = StatsExportStop(&gStatsExport);
+			if (status != noErr)
+				DisplaySCSIErrorMessage(
+					status, "\pCan't export the statistics");
+			else {
+				pstrcpy(work, "\pStatistics export stopped: written ");
+				AppendUnsigned(work, gStatsExport.exports);
+				pstrcat(work, "\p times");
+				LOG(work);
+			}
+		}
+		else {
+			SetPt(&where, 80, 80);
+			SFPutFile(where, "\pExport the statistics as:",
+				"\pSCSIStatistics.prom", NULL, &reply);
+			if (reply.good == FALSE)
+				return;
+			status = StatsExportStart(
+						&gStatsExport, reply.fName, reply.vRefNum,
+						kApplicationCreator, kStatsIntervalTicks);
+			if (status != noErr)
+				DisplaySCSIErrorMessage(
+					status, "\pCan't export the statistics");
+			else {
+				pstrcpy(work, "\pExporting statistics every ");
+				AppendUnsigned(work, kStatsIntervalTicks / 60L);
+				pstrcat(work, "\p seconds to \"");
+				pstrcat(work, gStatsExport.fileName);
+				pstrcat(work, "\p\" and \"");
+				pstrcat(work, gStatsExport.csvName);
+				pstrcat(work, "\p\"");
+				LOG(work);
+			}
+		}
+		gUpdateMenusNeeded = TRUE;
+}
@@ -0,0 +1,447 @@
+/*									DoThreadStressTest.c						*/
+/*
+ * DoThreadStressTest.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Check that AsyncSCSI may be called from several Thread Manager threads at
+ * once (see SCSIEnvironment.h). Four small RAM disks are added to the virtual
+ * bus, and kStressThreads cooperative threads are started, two on each disk.
+ * Each thread owns a range of blocks: on each pass, it writes a pattern of
+ * its own to one of them, reads it back, and compares. While a command is in
+ * progress, the environment's idle procedure yields, so the other threads
+ * issue their commands meanwhile. The threads are run twice:
+ *	-- Each thread with its own environment. Each environment's device
+ *	   policies should describe only its thread's disk.
+ *	-- All threads with one environment.
+ * For each run, every command should succeed and every block should read
+ * back as written. Afterwards, no request should be left in a watchdog
+ * table, and each environment's policies should have measured exactly the
+ * commands issued with it. The RAM disks are removed when the test ends.
+ */
+#include "SCSISimpleSample.h"
+#include <Gestalt.h>
+#include <Threads.h>
+
+#define kStressThreads			8
+#define kStressPasses			50
+#define kStressDiskBlocks		64L
+#define kStressThreadBlocks		32L				/* Two threads per disk		*/
+#define kStressDiskLatency		1L				/* msec						*/
+#define kStressTimeout			(60L * 5L)		/* Ticks					*/
+#define kStressLongs			(kVirtualBlockLength / sizeof (unsigned long))
+
+static const unsigned short		gStressTarget[] = { 1, 2, 4, 5 };
+#define kStressTargets			(sizeof gStressTarget / sizeof gStressTarget[0])
+
+struct StressThread {
+	SCSIEnvironmentPtr	environmentPtr;			/* Its own, or shared			*/
+	DeviceIdent			scsiDevice;
+	unsigned short		index;
+	unsigned long		firstBlock;				/* Of the blocks it owns		*/
+	unsigned long		commands;				/* Issued						*/
+	unsigned long		failed;					/* Status not noErr				*/
+	unsigned long		shortTransfers;			/* Less than one block			*/
+	unsigned long		mismatches;				/* Read back differs			*/
+	OSErr				lastError;
+	Boolean				done;
+	unsigned long		writeData[kStressLongs];
+	unsigned long		readData[kStressLongs];
+};
+typedef struct StressThread StressThread, *StressThreadPtr;
+
+struct StressRun {
+	SCSIEnvironment		environment[kStressThreads];	/* [0] if shared		*/
+	StressThread		thread[kStressThreads];
+};
+typedef struct StressRun StressRun, *StressRunPtr;
+
+static Boolean					HasThreadManager(void);
+static OSErr					AddStressDisks(void);
+static void						RemoveStressDisks(void);
+static OSErr					RunStressThreads(
+		StressRunPtr			runPtr,
+		unsigned short			bus,
+		Boolean					sharedEnvironment
+	);
+static pascal void				*StressThreadEntry(
+		void					*threadParam
+	);
+static OSErr					StressTransfer(
+		StressThreadPtr			threadPtr,
+		unsigned long			logicalBlock,
+		Boolean					writeToDevice
+	);
+static void						StressIdle(
+		SCSIEnvironmentPtr		environmentPtr
+	);
+static void						ShowStressRun(
+		ConstStr255Param		runName,
+		StressRunPtr			runPtr,
+		unsigned short			bus,
+		Boolean					sharedEnvironment,
+		unsigned long			elapsedTicks
+	);
+
+void
+DoThreadStressTest(void)
+{
+		unsigned short			bus;
+		StressRunPtr			runPtr;
+		unsigned long			startTicks;
+		register unsigned short	i;
+		OSErr					status;
+
+		if (VirtualSIMBusID(&bus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		if (HasThreadManager() == FALSE) {
+			LOG("\pThe Thread Manager is not installed");
+			return;
+		}
+		LOG("\pThread Stress Test (virtual bus)");
+		for (i = 0; i < kStressTargets; i++) {
+			if (VirtualSIMGetTarget(gStressTarget[i])->commandProc != NULL) {
+				LOG("\pVirtual targets 1, 2, 4, and 5 must be free");
+				return;
+			}
+		}
+		runPtr = (StressRunPtr) NewPtrClear(sizeof (StressRun));
+		if (runPtr == NULL) {
+			LOG("\pNo memory for the stress test");
+			return;
+		}
+		status = AddStressDisks();
+		if (status == noErr) {
+			startTicks = TickCount();
+			status = RunStressThreads(runPtr, bus, FALSE);
+			if (status == noErr) {
+				ShowStressRun("\pOne environment per thread",
+					runPtr, bus, FALSE, TickCount() - startTicks);
+			}
+		}
+		if (status == noErr) {
+			startTicks = TickCount();
+			status = RunStressThreads(runPtr, bus, TRUE);
+			if (status == noErr) {
+				ShowStressRun("\pOne environment for all threads",
+					runPtr, bus, TRUE, TickCount() - startTicks);
+			}
+		}
+		if (status != noErr)
+			DisplaySCSIErrorMessage(
+				status, "\pCan't run the thread stress test");
+		RemoveStressDisks();
+		DisposePtr((Ptr) runPtr);
+}
+
+static Boolean
+HasThreadManager(void)
+{
+		long					response;
+		OSErr					status;
+
+		status = Gestalt(gestaltThreadMgrAttr, &response);
+		return (status == noErr
+			 && (response & (1 << gestaltThreadMgrPresent)) != 0);
+}
+
+/*
+ * Start the threads and yield until they are all done. The idle procedure
+ * of each environment yields too, so the main thread runs only when every
+ * stress thread is waiting for a command.
+ */
+static OSErr
+RunStressThreads(
+		StressRunPtr			runPtr,
+		unsigned short			bus,
+		Boolean					sharedEnvironment
+	)
+{
+		register StressThreadPtr	threadPtr;
+		register unsigned short	i;
+		unsigned short			started;
+		unsigned short			doneCount;
+		ThreadID				threadID;
+		OSErr					status;
+
+		for (i = 0; i < kStressThreads; i++) {
+			SCSIEnvironmentInit(&runPtr->environment[i]);
+			runPtr->environment[i].policy.enableSelectWithATN =
+				gSCSIEnvironment.policy.enableSelectWithATN;
+			runPtr->environment[i].idleProc = StressIdle;
+			threadPtr = &runPtr->thread[i];
+			CLEAR(*threadPtr);
+			threadPtr->environmentPtr =
+				&runPtr->environment[(sharedEnvironment) ? 0 : i];
+			threadPtr->scsiDevice.bus = bus;
+			threadPtr->scsiDevice.targetID = gStressTarget[i % kStressTargets];
+			threadPtr->index = i;
+			threadPtr->firstBlock = (i / kStressTargets) * kStressThreadBlocks;
+		}
+		status = noErr;
+		for (started = 0; started < kStressThreads; started++) {
+			status = NewThread(
+						kCooperativeThread, StressThreadEntry,
+						&runPtr->thread[started], 0L, kCreateIfNeeded,
+						NULL, &threadID);
+			if (status != noErr)
+				break;
+		}
+		/*
+		 * The threads that started must finish before runPtr can be reused,
+		 * even if the others could not be started.
+		 */
+		do {
+			(void) YieldToAnyThread();
+			doneCount = 0;
+			for (i = 0; i < started; i++) {
+				if (runPtr->thread[i].done)
+					++doneCount;
+			}
+		} while (doneCount < started);
+		return (status);
+}
+
+/*
+ * Each pass writes one of the thread's blocks and reads it back. The thread
+ * is disposed of when this returns.
+ */
+static pascal void *
+StressThreadEntry(
+		void					*threadParam
+	)
+{
+		register StressThreadPtr	threadPtr;
+		register unsigned short	j;
+		unsigned short			pass;
+		unsigned long			logicalBlock;
+		OSErr					status;
+
+		threadPtr = (StressThreadPtr) threadParam;
+		for (pass = 0; pass < kStressPasses; pass++) {
+			logicalBlock = threadPtr->firstBlock + (pass % kStressThreadBlocks);
+			for (j = 0; j < kStressLongs; j++) {
+				threadPtr->writeData[j] =
+					  (((unsigned long) threadPtr->index) << 24)
+					| (((unsigned long) pass) << 12)
+					| j;
+				threadPtr->readData[j] = 0;
+			}
+			status = StressTransfer(threadPtr, logicalBlock, TRUE);
+			if (status == noErr)
+				status = StressTransfer(threadPtr, logicalBlock, FALSE);
+			if (status != noErr) {
+				++threadPtr->failed;
+				threadPtr->lastError = status;
+			}
+			else {
+				for (j = 0; j < kStressLongs; j++) {
+					if (threadPtr->readData[j] != threadPtr->writeData[j]) {
+						++threadPtr->mismatches;
+						break;
+					}
+				}
+			}
+		}
+		threadPtr->done = TRUE;
+		return (NULL);
+}
+
+/*
+ * Write writeData to the block, or read it into readData.
+ */
+static OSErr
+StressTransfer(
+		StressThreadPtr			threadPtr,
+		unsigned long			logicalBlock,
+		Boolean					writeToDevice
+	)
+{
+		SCSI_Command			command;
+		SCSI_Sense_Data			sense;
+		unsigned short			statusByte;
+		unsigned long			actualTransferCount;
+		OSErr					status;
+
+		CLEAR(command);
+		command.scsi10.opcode =
+			(writeToDevice) ? kScsiCmdWrite10 : kScsiCmdRead10;
+		command.scsi10.lbn4 = logicalBlock >> 24;
+		command.scsi10.lbn3 = logicalBlock >> 16;
+		command.scsi10.lbn2 = logicalBlock >> 8;
+		command.scsi10.lbn1 = logicalBlock;
+		command.scsi10.len1 = 1;
+		++threadPtr->commands;
+		status = AsyncSCSI(
+					threadPtr->environmentPtr,
+					threadPtr->scsiDevice,
+					&command,
+					sizeof (SCSI_10_Byte_Command),
+					writeToDevice,
+					(writeToDevice)
+						? (Ptr) threadPtr->writeData
+						: (Ptr) threadPtr->readData,
+					kVirtualBlockLength,
+					NULL,
+					&sense,
+					sizeof sense,
+					kStressTimeout,
+					&statusByte,
+					&actualTransferCount
+				);
+		if (status == noErr && actualTransferCount != kVirtualBlockLength)
+			++threadPtr->shortTransfers;
+		return (status);
+}
+
+static void
+StressIdle(
+		SCSIEnvironmentPtr		environmentPtr
+	)
+{
+		(void) YieldToAnyThread();
+}
+
+/*
+ * Display the totals for one run, and check the environments: the watchdog
+ * tables must be empty, and the policies must have measured every command
+ * (all of them should have succeeded). With one environment per thread,
+ * each environment's policies should describe only that thread's disk.
+ */
+static void
+ShowStressRun(
+		ConstStr255Param		runName,
+		StressRunPtr			runPtr,
+		unsigned short			bus,
+		Boolean					sharedEnvironment,
+		unsigned long			elapsedTicks
+	)
+{
+		register StressThreadPtr	threadPtr;
+		register DevicePolicyPtr	policyPtr;
+		register unsigned short	i;
+		unsigned short			j;
+		unsigned short			environments;
+		unsigned long			commands;
+		unsigned long			failed;
+		unsigned long			shortTransfers;
+		unsigned long			mismatches;
+		unsigned long			samples;
+		unsigned short			leftInWatchdog;
+		unsigned short			strayPolicies;
+		unsigned short			badEnvironments;
+		OSErr					lastError;
+		Str255					work;
+
+		commands = 0;
+		failed = 0;
+		shortTransfers = 0;
+		mismatches = 0;
+		lastError = noErr;
+		for (i = 0; i < kStressThreads; i++) {
+			threadPtr = &runPtr->thread[i];
+			commands += threadPtr->commands;
+			failed += threadPtr->failed;
+			shortTransfers += threadPtr->shortTransfers;
+			mismatches += threadPtr->mismatches;
+			if (threadPtr->lastError != noErr)
+				lastError = threadPtr->lastError;
+		}
+		leftInWatchdog = 0;
+		strayPolicies = 0;
+		badEnvironments = 0;
+		environments = (sharedEnvironment) ? 1 : kStressThreads;
+		for (i = 0; i < environments; i++) {
+			for (j = 0; j < kMaxWatchedRequests; j++) {
+				if (runPtr->environment[i].watchdog.table[j].execIOPBPtr
+						!= NULL)
+					++leftInWatchdog;
+			}
+			samples = 0;
+			for (j = 0; j < kPolicyMaxDevices; j++) {
+				policyPtr = &runPtr->environment[i].policy.device[j];
+				if (policyPtr->inUse == FALSE)
+					continue;
+				samples += policyPtr->samples;
+				if (policyPtr->bus != bus
+				 || (sharedEnvironment == FALSE
+				  && policyPtr->targetID
+						!= runPtr->thread[i].scsiDevice.targetID))
+					++strayPolicies;
+			}
+			if (sharedEnvironment) {
+				if (samples != commands)
+					++badEnvironments;
+			}
+			else {
+				if (samples != runPtr->thread[i].commands)
+					++badEnvironments;
+			}
+		}
+		if (elapsedTicks == 0)
+			elapsedTicks = 1;
+		pstrcpy(work, runName);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, kStressThreads);
+		pstrcat(work, "\p threads, ");
+		AppendUnsigned(work, commands);
+		pstrcat(work, "\p commands, ");
+		AppendUnsigned(work, (commands * 60L) / elapsedTicks);
+		pstrcat(work, "\p per second");
+		LOG(work);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, failed);
+		pstrcat(work, "\p failed, ");
+		AppendUnsigned(work, shortTransfers);
+		pstrcat(work, "\p short, ");
+		AppendUnsigned(work, mismatches);
+		pstrcat(work, "\p blocks read back wrong");
+		if (lastError != noErr) {
+			pstrcat(work, "\p (error ");
+			AppendSigned(work, lastError);
+			pstrcat(work, "\p)");
+		}
+		LOG(work);
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, leftInWatchdog);
+		pstrcat(work, "\p requests left in the watchdog, ");
+		AppendUnsigned(work, badEnvironments);
+		pstrcat(work, "\p environments miscounted, ");
+		AppendUnsigned(work, strayPolicies);
+		pstrcat(work, "\p stray device policies");
+		LOG(work);
+		if (failed == 0 && shortTransfers == 0 && mismatches == 0
+		 && leftInWatchdog == 0 && badEnvironments == 0 && strayPolicies == 0)
+			LOG("\p  Passed");
+		else {
+			LOG("\p  FAILED");
+		}
+}
+
+static OSErr
+AddStressDisks(void)
+{
+		register unsigned short	i;
+		OSErr					status;
+
+		for (i = 0; i < kStressTargets; i++) {
+			status = VirtualSIMSetTarget(
+						gStressTarget[i],
+						VirtualDiskCommand, kScsiDevTypeDirect,
+						kStressDiskBlocks, kStressDiskLatency, TRUE);
+			if (status != noErr)
+				return (status);
+		}
+		return (noErr);
+}
+
+static void
+RemoveStressDisks(void)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < kStressTargets; i++)
+			(void) VirtualSIMSetTarget(
+						gStressTarget[i], NULL, 0, 0L, 0L, FALSE);
+}
@@ -0,0 +1,275 @@
+/*								DoTraceAnalysis.c								*/
+/*
+ * DoTraceAnalysis.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Analyze a command trace (see TraceAnalysis.h) and display the results:
+ *	-- For each device and command, the number of commands and bytes, the
+ *	   latency percentiles, and the number of failures, Check Conditions,
+ *	   and Busy retries.
+ *	-- The commands and kilobytes per second in each time slot.
+ *	-- The sense keys, additional sense codes, and qualifiers, decoded as
+ *	   DoShowRequestSense decodes them.
+ *	-- The outliers, slowest (compared with the median) first.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+static void						ShowGroups(
+		TraceAnalysisPtr		analysisPtr
+	);
+static void						ShowSlots(
+		TraceAnalysisPtr		analysisPtr
+	);
+static void						ShowSense(
+		TraceAnalysisPtr		analysisPtr
+	);
+static void						ShowOutliers(
+		TraceAnalysisPtr		analysisPtr
+	);
+static void						AppendGroupName(
+		StringPtr				result,
+		const AnalysisGroup		*groupPtr
+	);
+static void						AppendRate(
+		StringPtr				result,
+		unsigned long			count,
+		unsigned long			total
+	);
+
+void
+DoTraceAnalysis(void)
+{
+		Point					where;
+		SFTypeList				typeList;
+		SFReply					reply;
+		TraceAnalysisPtr		analysisPtr;
+		unsigned long			startTicks;
+		OSErr					status;
+		Str255					work;
+
+		SetPt(&where, 80, 80);
+		typeList[0] = kTraceFileType;
+		SFGetFile(where, "\p", NULL, 1, typeList, NULL, &reply);
+		if (reply.good == FALSE)
+			return;
+		analysisPtr = (TraceAnalysisPtr) NewPtr(sizeof (TraceAnalysis));
+		if (analysisPtr == NULL) {
+			LOG("\pNo memory for the trace analysis");
+			return;
+		}
+		SetCursor(*GetCursor(watchCursor));
+		startTicks = TickCount();
+		status = TraceAnalyze(analysisPtr, reply.fName, reply.vRefNum);
+		InitCursor();
+		if (status != noErr)
+			DisplaySCSIErrorMessage(
+				status, "\pCan't analyze the command trace");
+		else {
+			pstrcpy(work, "\pAnalysis of \"");
+			pstrcat(work, reply.fName);
+			pstrcat(work, "\p\": ");
+			AppendUnsigned(work, analysisPtr->records);
+			pstrcat(work, "\p commands in ");
+			AppendUnsigned(work, analysisPtr->lastMsec);
+			pstrcat(work, "\p msec, analyzed in ");
+			AppendUnsigned(work, TickCount() - startTicks);
+			pstrcat(work, "\p ticks");
+			LOG(work);
+			ShowGroups(analysisPtr);
+			ShowSlots(analysisPtr);
+			ShowSense(analysisPtr);
+			ShowOutliers(analysisPtr);
+		}
+		DisposePtr((Ptr) analysisPtr);
+}
+
+static void
+ShowGroups(
+		TraceAnalysisPtr		analysisPtr
+	)
+{
+		register AnalysisGroupPtr	groupPtr;
+		register short			i;
+		Str255					work;
+
+		for (i = 0; i < analysisPtr->groupCount; i++) {
+			groupPtr = &analysisPtr->group[i];
+			pstrcpy(work, "\p  ");
+			AppendGroupName(work, groupPtr);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, groupPtr->commands);
+			pstrcat(work, "\p commands, ");
+			AppendUnsigned(work, groupPtr->bytes / 1024L);
+			pstrcat(work, "\p KB, usec average ");
+			AppendUnsigned(work, TraceAnalysisAverage(groupPtr));
+			LOG(work);
+			pstrcpy(work, "\p    50% ");
+			AppendUnsigned(work, TraceAnalysisPercentile(groupPtr, 500));
+			pstrcat(work, "\p, 90% ");
+			AppendUnsigned(work, TraceAnalysisPercentile(groupPtr, 900));
+			pstrcat(work, "\p, 99% ");
+			AppendUnsigned(work, TraceAnalysisPercentile(groupPtr, 990));
+			pstrcat(work, "\p, worst ");
+			AppendUnsigned(work, groupPtr->maxLatency);
+			LOG(work);
+			if (groupPtr->failed != 0 || groupPtr->retried != 0) {
+				pstrcpy(work, "\p    Failed ");
+				AppendRate(work, groupPtr->failed, groupPtr->commands);
+				pstrcat(work, "\p, Check Condition ");
+				AppendRate(work, groupPtr->checkConditions, groupPtr->commands);
+				pstrcat(work, "\p, retried ");
+				AppendRate(work, groupPtr->retried, groupPtr->commands);
+				pstrcat(work, "\p (");
+				AppendUnsigned(work, groupPtr->busyRetries);
+				pstrcat(work, "\p Busy retries)");
+				LOG(work);
+			}
+		}
+		if (analysisPtr->otherRecords != 0) {
+			pstrcpy(work, "\p  ");
+			AppendUnsigned(work, analysisPtr->otherRecords);
+			pstrcat(work,
+				"\p commands for other devices and commands are not shown");
+			LOG(work);
+		}
+}
+
+static void
+ShowSlots(
+		TraceAnalysisPtr		analysisPtr
+	)
+{
+		register short			i;
+		unsigned long			seconds;
+		Str255					work;
+
+		if (analysisPtr->slotCount == 0)
+			return;
+		pstrcpy(work, "\pThroughput per ");
+		AppendUnsigned(work, analysisPtr->slotMsec / 1000L);
+		pstrcat(work, "\p seconds:");
+		LOG(work);
+		seconds = analysisPtr->slotMsec / 1000L;
+		for (i = 0; i < analysisPtr->slotCount; i++) {
+			pstrcpy(work, "\p  ");
+			AppendUnsignedInField(work, i * seconds, 6);
+			pstrcat(work, "\p sec: ");
+			AppendUnsigned(work, analysisPtr->slot[i].commands / seconds);
+			pstrcat(work, "\p commands/sec, ");
+			AppendUnsigned(work, analysisPtr->slot[i].bytes / 1024L / seconds);
+			pstrcat(work, "\p KB/sec");
+			LOG(work);
+		}
+}
+
+static void
+ShowSense(
+		TraceAnalysisPtr		analysisPtr
+	)
+{
+		register AnalysisSense	*sensePtr;
+		register short			i;
+		Str255					senseMessage;
+		Str255					work;
+
+		if (analysisPtr->senseCount == 0)
+			return;
+		LOG("\pCheck Conditions:");
+		for (i = 0; i < analysisPtr->senseCount; i++) {
+			sensePtr = &analysisPtr->sense[i];
+			pstrcpy(work, "\p  ");
+			AppendUnsignedInField(work, sensePtr->count, 6);
+			pstrcat(work, "\p ");
+			pstrcat(work, GetSenseKeyText(sensePtr->senseKey));
+			pstrcat(work, "\p, ASC: ");
+			AppendHexLeadingZeros(work, sensePtr->senseCode, 2);
+			pstrcat(work, "\p, ASQ: ");
+			AppendHexLeadingZeros(work, sensePtr->senseQualifier, 2);
+			if (GetSenseCodeText(senseMessage,
+						sensePtr->senseCode, sensePtr->senseQualifier)) {
+				pstrcat(work, "\p, ");
+				pstrcat(work, senseMessage);
+			}
+			LOG(work);
+		}
+		if (analysisPtr->otherSense != 0) {
+			pstrcpy(work, "\p  ");
+			AppendUnsignedInField(work, analysisPtr->otherSense, 6);
+			pstrcat(work, "\p others");
+			LOG(work);
+		}
+}
+
+static void
+ShowOutliers(
+		TraceAnalysisPtr		analysisPtr
+	)
+{
+		register AnalysisOutlier	*outlierPtr;
+		register short			i;
+		Str255					work;
+
+		pstrcpy(work, "\pOutliers (over the 99th percentile and ");
+		AppendUnsigned(work, kAnalysisOutlierFactor);
+		pstrcat(work, "\p times the median): ");
+		AppendUnsigned(work, analysisPtr->outliers);
+		LOG(work);
+		for (i = 0; i < analysisPtr->outlierCount; i++) {
+			outlierPtr = &analysisPtr->outlier[i];
+			pstrcpy(work, "\p  Command ");
+			AppendUnsigned(work, outlierPtr->record + 1);
+			pstrcat(work, "\p, ");
+			AppendGroupName(work, &analysisPtr->group[outlierPtr->group]);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, outlierPtr->latency);
+			pstrcat(work, "\p usec (median ");
+			AppendUnsigned(work, analysisPtr->group[outlierPtr->group].median);
+			pstrcat(work, "\p)");
+			LOG(work);
+		}
+}
+
+static void
+AppendGroupName(
+		StringPtr				result,
+		const AnalysisGroup		*groupPtr
+	)
+{
+		DeviceIdent				scsiDevice;
+		StringPtr				commandName;
+
+		CLEAR(scsiDevice);
+		scsiDevice.bus = groupPtr->bus;
+		scsiDevice.targetID = groupPtr->targetID;
+		scsiDevice.LUN = groupPtr->LUN;
+		AppendDeviceID(result, scsiDevice);
+		pstrcat(result, "\p ");
+		commandName = GetCommandName(groupPtr->opcode);
+		if (commandName != NULL)
+			pstrcat(result, commandName);
+		else {
+			pstrcat(result, "\pCommand ");
+			AppendHexLeadingZeros(result, groupPtr->opcode, 2);
+		}
+}
+
+/*
+ * Append "count (n per 1000)".
+ */
+static void
+AppendRate(
+		StringPtr				result,
+		unsigned long			count,
+		unsigned long			total
+	)
+{
+		AppendUnsigned(result, count);
+		if (count != 0) {
+			pstrcat(result, "\p (");
+			AppendUnsigned(result, (count < 4000000L)
+				? (count * 1000L) / total
+				: count / (total / 1000L));
+			pstrcat(result, "\p per 1000)");
+		}
+}
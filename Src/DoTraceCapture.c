@@ -0,0 +1,56 @@
+/*									DoTraceCapture.c							*/
+/*
+ * DoTraceCapture.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Start capturing a command trace (see CommandTrace.h) in a file that the
+ * user names or, if a trace is being captured, stop and display the number
+ * of commands that it holds. Every command executed by DoSCSICommandWithSense
+ * is captured, whichever menu command issued it.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+void
+DoTraceCapture(void)
+{
+		Point					where;
+		SFReply					reply;
+		unsigned long			records;
+		OSErr					status;
+		Str255					work;
+
+		if (gCommandTrace.active) {
+			records = gCommandTrace.records;
+			status = CommandTraceStop(&gCommandTrace);
+			if (status != noErr)
+				DisplaySCSIErrorMessage(
+					status, "\pCan't write the command trace");
+			else {
+				pstrcpy(work, "\pCommand trace closed: ");
+				AppendUnsigned(work, records);
+				pstrcat(work, "\p commands");
+				LOG(work);
+			}
+		}
+		else {
+			SetPt(&where, 80, 80);
+			SFPutFile(where, "\pSave the command trace as:", "\pCommand Trace",
+				NULL, &reply);
+			if (reply.good == FALSE)
+				return;
+			status = CommandTraceStart(
+						&gCommandTrace, reply.fName, reply.vRefNum,
+						kApplicationCreator);
+			if (status != noErr)
+				DisplaySCSIErrorMessage(
+					status, "\pCan't create the command trace");
+			else {
+				pstrcpy(work, "\pCapturing commands in \"");
+				pstrcat(work, reply.fName);
+				pstrcat(work, "\p\"");
+				LOG(work);
+			}
+		}
+		gUpdateMenusNeeded = TRUE;
+}
@@ -0,0 +1,122 @@
+/*									DoTraceIndex.c								*/
+/*
+ * DoTraceIndex.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Display the index of a command trace (see CommandTrace.h): the number of
+ * commands, the width of its time buckets, and, for each device, the number
+ * of commands, when they completed, and the device's Inquiry string. Each
+ * device's commands are then found with CommandTraceQuery, and the number of
+ * records read and the time taken are displayed, with the time taken to read
+ * the whole trace for comparison.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+void
+DoTraceIndex(void)
+{
+		Point					where;
+		SFTypeList				typeList;
+		SFReply					reply;
+		TraceReader				reader;
+		TraceRecordPtr			recordPtr;
+		register TraceIndexPtr	indexPtr;
+		register TraceDevicePtr	devicePtr;
+		register short			i;
+		DeviceIdent				scsiDevice;
+		UnsignedWide			startTime;
+		unsigned long			records;
+		unsigned long			scanTime;
+		OSErr					status;
+		Str255					work;
+
+		SetPt(&where, 80, 80);
+		typeList[0] = kTraceFileType;
+		SFGetFile(where, "\p", NULL, 1, typeList, NULL, &reply);
+		if (reply.good == FALSE)
+			return;
+		status = CommandTraceOpen(&reader, reply.fName, reply.vRefNum);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't read the command trace");
+			return;
+		}
+		/*
+		 * Read every record, as a trace without an index must be read.
+		 */
+		records = 0;
+		Microseconds(&startTime);
+		while ((status = CommandTraceNext(&reader, &recordPtr)) == noErr)
+			++records;
+		scanTime = CommandTraceElapsed(&startTime);
+		pstrcpy(work, "\pCommand trace \"");
+		pstrcat(work, reply.fName);
+		pstrcat(work, "\p\": ");
+		AppendUnsigned(work, records);
+		pstrcat(work, "\p commands, read in ");
+		AppendUnsigned(work, scanTime);
+		pstrcat(work, "\p usec");
+		LOG(work);
+		if (status != eofErr)
+			DisplaySCSIErrorMessage(status, "\pCan't read the command trace");
+		indexPtr = reader.indexPtr;
+		if (indexPtr == NULL) {
+			LOG("\p  No index: an older trace, or one that was not closed");
+			CommandTraceClose(&reader);
+			return;
+		}
+		pstrcpy(work, "\p  ");
+		AppendUnsigned(work, indexPtr->bucketCount);
+		pstrcat(work, "\p buckets of ");
+		AppendUnsigned(work, indexPtr->bucketMsec);
+		pstrcat(work, "\p msec, ");
+		AppendUnsigned(work, indexPtr->deviceCount);
+		pstrcat(work, "\p devices");
+		if ((indexPtr->flags & kTraceIndexDeviceOverflow) != 0)
+			pstrcat(work, "\p (some devices are not indexed)");
+		LOG(work);
+		for (i = 0; i < indexPtr->deviceCount; i++) {
+			devicePtr = &indexPtr->device[i];
+			CLEAR(scsiDevice);
+			scsiDevice.bus = devicePtr->bus;
+			scsiDevice.targetID = devicePtr->targetID;
+			scsiDevice.LUN = devicePtr->LUN;
+			pstrcpy(work, "\p  ");
+			AppendDeviceID(work, scsiDevice);
+			pstrcat(work, "\p: ");
+			AppendUnsigned(work, devicePtr->records);
+			pstrcat(work, "\p commands, ");
+			AppendUnsigned(work, devicePtr->firstMsec);
+			pstrcat(work, "\p to ");
+			AppendUnsigned(work, devicePtr->lastMsec);
+			pstrcat(work, "\p msec");
+			if (devicePtr->stringOffset != kTraceNoString) {
+				pstrcat(work, "\p, \"");
+				pstrcat(work, &indexPtr->stringTable[devicePtr->stringOffset]);
+				pstrcat(work, "\p\"");
+			}
+			LOG(work);
+			Microseconds(&startTime);
+			status = CommandTraceQuery(&reader, &scsiDevice, 0L, 0xFFFFFFFF);
+			records = 0;
+			if (status == noErr) {
+				while ((status = CommandTraceNext(&reader, &recordPtr))
+						== noErr)
+					++records;
+			}
+			if (status != eofErr) {
+				DisplaySCSIErrorMessage(
+					status, "\pCan't read the command trace");
+				break;
+			}
+			pstrcpy(work, "\p    Query found ");
+			AppendUnsigned(work, records);
+			pstrcat(work, "\p, read ");
+			AppendUnsigned(work, reader.recordsRead);
+			pstrcat(work, "\p records in ");
+			AppendUnsigned(work, CommandTraceElapsed(&startTime));
+			pstrcat(work, "\p usec");
+			LOG(work);
+		}
+		CommandTraceClose(&reader);
+}
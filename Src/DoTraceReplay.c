@@ -0,0 +1,242 @@
+/*									DoTraceReplay.c								*/
+/*
+ * DoTraceReplay.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Replay a command trace (see CommandTrace.h). The trace's commands are
+ * re-issued through DoSCSICommandWithSense twice: first at their original
+ * pace (each command is issued as long after the start as it was when it was
+ * captured, or at once if the replay has fallen behind), then one after
+ * another, as fast as possible. For each pass, the elapsed time and the
+ * average recorded and replayed latency are displayed, with the command that
+ * slowed down the most and the number of commands whose result changed.
+ *
+ * The commands are sent to the devices that they were captured on or, if the
+ * Option key is held down when the command is chosen, to the same targets on
+ * the virtual bus. Only commands that are known not to change the device
+ * (IsReadOnlyCommand) are replayed on real devices: a trace may hold
+ * anything, and the kTraceWrite flag only says which way the data went,
+ * which misses commands such as Format Unit or Start Stop Unit. The others
+ * are skipped, and counted. On the virtual bus, where they change only the
+ * virtual disks, every command is replayed. Commands that transfer more than
+ * kReplayBufferSize bytes are skipped everywhere. Replayed commands are
+ * captured, if a trace is being captured.
+ */
+#include "SCSISimpleSample.h"
+#include <StandardFile.h>
+
+#define kReplayBufferSize		65536L
+
+static void						ReplayPass(
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		Boolean					onVirtualBus,
+		unsigned short			virtualBus,
+		Boolean					paced,
+		Ptr						bufferPtr,
+		ConstStr255Param		passName
+	);
+static Boolean					IsReadOnlyCommand(
+		unsigned char			opcode
+	);
+
+void
+DoTraceReplay(void)
+{
+		Boolean					onVirtualBus;
+		unsigned short			virtualBus;
+		Point					where;
+		SFTypeList				typeList;
+		SFReply					reply;
+		Ptr						bufferPtr;
+		Str255					work;
+
+		virtualBus = 0;
+		onVirtualBus = ((EVENT.modifiers & optionKey) != 0);
+		if (onVirtualBus && VirtualSIMBusID(&virtualBus) == FALSE) {
+			LOG("\pInstall the virtual SCSI bus first");
+			return;
+		}
+		SetPt(&where, 80, 80);
+		typeList[0] = kTraceFileType;
+		SFGetFile(where, "\p", NULL, 1, typeList, NULL, &reply);
+		if (reply.good == FALSE)
+			return;
+		bufferPtr = NewPtrClear(kReplayBufferSize);
+		if (bufferPtr == NULL) {
+			LOG("\pNo memory for the replay buffer");
+			return;
+		}
+		pstrcpy(work, "\pReplay \"");
+		pstrcat(work, reply.fName);
+		pstrcat(work, (onVirtualBus) ? "\p\" on the virtual bus" : "\p\"");
+		LOG(work);
+		ReplayPass(reply.fName, reply.vRefNum, onVirtualBus, virtualBus,
+			TRUE, bufferPtr, "\pOriginal pace");
+		ReplayPass(reply.fName, reply.vRefNum, onVirtualBus, virtualBus,
+			FALSE, bufferPtr, "\pAs fast as possible");
+		DisposePtr(bufferPtr);
+}
+
+static void
+ReplayPass(
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		Boolean					onVirtualBus,
+		unsigned short			virtualBus,
+		Boolean					paced,
+		Ptr						bufferPtr,
+		ConstStr255Param		passName
+	)
+{
+		TraceReader				reader;
+		TraceRecordPtr			recordPtr;
+		ScsiCmdBlock			scsiCmdBlock;
+		UnsignedWide			startTime;
+		UnsignedWide			issuedTime;
+		register short			i;
+		unsigned long			index;
+		unsigned long			latency;
+		unsigned long			replayed;
+		unsigned long			skipped;
+		unsigned long			unsafe;
+		unsigned long			changed;
+		unsigned long			recordedLatency;
+		unsigned long			replayedLatency;
+		unsigned long			recordedMsec;
+		unsigned long			worstSlowdown;
+		unsigned long			worstIndex;
+		OSErr					status;
+		Str255					work;
+#define SCB	(scsiCmdBlock)
+
+		status = CommandTraceOpen(&reader, fileName, vRefNum);
+		if (status != noErr) {
+			DisplaySCSIErrorMessage(status, "\pCan't read the command trace");
+			return;
+		}
+		replayed = 0;
+		skipped = 0;
+		unsafe = 0;
+		changed = 0;
+		recordedLatency = 0;
+		replayedLatency = 0;
+		recordedMsec = 0;
+		worstSlowdown = 0;
+		worstIndex = 0;
+		Microseconds(&startTime);
+		for (index = 0;
+				(status = CommandTraceNext(&reader, &recordPtr)) == noErr;
+				index++) {
+			recordedMsec = TraceCompletedMsec(recordPtr);
+			if (onVirtualBus == FALSE
+			 && (recordPtr->cdbLength == 0
+			  || (recordPtr->flags & kTraceWrite) != 0
+			  || IsReadOnlyCommand(recordPtr->cdb[0]) == FALSE)) {
+				++skipped;
+				++unsafe;
+				continue;
+			}
+			if (recordPtr->transferSize > kReplayBufferSize) {
+				++skipped;
+				continue;
+			}
+			CLEAR(SCB);
+			SCB.scsiDevice.bus = (onVirtualBus) ? virtualBus : recordPtr->bus;
+			SCB.scsiDevice.targetID = recordPtr->targetID;
+			SCB.scsiDevice.LUN = recordPtr->LUN;
+			for (i = 0; i < recordPtr->cdbLength; i++)
+				SCB.command.scsi[i] = recordPtr->cdb[i];
+			if (recordPtr->transferSize != 0)
+				SCB.bufferPtr = bufferPtr;
+			SCB.transferSize = recordPtr->transferSize;
+			SCB.transferQuantum = recordPtr->transferQuantum;
+			SCB.writeToDevice = ((recordPtr->flags & kTraceWrite) != 0);
+			if (paced) {
+				while (CommandTraceElapsedMsec(&startTime)
+						< recordPtr->issuedMsec)
+					SCSIEnvironmentIdle(&gSCSIEnvironment);
+			}
+			Microseconds(&issuedTime);
+			DoSCSICommandWithSense(
+				&scsiCmdBlock, FALSE, (recordPtr->flags & kTraceAsync) != 0);
+			latency = CommandTraceElapsed(&issuedTime);
+			++replayed;
+			recordedLatency += recordPtr->latency;
+			replayedLatency += latency;
+			if (latency > recordPtr->latency
+			 && latency - recordPtr->latency > worstSlowdown) {
+				worstSlowdown = latency - recordPtr->latency;
+				worstIndex = index;
+			}
+			if (SCB.status != recordPtr->status)
+				++changed;
+		}
+		CommandTraceClose(&reader);
+		if (status != eofErr)
+			DisplaySCSIErrorMessage(status, "\pCan't read the command trace");
+		pstrcpy(work, passName);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, replayed);
+		pstrcat(work, "\p commands in ");
+		AppendUnsigned(work, CommandTraceElapsedMsec(&startTime));
+		pstrcat(work, "\p msec (captured in ");
+		AppendUnsigned(work, recordedMsec);
+		pstrcat(work, "\p msec), ");
+		AppendUnsigned(work, skipped);
+		pstrcat(work, "\p skipped");
+		if (unsafe != 0) {
+			pstrcat(work, "\p (");
+			AppendUnsigned(work, unsafe);
+			pstrcat(work, "\p not read-only)");
+		}
+		LOG(work);
+		if (replayed == 0)
+			return;
+		pstrcpy(work, "\p  Average latency: ");
+		AppendUnsigned(work, recordedLatency / replayed);
+		pstrcat(work, "\p usec captured, ");
+		AppendUnsigned(work, replayedLatency / replayed);
+		pstrcat(work, "\p usec replayed");
+		LOG(work);
+		if (worstSlowdown != 0) {
+			pstrcpy(work, "\p  Worst slowdown: ");
+			AppendUnsigned(work, worstSlowdown);
+			pstrcat(work, "\p usec, command ");
+			AppendUnsigned(work, worstIndex + 1);
+			LOG(work);
+		}
+		if (changed != 0) {
+			pstrcpy(work, "\p  ");
+			AppendUnsigned(work, changed);
+			pstrcat(work, "\p commands had a different result");
+			LOG(work);
+		}
+#undef SCB
+}
+
+/*
+ * The commands that may be replayed on a real device: they only report
+ * on the device or read from it.
+ */
+static Boolean
+IsReadOnlyCommand(
+		unsigned char			opcode
+	)
+{
+		switch (opcode) {
+		case kScsiCmdTestUnitReady:
+		case kScsiCmdInquiry:
+		case kScsiCmdRead6:
+		case kScsiCmdRead10:
+		case kScsiCmdReadCapacity:
+		case kScsiCmdModeSense6:
+		case kScsiCmdModeSense12:
+		case kScsiCmdRequestSense:
+		case kScsiCmdReadCDTableOfContents:
+		case kScsiCmdReadBlockLimits:
+			return (TRUE);
+		default:
+			return (FALSE);
+		}
+}
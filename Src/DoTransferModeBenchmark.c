@@ -0,0 +1,507 @@
+/*							DoTransferModeBenchmark.c							*/
+/*
+ * DoTransferModeBenchmark.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Compare blind, polled, and learned transfers on the original SCSI Manager.
+ * This runs on a simulated bus, as the original manager's transfer mode is
+ * fixed by the hardware it happens to be running on, and a device that fails
+ * blind transfers is needed to see the difference. The same workload (reads,
+ * writes, and Inquiry commands, generated from a fixed seed) is run with each
+ * policy:
+ *	-- All polled: every transfer is polled, as if every TIB quantum were one.
+ *	-- All blind: every transfer is blind. A command whose transfer fails is
+ *	   not retried: it is returned to the caller as an error.
+ *	-- Learned: OriginalSCSI's policy (see OriginalSCSI.h), run on a table of
+ *	   our own with OriginalSCSIUsePolled and OriginalSCSILearnTransfer.
+ * Commands are executed one at a time, as the original manager does. Each is
+ * charged arbitration, selection, the command, status, and message bytes (at
+ * the bus simulator's asynchronous rate), and the target's own work. The data
+ * is charged whichever is slower: the handshake cost on the Macintosh side
+ * (per byte, plus a wait for REQ at each TIB quantum for blind transfers), or
+ * the target's own rate. There are three targets:
+ *	-- A fast disk (target 0) that is safe for blind transfers.
+ *	-- An old disk (target 2) that pauses for its buffer every 256 bytes, in
+ *	   the middle of its 512-byte blocks. A blind transfer overruns the pause:
+ *	   it stops with a bus timeout before the first block is counted.
+ *	-- A CD-ROM player (target 4) that delivers its data at 300K/sec, so the
+ *	   handshake cost hardly matters.
+ * Inquiry asks for 255 bytes, and each device returns 36, so every Inquiry
+ * ends with a phase error: the learned policy must not count this.
+ *
+ * For each policy, the simulated time, the throughput, the failed commands,
+ * and the polled retries are displayed, with the time spent on each target.
+ *
+ * The same workload is then run through a Check Condition storm: one command
+ * in kTMStormRate is rejected with Check Condition, and its sense data must
+ * be read. This is timed both ways OriginalSCSI has done it:
+ *	-- Separately: OriginalSCSI returns statusErr, releasing its memory holds,
+ *	   and the caller issues Request Sense with a second OriginalSCSI call,
+ *	   which takes the holds again.
+ *	-- Inline: OriginalSCSI issues Request Sense itself, at once, while
+ *	   everything is still held.
+ * Either way, each OriginalSCSI call holds and unholds kTMHolds ranges (the
+ * function, its stack, the command block or sense buffer, and the data) when
+ * virtual memory is running, so the storm is run with and without it. For
+ * each, the average Check Condition round trip (from the start of the
+ * rejected command until the sense data is in hand) is displayed, with the
+ * simulated time for the whole workload.
+ */
+#include "SCSISimpleSample.h"
+
+#define kTMCommands				2000
+#define kTMSeed					1994L
+#define kTMPolledByteTime		20L				/* 2.0 usec: test REQ, move	*/
+#define kTMBlindByteTime		4L				/* 0.4 usec					*/
+#define kTMQuantumTime			40L				/* 4.0 usec: wait for REQ	*/
+#define kTMGapTime				(kSimUnitsPerMsec / 10L)	/* Buffer pause	*/
+#define kTMFailTime				kSimUnitsPerMsec	/* Bus timeout, cleanup	*/
+#define kTMInquiryLength		255
+#define kTMInquiryData			36				/* Device's Inquiry data	*/
+#define kTMTargets				(sizeof gTMTarget / sizeof gTMTarget[0])
+#define kTMStormSeed			1995L
+#define kTMStormRate			3				/* One command in three		*/
+#define kTMCheckTime			(kSimUnitsPerMsec / 2L)	/* Target rejects	*/
+#define kTMSenseService			(kSimUnitsPerMsec / 5L)	/* Target reports	*/
+#define kTMSenseBytes			sizeof (SCSI_Sense_Data)
+#define kTMHoldTime				500L			/* 50 usec: Hold or Unhold	*/
+#define kTMHolds				4				/* Per OriginalSCSI call	*/
+#define kTMCallTime				200L			/* 20 usec: return, call	*/
+
+/*
+ * Transfer policies.
+ */
+enum {
+	kTMAllPolled = 0,
+	kTMAllBlind,
+	kTMLearned,
+	kTMPolicies
+};
+
+struct TMTarget {
+	unsigned short		targetID;
+	StringPtr			name;
+	unsigned long		rate;					/* Bytes per msec			*/
+	unsigned long		gapBytes;				/* Pauses after, 0 = none	*/
+	unsigned long		blockSize;				/* Read/Write TIB quantum	*/
+	unsigned long		service;				/* Target's own work		*/
+};
+typedef struct TMTarget TMTarget;
+
+static const TMTarget			gTMTarget[] = {
+	{ 0, "\pFast disk",	5000L,	0L,		512L,	1L * kSimUnitsPerMsec },
+	{ 2, "\pOld disk",	1200L,	256L,	512L,	15L * kSimUnitsPerMsec },
+	{ 4, "\pCD-ROM",	300L,	0L,		2048L,	30L * kSimUnitsPerMsec }
+};
+
+struct TMCommand {
+	unsigned short		target;					/* Index in gTMTarget		*/
+	unsigned char		opcode;
+	Boolean				write;
+	unsigned long		length;					/* transferSize				*/
+	unsigned long		quantum;				/* transferQuantum			*/
+};
+typedef struct TMCommand TMCommand, *TMCommandPtr;
+
+struct TMResult {
+	unsigned long		time;					/* Simulated				*/
+	unsigned long		bytes;					/* Of successful commands	*/
+	unsigned long		failed;
+	unsigned long		retries;				/* Polled, after blind		*/
+	unsigned long		targetTime[kTMTargets];
+	OriginalTransferInfo	info[kMaxOriginalTargetID + 1];	/* kTMLearned	*/
+};
+typedef struct TMResult TMResult, *TMResultPtr;
+
+struct TMStormResult {
+	unsigned long		time;					/* Simulated				*/
+	unsigned long		checks;					/* Check Conditions			*/
+	unsigned long		roundTrip;				/* Their total round trip	*/
+};
+typedef struct TMStormResult TMStormResult, *TMStormResultPtr;
+
+static const StringPtr			gTMPolicyName[kTMPolicies] = {
+	"\pAll polled",
+	"\pAll blind",
+	"\pLearned"
+};
+
+static unsigned long			gTMSeed;
+
+static void						RunTransferModePolicy(
+		unsigned short			policy,
+		const TMCommand			command[],
+		TMResultPtr				resultPtr
+	);
+static unsigned long			SimulateTransfer(
+		const TMCommand			*commandPtr,
+		Boolean					polled,
+		OSErr					*status,
+		unsigned long			*transferCount
+	);
+static void						ShowTransferModeResult(
+		unsigned short			policy,
+		const TMResult			*resultPtr
+	);
+static void						RunCheckConditionStorm(
+		const TMCommand			command[],
+		Boolean					inlineSense,
+		Boolean					vmRunning,
+		TMStormResultPtr		resultPtr
+	);
+static unsigned long			SimulateCheckCondition(
+		const TMCommand			*commandPtr
+	);
+static void						ShowCheckConditionStorm(
+		const TMCommand			command[]
+	);
+static void						MakeTransferWorkload(
+		TMCommand				command[]
+	);
+static unsigned long			TransferModeRandom(void);
+
+void
+DoTransferModeBenchmark(void)
+{
+		TMCommandPtr			commandPtr;
+		TMResultPtr				resultPtr;
+		register unsigned short	policy;
+
+		LOG("\pBlind and Polled Transfer Simulator");
+		commandPtr = (TMCommandPtr) NewPtr(sizeof (TMCommand) * kTMCommands);
+		resultPtr = (TMResultPtr) NewPtr(sizeof (TMResult));
+		if (commandPtr == NULL || resultPtr == NULL) {
+			LOG("\pNo memory for the simulated workload");
+			goto exit;
+		}
+		MakeTransferWorkload(commandPtr);
+		for (policy = 0; policy < kTMPolicies; policy++) {
+			RunTransferModePolicy(policy, commandPtr, resultPtr);
+			ShowTransferModeResult(policy, resultPtr);
+		}
+		ShowCheckConditionStorm(commandPtr);
+exit:
+		if (resultPtr != NULL)
+			DisposePtr((Ptr) resultPtr);
+		if (commandPtr != NULL)
+			DisposePtr((Ptr) commandPtr);
+}
+
+/*
+ * Run the workload with one policy. Each command is issued as OriginalSCSI
+ * would issue it: for kTMLearned, a blind transfer that fails is retried once,
+ * polled, if OriginalSCSILearnTransfer says so.
+ */
+static void
+RunTransferModePolicy(
+		unsigned short			policy,
+		const TMCommand			command[],
+		TMResultPtr				resultPtr
+	)
+{
+		register const TMCommand	*commandPtr;
+		register unsigned short	i;
+		OriginalTransferInfoPtr	infoPtr;
+		SCSI_Command			cdb;
+		Boolean					polled;
+		Boolean					retry;
+		unsigned long			time;
+		unsigned long			transferCount;
+		OSErr					status;
+
+		CLEAR(*resultPtr);
+		CLEAR(cdb);
+		for (i = 0; i < kTMCommands; i++) {
+			commandPtr = &command[i];
+			infoPtr = &resultPtr->info[gTMTarget[commandPtr->target].targetID];
+			cdb.scsi[0] = commandPtr->opcode;
+			switch (policy) {
+			case kTMAllPolled:	polled = TRUE;		break;
+			case kTMAllBlind:	polled = FALSE;		break;
+			default:
+				polled = OriginalSCSIUsePolled(infoPtr, commandPtr->quantum);
+				break;
+			}
+			time = SimulateTransfer(
+						commandPtr, polled, &status, &transferCount);
+			if (policy == kTMLearned) {
+				retry = OriginalSCSILearnTransfer(
+							infoPtr, &cdb, commandPtr->write, polled,
+							status, transferCount, commandPtr->length);
+				if (retry) {
+					resultPtr->retries++;
+					time += SimulateTransfer(
+								commandPtr, TRUE, &status, &transferCount);
+					(void) OriginalSCSILearnTransfer(
+							infoPtr, &cdb, commandPtr->write, TRUE,
+							status, transferCount, commandPtr->length);
+				}
+			}
+			/*
+			 * Inquiry normally ends with a phase error: the device had less
+			 * data than we asked for.
+			 */
+			if (status == scPhaseErr && commandPtr->opcode == kScsiCmdInquiry)
+				status = noErr;
+			if (status != noErr)
+				resultPtr->failed++;
+			else if (commandPtr->opcode == kScsiCmdInquiry)
+				resultPtr->bytes += kTMInquiryData;
+			else {
+				resultPtr->bytes += commandPtr->length;
+			}
+			resultPtr->time += time;
+			resultPtr->targetTime[commandPtr->target] += time;
+		}
+}
+
+/*
+ * Return the simulated time for one attempt at a command, with its transfer
+ * status and the byte count that the TIB would return.
+ */
+static unsigned long
+SimulateTransfer(
+		const TMCommand			*commandPtr,
+		Boolean					polled,
+		OSErr					*status,
+		unsigned long			*transferCount
+	)
+{
+		register const TMTarget	*targetPtr;
+		unsigned long			time;
+		unsigned long			deviceBytes;
+		unsigned long			bytes;
+		unsigned long			hostTime;
+		unsigned long			targetTime;
+
+		targetPtr = &gTMTarget[commandPtr->target];
+		time = kSimArbitrationTime
+			 + kSimSelectionTime
+			 + BusSimTransferTime(kSimCommandBytes + 2, kSimAsyncRate)
+			 + targetPtr->service;
+		deviceBytes = commandPtr->length;
+		if (commandPtr->opcode == kScsiCmdInquiry
+		 && deviceBytes > kTMInquiryData)
+			deviceBytes = kTMInquiryData;
+		*status = (deviceBytes < commandPtr->length) ? scPhaseErr : noErr;
+		bytes = deviceBytes;
+		if (polled == FALSE
+		 && targetPtr->gapBytes != 0
+		 && targetPtr->gapBytes < commandPtr->quantum
+		 && deviceBytes > targetPtr->gapBytes) {
+			/*
+			 * The target pauses inside a TIB quantum, where the blind loop
+			 * does not wait for REQ.
+			 */
+			bytes = targetPtr->gapBytes;
+			*status = scBusTOErr;
+			time += kTMFailTime;
+		}
+		*transferCount = (bytes / commandPtr->quantum) * commandPtr->quantum;
+		if (polled)
+			hostTime = bytes * kTMPolledByteTime;
+		else {
+			hostTime = bytes * kTMBlindByteTime
+					 + (bytes / commandPtr->quantum + 1) * kTMQuantumTime;
+		}
+		targetTime = BusSimTransferTime(bytes, targetPtr->rate);
+		time += (hostTime > targetTime) ? hostTime : targetTime;
+		if (targetPtr->gapBytes != 0)
+			time += (bytes / targetPtr->gapBytes) * kTMGapTime;
+		return (time);
+}
+
+static void
+ShowTransferModeResult(
+		unsigned short			policy,
+		const TMResult			*resultPtr
+	)
+{
+		register unsigned short	i;
+		unsigned long			msec;
+		Str255					work;
+
+		msec = resultPtr->time / kSimUnitsPerMsec;
+		if (msec == 0)
+			msec = 1;
+		pstrcpy(work, gTMPolicyName[policy]);
+		pstrcat(work, "\p: ");
+		AppendUnsigned(work, msec);
+		pstrcat(work, "\p msec simulated, ");
+		AppendUnsigned(work, resultPtr->bytes / msec);
+		pstrcat(work, "\pK/sec, ");
+		AppendUnsigned(work, resultPtr->failed);
+		pstrcat(work, "\p failed, ");
+		AppendUnsigned(work, resultPtr->retries);
+		pstrcat(work, "\p polled retries");
+		LOG(work);
+		pstrcpy(work, "\p  msec:");
+		for (i = 0; i < kTMTargets; i++) {
+			pstrcat(work, "\p ");
+			pstrcat(work, gTMTarget[i].name);
+			pstrcat(work, "\p ");
+			AppendUnsigned(work, resultPtr->targetTime[i] / kSimUnitsPerMsec);
+			if (policy == kTMLearned
+			 && resultPtr->info[gTMTarget[i].targetID].usePolledTransfer)
+				pstrcat(work, "\p (now polled)");
+		}
+		LOG(work);
+}
+
+/*
+ * Run the workload through the Check Condition storm, with the sense data read
+ * inline or by a separate call. The storm has its own seed, so every run
+ * rejects the same commands. A command that is not rejected is polled, as
+ * the transfer mode is not what is measured here.
+ */
+static void
+RunCheckConditionStorm(
+		const TMCommand			command[],
+		Boolean					inlineSense,
+		Boolean					vmRunning,
+		TMStormResultPtr		resultPtr
+	)
+{
+		register const TMCommand	*commandPtr;
+		register unsigned short	i;
+		unsigned long			holdTime;
+		unsigned long			time;
+		unsigned long			transferCount;
+		OSErr					status;
+
+		CLEAR(*resultPtr);
+		holdTime = (vmRunning) ? 2L * kTMHolds * kTMHoldTime : 0L;
+		gTMSeed = kTMStormSeed;
+		for (i = 0; i < kTMCommands; i++) {
+			commandPtr = &command[i];
+			time = holdTime;
+			if ((TransferModeRandom() % kTMStormRate) != 0)
+				time += SimulateTransfer(
+							commandPtr, TRUE, &status, &transferCount);
+			else {
+				time += SimulateCheckCondition(commandPtr);
+				if (inlineSense == FALSE)
+					time += kTMCallTime + holdTime;	/* Second OriginalSCSI	*/
+				resultPtr->checks++;
+				resultPtr->roundTrip += time;
+			}
+			resultPtr->time += time;
+		}
+}
+
+/*
+ * Return the simulated bus time for a command that the target rejects with
+ * Check Condition (before any data moves), followed by a Request Sense whose
+ * data is polled in.
+ */
+static unsigned long
+SimulateCheckCondition(
+		const TMCommand			*commandPtr
+	)
+{
+		register const TMTarget	*targetPtr;
+		unsigned long			time;
+		unsigned long			hostTime;
+		unsigned long			targetTime;
+
+		targetPtr = &gTMTarget[commandPtr->target];
+		time = kSimArbitrationTime
+			 + kSimSelectionTime
+			 + BusSimTransferTime(kSimCommandBytes + 2, kSimAsyncRate)
+			 + kTMCheckTime;
+		time += kSimArbitrationTime
+			 + kSimSelectionTime
+			 + BusSimTransferTime(
+					sizeof (SCSI_6_Byte_Command) + 2, kSimAsyncRate)
+			 + kTMSenseService;
+		hostTime = kTMSenseBytes * kTMPolledByteTime;
+		targetTime = BusSimTransferTime(kTMSenseBytes, targetPtr->rate);
+		time += (hostTime > targetTime) ? hostTime : targetTime;
+		return (time);
+}
+
+/*
+ * Run the storm both ways, without and with virtual memory, and display the
+ * average Check Condition round trip (in usec) and the simulated time.
+ */
+static void
+ShowCheckConditionStorm(
+		const TMCommand			command[]
+	)
+{
+		TMStormResult			separate;
+		TMStormResult			inlineResult;
+		unsigned short			vm;
+		Str255					work;
+
+		pstrcpy(work, "\pCheck Condition storm (one command in ");
+		AppendUnsigned(work, kTMStormRate);
+		pstrcat(work, "\p), separate vs. inline Request Sense:");
+		LOG(work);
+		for (vm = 0; vm < 2; vm++) {
+			RunCheckConditionStorm(command, FALSE, vm != 0, &separate);
+			RunCheckConditionStorm(command, TRUE, vm != 0, &inlineResult);
+			if (separate.checks == 0)
+				continue;
+			pstrcpy(work, (vm != 0) ? "\p  VM on: " : "\p  VM off: ");
+			AppendUnsigned(work,
+				separate.roundTrip / separate.checks / kSimUnitsPerUsec);
+			pstrcat(work, "\p vs. ");
+			AppendUnsigned(work,
+				inlineResult.roundTrip / inlineResult.checks
+					/ kSimUnitsPerUsec);
+			pstrcat(work, "\p usec per Check Condition, ");
+			AppendUnsigned(work, separate.time / kSimUnitsPerMsec);
+			pstrcat(work, "\p vs. ");
+			AppendUnsigned(work, inlineResult.time / kSimUnitsPerMsec);
+			pstrcat(work, "\p msec in all (");
+			AppendUnsigned(work, separate.checks);
+			pstrcat(work, "\p Check Conditions)");
+			LOG(work);
+		}
+}
+
+/*
+ * Generate the workload. About half of the commands are for the fast disk,
+ * 30% for the old disk, and 20% for the CD-ROM player. One command in ten is
+ * Inquiry; of the others, a quarter of the disk commands are writes.
+ */
+static void
+MakeTransferWorkload(
+		TMCommand				command[]
+	)
+{
+		register TMCommandPtr	commandPtr;
+		register unsigned short	i;
+		unsigned long			choice;
+
+		gTMSeed = kTMSeed;
+		for (i = 0; i < kTMCommands; i++) {
+			commandPtr = &command[i];
+			CLEAR(*commandPtr);
+			choice = TransferModeRandom() % 10;
+			commandPtr->target = (choice < 5) ? 0 : (choice < 8) ? 1 : 2;
+			if ((TransferModeRandom() % 10) == 0) {
+				commandPtr->opcode = kScsiCmdInquiry;
+				commandPtr->length = kTMInquiryLength;
+				commandPtr->quantum = kTMInquiryLength;
+			}
+			else {
+				commandPtr->write = (commandPtr->target != 2
+							&& (TransferModeRandom() & 3) == 0);
+				commandPtr->opcode =
+					(commandPtr->write) ? kScsiCmdWrite10 : kScsiCmdRead10;
+				commandPtr->quantum = gTMTarget[commandPtr->target].blockSize;
+				commandPtr->length = commandPtr->quantum
+							* (1 + TransferModeRandom()
+								% ((commandPtr->target == 2) ? 4 : 16));
+			}
+		}
+}
+
+static unsigned long
+TransferModeRandom(void)
+{
+		gTMSeed = gTMSeed * 1103515245L + 12345L;
+		return ((gTMSeed >> 16) & 0x7FFF);
+}
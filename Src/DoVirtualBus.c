@@ -0,0 +1,53 @@
+/*									DoVirtualBus.c								*/
+/*
+ * DoVirtualBus.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Install or remove the virtual SCSI bus. When the bus is removed, display
+ * the number of commands, bytes, and errors for each virtual target: these
+ * show where the sample's time went without a hardware analyzer. Attached disk
+ * images are written back first.
+ */
+#include "SCSISimpleSample.h"
+
+void
+DoVirtualBus(void)
+{
+		OSErr					status;
+		unsigned short			busID;
+		unsigned short			targetID;
+		VirtualTargetPtr		targetPtr;
+		Str255					work;
+
+		if (VirtualSIMBusID(&busID) == FALSE) {
+			status = VirtualSIMInstall();
+			if (status != noErr)
+				DisplaySCSIErrorMessage(status, "\pInstall Virtual SCSI Bus");
+			else if (VirtualSIMBusID(&busID)) {
+				pstrcpy(work, "\pVirtual SCSI bus installed as bus ");
+				AppendUnsigned(work, busID);
+				LOG(work);
+			}
+		}
+		else {
+			for (targetID = 0; targetID < kVirtualMaxTarget; targetID++) {
+				targetPtr = VirtualSIMGetTarget(targetID);
+				if (targetPtr != NULL && targetPtr->commandProc != NULL) {
+					pstrcpy(work, "\pTarget ");
+					AppendUnsigned(work, targetID);
+					pstrcat(work, "\p: ");
+					AppendUnsigned(work, targetPtr->commands);
+					pstrcat(work, "\p commands, ");
+					AppendUnsigned(work, targetPtr->bytesTransferred);
+					pstrcat(work, "\p bytes, ");
+					AppendUnsigned(work, targetPtr->checkConditions);
+					pstrcat(work, "\p errors");
+					LOG(work);
+				}
+			}
+			VirtualImageDetachAll();
+			VirtualSIMRemove();
+			LOG("\pVirtual SCSI bus removed");
+		}
+		gUpdateMenusNeeded = TRUE;
+}
@@ -0,0 +1,72 @@
+/*									DoWatchdogTest.c							*/
+/*
+ * DoWatchdogTest.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Exercise the watchdog recovery sequence. We can't make a real device hang,
+ * so we tell the watchdog to treat the next request as hung: its deadline
+ * expires at once, and the watchdog aborts the request and, if necessary,
+ * resets the device and the bus. The recovery statistics are then displayed.
+ * If the device is on the virtual SCSI bus, we can make it hang: the request
+ * then does not complete until the watchdog's recovery actually succeeds.
+ * Note: this may reset the SCSI bus, and should not be run while other
+ * devices on the bus are busy.
+ */
+#include "SCSISimpleSample.h"
+
+static void					ShowWatchdogValue(
+		ConstStr255Param		label,
+		unsigned long			value
+	);
+
+void
+DoWatchdogTest(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	)
+{
+		ScsiCmdBlock				scsiCmdBlock;
+		SCSIWatchdogStatistics		statistics;
+		unsigned long				startTicks;
+		unsigned short				virtualBusID;
+		Boolean						isVirtual;
+#define SCB	(scsiCmdBlock)
+
+		ShowSCSIBusID(scsiDevice, "\pWatchdog Recovery Test");
+		SCSIWatchdogResetStatistics(&gSCSIEnvironment.watchdog);
+		CLEAR(SCB);
+		SCB.scsiDevice = scsiDevice;
+		SCB.command.scsi6.opcode = kScsiCmdTestUnitReady;
+		isVirtual = (VirtualSIMBusID(&virtualBusID)
+					&& scsiDevice.bus == virtualBusID);
+		if (isVirtual)
+			VirtualSIMHangTarget(scsiDevice.targetID, TRUE);
+		gSCSIEnvironment.watchdog.simulateHang = TRUE;
+		startTicks = TickCount();
+		DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+		gSCSIEnvironment.watchdog.simulateHang = FALSE;
+		if (isVirtual)
+			VirtualSIMHangTarget(scsiDevice.targetID, FALSE);
+		SCSIWatchdogGetStatistics(&gSCSIEnvironment.watchdog, &statistics);
+		ShowWatchdogValue("\pElapsed ticks", TickCount() - startTicks);
+		ShowWatchdogValue("\pAbort Command", statistics.abortCommands);
+		ShowWatchdogValue("\pReset Device", statistics.deviceResets);
+		ShowWatchdogValue("\pReset Bus", statistics.busResets);
+		ShowWatchdogValue("\pRelease Queue", statistics.queueReleases);
+		ShowWatchdogValue("\pRecovery ticks", statistics.lastRecoveryTicks);
+#undef SCB
+}
+
+static void
+ShowWatchdogValue(
+		ConstStr255Param		label,
+		unsigned long			value
+	)
+{
+		Str255					work;
+
+		pstrcpy(work, label);
+		AppendChar(work, ':');
+		AppendChar(work, ' ');
+		AppendUnsigned(work, value);
+		LOG(work);
+}
@@ -0,0 +1,357 @@
+/*									HealthMonitor.c								*/
+/*
+ * HealthMonitor.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Poll devices with Test Unit Ready, in rounds. See HealthMonitor.h. A Unit
+ * Attention reports an event but does not change the device's state: the
+ * command was not executed, so the device is polled again after
+ * kHealthFastTicks to find out how it is now.
+ */
+#include "SCSISimpleSample.h"
+
+#define kAscMediumChanged		0x28			/* Not ready to ready change	*/
+#define kAscReset				0x29			/* Power on, reset, bus reset	*/
+#define kAscNoMedium			0x3A			/* Medium not present			*/
+
+static OSErr					StartRound(
+		HealthMonitorPtr		monitorPtr
+	);
+static void						FinishRound(
+		HealthMonitorPtr		monitorPtr
+	);
+static void						PollResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	);
+static unsigned short			GetHealthState(
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		unsigned short			oldState
+	);
+static unsigned short			FindBus(
+		HealthMonitorPtr		monitorPtr,
+		unsigned short			busID
+	);
+
+OSErr
+HealthMonitorStart(
+		HealthMonitorPtr		monitorPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		HealthEventProcPtr		eventProc,
+		long					refCon
+	)
+{
+		register unsigned short	i;
+		unsigned long			now;
+
+		CLEAR(*monitorPtr);
+		if (deviceCount == 0 || deviceCount > kHealthMaxDevices)
+			return (paramErr);
+		for (i = 0; i < deviceCount; i++) {
+			if (HealthMonitorAdd(monitorPtr, deviceList[i]) != noErr) {
+				CLEAR(*monitorPtr);
+				return (paramErr);
+			}
+		}
+		now = TickCount();
+		monitorPtr->environmentPtr = environmentPtr;
+		monitorPtr->eventProc = eventProc;
+		monitorPtr->refCon = refCon;
+		monitorPtr->startTicks = now;
+		monitorPtr->nextRoundTicks = now;
+		monitorPtr->active = TRUE;
+		return (noErr);
+}
+
+OSErr
+HealthMonitorIdle(
+		HealthMonitorPtr		monitorPtr
+	)
+{
+		OSErr					status;
+
+		if (monitorPtr->active == FALSE)
+			return (noErr);
+		if (monitorPtr->polling) {
+			if (DeviceSweepPoll(&monitorPtr->sweep) == FALSE)
+				FinishRound(monitorPtr);
+			return (noErr);
+		}
+		if (TickCount() < monitorPtr->nextRoundTicks)
+			return (noErr);
+		status = StartRound(monitorPtr);
+		if (status != noErr)
+			HealthMonitorStop(monitorPtr);
+		return (status);
+}
+
+OSErr
+HealthMonitorAdd(
+		HealthMonitorPtr		monitorPtr,
+		DeviceIdent				scsiDevice
+	)
+{
+		register HealthDevicePtr	devicePtr;
+		register unsigned short	i;
+
+		for (i = 0; i < monitorPtr->deviceCount; i++) {
+			devicePtr = &monitorPtr->device[i];
+			if (devicePtr->scsiDevice.bus == scsiDevice.bus
+			 && devicePtr->scsiDevice.targetID == scsiDevice.targetID
+			 && devicePtr->scsiDevice.LUN == scsiDevice.LUN)
+				return (noErr);
+		}
+		if (monitorPtr->deviceCount == kHealthMaxDevices)
+			return (paramErr);
+		if (FindBus(monitorPtr, scsiDevice.bus) == monitorPtr->busCount) {
+			if (monitorPtr->busCount == kSweepMaxBuses)
+				return (paramErr);
+			monitorPtr->bus[monitorPtr->busCount++].busID = scsiDevice.bus;
+		}
+		devicePtr = &monitorPtr->device[monitorPtr->deviceCount++];
+		CLEAR(*devicePtr);
+		devicePtr->scsiDevice = scsiDevice;
+		devicePtr->state = kHealthUnknown;
+		devicePtr->intervalTicks = kHealthFastTicks;
+		devicePtr->dueTicks = TickCount();
+		return (noErr);
+}
+
+void
+HealthMonitorRemove(
+		HealthMonitorPtr		monitorPtr,
+		unsigned short			deviceIndex
+	)
+{
+		if (deviceIndex >= monitorPtr->deviceCount)
+			return;
+		--monitorPtr->deviceCount;
+		monitorPtr->device[deviceIndex] =
+			monitorPtr->device[monitorPtr->deviceCount];
+}
+
+void
+HealthMonitorStop(
+		HealthMonitorPtr		monitorPtr
+	)
+{
+		if (monitorPtr->polling)
+			DeviceSweepClose(&monitorPtr->sweep);
+		monitorPtr->polling = FALSE;
+		monitorPtr->active = FALSE;
+}
+
+/*
+ * If a device is due, start a round with the devices that are due or nearly
+ * due, at most kHealthMaxPerRound on each bus, the most overdue first.
+ */
+static OSErr
+StartRound(
+		HealthMonitorPtr		monitorPtr
+	)
+{
+		register HealthDevicePtr	devicePtr;
+		register unsigned short	i;
+		DeviceIdent				deviceList[kHealthMaxDevices];
+		Boolean					chosen[kHealthMaxDevices];
+		unsigned short			deviceCount;
+		unsigned short			best;
+		unsigned short			busIndex;
+		unsigned long			now;
+		OSErr					status;
+
+		now = TickCount();
+		for (i = 0; i < monitorPtr->deviceCount; i++) {
+			if (monitorPtr->device[i].dueTicks <= now)
+				break;
+		}
+		if (i == monitorPtr->deviceCount)
+			return (noErr);							/* Nothing is due		*/
+		for (i = 0; i < monitorPtr->busCount; i++)
+			monitorPtr->bus[i].roundPolls = 0;
+		CLEAR(chosen);
+		deviceCount = 0;
+		for (;;) {
+			best = monitorPtr->deviceCount;
+			for (i = 0; i < monitorPtr->deviceCount; i++) {
+				devicePtr = &monitorPtr->device[i];
+				if (chosen[i]
+				 || devicePtr->dueTicks > now + devicePtr->intervalTicks / 4)
+					continue;
+				busIndex = FindBus(monitorPtr, devicePtr->scsiDevice.bus);
+				if (monitorPtr->bus[busIndex].roundPolls == kHealthMaxPerRound)
+					continue;
+				if (best == monitorPtr->deviceCount
+				 || devicePtr->dueTicks < monitorPtr->device[best].dueTicks)
+					best = i;
+			}
+			if (best == monitorPtr->deviceCount)
+				break;
+			chosen[best] = TRUE;
+			busIndex = FindBus(
+						monitorPtr, monitorPtr->device[best].scsiDevice.bus);
+			++monitorPtr->bus[busIndex].roundPolls;
+			monitorPtr->roundDevice[deviceCount] = best;
+			deviceList[deviceCount++] = monitorPtr->device[best].scsiDevice;
+		}
+		status = DeviceSweepOpen(
+					&monitorPtr->sweep, monitorPtr->environmentPtr,
+					deviceList, deviceCount,
+					kSweepTestUnitReady, kHealthPollsPerBus);
+		if (status != noErr)
+			return (status);
+		for (i = 0; i < deviceCount; i++)
+			monitorPtr->sweep.job[i].request.background = TRUE;
+		monitorPtr->sweep.resultProc = PollResult;
+		monitorPtr->sweep.refCon = (long) monitorPtr;
+		monitorPtr->roundStartTicks = now;
+		monitorPtr->polling = TRUE;
+		++monitorPtr->rounds;
+		return (noErr);
+}
+
+/*
+ * Every poll in the round has completed: add each bus's time to its total.
+ */
+static void
+FinishRound(
+		HealthMonitorPtr		monitorPtr
+	)
+{
+		register HealthBus		*busPtr;
+		register unsigned short	i;
+
+		DeviceSweepClose(&monitorPtr->sweep);
+		for (i = 0; i < monitorPtr->busCount; i++) {
+			busPtr = &monitorPtr->bus[i];
+			busPtr->busyTicks += busPtr->roundTicks;
+			busPtr->roundTicks = 0;
+		}
+		monitorPtr->polling = FALSE;
+		monitorPtr->nextRoundTicks = TickCount() + kHealthRoundTicks;
+}
+
+/*
+ * One device's Test Unit Ready has completed (called by DeviceSweepPoll).
+ */
+static void
+PollResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		register HealthMonitorPtr	monitorPtr;
+		register HealthDevicePtr	devicePtr;
+		HealthBus				*busPtr;
+		unsigned short			oldState;
+		unsigned short			event;
+		Boolean					changed;
+		unsigned long			now;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		monitorPtr = (HealthMonitorPtr) sweepPtr->refCon;
+		devicePtr = &monitorPtr->device[monitorPtr->roundDevice[
+					(SweepJob *) requestPtr - sweepPtr->job]];
+		now = TickCount();
+		busPtr = &monitorPtr->bus[FindBus(monitorPtr, SCB.scsiDevice.bus)];
+		++busPtr->polls;
+		busPtr->roundTicks = now - monitorPtr->roundStartTicks;
+		++monitorPtr->polls;
+		++devicePtr->polls;
+		devicePtr->status = SCB.status;
+		devicePtr->senseKey = 0;
+		devicePtr->senseCode = 0;
+		devicePtr->senseQualifier = 0;
+		if (SCB.status == statusErr) {
+			devicePtr->senseKey = SCB.sense.senseKey & kScsiSenseKeyMask;
+			devicePtr->senseCode = SCB.sense.additionalSenseCode;
+			devicePtr->senseQualifier = SCB.sense.additionalSenseQualifier;
+		}
+		oldState = devicePtr->state;
+		devicePtr->state = GetHealthState(&SCB, oldState);
+		changed = (devicePtr->state != oldState);
+		if (devicePtr->senseKey == kScsiSenseUnitAtn) {
+			switch (devicePtr->senseCode) {
+			case kAscMediumChanged:	event = kHealthMediaChange;		break;
+			case kAscReset:			event = kHealthReset;			break;
+			default:				event = kHealthUnitAttention;	break;
+			}
+			changed = TRUE;
+			++devicePtr->events;
+			++monitorPtr->events;
+			if (monitorPtr->eventProc != NULL)
+				(*monitorPtr->eventProc)(
+					monitorPtr, devicePtr, event, oldState);
+		}
+		else if (changed) {
+			++devicePtr->events;
+			++monitorPtr->events;
+			if (monitorPtr->eventProc != NULL)
+				(*monitorPtr->eventProc)(
+					monitorPtr, devicePtr, kHealthStateChange, oldState);
+		}
+		/*
+		 * Fast after anything unusual, slower each time nothing changes.
+		 */
+		if (changed || devicePtr->state != kHealthReady)
+			devicePtr->intervalTicks = kHealthFastTicks;
+		else if (devicePtr->intervalTicks < kHealthSlowTicks) {
+			devicePtr->intervalTicks *= 2;
+			if (devicePtr->intervalTicks > kHealthSlowTicks)
+				devicePtr->intervalTicks = kHealthSlowTicks;
+		}
+		devicePtr->dueTicks = now + devicePtr->intervalTicks;
+#undef SCB
+}
+
+/*
+ * The state shown by a Test Unit Ready result. Unit Attention leaves the
+ * state unchanged.
+ */
+static unsigned short
+GetHealthState(
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		unsigned short			oldState
+	)
+{
+#define SCB	(*scsiCmdBlockPtr)
+
+		switch (SCB.status) {
+		case noErr:
+			return (kHealthReady);
+		case statusErr:
+			switch (SCB.sense.senseKey & kScsiSenseKeyMask) {
+			case kScsiSenseUnitAtn:
+				return (oldState);
+			case kScsiSenseNotReady:
+				if (SCB.sense.additionalSenseCode == kAscNoMedium)
+					return (kHealthNoMedium);
+				return (kHealthNotReady);
+			default:
+				return (kHealthFailed);
+			}
+		case scsiDeviceNotThere:
+		case scsiSelectTimeout:
+			return (kHealthMissing);
+		default:
+			return (kHealthFailed);
+		}
+#undef SCB
+}
+
+static unsigned short
+FindBus(
+		HealthMonitorPtr		monitorPtr,
+		unsigned short			busID
+	)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < monitorPtr->busCount; i++) {
+			if (monitorPtr->bus[i].busID == busID)
+				break;
+		}
+		return (i);
+}
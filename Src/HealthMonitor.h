@@ -0,0 +1,156 @@
+/*									HealthMonitor.h								*/
+/*
+ * HealthMonitor.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Watch a list of devices with Test Unit Ready, and report when one changes
+ * state (becomes ready or not ready, loses its medium, or disappears) or
+ * returns Unit Attention (its medium was changed, or it was reset).
+ *
+ * Each device is polled on its own interval: kHealthFastTicks after an error,
+ * an event, or a change of state, then doubling each time it answers the
+ * same way, up to kHealthSlowTicks. The polls are made in rounds, from the
+ * event loop. A round starts when a device is due, and takes every device
+ * that will be due within a quarter of its interval, so that the devices are
+ * polled together rather than one at a time. A round is one DeviceSweep:
+ * the devices on different buses are polled at once, and within a bus at
+ * most kHealthPollsPerBus at a time, as background requests. The load on a
+ * bus is bounded: a round polls at most kHealthMaxPerRound devices on each
+ * bus (the most overdue first), and rounds start at least kHealthRoundTicks
+ * apart. Each bus counts its polls, and the time from the start of each round
+ * until its last poll completed.
+ */
+#ifndef __HealthMonitor__
+#define __HealthMonitor__
+#include "MacSCSICommand.h"
+#include "DeviceSweep.h"
+
+#define kHealthMaxDevices		32
+#define kHealthFastTicks		60L				/* One second				*/
+#define kHealthSlowTicks		(60L * 60L)		/* One minute				*/
+#define kHealthRoundTicks		60L
+#define kHealthPollsPerBus		1				/* At once					*/
+#define kHealthMaxPerRound		4				/* Per bus					*/
+
+/*
+ * Device states.
+ */
+enum {
+	kHealthUnknown = 0,					/* Not polled yet					*/
+	kHealthReady,
+	kHealthNotReady,					/* Becoming ready, or stopped		*/
+	kHealthNoMedium,					/* Not ready, medium not present	*/
+	kHealthMissing,						/* Selection timeout				*/
+	kHealthFailed						/* Any other error					*/
+};
+
+/*
+ * Events.
+ */
+enum {
+	kHealthStateChange = 0,				/* oldState to devicePtr->state		*/
+	kHealthMediaChange,					/* Unit Attention, ASC 28			*/
+	kHealthReset,						/* Unit Attention, ASC 29			*/
+	kHealthUnitAttention				/* Unit Attention, any other ASC	*/
+};
+
+struct HealthDevice {
+	DeviceIdent			scsiDevice;
+	unsigned short		state;					/* kHealthReady, etc.			*/
+	OSErr				status;					/* Of the last poll				*/
+	unsigned char		senseKey;				/* If status is statusErr		*/
+	unsigned char		senseCode;
+	unsigned char		senseQualifier;
+	unsigned char		reserved;
+	unsigned long		intervalTicks;			/* Until the next poll			*/
+	unsigned long		dueTicks;				/* When it is due				*/
+	unsigned long		polls;
+	unsigned long		events;
+};
+typedef struct HealthDevice HealthDevice, *HealthDevicePtr;
+
+struct HealthBus {
+	unsigned short		busID;
+	unsigned short		roundPolls;				/* In this round				*/
+	unsigned long		polls;
+	unsigned long		busyTicks;				/* Round start to last poll		*/
+	unsigned long		roundTicks;				/* In this round, so far		*/
+};
+typedef struct HealthBus HealthBus;
+
+typedef struct HealthMonitor HealthMonitor, *HealthMonitorPtr;
+/*
+ * The event procedure is called at task level, from HealthMonitorIdle.
+ */
+typedef void				(*HealthEventProcPtr)(
+		HealthMonitorPtr		monitorPtr,
+		HealthDevicePtr			devicePtr,
+		unsigned short			event,
+		unsigned short			oldState
+	);
+
+struct HealthMonitor {
+	Boolean				active;
+	Boolean				polling;				/* A round is in progress		*/
+	SCSIEnvironmentPtr	environmentPtr;
+	HealthEventProcPtr	eventProc;
+	long				refCon;					/* For the event procedure		*/
+	unsigned short		deviceCount;
+	HealthDevice		device[kHealthMaxDevices];
+	unsigned short		busCount;
+	HealthBus			bus[kSweepMaxBuses];
+	DeviceSweep			sweep;					/* The current round			*/
+	unsigned short		roundDevice[kHealthMaxDevices];	/* Sweep job to device	*/
+	unsigned long		roundStartTicks;
+	unsigned long		nextRoundTicks;			/* Earliest start of the next	*/
+	unsigned long		startTicks;				/* When the monitor started		*/
+	unsigned long		rounds;
+	unsigned long		polls;
+	unsigned long		events;
+};
+
+/*
+ * Start watching the devices in deviceList (at most kHealthMaxDevices, on at
+ * most kSweepMaxBuses buses). Every device is polled in the first round.
+ */
+OSErr						HealthMonitorStart(
+		HealthMonitorPtr		monitorPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		HealthEventProcPtr		eventProc,
+		long					refCon
+	);
+/*
+ * Called by the event loop on each null event: continue the current round
+ * or, if a device is due, start one. If a round can't be started, the monitor
+ * stops and the error is returned.
+ */
+OSErr						HealthMonitorIdle(
+		HealthMonitorPtr		monitorPtr
+	);
+/*
+ * Start watching one more device (a device that is watched already is left
+ * alone). It is polled in the next round. Returns paramErr if the monitor is
+ * full.
+ */
+OSErr						HealthMonitorAdd(
+		HealthMonitorPtr		monitorPtr,
+		DeviceIdent				scsiDevice
+	);
+/*
+ * Stop watching device[deviceIndex]. The last device takes its place. Call
+ * this only between rounds (when polling is FALSE).
+ */
+void						HealthMonitorRemove(
+		HealthMonitorPtr		monitorPtr,
+		unsigned short			deviceIndex
+	);
+/*
+ * Stop. A round in progress is abandoned: its results are not reported.
+ */
+void						HealthMonitorStop(
+		HealthMonitorPtr		monitorPtr
+	);
+
+#endif /* __HealthMonitor__ */
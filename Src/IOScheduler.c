@@ -0,0 +1,319 @@
+/*									IOScheduler.c								*/
+/*
+ * IOScheduler.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Order, merge, and dispatch read and write requests for one device. See
+ * IOScheduler.h for the policy. The queue is a singly-linked list: with the
+ * small number of requests that a Macintosh application keeps outstanding,
+ * a linear insertion is cheaper than any tree.
+ */
+#include "SCSISimpleSample.h"
+
+/*
+ * Default deadlines (in Ticks) for each request class.
+ */
+#define kReadDeadlineTicks		(60L / 2L)				/* Half a second		*/
+#define kWriteDeadlineTicks		(60L * 5L)				/* Five seconds			*/
+
+static Boolean					MustWait(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			requestPtr
+	);
+static void						CompleteRun(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			firstPtr,
+		OSErr					status
+	);
+
+OSErr
+IOSchedulerOpen(
+		IOSchedulerPtr			schedulerPtr,
+		DeviceIdent				scsiDevice,
+		unsigned long			blockLength,
+		unsigned short			maxTransferBlocks
+	)
+{
+		CLEAR(*schedulerPtr);
+		schedulerPtr->scsiDevice = scsiDevice;
+		schedulerPtr->blockLength = blockLength;
+		schedulerPtr->maxTransferBlocks = maxTransferBlocks;
+		schedulerPtr->policy = kIOPolicyElevator;
+		schedulerPtr->deadline[kIOClassRead] = kReadDeadlineTicks;
+		schedulerPtr->deadline[kIOClassWrite] = kWriteDeadlineTicks;
+		schedulerPtr->mergeBuffer = NewPtr(blockLength * maxTransferBlocks);
+		if (schedulerPtr->mergeBuffer == NULL)
+			return (memFullErr);
+		return (noErr);
+}
+
+void
+IOSchedulerClose(
+		IOSchedulerPtr			schedulerPtr
+	)
+{
+		register IORequestPtr	requestPtr;
+
+		while ((requestPtr = schedulerPtr->queueHead) != NULL) {
+			schedulerPtr->queueHead = requestPtr->next;
+			requestPtr->next = NULL;
+			requestPtr->status = abortErr;
+			requestPtr->completedTicks = TickCount();
+		}
+		if (schedulerPtr->mergeBuffer != NULL)
+			DisposePtr(schedulerPtr->mergeBuffer);
+		schedulerPtr->mergeBuffer = NULL;
+}
+
+/*
+ * Insert the request in logical block order (or at the end of the queue for
+ * the FIFO policy). Requests for the same block stay in order of arrival.
+ */
+void
+IOSchedulerQueue(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			requestPtr
+	)
+{
+		register IORequestPtr	*linkPtr;
+
+		requestPtr->sequence = schedulerPtr->sequence++;
+		requestPtr->queuedTicks = TickCount();
+		requestPtr->deadlineTicks =
+			  requestPtr->queuedTicks
+			+ schedulerPtr->deadline[requestPtr->requestClass];
+		requestPtr->completedTicks = 0;
+		requestPtr->status = 1;							/* In progress			*/
+		linkPtr = &schedulerPtr->queueHead;
+		if (schedulerPtr->policy == kIOPolicyFIFO) {
+			while (*linkPtr != NULL)
+				linkPtr = &(*linkPtr)->next;
+		}
+		else {
+			while (*linkPtr != NULL
+			 && (*linkPtr)->logicalBlock <= requestPtr->logicalBlock)
+				linkPtr = &(*linkPtr)->next;
+		}
+		requestPtr->next = *linkPtr;
+		*linkPtr = requestPtr;
+}
+
+/*
+ * Choose, merge, and execute the next request.
+ */
+Boolean
+IOSchedulerDispatch(
+		IOSchedulerPtr			schedulerPtr
+	)
+{
+		ScsiCmdBlock			scsiCmdBlock;
+		register IORequestPtr	requestPtr;
+		IORequestPtr			firstPtr;
+		IORequestPtr			lastPtr;
+		IORequestPtr			*linkPtr;
+		unsigned long			now;
+		unsigned long			logicalBlock;
+		unsigned long			blockCount;
+		unsigned long			offset;
+		Boolean					writeToDevice;
+#define SCB	(scsiCmdBlock)
+#define SCHED (*schedulerPtr)
+
+		if (SCHED.queueHead == NULL)
+			return (FALSE);
+		/*
+		 * Choose the first request of this dispatch.
+		 */
+		firstPtr = NULL;
+		if (SCHED.policy == kIOPolicyFIFO)
+			firstPtr = SCHED.queueHead;
+		else {
+			/*
+			 * If any request is past its deadline, take the oldest such. If
+			 * it must wait for an earlier request, take the oldest request
+			 * in the queue, which never waits.
+			 */
+			now = TickCount();
+			for (requestPtr = SCHED.queueHead;
+					requestPtr != NULL;
+					requestPtr = requestPtr->next) {
+				if (requestPtr->deadlineTicks <= now
+				 && (firstPtr == NULL
+				  || requestPtr->sequence < firstPtr->sequence))
+					firstPtr = requestPtr;
+			}
+			if (firstPtr != NULL) {
+				++SCHED.statistics.deadlineDispatches;
+				if (MustWait(schedulerPtr, firstPtr)) {
+					for (requestPtr = SCHED.queueHead;
+							requestPtr != NULL;
+							requestPtr = requestPtr->next) {
+						if (requestPtr->sequence < firstPtr->sequence)
+							firstPtr = requestPtr;
+					}
+				}
+			}
+			else {
+				/*
+				 * Continue the sweep: take the first request at or after
+				 * the head that need not wait. If there is none, return to
+				 * the start. The oldest request never waits, so one is
+				 * always found.
+				 */
+				for (firstPtr = SCHED.queueHead;
+						firstPtr != NULL
+						&& (firstPtr->logicalBlock < SCHED.headPosition
+						 || MustWait(schedulerPtr, firstPtr));
+						firstPtr = firstPtr->next)
+					;
+				if (firstPtr == NULL) {
+					for (firstPtr = SCHED.queueHead;
+							MustWait(schedulerPtr, firstPtr);
+							firstPtr = firstPtr->next)
+						;
+				}
+			}
+		}
+		/*
+		 * Merge the requests that follow it if they are adjacent, in the
+		 * same direction, fit in the merge buffer, and need not wait.
+		 */
+		logicalBlock = firstPtr->logicalBlock;
+		blockCount = firstPtr->blockCount;
+		writeToDevice = (firstPtr->requestClass == kIOClassWrite);
+		lastPtr = firstPtr;
+		if (SCHED.policy != kIOPolicyFIFO) {
+			while ((requestPtr = lastPtr->next) != NULL
+			 && requestPtr->requestClass == firstPtr->requestClass
+			 && requestPtr->logicalBlock == logicalBlock + blockCount
+			 && blockCount + requestPtr->blockCount <= SCHED.maxTransferBlocks
+			 && MustWait(schedulerPtr, requestPtr) == FALSE) {
+				blockCount += requestPtr->blockCount;
+				lastPtr = requestPtr;
+				++SCHED.statistics.mergedRequests;
+			}
+		}
+		/*
+		 * Remove the run from the queue.
+		 */
+		for (linkPtr = &SCHED.queueHead;
+				*linkPtr != firstPtr;
+				linkPtr = &(*linkPtr)->next)
+			;
+		*linkPtr = lastPtr->next;
+		lastPtr->next = NULL;
+		/*
+		 * Build the command. A single request uses its own buffer, a merged
+		 * run uses the merge buffer.
+		 */
+		CLEAR(SCB);
+		SCB.scsiDevice = SCHED.scsiDevice;
+		SCB.command.scsi10.opcode =
+			(writeToDevice) ? kScsiCmdWrite10 : kScsiCmdRead10;
+		SCB.command.scsi10.lbn4 = logicalBlock >> 24;
+		SCB.command.scsi10.lbn3 = logicalBlock >> 16;
+		SCB.command.scsi10.lbn2 = logicalBlock >> 8;
+		SCB.command.scsi10.lbn1 = logicalBlock;
+		SCB.command.scsi10.len2 = blockCount >> 8;
+		SCB.command.scsi10.len1 = blockCount;
+		SCB.bufferPtr =
+			(firstPtr == lastPtr) ? firstPtr->bufferPtr : SCHED.mergeBuffer;
+		SCB.transferSize = blockCount * SCHED.blockLength;
+		SCB.transferQuantum = SCHED.blockLength;
+		SCB.writeToDevice = writeToDevice;
+		if (writeToDevice && firstPtr != lastPtr) {
+			offset = 0;
+			for (requestPtr = firstPtr;
+					requestPtr != NULL;
+					requestPtr = requestPtr->next) {
+				BlockMove(
+					requestPtr->bufferPtr,
+					SCHED.mergeBuffer + offset,
+					requestPtr->blockCount * SCHED.blockLength
+				);
+				offset += requestPtr->blockCount * SCHED.blockLength;
+			}
+		}
+		DoSCSICommandWithSense(&scsiCmdBlock, TRUE, TRUE);
+		if (writeToDevice == FALSE
+		 && firstPtr != lastPtr
+		 && SCB.status == noErr) {
+			offset = 0;
+			for (requestPtr = firstPtr;
+					requestPtr != NULL;
+					requestPtr = requestPtr->next) {
+				BlockMove(
+					SCHED.mergeBuffer + offset,
+					requestPtr->bufferPtr,
+					requestPtr->blockCount * SCHED.blockLength
+				);
+				offset += requestPtr->blockCount * SCHED.blockLength;
+			}
+		}
+		/*
+		 * Update the head position and statistics.
+		 */
+		SCHED.statistics.seekDistance += (logicalBlock > SCHED.headPosition)
+					? logicalBlock - SCHED.headPosition
+					: SCHED.headPosition - logicalBlock;
+		SCHED.headPosition = logicalBlock + blockCount;
+		++SCHED.statistics.commands;
+		SCHED.statistics.blocks += blockCount;
+		CompleteRun(schedulerPtr, firstPtr, SCB.status);
+		return (TRUE);
+#undef SCB
+#undef SCHED
+}
+
+/*
+ * Return TRUE if the request must wait for an earlier request (one that was
+ * queued before it) whose blocks overlap its own, where either of them is a
+ * write. A run's requests do not overlap each other, so a request that is
+ * merged into a run never waits for a request in the run.
+ */
+static Boolean
+MustWait(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			requestPtr
+	)
+{
+		register IORequestPtr	earlierPtr;
+
+		for (earlierPtr = schedulerPtr->queueHead;
+				earlierPtr != NULL;
+				earlierPtr = earlierPtr->next) {
+			if (earlierPtr->sequence < requestPtr->sequence
+			 && (earlierPtr->requestClass == kIOClassWrite
+			  || requestPtr->requestClass == kIOClassWrite)
+			 && earlierPtr->logicalBlock
+					< requestPtr->logicalBlock + requestPtr->blockCount
+			 && requestPtr->logicalBlock
+					< earlierPtr->logicalBlock + earlierPtr->blockCount)
+				return (TRUE);
+		}
+		return (FALSE);
+}
+
+/*
+ * Complete every request in a run (which has been removed from the queue).
+ */
+static void
+CompleteRun(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			firstPtr,
+		OSErr					status
+	)
+{
+		register IORequestPtr	requestPtr;
+		IORequestPtr			nextPtr;
+		unsigned long			now;
+
+		now = TickCount();
+		for (requestPtr = firstPtr; requestPtr != NULL; requestPtr = nextPtr) {
+			nextPtr = requestPtr->next;
+			requestPtr->next = NULL;
+			requestPtr->status = status;
+			requestPtr->completedTicks = now;
+			++schedulerPtr->statistics.requests;
+		}
+}
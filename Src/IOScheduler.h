@@ -0,0 +1,134 @@
+/*									IOScheduler.h								*/
+/*
+ * IOScheduler.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * A per-device request scheduler. Callers queue read and write requests; the
+ * scheduler decides the order in which they are sent to the device:
+ *	-- Requests are kept sorted by logical block. The scheduler sweeps the
+ *	   disk in one direction (C-SCAN): it dispatches the request at or after
+ *	   the current head position, and returns to the lowest block when it
+ *	   reaches the end of the queue. This minimizes seeks.
+ *	-- Adjacent requests in the same direction are merged into one Read(10)
+ *	   or Write(10) command (up to maxTransferBlocks).
+ *	-- Each request class has a deadline. If the oldest request has passed its
+ *	   deadline, it is dispatched next, regardless of its position. This keeps
+ *	   requests at the far end of the disk from starving.
+ *	-- Neither rule lets a request pass an earlier one whose blocks overlap
+ *	   its own if either of them is a write: a read after a write must see
+ *	   the new data, and two writes must reach the disk in order. Such a
+ *	   request waits until the earlier one is dispatched. If the oldest
+ *	   request past its deadline must wait, the oldest request in the queue
+ *	   (which never waits) is dispatched instead.
+ * Dispatching is synchronous: each command is executed by
+ * DoSCSICommandWithSense.
+ */
+#ifndef __IOScheduler__
+#define __IOScheduler__
+#include "MacSCSICommand.h"
+
+/*
+ * Request classes. Reads have a shorter deadline than writes, as someone is
+ * usually waiting for them.
+ */
+enum {
+	kIOClassRead = 0,
+	kIOClassWrite,
+	kIOClassCount
+};
+
+/*
+ * Scheduling policies. kIOPolicyFIFO dispatches requests in the order they
+ * were queued, without merging: it is used to measure the scheduler.
+ */
+enum {
+	kIOPolicyElevator = 0,
+	kIOPolicyFIFO
+};
+
+typedef struct IORequest IORequest, *IORequestPtr;
+struct IORequest {
+	IORequestPtr		next;					/* Queue link (scheduler use)	*/
+	unsigned long		logicalBlock;			/* -> First block				*/
+	unsigned short		blockCount;				/* -> Number of blocks			*/
+	unsigned short		requestClass;			/* -> kIOClassRead, etc.		*/
+	Ptr					bufferPtr;				/* -> Data buffer				*/
+	unsigned long		sequence;				/* <- Order of arrival			*/
+	unsigned long		queuedTicks;			/* <- When queued				*/
+	unsigned long		deadlineTicks;			/* <- Dispatch before this		*/
+	unsigned long		completedTicks;			/* <- When completed			*/
+	OSErr				status;					/* <- Final status				*/
+};
+
+struct IOSchedulerStatistics {
+	unsigned long		requests;				/* Requests completed			*/
+	unsigned long		commands;				/* SCSI commands issued			*/
+	unsigned long		mergedRequests;			/* Requests merged into another	*/
+	unsigned long		deadlineDispatches;		/* Dispatched out of order		*/
+	unsigned long		blocks;					/* Blocks transferred			*/
+	unsigned long		seekDistance;			/* Sum of head movement			*/
+};
+typedef struct IOSchedulerStatistics IOSchedulerStatistics;
+
+typedef struct IOScheduler IOScheduler, *IOSchedulerPtr;
+struct IOScheduler {
+	DeviceIdent			scsiDevice;				/* Bus/target/LUN				*/
+	unsigned long		blockLength;			/* Logical block length			*/
+	unsigned short		maxTransferBlocks;		/* Merge limit					*/
+	unsigned short		policy;					/* kIOPolicyElevator, etc.		*/
+	unsigned long		deadline[kIOClassCount];	/* Ticks, per class			*/
+	Ptr					mergeBuffer;			/* For merged transfers			*/
+	IORequestPtr		queueHead;				/* Sorted by logical block		*/
+	unsigned long		headPosition;			/* Block after last transfer	*/
+	unsigned long		sequence;				/* Next arrival number			*/
+	IOSchedulerStatistics	statistics;
+};
+
+/*
+ * Usage:
+ *		OSErr						IOSchedulerOpen(
+ *				IOSchedulerPtr			schedulerPtr,
+ *				DeviceIdent				scsiDevice,
+ *				unsigned long			blockLength,
+ *				unsigned short			maxTransferBlocks
+ *			);
+ *	Initialize a scheduler for one device. This allocates the merge buffer:
+ *	it returns memFullErr if it can't.
+ *
+ *		void						IOSchedulerClose(
+ *				IOSchedulerPtr			schedulerPtr
+ *			);
+ *	Dispose of the merge buffer. Any requests that are still queued are
+ *	completed with abortErr.
+ *
+ *		void						IOSchedulerQueue(
+ *				IOSchedulerPtr			schedulerPtr,
+ *				IORequestPtr			requestPtr
+ *			);
+ *	Add a request to the queue. Its status is set to 1 (in progress) until
+ *	it completes.
+ *
+ *		Boolean						IOSchedulerDispatch(
+ *				IOSchedulerPtr			schedulerPtr
+ *			);
+ *	Choose the next request (merging adjacent requests if possible) and
+ *	execute it. Returns FALSE if the queue was empty.
+ */
+OSErr						IOSchedulerOpen(
+		IOSchedulerPtr			schedulerPtr,
+		DeviceIdent				scsiDevice,
+		unsigned long			blockLength,
+		unsigned short			maxTransferBlocks
+	);
+void						IOSchedulerClose(
+		IOSchedulerPtr			schedulerPtr
+	);
+void						IOSchedulerQueue(
+		IOSchedulerPtr			schedulerPtr,
+		IORequestPtr			requestPtr
+	);
+Boolean						IOSchedulerDispatch(
+		IOSchedulerPtr			schedulerPtr
+	);
+
+#endif /* __IOScheduler__ */
@@ -561,7 +561,7 @@ LogStatus(
 void
 DisplayLogString(
 		ListHandle						logListHandle,
-		const StringPtr					theString
+		ConstStr255Param				theString
 	)
 {
 		short						theRow;
@@ -278,7 +278,7 @@ void								LogStatus(
  */
 void								DisplayLogString(
 		ListHandle						logListHandle,
-		const StringPtr					theString
+		ConstStr255Param				theString
 	);
 StringHandle						GetLogStringHandle(
 		ListHandle						logListHandle,
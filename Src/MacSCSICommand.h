@@ -285,6 +285,12 @@ typedef union SCSI_LogSenseParamPage SCSI_LogSenseParamPage;
 #define	 kScsiStatusQueueFull		0x28	/* Target can't do command	*/
 #define	 kScsiStatusReservedMask	0x3e	/* Vendor specific?			*/
 
+/*
+ * These bits are in the last (control) byte of the command block.
+ */
+#define	 kScsiControlLink			0x01	/* Link to next command		*/
+#define	 kScsiControlFlag			0x02	/* Linked Cmd Complete Flag	*/
+
 /*
  * SCSI command codes. Commands defined as ...6, ...10, ...12, are
  * six-byte, ten-byte, and twelve-byte variants of the indicated command.
@@ -347,6 +353,7 @@ typedef union SCSI_LogSenseParamPage SCSI_LogSenseParamPage;
  * These commands are supported by sequential devices.
  */
 #define kScsiCmdRewind				0x01
+#define kScsiCmdReadBlockLimits		0x05
 #define kScsiCmdWriteFilemarks		0x10
 #define kScsiCmdSpace				0x11
 #define kScsiCmdLoadUnload			0x1B
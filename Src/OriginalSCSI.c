@@ -5,29 +5,35 @@
  *
  * Talk to the Macintosh SCSI Handler using the "old" interface as defined in
  * Inside Mac IV. This is a synchronous call that executes a single SCSI Command
- * on a device. It does not support multiple busses or logical units.
+ * on a device. It does not support multiple busses. Logical units are addressed
+ * by storing the LUN in the command block.
  *
  * Calling Sequence:
  *		OSErr				OriginalSCSI(
- *				short					targetID,
+ *				DeviceIdent				scsiDevice,
  *				const SCSI_CommandPtr	scsiCommand,
  *				unsigned short			cmdBlockLength,
  *				Boolean					writeToDevice,
  *				Ptr						bufferPtr,
  *				unsigned long			transferSize,
  *				unsigned long			transferQuantum,
+ *				SCSI_Sense_Data			*senseDataPtr,
+ *				unsigned long			senseDataSize,
  *				unsigned long			completionTimeout,
  *				unsigned short			*stsBytePtr,
  *				unsigned long			*actualTransferCount
  *			);
  * The parameters have the following meaning:
  *
- *	targetID			The SCSI Bus ID of the target (0 .. 6). Note that this
- *						function can only access LUN zero.
+ *	scsiDevice			The SCSI Bus ID of the target (0 .. 6) and logical unit
+ *						(0 .. 7). The bus is ignored: the original SCSI Manager
+ *						can only access one bus.
  *	scsiCommand			The SCSI Command Block (6, 10, or 12 bytes). The command
- *						block length will be determined by examining the command
- *						parameter. This is standardized for all but
- *						"vendor-specific" commands.
+ *						is copied, and the logical unit is stored in the top
+ *						three bits of byte 1 of the copy, as SCSI-1 devices
+ *						(and the original SCSI Manager, which does not send an
+ *						Identify message) require. The caller's command block is
+ *						not modified.
  *	writeToDevice		TRUE if this command writes to the device. FALSE if this
  *						command reads from the device or does not require a data
  *						phase.
@@ -36,7 +42,10 @@
  *						(e.g. for Test Unit Ready).
  *	transferSize		The total number of bytes to transfer to or from the device.
  *	transferQuantum		This is needed to configure the transfer information block
- *						(TIB). The following values are appropriate:
+ *						(TIB). Note that OriginalSCSI may substitute a polled
+ *						transfer for a blind transfer if this target has
+ *						previously failed blind transfers (see below).
+ *						The following values are appropriate:
  *						-- Set to zero for a one-shot blind transfer.
  *							ActualTransferCount is not correctly returned.
  *						-- Set to one if a polled transfer is needed. This is
@@ -53,6 +62,10 @@
  *						-- Set to a sub-multiple (such as a block length) for
  *							requests that need re-synchronization between sectors.
  *						-- Other values will likely result in errors.
+ *	senseDataPtr		If not NULL and the device returns Check Condition, this
+ *						will be filled with the result from a Request Sense
+ *						operation that is issued before OriginalSCSI returns.
+ *	senseDataSize		This is the size of the Request Sense data buffer.
  *	completionTimeout	The timeout (in Ticks) for the command. This should be short
  *						for disks, but must be long for tape devices and some setup
  *						requests, such as Mode Select.
@@ -70,8 +83,12 @@
  *					you may merely have given a large buffer size to
  *					a variable-length request, such as Device Inquiry.
  *	sc...			other SCSI error.
- *	statusErr		Device returned "Check condition." The caller should
- *					issue a Request Sense SCSI Command to this device.
+ *	statusErr		Device returned "Check condition." If senseDataPtr was
+ *					supplied, it contains the Request Sense data. Otherwise,
+ *					the caller should issue a Request Sense SCSI Command to
+ *					this device.
+ *	scsiNonZeroStatus Device returned "Check condition" but the Request
+ *					Sense command failed.
  *	controlErr		Device returned "Busy"
  *	ioErr			Other (serious) device status. The caller should
  *					examine the Status and Message bytes to determine
@@ -84,6 +101,7 @@
 #include <Memory.h>
 #include <Events.h>
 #include "MacSCSICommand.h"
+#include "OriginalSCSI.h"
 #ifndef TRUE
 #define FALSE		0
 #define TRUE		1
@@ -93,22 +111,27 @@
  * Execute a SCSI command using the original (Inside Mac IV) SCSI Manager.
  * Return codes:
  *
- *	noErr			normal
- *	paramErr		could not determine command length from command
- *	scCommErr		could not select this device or bus busy
- *	sc...			other scsi error
- *	statusErr		Device returned "Check condition"
- *	controlErr		Device returned "Busy" (Note: device error)
- *	ioErr			Other (serious) device status -- bug.
+ *	noErr				normal
+ *	paramErr			could not determine command length from command
+ *	scCommErr			could not select this device or bus busy
+ *	sc...				other scsi error
+ *	statusErr			Device returned "Check condition." If a sense buffer
+ *						was supplied, it contains the Request Sense data.
+ *	scsiNonZeroStatus	Device returned "Check condition" but Request Sense
+ *						failed (only if a sense buffer was supplied).
+ *	controlErr			Device returned "Busy" (Note: device error)
+ *	ioErr				Other (serious) device status -- bug.
  */
 OSErr						OriginalSCSI(
-		short					targetID,			/* Device ID on this bus	*/
+		DeviceIdent				scsiDevice,			/* -> target/LUN			*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
 		Boolean					writeToDevice,		/* TRUE to write			*/
 		Ptr						bufferPtr,			/* -> user data buffer		*/
 		unsigned long			transferSize,		/* How much to transfer		*/
 		unsigned long			transferQuantum,	/* TIB setup parameter		*/
+		SCSI_Sense_Data			*senseDataPtr,		/* Request Sense results	*/
+		unsigned long			senseDataSize,		/* Request Sense data size	*/
 		unsigned long			completionTimeout,	/* Ticks to wait			*/
 		unsigned short			*stsBytePtr,		/* <- status phase byte		*/
 		unsigned long			*actualTransferCount
@@ -142,6 +165,57 @@ OSErr						OriginalSCSI(
 #endif
 #define ScsiBusBusy()		((SCSIStat() & (kScsiStatBSY | kScsiStatSEL)) != 0)
 
+/*
+ * What we have learned about each target's transfers (see OriginalSCSI.h).
+ */
+static OriginalTransferInfo	gOriginalTransferInfo[kMaxOriginalTargetID + 1];
+
+/*
+ * The TIB programs for the most recently used transferSize and transferQuantum
+ * pairs are cached: most devices are called repeatedly with the same block
+ * size, and the 32-bit divide is a library call on the 68000. The cache is
+ * shared by all targets and logical units, so two units with different block
+ * sizes do not evict each other. A cached program has no buffer or transfer
+ * count address: these are stored in the copy that is made for each attempt.
+ * Request Sense is never cached, as its length depends on the caller's sense
+ * buffer and it would evict the data transfer programs. When the cache is
+ * full, the least recently used program is replaced.
+ */
+#define kTIBCacheSize				4
+typedef struct OriginalTIBProgram {
+	unsigned long		transferSize;			/* Key: 0 if the entry is free	*/
+	unsigned long		transferQuantum;		/* Key							*/
+	unsigned long		lastUse;				/* For replacement				*/
+	SCSIInstr			tib[4];					/* The program					*/
+} OriginalTIBProgram, *OriginalTIBProgramPtr;
+static OriginalTIBProgram	gOriginalTIBProgram[kTIBCacheSize];
+static unsigned long		gOriginalTIBUseCount;
+
+static OSErr	DoOriginalSCSICommand(
+		DeviceIdent				scsiDevice,
+		const SCSI_CommandPtr	scsiCommand,
+		unsigned short			cmdBlockLength,
+		Boolean					writeToDevice,
+		Ptr						bufferPtr,
+		unsigned long			transferSize,
+		unsigned long			transferQuantum,
+		unsigned long			completionTimeout,
+		unsigned short			*stsBytePtr,
+		unsigned long			*actualTransferCount
+	);
+static Boolean	IsFixedLengthTransfer(
+		const SCSI_CommandPtr	scsiCommand,
+		Boolean					writeToDevice
+	);
+static void		BuildTIBProgram(
+		SCSIInstr				tib[4],
+		unsigned long			transferSize,
+		unsigned long			transferQuantum
+	);
+static const SCSIInstr *GetTIBProgram(
+		unsigned long			transferSize,
+		unsigned long			transferQuantum
+	);
 static void		NextFunction(void);		/* Dummy function for OriginalSCSI size	*/
 static Boolean	IsVirtualMemoryRunning(void);
 /*
@@ -151,46 +225,43 @@ static Boolean	IsVirtualMemoryRunning(void);
 #define kHoldFunction			0x0001				/* AsyncSCSI function code	*/
 #define kHoldStack				0x0002				/* Local variables			*/
 #define kHoldUserBuffer			0x0004				/* User data buffer, if any	*/
-#define kHoldCommandBlock		0x0008				/* SCSI Command Data Block	*/
+#define kHoldSenseBuffer		0x0008				/* Sense buffer, if any		*/
 
 /*
- * Execute a SCSI command.
+ * Execute a SCSI command. If the device returns Check Condition and the caller
+ * supplied a sense buffer, issue Request Sense immediately (while our memory
+ * is still held) so that the caller sees the same result as the asynchronous
+ * SCSI Manager's autosense.
  * Returns the final status as noted above.
  */
 OSErr
 OriginalSCSI(
-		short					targetID,			/* SCSI device on this bus	*/
+		DeviceIdent				scsiDevice,			/* -> target/LUN			*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
 		Boolean					writeToDevice,		/* TRUE to write			*/
 		Ptr						bufferPtr,			/* -> user data buffer		*/
 		unsigned long			transferSize,		/* How much to transfer		*/
 		unsigned long			transferQuantum,	/* TIB setup parameter		*/
+		SCSI_Sense_Data			*senseDataPtr,		/* Request Sense results	*/
+		unsigned long			senseDataSize,		/* Request Sense data size	*/
 		unsigned long			completionTimeout,	/* Ticks to wait			*/
 		unsigned short			*stsBytePtr,		/* <- status phase byte		*/
 		unsigned long			*actualTransferCount
 	)
 {
 		OSErr					status;				/* Final status				*/
-		OSErr					completionStatus;	/* Status from ScsiComplete	*/
-		short					totalTries;			/* Get/Select retries		*/
-		short					getTries;			/* Get retries				*/
-		short					iCount;				/* Bus free counter			*/
-		unsigned long			watchdog;			/* Timeout after this		*/
-		unsigned long			myTransferCount;	/* Gets TIB loop counter	*/
+		OSErr					senseStatus;		/* Request Sense status		*/
+		unsigned short			senseStsByte;		/* Request Sense STS byte	*/
+		unsigned long			senseCount;			/* Request Sense length		*/
+		register short			i;					/* Command block index		*/
 		/*
-		 * The TIB has the following format:
-		 *	[0]	scInc	user buffer			transferQuantum or transferSize
-		 *	[1] scAdd	&theTransferCount	1
-		 *	[2] scLoop	-> tib[0]			transferSize / transferQuantum
-		 *	[3] scStop
-		 * The intent of this is to return, in actualTransferCount, the number
-		 * of times we cycled through the tib[] loop. This will be the actual
-		 * transfer count if transferQuantum equals one, or the number of
-		 * "blocks" if transferQuantum is the length of one sector.
+		 * The command is copied into our local variables so we can store the
+		 * logical unit without modifying the caller's command. This also
+		 * means that the command block is protected by the stack hold.
 		 */
-		SCSIInstr				tib[4];				/* Current TIB				*/
-		short					messageByte;		/* For Command Complete 
+		SCSI_Command			lunCommand;			/* Command with LUN			*/
+		SCSI_6_Byte_Command		requestSense;		/* For autosense			*/
 		/*
 		 * The following parameters are used to manage virtual memory. The code
 		 * is taken from the DTS SCSI Sample Driver.
@@ -200,36 +271,36 @@ OriginalSCSI(
 		char					*vmProtectedStackBase;	/* Last local variable	*/
 /*
  * These values are used to compute the size of the stack that we must hold in
- * protected (non-virtual) memory. kSCSIManagerStackEstimate is an estimate.
+ * protected (non-virtual) memory. kSCSIManagerStackEstimate is an estimate
+ * that includes DoOriginalSCSICommand's local variables.
  */
 #define kSCSILocalVariableSize	( \
 		(unsigned long) (((Ptr) &status) - ((Ptr) &vmProtectedStackBase))	\
 	)
-#define kSCSIManagerStackEstimate 512
+#define kSCSIManagerStackEstimate 768
 #define kSCSIProtectedStackSize (kSCSIManagerStackEstimate + kSCSILocalVariableSize)
 
 		status = noErr;
 		vmHoldMask = 0;
+		if (senseDataPtr == NULL || senseDataSize < 5)
+			senseDataPtr = NULL;				/* No autosense				*/
+		else {
+			senseDataPtr->errorCode = 0;
+			if (senseDataSize > 0xFF)			/* Allocation length byte	*/
+				senseDataSize = 0xFF;
+		}
 		/*
-		 * If there is a data transfer, setup the tib.
+		 * Copy the command and store the logical unit in the top three bits
+		 * of byte 1 (this is the same for 6, 10, and 12-byte commands).
 		 */
-		myTransferCount = 0;
-		if (transferQuantum == 0)
-			transferQuantum = transferSize;
-		if (bufferPtr != NULL) {
-			tib[0].scOpcode = scInc;
-			tib[0].scParam1 = (unsigned long) bufferPtr;
-			tib[0].scParam2 = transferQuantum;
-			tib[1].scOpcode = scAdd;
-			tib[1].scParam1 = (unsigned long) &myTransferCount;
-			tib[1].scParam2 = transferQuantum;
-			tib[2].scOpcode = scLoop;
-			tib[2].scParam1 = (-2 * sizeof (SCSIInstr));
-			tib[2].scParam2 = transferSize / tib[0].scParam2;
-			tib[3].scOpcode = scStop;
-			tib[3].scParam1 = 0;
-			tib[3].scParam2 = 0;
+		if (cmdBlockLength > sizeof lunCommand) {
+			status = paramErr;
+			goto exit;
 		}
+		for (i = 0; i < cmdBlockLength; i++)
+			lunCommand.scsi[i] = scsiCommand->scsi[i];
+		lunCommand.scsi[1] &= ~0xE0;
+		lunCommand.scsi[1] |= (scsiDevice.LUN & 0x07) << 5;
 		if (IsVirtualMemoryRunning()) {
 
 			/*
@@ -245,11 +316,10 @@ OriginalSCSI(
 			 *		status = CallSCSIManager(...);
 			 *		UnholdMemory(...);
 			 *
-			 * First, hold the MacSCSI function. It starts at AsyncSCSI and
-			 * extends to the start of the next function. This is marked by a
-			 * dummy function. The left-margin comments indicate the value
-			 * of vmHoldCount if the indicated HoldMemory succeeded. This is not
-			 * needed for drivers.
+			 * First, hold the MacSCSI function. It starts at OriginalSCSI and
+			 * extends to the start of the next function (this includes
+			 * DoOriginalSCSICommand). This is marked by a dummy function.
+			 * This is not needed for drivers.
 			 */
 			vmFunctionSize =
 				(unsigned long) NextFunction - (unsigned long) OriginalSCSI;
@@ -268,29 +338,158 @@ OriginalSCSI(
 				if (status == noErr)
 					vmHoldMask |= kHoldStack;
 			}
-			if (status == noErr) {
-				/*
-				 * Lock down the command block. In this sample, we allocated
-				 * the command block in the application heap. A driver would
-				 * typically allocate it in the System Heap and, hence, would
-				 * not require this call.
-				 */
-				status = HoldMemory((Ptr) scsiCommand, cmdBlockLength);
-				if (status == noErr)
-					vmHoldMask |= kHoldCommandBlock;
-			}		
 			if (status == noErr && bufferPtr != NULL) {
 				/*
 				 * Lock down the user buffer, if any. In a real-world application
 				 * or driver, this would be done before calling the SCSI interface.
 				 */
 				status = HoldMemory(bufferPtr, transferSize);
-				if (status != noErr)
-					vmHoldMask |= kHoldStack;
+				if (status == noErr)
+					vmHoldMask |= kHoldUserBuffer;
+			}
+			if (status == noErr && senseDataPtr != NULL) {
+				/*
+				 * Lock down the sense buffer now, so Request Sense can be
+				 * issued without any further memory management.
+				 */
+				status = HoldMemory((Ptr) senseDataPtr, senseDataSize);
+				if (status == noErr)
+					vmHoldMask |= kHoldSenseBuffer;
 			}
 			if (status != noErr)
 				goto exit;
 		}
+		status = DoOriginalSCSICommand(
+					scsiDevice,
+					&lunCommand,
+					cmdBlockLength,
+					writeToDevice,
+					bufferPtr,
+					transferSize,
+					transferQuantum,
+					completionTimeout,
+					stsBytePtr,
+					actualTransferCount
+				);
+		if (status == statusErr && senseDataPtr != NULL) {
+			/*
+			 * The device returned Check Condition. Issue Request Sense now:
+			 * the target holds the sense data only until it receives the next
+			 * command, and everything we need is still held in memory. This
+			 * is a polled transfer, as the sense data is variable-length.
+			 */
+			requestSense.opcode = kScsiCmdRequestSense;
+			requestSense.lbn3 = (scsiDevice.LUN & 0x07) << 5;
+			requestSense.lbn2 = 0;
+			requestSense.lbn1 = 0;
+			requestSense.len = senseDataSize;
+			requestSense.ctrl = 0;
+			senseStatus = DoOriginalSCSICommand(
+						scsiDevice,
+						(SCSI_CommandPtr) &requestSense,
+						sizeof requestSense,
+						FALSE,
+						(Ptr) senseDataPtr,
+						senseDataSize,
+						1,
+						completionTimeout,
+						&senseStsByte,
+						&senseCount
+					);
+			if (senseStatus != noErr || senseCount == 0)
+				status = scsiNonZeroStatus;		/* Autosense failed			*/
+		}
+exit:
+		/*
+		 * If we held memory, unhold it now.  We ignore UnholdMemory errors:
+		 * there isn't much we can do about them. Note that this must be
+		 * done by driver or asynchronous completion routines.
+		 */
+		if ((vmHoldMask & kHoldSenseBuffer) != 0)
+			(void) UnholdMemory((Ptr) senseDataPtr, senseDataSize);
+		if ((vmHoldMask & kHoldUserBuffer) != 0)
+			(void) UnholdMemory(bufferPtr, transferSize);
+		if ((vmHoldMask & kHoldStack) != 0)
+			(void) UnholdMemory(vmProtectedStackBase, kSCSIProtectedStackSize);
+		if ((vmHoldMask & kHoldFunction) != 0)
+			(void) UnholdMemory(OriginalSCSI, vmFunctionSize);
+		return (status);
+}
+
+/*
+ * Perform one command on the bus: arbitrate, select, send the command, transfer
+ * the data, and complete. The command block must already contain the LUN and
+ * all memory must be held. This is called once for the caller's command and,
+ * if needed, once more for Request Sense. It must be located between
+ * OriginalSCSI and NextFunction so that it is protected by the function hold.
+ */
+static OSErr
+DoOriginalSCSICommand(
+		DeviceIdent				scsiDevice,			/* -> target/LUN			*/
+		const SCSI_CommandPtr	scsiCommand,		/* Command (with LUN)		*/
+		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
+		Boolean					writeToDevice,		/* TRUE to write			*/
+		Ptr						bufferPtr,			/* -> user data buffer		*/
+		unsigned long			transferSize,		/* How much to transfer		*/
+		unsigned long			transferQuantum,	/* TIB setup parameter		*/
+		unsigned long			completionTimeout,	/* Ticks to wait			*/
+		unsigned short			*stsBytePtr,		/* <- status phase byte		*/
+		unsigned long			*actualTransferCount
+	)
+{
+		OSErr					status;				/* Final status				*/
+		OSErr					completionStatus;	/* Status from ScsiComplete	*/
+		short					totalTries;			/* Get/Select retries		*/
+		short					getTries;			/* Get retries				*/
+		short					iCount;				/* Bus free counter			*/
+		unsigned long			watchdog;			/* Timeout after this		*/
+		unsigned long			myTransferCount;	/* Gets TIB loop counter	*/
+		/*
+		 * The TIB has the following format:
+		 *	[0]	scInc	user buffer			transferQuantum or transferSize
+		 *	[1] scAdd	&theTransferCount	1
+		 *	[2] scLoop	-> tib[0]			transferSize / transferQuantum
+		 *	[3] scStop
+		 * The intent of this is to return, in actualTransferCount, the number
+		 * of times we cycled through the tib[] loop. This will be the actual
+		 * transfer count if transferQuantum equals one, or the number of
+		 * "blocks" if transferQuantum is the length of one sector.
+		 */
+		SCSIInstr				tib[4];				/* Current TIB				*/
+		SCSIInstr				senseTIB[4];		/* Request Sense program	*/
+		const SCSIInstr			*programPtr;		/* The TIB to copy			*/
+		short					i;					/* TIB instruction index	*/
+		short					messageByte;		/* For Command Complete 	*/
+		OriginalTransferInfoPtr	infoPtr;			/* Learned transfer mode	*/
+		Boolean					usePolledTransfer;	/* TRUE for SCSIRead/Write	*/
+		Boolean					triedPolledRetry;	/* Blind failed, retried	*/
+		Boolean					retryPolled;		/* Retry this command now	*/
+
+		status = noErr;
+		messageByte = 0;
+		/*
+		 * If there is a data transfer, find the tib program: it is taken from
+		 * the cache unless this is Request Sense. Without a program, there is
+		 * no data phase.
+		 */
+		myTransferCount = 0;
+		programPtr = NULL;
+		if (transferQuantum == 0)
+			transferQuantum = transferSize;
+		infoPtr =
+			&gOriginalTransferInfo[scsiDevice.targetID & kMaxOriginalTargetID];
+		usePolledTransfer = OriginalSCSIUsePolled(infoPtr, transferQuantum);
+		triedPolledRetry = FALSE;
+		retryPolled = FALSE;
+		if (bufferPtr != NULL && transferSize != 0) {
+			if (scsiCommand->scsi[0] == kScsiCmdRequestSense) {
+				BuildTIBProgram(senseTIB, transferSize, transferQuantum);
+				programPtr = senseTIB;
+			}
+			else {
+				programPtr = GetTIBProgram(transferSize, transferQuantum);
+			}
+		}
 		/*
 		 * Arbitrate for the scsi bus.  This will fail if some other device is
 		 * accessing the bus at this time (which is unlikely).
@@ -301,6 +500,20 @@ OriginalSCSI(
 		 *
 		 */
 		for (totalTries = 0; totalTries < kMaxSCSIRetries; totalTries++) {
+			/*
+			 * Setup the tib for this attempt from the program. The SCSI
+			 * Manager executes the tib in place: scInc advances the buffer
+			 * address in tib[0] and scLoop counts down tib[2]. After a blind
+			 * transfer that stopped part way, or a Busy status, the old tib
+			 * would start in the middle of the buffer and run past its end.
+			 */
+			myTransferCount = 0;
+			if (programPtr != NULL) {
+				for (i = 0; i < 4; i++)
+					tib[i] = programPtr[i];
+				tib[0].scParam1 = (unsigned long) bufferPtr;
+				tib[1].scParam1 = (unsigned long) &myTransferCount;
+			}
 			for (getTries = 0; getTries < 4; getTries++) {
 				/*
 				 * Wait for the bus to go free.
@@ -339,7 +552,7 @@ OriginalSCSI(
 			/*
 			 * We now own the SCSI bus. Try to select the device.
 			 */
-			if ((status = SCSISelect(targetID)) != noErr)
+			if ((status = SCSISelect(scsiDevice.targetID)) != noErr)
 				goto exit;
 			/*
 			 * From this point on, we must exit through SCSIComplete() even if an
@@ -349,26 +562,43 @@ OriginalSCSI(
 			 * "device busy", we will try it again.
 			 */
 			status = SCSICmd((Ptr) scsiCommand, cmdBlockLength);
-			if (status == noErr && bufferPtr != NULL) {
+			if (status == noErr && programPtr != NULL) {
 				/*
 				 * This command requires a data transfer.
 				 */
 				if (writeToDevice) {
-					if (transferQuantum == 1)
+					if (usePolledTransfer)
 						status = SCSIWrite((Ptr) tib);
 					else {
 						status = SCSIWBlind((Ptr) tib);
 					}
 				}
 				else {
-					if (transferQuantum == 1)
+					if (usePolledTransfer)
 						status = SCSIRead((Ptr) tib);
 					else {
 						status = SCSIRBlind((Ptr) tib);
 					}
 				}
+				/*
+				 * If a blind transfer failed because the target did not
+				 * keep up with the handshake, retry this command (once)
+				 * with a polled transfer.
+				 */
+				if (OriginalSCSILearnTransfer(
+							infoPtr,
+							scsiCommand,
+							writeToDevice,
+							usePolledTransfer,
+							status,
+							myTransferCount,
+							transferSize)
+				 && triedPolledRetry == FALSE) {
+					triedPolledRetry = TRUE;
+					retryPolled = TRUE;
+					usePolledTransfer = TRUE;
+				}
 			}
-finish:
 			/*
 			 * SCSIComplete "runs" the bus-phase algorithm until the bitter end,
 			 * returning the status and command-completion message bytes..
@@ -384,6 +614,14 @@ finish:
 			 */
 			if (completionStatus != noErr)
 				status = completionStatus;
+			else if (retryPolled && *stsBytePtr == kScsiStatusGood) {
+				/*
+				 * The blind transfer failed and the device did not report
+				 * an error: retry this command with a polled transfer.
+				 */
+				retryPolled = FALSE;
+				continue;
+			}
 			else {
 				/*
 				 * ScsiComplete is happy. If the device is busy, Pause for 1/4
@@ -402,19 +640,6 @@ finish:
 			break;
 		} /* totalTries loop */
 exit:
-		/*
-		 * If we held memory, unhold it now.  We ignore UnholdMemory errors:
-		 * there isn't much we can do about them. Note that this must be
-		 * done by driver or asynchronous completion routines.
-		 */
-		if ((vmHoldMask & kHoldUserBuffer) != 0)
-			(void) UnholdMemory(bufferPtr, transferSize);
-		if ((vmHoldMask & kHoldCommandBlock) != 0)
-			(void) UnholdMemory((Ptr) scsiCommand, cmdBlockLength);
-		if ((vmHoldMask & kHoldStack) != 0)
-			(void) UnholdMemory(vmProtectedStackBase, kSCSIProtectedStackSize);
-		if ((vmHoldMask & kHoldFunction) != 0)
-			(void) UnholdMemory(OriginalSCSI, vmFunctionSize);
 		/*
 		 * Return the number of bytes transferred to the caller. If the caller
 		 * supplied an actual count and the count is no greater than the maximum,
@@ -453,8 +678,164 @@ exit:
 		return (status);
 }
 
+/*
+ * Build the tib program for this transfer (see DoOriginalSCSICommand). The
+ * buffer and transfer count addresses are left zero.
+ */
+static void
+BuildTIBProgram(
+		SCSIInstr				tib[4],
+		unsigned long			transferSize,
+		unsigned long			transferQuantum
+	)
+{
+		tib[0].scOpcode = scInc;
+		tib[0].scParam1 = 0;					/* Buffer, for each attempt	*/
+		tib[0].scParam2 = transferQuantum;
+		tib[1].scOpcode = scAdd;
+		tib[1].scParam1 = 0;					/* &myTransferCount			*/
+		tib[1].scParam2 = transferQuantum;
+		tib[2].scOpcode = scLoop;
+		tib[2].scParam1 = (-2 * sizeof (SCSIInstr));
+		tib[2].scParam2 = transferSize / transferQuantum;
+		tib[3].scOpcode = scStop;
+		tib[3].scParam1 = 0;
+		tib[3].scParam2 = 0;
+}
+
+/*
+ * Return the cached tib program for this transfer size and quantum, building
+ * it (in the least recently used entry) if it is not in the cache. The caller
+ * must copy the program before using it. transferSize must not be zero.
+ */
+static const SCSIInstr *
+GetTIBProgram(
+		unsigned long			transferSize,
+		unsigned long			transferQuantum
+	)
+{
+		register OriginalTIBProgramPtr	entryPtr;
+		register OriginalTIBProgramPtr	oldestPtr;
+		register short			i;
+
+		oldestPtr = &gOriginalTIBProgram[0];
+		for (i = 0; i < kTIBCacheSize; i++) {
+			entryPtr = &gOriginalTIBProgram[i];
+			if (entryPtr->transferSize == transferSize
+			 && entryPtr->transferQuantum == transferQuantum)
+				break;
+			if (entryPtr->lastUse < oldestPtr->lastUse)
+				oldestPtr = entryPtr;
+		}
+		if (i >= kTIBCacheSize) {
+			entryPtr = oldestPtr;
+			entryPtr->transferSize = transferSize;
+			entryPtr->transferQuantum = transferQuantum;
+			BuildTIBProgram(entryPtr->tib, transferSize, transferQuantum);
+		}
+		entryPtr->lastUse = ++gOriginalTIBUseCount;
+		return (entryPtr->tib);
+}
+
+/*
+ * Return TRUE if this transfer should be polled (see OriginalSCSI.h).
+ */
+Boolean
+OriginalSCSIUsePolled(
+		const OriginalTransferInfo	*infoPtr,
+		unsigned long			transferQuantum
+	)
+{
+		return (transferQuantum == 1 || infoPtr->usePolledTransfer);
+}
+
+/*
+ * Record the result of a data transfer, and return TRUE if a blind transfer
+ * failed. A failure is only counted if a fixed-length command stopped before
+ * the whole buffer was transferred: a variable-length read that stops short
+ * has merely run out of data. One failure does not permanently disable blind
+ * transfers for this target, as it may have been a real phase error. This is
+ * called while the bus is owned, so it must be located before NextFunction.
+ */
+Boolean
+OriginalSCSILearnTransfer(
+		OriginalTransferInfoPtr	infoPtr,
+		const SCSI_CommandPtr	scsiCommand,
+		Boolean					writeToDevice,
+		Boolean					polled,
+		OSErr					status,
+		unsigned long			transferCount,
+		unsigned long			transferSize
+	)
+{
+		if (polled) {
+			if (status == noErr)
+				infoPtr->polledTransfers++;
+			return (FALSE);
+		}
+		if (status == noErr) {
+			infoPtr->blindFailures = 0;
+			infoPtr->blindTransfers++;
+			return (FALSE);
+		}
+		if ((status == scPhaseErr || status == scBusTOErr)
+		 && transferCount < transferSize
+		 && IsFixedLengthTransfer(scsiCommand, writeToDevice)) {
+			if (++infoPtr->blindFailures >= kMaxBlindFailures)
+				infoPtr->usePolledTransfer = TRUE;
+			return (TRUE);
+		}
+		return (FALSE);
+}
+
+/*
+ * Return TRUE if the target must transfer exactly transferSize bytes for this
+ * command: all writes, and the reads whose length is set by the command (Read
+ * and Read Capacity). Other reads, such as Inquiry, Mode Sense, and Request
+ * Sense, return as much data as the device has, up to the allocation length.
+ * This is called while OriginalSCSI's memory is held, so it must be located
+ * before NextFunction.
+ */
+static Boolean
+IsFixedLengthTransfer(
+		const SCSI_CommandPtr	scsiCommand,
+		Boolean					writeToDevice
+	)
+{
+		if (writeToDevice)
+			return (TRUE);
+		switch (scsiCommand->scsi[0]) {
+		case kScsiCmdRead6:
+		case kScsiCmdRead10:
+		case kScsiCmdReadCapacity:
+			return (TRUE);
+		default:
+			return (FALSE);
+		}
+}
+
 static void NextFunction(void) { }	/* Dummy function for OriginalSCSI size	*/
 
+/*
+ * Forget everything we learned about blind transfers, and the cached tib
+ * programs. This should be called when the device population may have changed
+ * (for example, before scanning the bus).
+ */
+void
+OriginalSCSIForgetTransferModes(void)
+{
+		register short				i;
+		register char				*ptr;
+		
+		ptr = (char *) gOriginalTransferInfo;
+		for (i = 0; i < sizeof gOriginalTransferInfo; i++)
+			*ptr++ = 0;
+		ptr = (char *) gOriginalTIBProgram;
+		for (i = 0; i < sizeof gOriginalTIBProgram; i++)
+			*ptr++ = 0;
+		gOriginalTIBUseCount = 0;
+}
+
 static Boolean
 IsVirtualMemoryRunning(void)
 {
@@ -0,0 +1,65 @@
+/*									OriginalSCSI.h								*/
+/*
+ * OriginalSCSI.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * How OriginalSCSI chooses between blind and polled transfers. The original
+ * SCSI Manager cannot tell us whether a target (or the bus interface that is
+ * patched into the SCSI Manager traps) can handle blind transfers. We start
+ * each target with the blind transfer the caller requested (normally sized to
+ * the device block). If a blind transfer of a fixed-length command (a write,
+ * Read, or Read Capacity) fails with a phase or bus timeout error before the
+ * whole buffer was transferred, the command is retried once using a polled
+ * transfer and, after kMaxBlindFailures consecutive failures, the target is
+ * switched to polled transfers permanently (until
+ * OriginalSCSIForgetTransferModes is called). A variable-length read, such as
+ * Inquiry or Mode Sense, normally ends with a phase error when the device has
+ * less data than the caller asked for, so it is never counted as a failure.
+ * The original manager can only access one bus, so OriginalSCSI keeps the
+ * state in a table indexed by target ID.
+ *
+ * The decisions are made by the two functions below, which only look at an
+ * OriginalTransferInfo record. This lets the transfer mode benchmark (see
+ * DoTransferModeBenchmark.c) run the same policy against a simulated bus.
+ */
+#ifndef __OriginalSCSI__
+#define __OriginalSCSI__
+#include "MacSCSICommand.h"
+
+#define kMaxOriginalTargetID		7
+#define kMaxBlindFailures			2
+
+struct OriginalTransferInfo {
+	Boolean				usePolledTransfer;		/* Blind is unsafe for target	*/
+	unsigned short		blindFailures;			/* Consecutive blind failures	*/
+	unsigned long		blindTransfers;			/* Successful blind transfers	*/
+	unsigned long		polledTransfers;		/* Successful polled transfers	*/
+};
+typedef struct OriginalTransferInfo OriginalTransferInfo;
+typedef OriginalTransferInfo *OriginalTransferInfoPtr;
+
+/*
+ * Return TRUE if this transfer should be polled: the caller asked for a polled
+ * transfer (transferQuantum is one), or the target has failed blind transfers.
+ */
+Boolean						OriginalSCSIUsePolled(
+		const OriginalTransferInfo	*infoPtr,
+		unsigned long			transferQuantum
+	);
+/*
+ * Record the result of a data transfer: status is the result of the SCSIRead,
+ * SCSIWrite, SCSIRBlind, or SCSIWBlind call, and transferCount the number of
+ * bytes that the TIB counted. Return TRUE if a blind transfer failed: the
+ * command may be retried (once) with a polled transfer.
+ */
+Boolean						OriginalSCSILearnTransfer(
+		OriginalTransferInfoPtr	infoPtr,
+		const SCSI_CommandPtr	scsiCommand,
+		Boolean					writeToDevice,
+		Boolean					polled,
+		OSErr					status,
+		unsigned long			transferCount,
+		unsigned long			transferSize
+	);
+
+#endif /* __OriginalSCSI__ */
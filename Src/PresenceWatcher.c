@@ -0,0 +1,390 @@
+/*									PresenceWatcher.c							*/
+/*
+ * PresenceWatcher.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Probe the empty target IDs with exponential backoff, and hand the targets
+ * that answer to the health monitor. See PresenceWatcher.h. A probe that
+ * fails with anything but a selection timeout (the bus was busy, or was
+ * reset) is inconclusive: it is repeated at the same interval.
+ */
+#include "SCSISimpleSample.h"
+
+static OSErr					StartRound(
+		PresenceWatcherPtr		watcherPtr
+	);
+static void						FinishRound(
+		PresenceWatcherPtr		watcherPtr
+	);
+static void						ProbeResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	);
+static void						RemoveMissing(
+		PresenceWatcherPtr		watcherPtr
+	);
+static PresenceTargetPtr		FindTarget(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID,
+		unsigned short			targetID
+	);
+static unsigned short			FindBus(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID
+	);
+
+OSErr
+PresenceWatcherStart(
+		PresenceWatcherPtr		watcherPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		HealthMonitorPtr		monitorPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		PresenceEventProcPtr	eventProc,
+		long					refCon
+	)
+{
+		register PresenceTargetPtr	targetPtr;
+		register unsigned short	i;
+		DeviceIdent				scsiDevice;
+		unsigned short			lastHostBus;
+		unsigned short			busID;
+		unsigned short			initiatorID;
+		unsigned short			maxTarget;
+		unsigned short			targetID;
+		Boolean					useAsynchManager;
+		unsigned long			now;
+		OSErr					status;
+
+		CLEAR(*watcherPtr);
+		status = SCSIGetHighHostBusAdaptor(&lastHostBus);
+		if (status != noErr)
+			return (status);
+		now = TickCount();
+		/*
+		 * Find the buses as List SCSI Devices does, but keep only those that
+		 * the asynchronous SCSI Manager (and so the dispatcher) reaches.
+		 */
+		CLEAR(scsiDevice);
+		for (busID = 0; busID <= lastHostBus; busID++) {
+			if (watcherPtr->busCount == kSweepMaxBuses)
+				break;
+			scsiDevice.bus = busID;
+			if (SCSIBusAPI(scsiDevice, &useAsynchManager) != noErr
+			 || useAsynchManager == FALSE
+			 || SCSIGetInitiatorID(scsiDevice, &initiatorID) != noErr
+			 || SCSIGetMaxTargetID(scsiDevice, &maxTarget) != noErr)
+				continue;
+			if (maxTarget >= kDispatchMaxTargets)
+				maxTarget = kDispatchMaxTargets - 1;
+			watcherPtr->bus[watcherPtr->busCount++].busID = busID;
+			for (targetID = 0; targetID <= maxTarget; targetID++) {
+				if (targetID == initiatorID)
+					continue;
+				targetPtr = &watcherPtr->target[watcherPtr->targetCount++];
+				targetPtr->bus = busID;
+				targetPtr->targetID = targetID;
+				for (i = 0; i < deviceCount; i++) {
+					if (deviceList[i].bus == busID
+					 && deviceList[i].targetID == targetID)
+						break;
+				}
+				targetPtr->populated = (i < deviceCount);
+				targetPtr->intervalTicks = kPresenceFastTicks;
+				targetPtr->dueTicks = now + kPresenceFastTicks;
+			}
+		}
+		watcherPtr->environmentPtr = environmentPtr;
+		watcherPtr->monitorPtr = monitorPtr;
+		watcherPtr->eventProc = eventProc;
+		watcherPtr->refCon = refCon;
+		watcherPtr->startTicks = now;
+		watcherPtr->nextRoundTicks = now;
+		watcherPtr->active = TRUE;
+		return (noErr);
+}
+
+OSErr
+PresenceWatcherIdle(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		OSErr					status;
+
+		if (watcherPtr->active == FALSE)
+			return (noErr);
+		RemoveMissing(watcherPtr);
+		if (watcherPtr->probing) {
+			if (DeviceSweepPoll(&watcherPtr->sweep) == FALSE)
+				FinishRound(watcherPtr);
+			return (noErr);
+		}
+		if (TickCount() < watcherPtr->nextRoundTicks)
+			return (noErr);
+		status = StartRound(watcherPtr);
+		if (status != noErr)
+			PresenceWatcherStop(watcherPtr);
+		return (status);
+}
+
+void
+PresenceWatcherKick(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID
+	)
+{
+		register PresenceTargetPtr	targetPtr;
+		register unsigned short	i;
+		unsigned long			now;
+
+		now = TickCount();
+		for (i = 0; i < watcherPtr->targetCount; i++) {
+			targetPtr = &watcherPtr->target[i];
+			if (targetPtr->bus == busID && targetPtr->populated == FALSE) {
+				targetPtr->intervalTicks = kPresenceFastTicks;
+				targetPtr->dueTicks = now;
+			}
+		}
+}
+
+void
+PresenceWatcherStop(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		if (watcherPtr->probing)
+			DeviceSweepClose(&watcherPtr->sweep);
+		watcherPtr->probing = FALSE;
+		watcherPtr->active = FALSE;
+}
+
+/*
+ * If an empty ID is due, start a round with the empty IDs that are due or
+ * nearly due, at most kPresenceMaxPerRound on each bus, the most overdue
+ * first.
+ */
+static OSErr
+StartRound(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		register PresenceTargetPtr	targetPtr;
+		register unsigned short	i;
+		DeviceIdent				deviceList[kPresenceMaxTargets];
+		Boolean					chosen[kPresenceMaxTargets];
+		unsigned short			deviceCount;
+		unsigned short			best;
+		unsigned short			busIndex;
+		unsigned long			now;
+		OSErr					status;
+
+		now = TickCount();
+		for (i = 0; i < watcherPtr->targetCount; i++) {
+			targetPtr = &watcherPtr->target[i];
+			if (targetPtr->populated == FALSE && targetPtr->dueTicks <= now)
+				break;
+		}
+		if (i == watcherPtr->targetCount)
+			return (noErr);							/* Nothing is due		*/
+		for (i = 0; i < watcherPtr->busCount; i++)
+			watcherPtr->bus[i].roundProbes = 0;
+		CLEAR(chosen);
+		deviceCount = 0;
+		for (;;) {
+			best = watcherPtr->targetCount;
+			for (i = 0; i < watcherPtr->targetCount; i++) {
+				targetPtr = &watcherPtr->target[i];
+				if (chosen[i]
+				 || targetPtr->populated
+				 || targetPtr->dueTicks > now + targetPtr->intervalTicks / 4)
+					continue;
+				busIndex = FindBus(watcherPtr, targetPtr->bus);
+				if (watcherPtr->bus[busIndex].roundProbes
+						== kPresenceMaxPerRound)
+					continue;
+				if (best == watcherPtr->targetCount
+				 || targetPtr->dueTicks < watcherPtr->target[best].dueTicks)
+					best = i;
+			}
+			if (best == watcherPtr->targetCount)
+				break;
+			chosen[best] = TRUE;
+			targetPtr = &watcherPtr->target[best];
+			++watcherPtr->bus[FindBus(watcherPtr, targetPtr->bus)].roundProbes;
+			watcherPtr->roundTarget[deviceCount] = best;
+			CLEAR(deviceList[deviceCount]);
+			deviceList[deviceCount].bus = targetPtr->bus;
+			deviceList[deviceCount].targetID = targetPtr->targetID;
+			++deviceCount;
+		}
+		status = DeviceSweepOpen(
+					&watcherPtr->sweep, watcherPtr->environmentPtr,
+					deviceList, deviceCount, kSweepTestUnitReady, 1);
+		if (status != noErr)
+			return (status);
+		for (i = 0; i < deviceCount; i++) {
+			watcherPtr->sweep.job[i].request.background = TRUE;
+			watcherPtr->sweep.job[i].request.selectTimeout =
+				kPresenceSelectMsec;
+		}
+		watcherPtr->sweep.resultProc = ProbeResult;
+		watcherPtr->sweep.refCon = (long) watcherPtr;
+		watcherPtr->roundStartTicks = now;
+		watcherPtr->probing = TRUE;
+		++watcherPtr->rounds;
+		return (noErr);
+}
+
+/*
+ * Every probe in the round has completed: add each bus's time to its total.
+ */
+static void
+FinishRound(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		register PresenceBus	*busPtr;
+		register unsigned short	i;
+
+		DeviceSweepClose(&watcherPtr->sweep);
+		for (i = 0; i < watcherPtr->busCount; i++) {
+			busPtr = &watcherPtr->bus[i];
+			busPtr->busyTicks += busPtr->roundTicks;
+			busPtr->roundTicks = 0;
+		}
+		watcherPtr->probing = FALSE;
+		watcherPtr->nextRoundTicks = TickCount() + kPresenceRoundTicks;
+}
+
+/*
+ * One empty ID's probe has completed (called by DeviceSweepPoll). Any answer
+ * at all, even Check Condition, means that a target is there.
+ */
+static void
+ProbeResult(
+		DeviceSweepPtr			sweepPtr,
+		BusRequestPtr			requestPtr
+	)
+{
+		register PresenceWatcherPtr	watcherPtr;
+		register PresenceTargetPtr	targetPtr;
+		PresenceBus				*busPtr;
+		unsigned long			now;
+#define SCB	(requestPtr->scsiCmdBlock)
+
+		watcherPtr = (PresenceWatcherPtr) sweepPtr->refCon;
+		targetPtr = &watcherPtr->target[watcherPtr->roundTarget[
+					(SweepJob *) requestPtr - sweepPtr->job]];
+		now = TickCount();
+		busPtr = &watcherPtr->bus[FindBus(watcherPtr, SCB.scsiDevice.bus)];
+		++busPtr->probes;
+		busPtr->roundTicks = now - watcherPtr->roundStartTicks;
+		++watcherPtr->probes;
+		++targetPtr->probes;
+		switch (SCB.status) {
+		case noErr:
+		case statusErr:
+			targetPtr->populated = TRUE;
+			++watcherPtr->added;
+			if (watcherPtr->monitorPtr != NULL)
+				(void) HealthMonitorAdd(watcherPtr->monitorPtr, SCB.scsiDevice);
+			if (watcherPtr->eventProc != NULL)
+				(*watcherPtr->eventProc)(
+					watcherPtr, SCB.scsiDevice, kPresenceAdd);
+			break;
+		case scsiSelectTimeout:
+		case scsiDeviceNotThere:
+			if (targetPtr->intervalTicks < kPresenceSlowTicks) {
+				targetPtr->intervalTicks *= 2;
+				if (targetPtr->intervalTicks > kPresenceSlowTicks)
+					targetPtr->intervalTicks = kPresenceSlowTicks;
+			}
+			break;
+		default:
+			++watcherPtr->errors;
+			break;
+		}
+		targetPtr->dueTicks = now + targetPtr->intervalTicks;
+#undef SCB
+}
+
+/*
+ * Take the devices that the health monitor found missing out of the monitor.
+ * A target with no devices left in the monitor is empty again. This is done
+ * between the monitor's rounds, when its device table may be changed.
+ */
+static void
+RemoveMissing(
+		PresenceWatcherPtr		watcherPtr
+	)
+{
+		register HealthMonitorPtr	monitorPtr;
+		register PresenceTargetPtr	targetPtr;
+		register unsigned short	i;
+		unsigned short			j;
+		DeviceIdent				scsiDevice;
+
+		monitorPtr = watcherPtr->monitorPtr;
+		if (monitorPtr == NULL
+		 || monitorPtr->active == FALSE
+		 || monitorPtr->polling)
+			return;
+		i = 0;
+		while (i < monitorPtr->deviceCount) {
+			if (monitorPtr->device[i].state != kHealthMissing) {
+				++i;
+				continue;
+			}
+			scsiDevice = monitorPtr->device[i].scsiDevice;
+			HealthMonitorRemove(monitorPtr, i);		/* The last one moves to i	*/
+			++watcherPtr->removed;
+			for (j = 0; j < monitorPtr->deviceCount; j++) {
+				if (monitorPtr->device[j].scsiDevice.bus == scsiDevice.bus
+				 && monitorPtr->device[j].scsiDevice.targetID
+						== scsiDevice.targetID)
+					break;
+			}
+			targetPtr = FindTarget(
+						watcherPtr, scsiDevice.bus, scsiDevice.targetID);
+			if (j == monitorPtr->deviceCount && targetPtr != NULL) {
+				targetPtr->populated = FALSE;
+				targetPtr->intervalTicks = kPresenceFastTicks;
+				targetPtr->dueTicks = TickCount() + kPresenceFastTicks;
+			}
+			if (watcherPtr->eventProc != NULL)
+				(*watcherPtr->eventProc)(
+					watcherPtr, scsiDevice, kPresenceRemove);
+		}
+}
+
+static PresenceTargetPtr
+FindTarget(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID,
+		unsigned short			targetID
+	)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < watcherPtr->targetCount; i++) {
+			if (watcherPtr->target[i].bus == busID
+			 && watcherPtr->target[i].targetID == targetID)
+				return (&watcherPtr->target[i]);
+		}
+		return (NULL);
+}
+
+static unsigned short
+FindBus(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID
+	)
+{
+		register unsigned short	i;
+
+		for (i = 0; i < watcherPtr->busCount; i++) {
+			if (watcherPtr->bus[i].busID == busID)
+				break;
+		}
+		return (i);
+}
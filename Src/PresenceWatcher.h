@@ -0,0 +1,153 @@
+/*									PresenceWatcher.h							*/
+/*
+ * PresenceWatcher.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Find devices that are connected, and notice devices that are disconnected,
+ * without another List SCSI Devices. The watcher knows, for each target ID
+ * on each bus that the asynchronous SCSI Manager reaches, whether a device
+ * was found there.
+ *	-- An empty target ID is probed with Test Unit Ready, the cheapest
+ *	   command there is, with a selection timeout of kPresenceSelectMsec
+ *	   rather than the SIM's 250 msec default: a missing target holds the
+ *	   bus only until the selection times out. The first probe is made
+ *	   kPresenceFastTicks after the ID is found empty, and the interval
+ *	   doubles after each probe that finds nothing, up to kPresenceSlowTicks.
+ *	   If a target answers, it is added: a kPresenceAdd event is reported,
+ *	   and LUN 0 is given to the health monitor.
+ *	-- A populated target ID is never probed by the watcher: its devices are
+ *	   polled by the health monitor (see HealthMonitor.h). When the monitor
+ *	   finds a device missing, the device is removed from the monitor and a
+ *	   kPresenceRemove event is reported. When a target has no devices left,
+ *	   its ID is empty again, and is probed from the fast interval, so that a
+ *	   device that is reconnected is found at once.
+ * PresenceWatcherKick restarts the backoff of a bus's empty IDs: it is called
+ * when something suggests that the bus has changed (such as a reset that the
+ * health monitor saw).
+ *
+ * The probes are made in rounds, from the event loop, as the health monitor's
+ * polls are: each round is one DeviceSweep, of background requests, one at a
+ * time on each bus and at most kPresenceMaxPerRound per bus, and the rounds
+ * start at least kPresenceRoundTicks apart. In the steady state, with all
+ * empty IDs at the slow interval, each empty ID holds its bus for at most
+ * kPresenceSelectMsec every kPresenceSlowTicks. Each bus counts its probes,
+ * and the time from the start of each round until its last probe completed.
+ *
+ * Only the targets that the bus dispatcher can address are watched (target
+ * IDs below kDispatchMaxTargets). Targets that only the original SCSI Manager
+ * reaches are not watched.
+ */
+#ifndef __PresenceWatcher__
+#define __PresenceWatcher__
+#include "MacSCSICommand.h"
+#include "DeviceSweep.h"
+#include "HealthMonitor.h"
+
+#define kPresenceMaxTargets		(kSweepMaxBuses * kDispatchMaxTargets)
+#define kPresenceSelectMsec		16				/* Probe selection timeout	*/
+#define kPresenceFastTicks		30L				/* Half a second			*/
+#define kPresenceSlowTicks		(60L * 30L)		/* Thirty seconds			*/
+#define kPresenceRoundTicks		30L
+#define kPresenceMaxPerRound	2				/* Per bus					*/
+
+/*
+ * Events.
+ */
+enum {
+	kPresenceAdd = 0,					/* A target answered a probe		*/
+	kPresenceRemove						/* The health monitor lost a device	*/
+};
+
+struct PresenceTarget {
+	unsigned char		bus;
+	unsigned char		targetID;
+	Boolean				populated;				/* Not probed if TRUE			*/
+	Boolean				reserved;
+	unsigned long		intervalTicks;			/* Until the next probe			*/
+	unsigned long		dueTicks;				/* When it is due				*/
+	unsigned long		probes;
+};
+typedef struct PresenceTarget PresenceTarget, *PresenceTargetPtr;
+
+struct PresenceBus {
+	unsigned short		busID;
+	unsigned short		roundProbes;			/* In this round				*/
+	unsigned long		probes;
+	unsigned long		busyTicks;				/* Round start to last probe	*/
+	unsigned long		roundTicks;				/* In this round, so far		*/
+};
+typedef struct PresenceBus PresenceBus;
+
+typedef struct PresenceWatcher PresenceWatcher, *PresenceWatcherPtr;
+/*
+ * The event procedure is called at task level, from PresenceWatcherIdle.
+ * For kPresenceAdd, scsiDevice is LUN 0 of the target that answered.
+ */
+typedef void				(*PresenceEventProcPtr)(
+		PresenceWatcherPtr		watcherPtr,
+		DeviceIdent				scsiDevice,
+		unsigned short			event
+	);
+
+struct PresenceWatcher {
+	Boolean				active;
+	Boolean				probing;				/* A round is in progress		*/
+	SCSIEnvironmentPtr	environmentPtr;
+	HealthMonitorPtr	monitorPtr;				/* Polls the populated IDs		*/
+	PresenceEventProcPtr	eventProc;
+	long				refCon;					/* For the event procedure		*/
+	unsigned short		targetCount;
+	PresenceTarget		target[kPresenceMaxTargets];
+	unsigned short		busCount;
+	PresenceBus			bus[kSweepMaxBuses];
+	DeviceSweep			sweep;					/* The current round			*/
+	unsigned short		roundTarget[kPresenceMaxTargets];	/* Sweep job to target	*/
+	unsigned long		roundStartTicks;
+	unsigned long		nextRoundTicks;			/* Earliest start of the next	*/
+	unsigned long		startTicks;				/* When the watcher started		*/
+	unsigned long		rounds;
+	unsigned long		probes;
+	unsigned long		errors;					/* Inconclusive probes			*/
+	unsigned long		added;
+	unsigned long		removed;
+};
+
+/*
+ * Find the buses and their target IDs, and start watching. The target IDs
+ * of the devices in deviceList (as found by List SCSI Devices) are populated;
+ * the others are empty. monitorPtr is the health monitor that polls the
+ * populated IDs: it should be active.
+ */
+OSErr						PresenceWatcherStart(
+		PresenceWatcherPtr		watcherPtr,
+		SCSIEnvironmentPtr		environmentPtr,
+		HealthMonitorPtr		monitorPtr,
+		const DeviceIdent		deviceList[],
+		unsigned short			deviceCount,
+		PresenceEventProcPtr	eventProc,
+		long					refCon
+	);
+/*
+ * Called by the event loop on each null event: remove the devices that the
+ * health monitor found missing, then continue the current round or, if an
+ * empty ID is due, start one. If a round can't be started, the watcher stops
+ * and the error is returned.
+ */
+OSErr						PresenceWatcherIdle(
+		PresenceWatcherPtr		watcherPtr
+	);
+/*
+ * Probe the empty IDs on this bus soon, from the fast interval.
+ */
+void						PresenceWatcherKick(
+		PresenceWatcherPtr		watcherPtr,
+		unsigned short			busID
+	);
+/*
+ * Stop. A round in progress is abandoned: its results are not reported.
+ */
+void						PresenceWatcherStop(
+		PresenceWatcherPtr		watcherPtr
+	);
+
+#endif /* __PresenceWatcher__ */
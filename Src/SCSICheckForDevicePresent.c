@@ -33,7 +33,14 @@ SCSICheckForDevicePresent(
 		DoSCSICommandWithSense(&scsiCmdBlock, FALSE, enableAsynchSCSI);
 		switch (SCB.status) {
 		case noErr:
-			if (inquiry.devType == kScsiDevTypeMissing) {
+			/*
+			 * A target that supports multiple logical units returns the
+			 * "missing" peripheral qualifier for an unimplemented LUN. Some
+			 * SCSI-1 devices return only the device type 0x1F.
+			 */
+			if (inquiry.devType == kScsiDevTypeMissing
+			 || (inquiry.devType & kScsiDevTypeQualifierMask)
+			 		== kScsiDevTypeQualifierMissing) {
 				VERBOSE("\pNo such device");
 				result = FALSE;
 			}
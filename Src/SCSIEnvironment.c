@@ -0,0 +1,94 @@
+/*									SCSIEnvironment.c							*/
+/*
+ * SCSIEnvironment.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * The SCSI command core's context record, and its Busy retry rules. See
+ * SCSIEnvironment.h. Like AsyncSCSI.c, this is self-contained and does not
+ * use the application log.
+ */
+#include <OSUtils.h>
+#include <Events.h>
+#include <Errors.h>
+#include "SCSIEnvironment.h"
+#include "CoreMacros.h"
+
+void
+SCSIEnvironmentInit(
+		SCSIEnvironmentPtr		environmentPtr
+	)
+{
+		CLEAR(*environmentPtr);
+		SCSIWatchdogInit(&environmentPtr->watchdog);
+		CompletionQueueInit(&environmentPtr->completions);
+		environmentPtr->policy.enableSelectWithATN = TRUE;
+}
+
+/*
+ * The asynchronous SCSI Manager may be installed by a System Extension, so a
+ * driver that is opened early must not test for it until the system has
+ * been completely initialized.
+ */
+Boolean
+SCSIEnvironmentHasAsyncSCSIManager(
+		SCSIEnvironmentPtr		environmentPtr
+	)
+{
+		if (environmentPtr->testedForAsyncSCSIManager == FALSE) {
+			environmentPtr->testedForAsyncSCSIManager = TRUE;
+			environmentPtr->hasAsyncSCSIManager = (
+					NGetTrapAddress(_SCSIAtomic, OSTrap)
+					!= NGetTrapAddress(_Unimplemented, OSTrap)
+				);
+		}
+		return (environmentPtr->hasAsyncSCSIManager);
+}
+
+void
+SCSIEnvironmentIdle(
+		SCSIEnvironmentPtr		environmentPtr
+	)
+{
+		if (environmentPtr->idleProc != NULL)
+			(*environmentPtr->idleProc)(environmentPtr);
+}
+
+OSErr
+SCSIBusyStatus(
+		OSErr					status,
+		unsigned short			statusByte
+	)
+{
+		if (status == scsiNonZeroStatus
+		 && (statusByte == kScsiStatusBusy
+				  || statusByte == kScsiStatusQueueFull))
+			status = controlErr;
+		return (status);
+}
+
+void
+SCSIBusyRetryInit(
+		SCSIBusyRetryPtr		retryPtr
+	)
+{
+		retryPtr->startTicks = TickCount();
+		retryPtr->pauseTicks = 1;
+		retryPtr->resumeTicks = retryPtr->startTicks;
+}
+
+Boolean
+SCSIBusyRetryNext(
+		SCSIBusyRetryPtr		retryPtr
+	)
+{
+		unsigned long			now;
+
+		now = TickCount();
+		if ((now - retryPtr->startTicks) >= kBusyRetryTicks)
+			return (FALSE);
+		retryPtr->resumeTicks = now + retryPtr->pauseTicks;
+		retryPtr->pauseTicks *= 2;
+		if (retryPtr->pauseTicks > kBusyMaxPauseTicks)
+			retryPtr->pauseTicks = kBusyMaxPauseTicks;
+		return (TRUE);
+}
@@ -0,0 +1,126 @@
+/*									SCSIEnvironment.h							*/
+/*
+ * SCSIEnvironment.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * The state shared by the SCSI command core (AsyncSCSI, SubmitBatch, and the
+ * bus dispatcher). The core keeps nothing in globals or static variables:
+ * each caller passes its SCSIEnvironment, and callers with different
+ * environments never touch the same data. A driver would keep its environment
+ * in its driver globals, and code that runs commands from several Thread
+ * Manager threads may give each thread its own environment (or share one,
+ * since cooperative threads only switch when they yield). The Thread Stress
+ * Test (DoThreadStressTest.c) checks both.
+ *
+ * The rest of the application is not so careful:
+ *	-- DoSCSICommandWithSense and DoSCSICommandBatch always use the
+ *	   application's environment (gSCSIEnvironment) and read
+ *	   gEnableNewSCSIManager, and DoSCSICommandWithSense feeds the command
+ *	   trace and the statistics export. A thread that wants its own
+ *	   environment must call AsyncSCSI, SubmitBatch, or a bus dispatcher
+ *	   directly.
+ *	-- OriginalSCSI keeps the transfer modes that it learned for each target,
+ *	   and its cache of TIB programs, in static tables. There is only one
+ *	   bus for the original SCSI Manager, and its commands are serialized
+ *	   by SCSIGet anyway.
+ *
+ * The bus dispatchers opened with an environment post their command
+ * completions to its completion queue (see CompletionQueue.h). Whoever drains
+ * the queue -- BusDispatcherPoll, or the application's event loop -- finishes
+ * the commands of every dispatcher using the environment.
+ *
+ * The environment must not be moved while a command is in progress.
+ */
+#ifndef __SCSIEnvironment__
+#define __SCSIEnvironment__
+#include "MacSCSICommand.h"
+#include "SCSIWatchdog.h"
+#include "DevicePolicy.h"
+#include "CompletionQueue.h"
+
+typedef struct SCSIEnvironment SCSIEnvironment, *SCSIEnvironmentPtr;
+/*
+ * The idle procedure is called repeatedly while AsyncSCSI waits for a command
+ * to complete. A threaded caller would call YieldToAnyThread here, so other
+ * threads can run (and issue their own commands, with this environment or
+ * another) while this one waits. The idle procedure itself must not call
+ * AsyncSCSI: it would be called again while that command waits.
+ */
+typedef void				(*SCSIIdleProcPtr)(
+		SCSIEnvironmentPtr		environmentPtr
+	);
+struct SCSIEnvironment {
+	Boolean				testedForAsyncSCSIManager;
+	Boolean				hasAsyncSCSIManager;
+	SCSIIdleProcPtr		idleProc;				/* NULL to spin					*/
+	long				refCon;					/* For the idle procedure		*/
+	SCSIWatchdog		watchdog;				/* Late request recovery		*/
+	DevicePolicyTable	policy;					/* Disconnect, Select with ATN	*/
+	CompletionQueue		completions;			/* From the bus dispatchers		*/
+};
+
+/*
+ * Clear the environment. Select with Attention is enabled, and there is no
+ * idle procedure.
+ */
+void						SCSIEnvironmentInit(
+		SCSIEnvironmentPtr		environmentPtr
+	);
+/*
+ * Return TRUE if the asynchronous SCSI Manager is installed. The test is
+ * made once for each environment. This must not be called before the
+ * Process Manager is running (a driver must defer the test).
+ */
+Boolean						SCSIEnvironmentHasAsyncSCSIManager(
+		SCSIEnvironmentPtr		environmentPtr
+	);
+/*
+ * Call the idle procedure, if any.
+ */
+void						SCSIEnvironmentIdle(
+		SCSIEnvironmentPtr		environmentPtr
+	);
+
+/*
+ * A target that is Busy, or whose command queue is full, did not execute the
+ * command. AsyncSCSI, SubmitBatch, and the bus dispatcher all return
+ * controlErr for it (as OriginalSCSI does for Busy), and all retry it in the
+ * same way: for as long as OriginalSCSI retries Busy (kBusyRetryTicks), with
+ * the first retry after one tick and the pause doubling up to OriginalSCSI's
+ * fixed quarter second. A target that is busy only briefly costs little, and
+ * one that is busy for long is not flooded.
+ */
+#define kBusyRetryTicks			(60L * 10L)
+#define kBusyMaxPauseTicks		15L
+
+struct SCSIBusyRetry {
+	unsigned long		startTicks;				/* When first started			*/
+	unsigned long		pauseTicks;				/* Before the next retry		*/
+	unsigned long		resumeTicks;			/* <- Retry at this time		*/
+};
+typedef struct SCSIBusyRetry SCSIBusyRetry, *SCSIBusyRetryPtr;
+
+/*
+ * Return controlErr if the command completed with scsiNonZeroStatus and a
+ * Busy or Queue Full status byte; otherwise, return status unchanged.
+ */
+OSErr						SCSIBusyStatus(
+		OSErr					status,
+		unsigned short			statusByte
+	);
+/*
+ * Call before a command is first started.
+ */
+void						SCSIBusyRetryInit(
+		SCSIBusyRetryPtr		retryPtr
+	);
+/*
+ * The command returned controlErr. Return FALSE if it has been retried for
+ * kBusyRetryTicks already. Otherwise, set resumeTicks to the time at which it
+ * should be started again, double the pause, and return TRUE.
+ */
+Boolean						SCSIBusyRetryNext(
+		SCSIBusyRetryPtr		retryPtr
+	);
+
+#endif /* __SCSIEnvironment__ */
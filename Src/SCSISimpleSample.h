@@ -55,7 +55,15 @@
 #endif
 
 #include "MacSCSICommand.h"
+#include "OriginalSCSI.h"
 #include "LogManager.h"
+#include "SCSIWatchdog.h"
+#include "VirtualSIM.h"
+#include "VirtualImage.h"
+#include "DevicePolicy.h"
+#include "SCSIEnvironment.h"
+#include "IOScheduler.h"
+#include "BusSimulator.h"
 
 #define kScrollBarWidth		16
 #define kScrollBarOffset	(kScrollBarWidth - 1)
@@ -97,15 +105,43 @@ enum EditMenu {
 enum {
 	kTestEnableNewManager = 1,
 	kTestEnableAllLogicalUnits,
+	kTestThrottleScan,
 	kTestEnableSelectWithATN,
 	kTestUnused1,
 	kTestDoDisconnect,
 	kTestDontDisconnect,
+	kTestDisconnectPolicy,
+	kTestSelectWithATNPolicy,
+	kTestVirtualBus,
+	kTestDiskImage,
+	kTestCaptureTrace,
+	kTestReplayTrace,
+	kTestTraceIndex,
+	kTestTraceAnalysis,
+	kTestExportStatistics,
+	kTestHealthMonitor,
+	kTestPresenceWatcher,
 	kTestUnused2,
 	kTestListSCSIDevices,
 	kTestGetDriveInfo,
 	kTestUnitReady,
 	kTestReadBlockZero,
+	kTestDeviceSummary,
+	kTestSweepUnitReady,
+	kTestSweepInquiry,
+	kTestSweepReadBlockZero,
+	kTestSchedulerBenchmark,
+	kTestBusShareBenchmark,
+	kTestScanImpactBenchmark,
+	kTestDisconnectBenchmark,
+	kTestFlowBenchmark,
+	kTestCompletionTest,
+	kTestMediaBenchmark,
+	kTestFaultBenchmark,
+	kTestThreadStressTest,
+	kTestBusSimulator,
+	kTestTransferModeBenchmark,
+	kTestWatchdogRecovery,
 	kTestUnused3,
 	kTestVerboseDisplay,
 	kTestDummyLastEntryThankYouANSICCommittee
@@ -127,6 +163,7 @@ struct ScsiCmdBlock {
 	unsigned long		scsiFlags;				/* -> asynch flags				*/
 	OSErr				status;					/* <- Current OSErr				*/
 	OSErr				requestSenseStatus;		/* <- From RequestSense			*/
+	unsigned short		busyRetries;			/* <- Busy/Queue Full retries	*/
 	SCSI_Command		command;				/* -> Current command			*/
 	SCSI_Sense_Data		sense;					/* <- Gets Sense data			*/
 };
@@ -134,8 +171,8 @@ typedef struct ScsiCmdBlock ScsiCmdBlock, *ScsiCmdBlockPtr;
 /*
  * Notes on the above:
  *	scsiDevice			Used for both managers, but the original manager
- *						ignores the bus and LUN designations. The caller
- *						must stuff the LUN into the command data block.
+ *						ignores the bus designation. The LUN is stored in
+ *						the command data block for both managers.
  *	bufferPtr			If NULL, no read/write is performed.
  *	transferSize		If zero, no read/write is performed.
  *	transferQuantum		This is used by the handshake and TIB setup. Note:
@@ -144,24 +181,111 @@ typedef struct ScsiCmdBlock ScsiCmdBlock, *ScsiCmdBlockPtr;
  *							0		transferQuantum := transferSize
  *							1		force polled read/write
  *							> 1		blocked read (for example, 512)
+ *						The original SCSI Manager path may replace a blind
+ *						transfer with a polled transfer if the target has
+ *						failed blind transfers.
  *	statusByte			Returned from the device
  *	actualTransfercount Returned in bytes (transferQuantum sets granularity)
  *	scsiFlags			Set special flags (scsiDontDisconnect) here.
  *	status				Overall operation status (note special status values)
  *	requestSenseStatus	Has status of Request Sense (only if status was
  *						statusErr, indicating that "Check condition" status.
+ *	busyRetries			The number of times DoSCSICommandWithSense (or
+ *						DoSCSICommandBatch, or the bus dispatcher) retried
+ *						the command because the device was busy (asynchronous
+ *						SCSI Manager only: OriginalSCSI retries on its own).
  */
+#include "BusDispatcher.h"			/* Needs ScsiCmdBlock			*/
+#include "CommandTrace.h"			/* Needs ScsiCmdBlock			*/
+#include "TraceAnalysis.h"
+#include "ScanLimiter.h"
+#include "DeviceSweep.h"
+#include "DeviceFlow.h"
+#include "StatsExport.h"			/* Needs ScsiCmdBlock			*/
+#include "HealthMonitor.h"
+#include "PresenceWatcher.h"
 	
 /*
  * These are the things the user can choose from the menu:
  *	ListSCSIDevices				Scan all busses and display info for all
- *								devices (all targets, all LUNs)
+ *								devices (all targets, all LUNs). The scan
+ *								runs from null events (ContinueListSCSI-
+ *								Devices): Command-period cancels it.
  *	DeviceInquiry				Execute an Inquiry command for this device
  *								and display the results.
  *	TestUnitReady				Execute a Test Unit Ready command for this
  *								device and display the results.
+ *	WatchdogTest				Simulate a hung device and display how long
+ *								the watchdog took to recover.
+ *	DeviceSummary				Execute Test Unit Ready, Inquiry, Read
+ *								Capacity, and Mode Sense as one batch.
+ *	SchedulerBenchmark			Run a random read workload in arrival order
+ *								and through the I/O scheduler.
+ *	BusShareBenchmark			Run a mixed workload on the virtual bus in
+ *								arrival order and through the bus dispatcher.
+ *	ScanImpactBenchmark			Measure a streaming read on the virtual bus
+ *								while the bus is scanned, with and without
+ *								the scan limiter.
+ *	DisconnectPolicy			Change the current device's disconnect
+ *								override and display its policy.
+ *	SelectWithATNPolicy			Change the current device's Select with
+ *								ATN override and display its policy.
+ *	DisconnectBenchmark			Measure bus throughput on the virtual bus
+ *								with each disconnect policy.
+ *	VirtualBus					Install (or remove) the virtual SCSI bus.
+ *	DiskImage					Attach a disk image file to the virtual bus
+ *								(or detach it).
+ *	TraceCapture				Start capturing the commands executed by
+ *								DoSCSICommandWithSense in a trace file (or
+ *								stop).
+ *	TraceReplay					Replay a command trace, at its original pace
+ *								and as fast as possible, and compare the
+ *								latencies with the recorded ones.
+ *	TraceIndex					Display a command trace's index, and time a
+ *								query for each device in it.
+ *	TraceAnalysis				Display latency percentiles, error rates,
+ *								throughput, sense codes, and outliers from a
+ *								command trace (see TraceAnalysis.h).
+ *	StatsExport					Start exporting device and bus statistics
+ *								to Prometheus and CSV files (or stop).
+ *	HealthMonitor				Start watching the devices that List SCSI
+ *								Devices found, and log each change (or stop,
+ *								and display the load on each bus).
+ *	PresenceWatcher				Start probing the empty target IDs with
+ *								backoff, and adding and removing devices as
+ *								they are connected and disconnected (or stop).
+ *	DeviceSweep					Run Test Unit Ready, Inquiry, or Read Block
+ *								Zero on every device that List SCSI Devices
+ *								found, on all buses at once.
+ *	FlowBenchmark				Run a thousand device flows at once on the
+ *								virtual bus, and one at a time.
+ *	CompletionTest				Keep commands in flight on the virtual bus,
+ *								finished by the event loop, and display the
+ *								completion latency with the fixed and the
+ *								adaptive WaitNextEvent sleep.
+ *	MediaBenchmark				Time discovery and media I/O for a CD-ROM
+ *								player and a tape drive on the virtual bus.
+ *	FaultBenchmark				Time a read workload on the virtual bus with
+ *								each kind of injected fault (Busy, Unit
+ *								Attention, timeouts, and so on).
+ *	ThreadStressTest			Write and read back from several Thread
+ *								Manager threads at once on the virtual bus,
+ *								with separate and with shared environments.
+ *	BusSimulator				Compare disconnect and queueing policies on
+ *								a simulated bus (see BusSimulator.h).
+ *	TransferModeBenchmark		Compare blind, polled, and learned transfers
+ *								for the original SCSI Manager on a simulated
+ *								bus (see OriginalSCSI.h).
  */
 void						DoListSCSIDevices(void);
+Boolean						ContinueListSCSIDevices(void);
+void						CancelListSCSIDevices(void);
+void						RememberDevice(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	);
+void						ForgetDevice(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	);
 void						DoGetDriveInfo(
 		DeviceIdent				scsiDevice,				/* -> Bus/target/LUN	*/
 		Boolean					noIntroMsg,
@@ -173,6 +297,42 @@ void						DoTestUnitReady(
 void						DoReadBlockZero(
 		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
 	);
+void						DoWatchdogTest(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	);
+void						DoDeviceSummary(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	);
+void						DoSchedulerBenchmark(
+		DeviceIdent				scsiDevice				/* -> Bus/target/LUN	*/
+	);
+void						DoBusShareBenchmark(void);
+void						DoScanImpactBenchmark(void);
+void						DoDevicePolicy(
+		DeviceIdent				scsiDevice,				/* -> Bus/target/LUN	*/
+		Boolean					changeSelectWithATN
+	);
+void						DoDisconnectBenchmark(void);
+void						DoFlowBenchmark(void);
+void						DoCompletionTest(void);
+void						ContinueCompletionTest(void);
+void						DoMediaBenchmark(void);
+void						DoFaultBenchmark(void);
+void						DoThreadStressTest(void);
+void						DoBusSimBenchmark(void);
+void						DoTransferModeBenchmark(void);
+void						DoVirtualBus(void);
+void						DoDiskImage(void);
+void						DoTraceCapture(void);
+void						DoTraceReplay(void);
+void						DoTraceIndex(void);
+void						DoTraceAnalysis(void);
+void						DoStatsExport(void);
+void						DoHealthMonitor(void);
+void						DoPresenceWatcher(void);
+void						DoDeviceSweep(
+		unsigned short			operation			/* kSweepTestUnitReady...	*/
+	);
 /*
  * These are low-level commands that are needed to scan the bus.
  */
@@ -223,14 +383,33 @@ Boolean						AsyncSCSIPresent(void);
 /*
  * All commands are performed by this function. If the asynchronous SCSI Manager
  * is present, it is called directly. If it is not present, the original SCSI
- * Manager is called and, if the device returns Check Condition, a Request
- * Sense command is issued.
+ * Manager is called. In both cases, if the device returns Check Condition, a
+ * Request Sense command is issued before the function returns.
  */
 void						DoSCSICommandWithSense(
 		register ScsiCmdBlockPtr	scsiCmdBlockPtr,
 		Boolean					displayError,
 		Boolean					enableAsynchSCSI
 	);
+/*
+ * Execute a sequence of commands for one device as a single submission.
+ * The commands are linked if the bus supports linked commands; otherwise,
+ * they are queued together. Each SCB receives its own status. Returns the
+ * status of the first command that failed.
+ */
+OSErr						DoSCSICommandBatch(
+		ScsiCmdBlockPtr			scsiCmdBlockArray,
+		unsigned short			cmdCount,
+		Boolean					displayError,
+		Boolean					enableAsynchSCSI
+	);
+/*
+ * Set SCB.requestSenseStatus from SCB.status and display any error.
+ */
+void						CheckSCSICommandStatus(
+		register ScsiCmdBlockPtr	scsiCmdBlockPtr,
+		Boolean					displayError
+	);
 
 /*
  * The following functions display operation results.
@@ -257,10 +436,30 @@ void						ShowStatusError(
 		OSErr					errorStatus,
 		const SCSI_CommandPtr	scsiCommand
 	);
+void						ShowStatusByteError(
+		DeviceIdent				scsiDevice,				/* -> Bus/target/LUN	*/
+		unsigned short			statusByte,
+		const SCSI_CommandPtr	scsiCommand
+	);
 void						DoShowSCSICommand(
 		const SCSI_CommandPtr	cmdBlock,			/* -> SCSI command			*/
 		ConstStr255Param		message
 	);
+/*
+ * These look up the texts that DoShowRequestSense and DoShowSCSICommand
+ * display.
+ */
+StringPtr					GetSenseKeyText(
+		unsigned short			senseKey
+	);
+Boolean						GetSenseCodeText(
+		StringPtr				result,
+		unsigned short			senseCode,
+		unsigned short			senseQualifier
+	);
+StringPtr					GetCommandName(
+		unsigned short			opcode
+	);
 /*
  * The inquiry data is stored in SCB.bufferPtr
  */
@@ -298,29 +497,39 @@ unsigned short				SCSIGetCommandLength(
  *	noErr			normal
  *	unimpErr		AsyncSCSI called, but SCSI Manager 4.3 not installed.
  *	scCommErr		Could not select this device or bus busy (Original only)
- *	statusErr		Device returned "Check condition"
- *	controlErr		Device returned "Busy" (Note: device error)
+ *	statusErr		Device returned "Check condition" (Sense data is valid)
+ *	scsiNonZeroStatus Device returned "Check condition," Request Sense failed
+ *	controlErr		Device returned "Busy" (Note: device error), or
+ *					"Queue Full" (Async only)
  *	ioErr			Other (serious) device status -- bug.
  *	sc...			Other (Inside Mac IV) SCSI Manager error
  *	scsi...			Other (SCSI Manager 4.3) error.
  */
 OSErr						OriginalSCSI(
-		unsigned short			targetID,			/* Device ID on this bus	*/
+		DeviceIdent				scsiDevice,			/* -> target/LUN (no bus)	*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
 		Boolean					writeToDevice,		/* TRUE to write			*/
 		Ptr						bufferPtr,			/* -> user data buffer		*/
 		unsigned long			transferSize,		/* How much to transfer		*/
 		unsigned long			transferQuantum,	/* TIB setup parameter		*/
+		SCSI_Sense_Data			*senseDataPtr,		/* Request Sense results	*/
+		unsigned long			senseDataSize,		/* Request Sense data size	*/
 		unsigned long			completionTimeout,	/* Ticks to wait			*/
 		unsigned short			*stsBytePtr,		/* <- status phase byte		*/
 		unsigned long			*actualTransferCount
 	);
+/*
+ * OriginalSCSI remembers, per target, whether blind transfers are safe. Call
+ * this to forget this information (for example, before scanning the bus).
+ */
+void						OriginalSCSIForgetTransferModes(void);
 /*
  * AsyncSCSI returns unimpErr if the _SCSIAtomic (SCSI Manager 4.3)
  * trap is not present. If so, just call the "old" OriginalSCSI.
  */
 OSErr						AsyncSCSI(
+		SCSIEnvironmentPtr		environmentPtr,		/* -> Caller's context		*/
 		DeviceIdent				scsiDevice,			/* -> Bus/target/LUN		*/
 		const SCSI_CommandPtr	scsiCommand,		/* The actual scsi command	*/
 		unsigned short			cmdBlockLength,		/* -> Length of CDB			*/
@@ -459,20 +668,60 @@ EXTERN Boolean					gQuitNow;
 EXTERN Boolean					gUpdateMenusNeeded;
 EXTERN Boolean					gInForeground;
 /*
- * These flags are set/cleared by menu options to control the asynchronous SCSI
- * Manager -- they are not used if the asynchronous manager is not present.
+ * The event loop drains gSCSIEnvironment's completion queue, at most
+ * kEventCompletionBudget entries per event. If gAdaptiveEventSleep is set,
+ * the WaitNextEvent sleep adapts to the completions (see EventSleepTicks),
+ * otherwise it is fixed.
+ */
+#define kEventCompletionBudget	8
+struct EventLoopStatistics {
+	unsigned long		events;					/* WaitNextEvent calls			*/
+	unsigned long		yieldedTicks;			/* Time in WaitNextEvent		*/
+	unsigned long		completions;			/* Drained by the event loop	*/
+};
+typedef struct EventLoopStatistics EventLoopStatistics;
+EXTERN Boolean					gAdaptiveEventSleep;
+EXTERN EventLoopStatistics		gEventLoopStatistics;
+/*
+ * gSCSIEnvironment holds the state of the SCSI command core (see
+ * SCSIEnvironment.h). These settings in it are set/cleared by menu options to
+ * control the asynchronous SCSI Manager -- they are not used if the
+ * asynchronous manager is not present.
+ *	policy.enableSelectWithATN	FALSE to supress Select With ATN.
+ *	policy.doDisconnect			Set the scsibDoDisconnect flag
+ *	policy.dontDisconnect		Set the scsibDontDisconnect flag.
+ *								Note: both "do" and "don't" may be set.
+ * The disconnect flags apply to every device that does not have its own
+ * override: they replace the adaptive policy (see DevicePolicy.h) and are
+ * intended for testing.
  *	gEnableNewSCSIManager		FALSE to always use the original manager,
  *								even if the new manager is present.
- *	gEnableSelectWithATN		FALSE to supress Select With ATN.
- *	gDoDisconnect				Set the scsibDoDisconnect flag
- *	gDontDisconnect				Set the scsibDontDisconnect flag.
- *								Note: both "do" and "don't" may be set.
  */
+EXTERN SCSIEnvironment			gSCSIEnvironment;
+/*
+ * While gCommandTrace is active, DoSCSICommandWithSense records every command
+ * in its trace file (see CommandTrace.h).
+ */
+EXTERN CommandTrace				gCommandTrace;
+/*
+ * While gStatsExport is active, DoSCSICommandWithSense counts every command,
+ * and the event loop exports the counters (see StatsExport.h).
+ */
+EXTERN StatsExport				gStatsExport;
+/*
+ * While gHealthMonitor is active, the event loop polls the devices that it
+ * watches (see HealthMonitor.h).
+ */
+EXTERN HealthMonitor			gHealthMonitor;
+/*
+ * While gPresenceWatcher is active, the event loop probes the empty target
+ * IDs, and its events update gDeviceList (see PresenceWatcher.h).
+ */
+EXTERN PresenceWatcher			gPresenceWatcher;
 EXTERN Boolean					gEnableNewSCSIManager;
-EXTERN Boolean					gEnableSelectWithATN;
-EXTERN Boolean					gDoDisconnect;
-EXTERN Boolean					gDontDisconnect;
 EXTERN Boolean					gVerboseDisplay;
+EXTERN Boolean					gThrottleScan;
+EXTERN Boolean					gScanInProgress;	/* List SCSI Devices is running	*/
 EXTERN MenuHandle				gAppleMenu;
 EXTERN MenuHandle				gFileMenu;
 EXTERN MenuHandle				gEditMenu;
@@ -482,6 +731,11 @@ EXTERN MenuHandle				gCurrentTargetMenu;
 EXTERN MenuHandle				gCurrentLUNMenu;
 EXTERN DeviceIdent				gCurrentDevice;
 EXTERN unsigned short			gMaxLogicalUnit;
+/*
+ * gDeviceList holds the devices found by the last List SCSI Devices that can
+ * be reached through the asynchronous SCSI Manager, as updated by the
+ * presence watcher. The sweep commands run on these devices.
+ */
 EXTERN DeviceIdent				*gDeviceList;
 EXTERN unsigned short			gMaxDevice;		/* Number of items in gDeviceList	*/
 
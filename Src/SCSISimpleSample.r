@@ -123,15 +123,43 @@ resource 'MENU' (MENU_Test, "Test Commands") {
 	{
 		"Enable Asynchronous SCSI Manager",	noIcon, noKey, noMark, plain,
 		"Enable All Logical Units",			noIcon, noKey, noMark, plain,
+		"Throttle Bus Scans",				noIcon, noKey, noMark, plain,
 		"Enable Select with Attention",		noIcon, noKey, noMark, plain,
 		"-",								noIcon, noKey, noMark, plain,
 		"Explicitly Do Disconnect",			noIcon, noKey, noMark, plain,
 		"Explicitly Do Not Disconnect",		noIcon, noKey, noMark, plain,
+		"Device Disconnect Policy",			noIcon, noKey, noMark, plain,
+		"Device Select with ATN Policy",	noIcon, noKey, noMark, plain,
+		"Install Virtual SCSI Bus",			noIcon, noKey, noMark, plain,
+		"Attach Disk Image",				noIcon, noKey, noMark, plain,
+		"Capture Command Trace",			noIcon, noKey, noMark, plain,
+		"Replay Command Trace",			noIcon, noKey, noMark, plain,
+		"Show Trace Index",				noIcon, noKey, noMark, plain,
+		"Analyze Command Trace",			noIcon, noKey, noMark, plain,
+		"Export Statistics",				noIcon, noKey, noMark, plain,
+		"Health Monitor",					noIcon, noKey, noMark, plain,
+		"Presence Watcher",					noIcon, noKey, noMark, plain,
 		"-",								noIcon, noKey, noMark, plain,
 		"List All SCSI Devices",			noIcon, noKey, noMark, plain,
 		"Device Inquiry",					noIcon, noKey, noMark, plain,
 		"Test Unit Ready",					noIcon, noKey, noMark, plain,
 		"Read Block Zero",					noIcon, noKey, noMark, plain,
+		"Device Summary",					noIcon, noKey, noMark, plain,
+		"Sweep: Test Unit Ready",			noIcon, noKey, noMark, plain,
+		"Sweep: Inquiry",					noIcon, noKey, noMark, plain,
+		"Sweep: Read Block Zero",			noIcon, noKey, noMark, plain,
+		"I/O Scheduler Benchmark",			noIcon, noKey, noMark, plain,
+		"Bus Share Benchmark",				noIcon, noKey, noMark, plain,
+		"Scan Impact Benchmark",			noIcon, noKey, noMark, plain,
+		"Disconnect Policy Benchmark",		noIcon, noKey, noMark, plain,
+		"Device Flow Benchmark",			noIcon, noKey, noMark, plain,
+		"Event Loop Completion Test",		noIcon, noKey, noMark, plain,
+		"Removable Media Benchmark",		noIcon, noKey, noMark, plain,
+		"Fault Injection Benchmark",		noIcon, noKey, noMark, plain,
+		"Thread Stress Test",				noIcon, noKey, noMark, plain,
+		"Bus Timing Simulator",				noIcon, noKey, noMark, plain,
+		"Blind Transfer Simulator",			noIcon, noKey, noMark, plain,
+		"Watchdog Recovery Test",			noIcon, noKey, noMark, plain,
 		"-",								noIcon, noKey, noMark, plain,
 		"Verbose Display",					noIcon, noKey, noMark, plain,
 	}
@@ -137,7 +137,6 @@ DoShowRequestSense(
 		const SCSI_Sense_Data	*sensePtr
 	)
 {
-		register int				i;
 		Str255						work;
 		Str255						senseMessage;
 #define SENSE		(*sensePtr)
@@ -166,8 +165,7 @@ DoShowRequestSense(
 				LOG(work);
 			}
 			else {
-				AppendPascalString(
-					work, gSenseKeyText[SENSE.senseKey & kScsiSenseKeyMask]);
+				AppendPascalString(work, GetSenseKeyText(SENSE.senseKey));
 				if ((SENSE.senseKey & kScsiSenseILI) != 0)
 					AppendPascalString(work, "\p, Illegal Logical Length");
 				if ((SENSE.senseKey & kScsiSenseEOM) != 0)
@@ -180,29 +178,11 @@ DoShowRequestSense(
 				AppendHexLeadingZeros(work, SENSE.additionalSenseCode, 2);
 				AppendPascalString(work, "\p, ASQ: ");
 				AppendHexLeadingZeros(work, SENSE.additionalSenseQualifier, 2);
-				for (i = 1;; ++i) {
-					GetIndString(
-						senseMessage, SENSE.additionalSenseCode + STRS_SenseBase, i);
-					if (senseMessage[0] == 0) {
-						/*
-						 * We don't know the sense qualifier, use the default
-						 * additional sense code message, if any.
-						 */
-						GetIndString(
-							senseMessage,
-							SENSE.additionalSenseCode + STRS_SenseBase,
-							1
-						);
-						if (senseMessage[0] != 0)
-							goto displaySense;
-						break;
-					}
-					if (senseMessage[1] == SENSE.additionalSenseQualifier) {
-displaySense:			senseMessage[1] = senseMessage[0] - 1;
-						AppendPascalString(work, "\p, ");
-						AppendPascalString(work, (StringPtr) &senseMessage[1]);
-						break;
-					}
+				if (GetSenseCodeText(senseMessage,
+						SENSE.additionalSenseCode,
+						SENSE.additionalSenseQualifier)) {
+					AppendPascalString(work, "\p, ");
+					AppendPascalString(work, senseMessage);
 				}
 				LOG(work);
 			}
@@ -210,6 +190,68 @@ displaySense:			senseMessage[1] = senseMessage[0] - 1;
 #undef SENSE
 }
 
+/*
+ * Return the name of a sense key.
+ */
+StringPtr
+GetSenseKeyText(
+		unsigned short			senseKey
+	)
+{
+		return (gSenseKeyText[senseKey & kScsiSenseKeyMask]);
+}
+
+/*
+ * Get the message for an additional sense code and qualifier from the sense
+ * code STR# resources: each string starts with the qualifier that it
+ * describes. If we don't know the sense qualifier, use the default additional
+ * sense code message (the first string), if any. Returns FALSE if there is
+ * no message.
+ */
+Boolean
+GetSenseCodeText(
+		StringPtr				result,
+		unsigned short			senseCode,
+		unsigned short			senseQualifier
+	)
+{
+		register int			i;
+		Str255					senseMessage;
+
+		result[0] = 0;
+		for (i = 1;; ++i) {
+			GetIndString(senseMessage, senseCode + STRS_SenseBase, i);
+			if (senseMessage[0] == 0) {
+				GetIndString(senseMessage, senseCode + STRS_SenseBase, 1);
+				if (senseMessage[0] == 0)
+					return (FALSE);
+				break;
+			}
+			if (senseMessage[1] == senseQualifier)
+				break;
+		}
+		result[0] = senseMessage[0] - 1;
+		BlockMove(&senseMessage[2], &result[1], result[0]);
+		return (TRUE);
+}
+
+/*
+ * Return the name of a command, or NULL if we don't know it.
+ */
+StringPtr
+GetCommandName(
+		unsigned short			opcode
+	)
+{
+		register CmdInfoPtr		cmdInfoPtr;
+
+		for (cmdInfoPtr = gCmdInfo; cmdInfoPtr->text != NULL; cmdInfoPtr++) {
+			if (cmdInfoPtr->cmdByte == opcode)
+				return (cmdInfoPtr->text);
+		}
+		return (NULL);
+}
+
 /*
  * This formats and displays the SCSI Manager OSErr code (with out extensions)
  */
@@ -255,6 +297,40 @@ ShowStatusError(
 		}
 }
 
+/*
+ * This displays a status byte other than Good or Check Condition, which the
+ * asynchronous SCSI Manager reports as scsiNonZeroStatus.
+ */
+void
+ShowStatusByteError(
+		DeviceIdent				scsiDevice,
+		unsigned short			statusByte,
+		const SCSI_CommandPtr	scsiCommand
+	)
+{
+		Str255					work;
+
+		pstrcpy(work, "\pDevice: ");
+		AppendDeviceID(work, scsiDevice);
+		AppendPascalString(work, "\p, status 0x");
+		AppendHexLeadingZeros(work, statusByte, 2);
+		switch (statusByte) {
+		case kScsiStatusBusy:
+			AppendPascalString(work, "\p, Busy");
+			break;
+		case kScsiStatusResConflict:
+			AppendPascalString(work, "\p, Reservation Conflict");
+			break;
+		case kScsiStatusQueueFull:
+			AppendPascalString(work, "\p, Queue Full");
+			break;
+		default:
+			break;
+		}
+		LOG(work);
+		DoShowSCSICommand(scsiCommand, NULL);
+}
+
 void
 DoShowInquiry(
 		DeviceIdent				scsiDevice,				/* -> Bus/target/LUN	*/
@@ -325,8 +401,8 @@ DoShowSCSICommand(
 		ConstStr255Param		message
 	)
 {
-		register CmdInfoPtr		cmdInfoPtr;
 		register unsigned short	i;
+		StringPtr				commandName;
 		unsigned short			cmdBlockLength;		/* -> Length of CDB			*/
 		Str255					work;
 		
@@ -336,13 +412,11 @@ DoShowSCSICommand(
 			AppendPascalString(work, "\p, ");
 		}
 		pstrcpy(work, "\pCommand ");
-		for (cmdInfoPtr = gCmdInfo; cmdInfoPtr->text != NULL; cmdInfoPtr++) {
-			if (cmdInfoPtr->cmdByte == scsiCommand->scsi[0]) {
-				AppendPascalString(work, "\p (");
-				AppendPascalString(work, cmdInfoPtr->text);
-				AppendPascalString(work, "\p)");
-				break;
-			}
+		commandName = GetCommandName(scsiCommand->scsi[0]);
+		if (commandName != NULL) {
+			AppendPascalString(work, "\p (");
+			AppendPascalString(work, commandName);
+			AppendPascalString(work, "\p)");
 		}
 		AppendPascalString(work, "\p =");
 		cmdBlockLength = SCSIGetCommandLength((Ptr) scsiCommand);
@@ -35,6 +35,7 @@ void								AdjustEditMenu(
 		Boolean							isDeskAccessory
 	);
 void								SetupMenus(void);
+unsigned long						EventSleepTicks(void);
 void								BuildWindow(void);
 void								DecorateDisplay(
 		WindowPtr						theWindow,
@@ -61,10 +62,16 @@ Boolean								HexToNum(
  * between "old" and "new" SCSI Managers.
  */
 static unsigned short				gOldHostBusID;
+/*
+ * The adaptive WaitNextEvent sleep: 0 after an event that handled completions,
+ * then doubled on each idle event, up to the fixed sleep.
+ */
+static unsigned long				gEventSleep;
 
 void
 main(void)
 {
+		SCSIEnvironmentInit(&gSCSIEnvironment);
 		SetupEverything();
 		BuildWindow();
 		gUpdateMenusNeeded = TRUE;
@@ -75,11 +82,24 @@ main(void)
 		else {
 			LOG("\pAsynchronous SCSI Manager not present");
 		}
-		gEnableSelectWithATN = gEnableNewSCSIManager;
+		gSCSIEnvironment.policy.enableSelectWithATN = gEnableNewSCSIManager;
+		gAdaptiveEventSleep = TRUE;
+		CompletionQueueSetWakeProcess(&gSCSIEnvironment.completions, TRUE);
+		(void) DevicePolicyLoad(&gSCSIEnvironment.policy);
 		InitCursor();
 		while (gQuitNow == FALSE) {
 			EventLoop();
 		}
+		/*
+		 * The virtual bus code is in our application heap: it must be
+		 * removed before we quit (and disk images written back first).
+		 */
+		(void) CommandTraceStop(&gCommandTrace);
+		(void) StatsExportStop(&gStatsExport);
+		PresenceWatcherStop(&gPresenceWatcher);
+		HealthMonitorStop(&gHealthMonitor);
+		VirtualImageDetachAll();
+		VirtualSIMRemove();
 		ExitToShell();
 }
 
@@ -140,27 +160,72 @@ EventLoop(void)
 		register WindowPtr				theWindow;
 		GrafPtr							savePort;
 		Boolean							isActivating;
+		unsigned long					startTicks;
+		unsigned short					handled;
+		OSErr							status;
 		
 		if (gUpdateMenusNeeded) {
 			gUpdateMenusNeeded = FALSE;
 			AdjustMenus();
 		}
+		startTicks = TickCount();
 		WaitNextEvent(
 			everyEvent,
 			&EVENT,
-			(gInForeground) ? 10L : 60L,
+			EventSleepTicks(),
 			NULL
 		);
+		++gEventLoopStatistics.events;
+		gEventLoopStatistics.yieldedTicks += TickCount() - startTicks;
+		/*
+		 * Finish the SCSI commands that have completed (a few at a time, so
+		 * that the user's events are not held up). If any were handled, the
+		 * next WaitNextEvent doesn't sleep: more may follow.
+		 */
+		handled = CompletionQueueDrain(
+					&gSCSIEnvironment.completions, kEventCompletionBudget);
+		gEventLoopStatistics.completions += handled;
+		if (handled != 0)
+			gEventSleep = 0;
+		else if (gEventSleep < 60L) {
+			gEventSleep = (gEventSleep == 0) ? 1 : gEventSleep * 2;
+		}
 		theWindow = FrontWindow();
 		switch (EVENT.what) {
 		case nullEvent:
+			(void) ContinueListSCSIDevices();
+			ContinueCompletionTest();
+			status = StatsExportIdle(&gStatsExport);
+			if (status != noErr) {
+				DisplaySCSIErrorMessage(
+					status, "\pCan't export the statistics: export stopped");
+				gUpdateMenusNeeded = TRUE;
+			}
+			status = HealthMonitorIdle(&gHealthMonitor);
+			if (status != noErr) {
+				DisplaySCSIErrorMessage(
+					status, "\pCan't poll the devices: health monitor stopped");
+				gUpdateMenusNeeded = TRUE;
+			}
+			if (gScanInProgress == FALSE) {
+				status = PresenceWatcherIdle(&gPresenceWatcher);
+				if (status != noErr) {
+					DisplaySCSIErrorMessage(status,
+						"\pCan't probe empty IDs: presence watcher stopped");
+					gUpdateMenusNeeded = TRUE;
+				}
+			}
 			break;
 		case keyDown:
 		case autoKey:
 			if ((EVENT.message & charCodeMask) == '.'
 			 && (EVENT.modifiers & cmdKey) != 0) {
 				FlushEvents(keyDown | autoKey, 0);
-				gQuitNow = TRUE;
+				if (gScanInProgress)
+					CancelListSCSIDevices();
+				else {
+					gQuitNow = TRUE;
+				}
 			}
 			else if ((EVENT.modifiers & cmdKey) != 0) {
 				if (EVENT.what == keyDown) {
@@ -225,6 +290,30 @@ activateEvent:		if (isActivating) {
 		}
 }
 
+/*
+ * Return the WaitNextEvent sleep time. The fixed sleep is 10 ticks in the
+ * foreground and 60 in the background. With the adaptive sleep, we don't
+ * sleep while completions are waiting, and sleep longer (up to the fixed
+ * sleep) the longer we are idle: a completion wakes us in any case (see
+ * CompletionQueueSetWakeProcess).
+ */
+unsigned long
+EventSleepTicks(void)
+{
+		unsigned long					maxSleep;
+
+		if (gScanInProgress)
+			return (0);
+		maxSleep = (gInForeground) ? 10L : 60L;
+		if (gAdaptiveEventSleep == FALSE)
+			return (maxSleep);
+		if (CompletionQueuePending(&gSCSIEnvironment.completions))
+			return (0);
+		if (gEventSleep > maxSleep)
+			gEventSleep = maxSleep;
+		return (gEventSleep);
+}
+
 /*
  * DoMouseEvent
  * The user clicked on something. Handle application-wide processing here, or call
@@ -434,18 +523,31 @@ DoCommand(
 					gCurrentDevice.LUN = gMaxLogicalUnit;
 				gUpdateMenusNeeded = TRUE;
 				break;
+			case kTestThrottleScan:
+				gThrottleScan = (!gThrottleScan);
+				gUpdateMenusNeeded = TRUE;
+				break;
 			case kTestEnableSelectWithATN:
-				gEnableSelectWithATN = !gEnableSelectWithATN;
+				gSCSIEnvironment.policy.enableSelectWithATN =
+					!gSCSIEnvironment.policy.enableSelectWithATN;
 				gUpdateMenusNeeded = TRUE;
 				break;
 			case kTestDoDisconnect:
-				gDoDisconnect = !gDoDisconnect;
+				gSCSIEnvironment.policy.doDisconnect =
+					!gSCSIEnvironment.policy.doDisconnect;
 				gUpdateMenusNeeded = TRUE;
 				break;
 			case kTestDontDisconnect:
-				gDontDisconnect = !gDontDisconnect;
+				gSCSIEnvironment.policy.dontDisconnect =
+					!gSCSIEnvironment.policy.dontDisconnect;
 				gUpdateMenusNeeded = TRUE;
 				break;
+			case kTestDisconnectPolicy:
+				DoDevicePolicy(gCurrentDevice, FALSE);
+				break;
+			case kTestSelectWithATNPolicy:
+				DoDevicePolicy(gCurrentDevice, TRUE);
+				break;
 			case kTestVerboseDisplay:
 				gVerboseDisplay = (!gVerboseDisplay);
 				gUpdateMenusNeeded = TRUE;
@@ -465,6 +567,81 @@ DoCommand(
 			case kTestReadBlockZero:
 				DoReadBlockZero(gCurrentDevice);
 				break;
+			case kTestDeviceSummary:
+				DoDeviceSummary(gCurrentDevice);
+				break;
+			case kTestSweepUnitReady:
+				DoDeviceSweep(kSweepTestUnitReady);
+				break;
+			case kTestSweepInquiry:
+				DoDeviceSweep(kSweepInquiry);
+				break;
+			case kTestSweepReadBlockZero:
+				DoDeviceSweep(kSweepReadBlockZero);
+				break;
+			case kTestSchedulerBenchmark:
+				DoSchedulerBenchmark(gCurrentDevice);
+				break;
+			case kTestBusShareBenchmark:
+				DoBusShareBenchmark();
+				break;
+			case kTestScanImpactBenchmark:
+				DoScanImpactBenchmark();
+				break;
+			case kTestDisconnectBenchmark:
+				DoDisconnectBenchmark();
+				break;
+			case kTestFlowBenchmark:
+				DoFlowBenchmark();
+				break;
+			case kTestCompletionTest:
+				DoCompletionTest();
+				break;
+			case kTestMediaBenchmark:
+				DoMediaBenchmark();
+				break;
+			case kTestFaultBenchmark:
+				DoFaultBenchmark();
+				break;
+			case kTestThreadStressTest:
+				DoThreadStressTest();
+				break;
+			case kTestBusSimulator:
+				DoBusSimBenchmark();
+				break;
+			case kTestTransferModeBenchmark:
+				DoTransferModeBenchmark();
+				break;
+			case kTestWatchdogRecovery:
+				DoWatchdogTest(gCurrentDevice);
+				break;
+			case kTestVirtualBus:
+				DoVirtualBus();
+				break;
+			case kTestDiskImage:
+				DoDiskImage();
+				break;
+			case kTestCaptureTrace:
+				DoTraceCapture();
+				break;
+			case kTestReplayTrace:
+				DoTraceReplay();
+				break;
+			case kTestTraceIndex:
+				DoTraceIndex();
+				break;
+			case kTestTraceAnalysis:
+				DoTraceAnalysis();
+				break;
+			case kTestExportStatistics:
+				DoStatsExport();
+				break;
+			case kTestHealthMonitor:
+				DoHealthMonitor();
+				break;
+			case kTestPresenceWatcher:
+				DoPresenceWatcher();
+				break;
 			default:
 				break;
 			}
@@ -532,6 +709,7 @@ AdjustMenus(void)
 		short					i;
 		short					nItems;
 		unsigned short			maxTarget;
+		unsigned short			virtualBusID;
 		unsigned short			lastHostBus;
 		OSErr					status;
 		
@@ -543,8 +721,21 @@ AdjustMenus(void)
 			EnableItem(gTestMenu, kTestListSCSIDevices);
 			EnableItem(gTestMenu, kTestGetDriveInfo);
 			EnableItem(gTestMenu, kTestUnitReady);
+			EnableItem(gTestMenu, kTestDeviceSummary);
+			EnableItem(gTestMenu, kTestSchedulerBenchmark);
+			EnableItem(gTestMenu, kTestBusSimulator);
+			EnableItem(gTestMenu, kTestTransferModeBenchmark);
+			EnableItem(gTestMenu, kTestCaptureTrace);
+			CheckItem(gTestMenu, kTestCaptureTrace, gCommandTrace.active);
+			EnableItem(gTestMenu, kTestReplayTrace);
+			EnableItem(gTestMenu, kTestTraceIndex);
+			EnableItem(gTestMenu, kTestTraceAnalysis);
+			EnableItem(gTestMenu, kTestExportStatistics);
+			CheckItem(gTestMenu, kTestExportStatistics, gStatsExport.active);
 			EnableItem(gTestMenu, kTestVerboseDisplay);
 			CheckItem(gTestMenu, kTestVerboseDisplay, gVerboseDisplay);	
+			EnableItem(gTestMenu, kTestThrottleScan);
+			CheckItem(gTestMenu, kTestThrottleScan, gThrottleScan);
 			EnableItem(gTestMenu, kTestEnableAllLogicalUnits);
 			CheckItem(gTestMenu, kTestEnableAllLogicalUnits, (gMaxLogicalUnit == 7));
 			if (AsyncSCSIPresent()) {
@@ -558,17 +749,88 @@ AdjustMenus(void)
 				EnableItem(gTestMenu, kTestEnableSelectWithATN);
 				EnableItem(gTestMenu, kTestDoDisconnect);
 				EnableItem(gTestMenu, kTestDontDisconnect);
+				EnableItem(gTestMenu, kTestDisconnectPolicy);
+				EnableItem(gTestMenu, kTestSelectWithATNPolicy);
+				EnableItem(gTestMenu, kTestWatchdogRecovery);
+				EnableItem(gTestMenu, kTestVirtualBus);
+				EnableItem(gTestMenu, kTestSweepUnitReady);
+				EnableItem(gTestMenu, kTestSweepInquiry);
+				EnableItem(gTestMenu, kTestSweepReadBlockZero);
+				EnableItem(gTestMenu, kTestHealthMonitor);
+				EnableItem(gTestMenu, kTestPresenceWatcher);
+				if (VirtualSIMBusID(&virtualBusID)) {
+					EnableItem(gTestMenu, kTestBusShareBenchmark);
+					EnableItem(gTestMenu, kTestScanImpactBenchmark);
+					EnableItem(gTestMenu, kTestDisconnectBenchmark);
+					EnableItem(gTestMenu, kTestFlowBenchmark);
+					EnableItem(gTestMenu, kTestCompletionTest);
+					EnableItem(gTestMenu, kTestMediaBenchmark);
+					EnableItem(gTestMenu, kTestFaultBenchmark);
+					EnableItem(gTestMenu, kTestThreadStressTest);
+					EnableItem(gTestMenu, kTestDiskImage);
+				}
+				else {
+					DisableItem(gTestMenu, kTestBusShareBenchmark);
+					DisableItem(gTestMenu, kTestScanImpactBenchmark);
+					DisableItem(gTestMenu, kTestDisconnectBenchmark);
+					DisableItem(gTestMenu, kTestFlowBenchmark);
+					DisableItem(gTestMenu, kTestCompletionTest);
+					DisableItem(gTestMenu, kTestMediaBenchmark);
+					DisableItem(gTestMenu, kTestFaultBenchmark);
+					DisableItem(gTestMenu, kTestThreadStressTest);
+					DisableItem(gTestMenu, kTestDiskImage);
+				}
 			}
 			else {
 				DisableItem(gCurrentBusMenu, 0);
 				DisableItem(gTestMenu, kTestEnableSelectWithATN);
 				DisableItem(gTestMenu, kTestDoDisconnect);
 				DisableItem(gTestMenu, kTestDontDisconnect);
+				DisableItem(gTestMenu, kTestDisconnectPolicy);
+				DisableItem(gTestMenu, kTestSelectWithATNPolicy);
+				DisableItem(gTestMenu, kTestWatchdogRecovery);
+				DisableItem(gTestMenu, kTestVirtualBus);
+				DisableItem(gTestMenu, kTestSweepUnitReady);
+				DisableItem(gTestMenu, kTestSweepInquiry);
+				DisableItem(gTestMenu, kTestSweepReadBlockZero);
+				DisableItem(gTestMenu, kTestBusShareBenchmark);
+				DisableItem(gTestMenu, kTestScanImpactBenchmark);
+				DisableItem(gTestMenu, kTestDisconnectBenchmark);
+				DisableItem(gTestMenu, kTestFlowBenchmark);
+				DisableItem(gTestMenu, kTestCompletionTest);
+				DisableItem(gTestMenu, kTestMediaBenchmark);
+				DisableItem(gTestMenu, kTestFaultBenchmark);
+				DisableItem(gTestMenu, kTestThreadStressTest);
+				DisableItem(gTestMenu, kTestDiskImage);
+				if (gHealthMonitor.active) {
+					EnableItem(gTestMenu, kTestHealthMonitor);
+				}
+				else {
+					DisableItem(gTestMenu, kTestHealthMonitor);
+				}
+				if (gPresenceWatcher.active) {
+					EnableItem(gTestMenu, kTestPresenceWatcher);
+				}
+				else {
+					DisableItem(gTestMenu, kTestPresenceWatcher);
+				}
 			}
+			CheckItem(gTestMenu, kTestHealthMonitor, gHealthMonitor.active);
+			CheckItem(gTestMenu, kTestPresenceWatcher, gPresenceWatcher.active);
 			CheckItem(gTestMenu, kTestEnableNewManager, gEnableNewSCSIManager);
-			CheckItem(gTestMenu, kTestEnableSelectWithATN, gEnableSelectWithATN);
-			CheckItem(gTestMenu, kTestDoDisconnect, gDoDisconnect);
-			CheckItem(gTestMenu, kTestDontDisconnect, gDontDisconnect);
+			CheckItem(gTestMenu, kTestEnableSelectWithATN,
+				gSCSIEnvironment.policy.enableSelectWithATN);
+			CheckItem(gTestMenu, kTestDoDisconnect,
+				gSCSIEnvironment.policy.doDisconnect);
+			CheckItem(gTestMenu, kTestDontDisconnect,
+				gSCSIEnvironment.policy.dontDisconnect);
+			CheckItem(gTestMenu, kTestVirtualBus,
+				VirtualSIMBusID(&virtualBusID));
+			for (i = 0;
+					i < kVirtualMaxTarget && VirtualImageAttached(i) == FALSE;
+					i++)
+				;
+			CheckItem(gTestMenu, kTestDiskImage, (i < kVirtualMaxTarget));
 			EnableItem(gTestMenu, kTestEnableAllLogicalUnits);
 			CheckItem(gTestMenu, kTestEnableAllLogicalUnits, (gMaxLogicalUnit == 7));
 			/* */
@@ -0,0 +1,332 @@
+/*									SCSIWatchdog.c								*/
+/*
+ * SCSIWatchdog.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Recover from requests that do not complete. See SCSIWatchdog.h for the
+ * calling sequence. Each watched request moves through these states:
+ *
+ *	kWatchWaiting		Issued, deadline not yet reached.
+ *	kWatchAborted		Past its deadline: SCSIAbortCommand was issued.
+ *	kWatchDeviceReset	Abort did not complete it: SCSIResetDevice was issued.
+ *	kWatchBusReset		Device reset did not complete it: SCSIResetBus was
+ *						issued. There is nothing more we can do: the SIM is
+ *						required to complete all requests after a bus reset.
+ *
+ * Each recovery step is given kWatchdogGraceTicks to take effect before the
+ * next (more drastic) step is tried. A bus reset affects every device on the
+ * bus, which is why it is the last resort.
+ *
+ * The abort and reset requests are issued synchronously: the watchdog is
+ * called from the application's polling loop, never from a completion
+ * routine, so the code and data here need not be held in physical memory.
+ */
+#include <Events.h>
+#include <Errors.h>
+#include "SCSIWatchdog.h"
+#include "CoreMacros.h"
+
+/*
+ * How long (in Ticks) to wait for each recovery step to take effect.
+ */
+#define kWatchdogGraceTicks		(60L * 2L)			/* Two seconds				*/
+/*
+ * Per-opcode limits (in Ticks). Commands that are not listed are limited only
+ * by the caller's completion timeout. The limits are only applied to commands
+ * that are fast on all device types: for example, Read(6) is not limited, as
+ * a tape drive may take minutes to complete it.
+ */
+#define kWatchdogShortTicks		(60L * 5L)			/* Inquiry, etc.			*/
+#define kWatchdogMediumTicks	(60L * 20L)			/* Disk Read(10), Write(10)	*/
+
+enum {
+	kWatchIdle = 0,
+	kWatchWaiting,
+	kWatchAborted,
+	kWatchDeviceReset,
+	kWatchBusReset
+};
+
+static WatchEntry				*FindWatchEntry(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+static OSErr					WatchdogAction(
+		unsigned char			functionCode,
+		DeviceIdent				scsiDevice,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+
+/*
+ * Return the deadline for this command (in Ticks from now).
+ */
+unsigned long
+SCSIWatchdogDeadline(
+		const SCSI_CommandPtr	scsiCommand,
+		unsigned long			completionTimeout
+	)
+{
+		unsigned long			opcodeLimit;
+
+		switch (scsiCommand->scsi[0]) {
+		case kScsiCmdTestUnitReady:
+		case kScsiCmdRequestSense:
+		case kScsiCmdInquiry:
+		case kScsiCmdModeSense6:
+		case kScsiCmdModeSense12:
+		case kScsiCmdReadCapacity:
+		case kScsiCmdPreventAllowRemoval:
+			opcodeLimit = kWatchdogShortTicks;
+			break;
+		case kScsiCmdRead10:
+		case kScsiCmdWrite10:
+			opcodeLimit = kWatchdogMediumTicks;
+			break;
+		default:
+			opcodeLimit = 0;
+			break;
+		}
+		if (opcodeLimit == 0
+		 || (completionTimeout != 0 && completionTimeout < opcodeLimit))
+			opcodeLimit = completionTimeout;
+		return (opcodeLimit);
+}
+
+/*
+ * Start watching a request.
+ */
+Boolean
+SCSIWatchdogStart(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		register WatchEntry		*entryPtr;
+		unsigned long			deadline;
+
+		entryPtr = FindWatchEntry(watchdogPtr, NULL);
+		if (entryPtr != NULL) {
+			deadline = SCSIWatchdogDeadline(
+						(SCSI_CommandPtr) execIOPBPtr->scsiCDB.cdbBytes,
+						(unsigned long) execIOPBPtr->scsiTimeout
+					);
+			if (watchdogPtr->simulateHang)
+				deadline = 0;
+			else if (deadline == 0) {
+				/*
+				 * No timeout: the request is not watched.
+				 */
+				return (FALSE);
+			}
+			entryPtr->execIOPBPtr = execIOPBPtr;
+			entryPtr->deadlineTicks = TickCount() + deadline;
+			entryPtr->nextStepTicks = entryPtr->deadlineTicks;
+			entryPtr->state = kWatchWaiting;
+		}
+		return (entryPtr != NULL);
+}
+
+/*
+ * Called while the request is in progress. If it is late, take the next
+ * recovery step.
+ */
+void
+SCSIWatchdogPoll(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		register WatchEntry		*entryPtr;
+		OSErr					status;
+
+		entryPtr = FindWatchEntry(watchdogPtr, execIOPBPtr);
+		if (entryPtr == NULL
+		 || execIOPBPtr->scsiResult != scsiRequestInProgress
+		 || TickCount() < entryPtr->nextStepTicks)
+			return;
+		switch (entryPtr->state) {
+		case kWatchWaiting:
+			/*
+			 * The request is late. Ask the SIM to abort it. If the SIM can't
+			 * abort it, go on to the next step without waiting.
+			 */
+			++watchdogPtr->statistics.lateRequests;
+			++watchdogPtr->statistics.abortCommands;
+			status = WatchdogAction(
+						SCSIAbortCommand,
+						execIOPBPtr->scsiDevice,
+						execIOPBPtr
+					);
+			entryPtr->state = kWatchAborted;
+			break;
+		case kWatchAborted:
+			/*
+			 * The abort didn't work. Reset the device: this affects only
+			 * requests to this target.
+			 */
+			++watchdogPtr->statistics.deviceResets;
+			status = WatchdogAction(
+						SCSIResetDevice,
+						execIOPBPtr->scsiDevice,
+						NULL
+					);
+			entryPtr->state = kWatchDeviceReset;
+			break;
+		case kWatchDeviceReset:
+			/*
+			 * Last resort: reset the bus. This affects all devices on the bus.
+			 */
+			++watchdogPtr->statistics.busResets;
+			status = WatchdogAction(
+						SCSIResetBus,
+						execIOPBPtr->scsiDevice,
+						NULL
+					);
+			entryPtr->state = kWatchBusReset;
+			break;
+		default:
+			/*
+			 * Nothing more to do: wait for the SIM to complete the request.
+			 */
+			status = noErr;
+			break;
+		}
+		entryPtr->nextStepTicks = TickCount();
+		if (status == noErr)
+			entryPtr->nextStepTicks += kWatchdogGraceTicks;
+}
+
+/*
+ * Poll all watched requests.
+ */
+void
+SCSIWatchdogIdle(
+		SCSIWatchdogPtr			watchdogPtr
+	)
+{
+		register short			i;
+
+		for (i = 0; i < kMaxWatchedRequests; i++) {
+			if (watchdogPtr->table[i].execIOPBPtr != NULL)
+				SCSIWatchdogPoll(
+					watchdogPtr, watchdogPtr->table[i].execIOPBPtr);
+		}
+}
+
+/*
+ * Stop watching a request. Release the SIM queue if it was frozen, and
+ * return the final status.
+ */
+OSErr
+SCSIWatchdogFinish(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		OSErr					status
+	)
+{
+		register WatchEntry		*entryPtr;
+		unsigned long			recoveryTicks;
+
+		/*
+		 * The request is complete, so the SIM queue will not change under us.
+		 * If this request froze the queue (the sample normally sets
+		 * scsiSIMQNoFreeze, but an abort or reset may still freeze the queue),
+		 * it must be released, or all further requests to this device will
+		 * stall.
+		 */
+		if ((execIOPBPtr->scsiResultFlags & scsiSIMQFrozen) != 0) {
+			++watchdogPtr->statistics.queueReleases;
+			(void) WatchdogAction(SCSIReleaseQ, execIOPBPtr->scsiDevice, NULL);
+		}
+		entryPtr = FindWatchEntry(watchdogPtr, execIOPBPtr);
+		if (entryPtr != NULL) {
+			if (entryPtr->state != kWatchWaiting) {
+				/*
+				 * The watchdog intervened. Record how long recovery took and
+				 * make sure that the caller sees a timeout, rather than the
+				 * "aborted by host" error that the SIM returns.
+				 */
+				recoveryTicks = TickCount() - entryPtr->deadlineTicks;
+				watchdogPtr->statistics.lastRecoveryTicks = recoveryTicks;
+				if (recoveryTicks > watchdogPtr->statistics.maxRecoveryTicks)
+					watchdogPtr->statistics.maxRecoveryTicks = recoveryTicks;
+				if (status == scsiRequestAborted)
+					status = scsiCommandTimeout;
+			}
+			entryPtr->execIOPBPtr = NULL;
+			entryPtr->state = kWatchIdle;
+		}
+		return (status);
+}
+
+void
+SCSIWatchdogInit(
+		SCSIWatchdogPtr			watchdogPtr
+	)
+{
+		CLEAR(*watchdogPtr);
+}
+
+void
+SCSIWatchdogGetStatistics(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIWatchdogStatistics	*statistics
+	)
+{
+		*statistics = watchdogPtr->statistics;
+}
+
+void
+SCSIWatchdogResetStatistics(
+		SCSIWatchdogPtr			watchdogPtr
+	)
+{
+		CLEAR(watchdogPtr->statistics);
+}
+
+/*
+ * Locate the table entry for this request. If execIOPBPtr is NULL, this
+ * returns a free entry. Returns NULL if there is no such entry.
+ */
+static WatchEntry *
+FindWatchEntry(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		register short			i;
+
+		for (i = 0; i < kMaxWatchedRequests; i++) {
+			if (watchdogPtr->table[i].execIOPBPtr == execIOPBPtr)
+				return (&watchdogPtr->table[i]);
+		}
+		return (NULL);
+}
+
+/*
+ * Issue an abort, reset, or release queue request synchronously. All four
+ * parameter blocks share the SCSIHdr layout: the abort parameter block adds
+ * only the pointer to the request to abort.
+ */
+static OSErr
+WatchdogAction(
+		unsigned char			functionCode,
+		DeviceIdent				scsiDevice,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		OSErr					status;
+		SCSIAbortCommandPB		actionPB;
+
+		CLEAR(actionPB);
+		actionPB.scsiPBLength = (functionCode == SCSIAbortCommand)
+					? sizeof (SCSIAbortCommandPB)
+					: sizeof (SCSIResetDevicePB);
+		actionPB.scsiFunctionCode = functionCode;
+		actionPB.scsiDevice = scsiDevice;
+		actionPB.scsiIOptr = execIOPBPtr;
+		status = SCSIAction((SCSI_PB *) &actionPB);
+		if (status == noErr)
+			status = actionPB.scsiResult;
+		return (status);
+}
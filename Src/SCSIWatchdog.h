@@ -0,0 +1,138 @@
+/*									SCSIWatchdog.h								*/
+/*
+ * SCSIWatchdog.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * The watchdog tracks asynchronous SCSI Manager 4.3 requests that have been
+ * issued, but not yet completed. If a request runs past its deadline, the
+ * watchdog tries, in order, to abort the request, reset the device, and reset
+ * the bus. This lets one hung device be recovered in a few seconds instead of
+ * stalling every request to its bus for the full spin-up timeout. This module
+ * is self-contained (like AsyncSCSI.c) and does not use the application log.
+ * All of its state is in a SCSIWatchdog record (normally, the one in the
+ * caller's SCSIEnvironment), so independent callers do not share a table.
+ */
+#ifndef __SCSIWatchdog__
+#define __SCSIWatchdog__
+#include "MacSCSICommand.h"
+
+/*
+ * This is the number of requests that may be watched at the same time. The
+ * sample only issues one request at a time: the table allows for a driver or
+ * application that keeps several requests in progress.
+ */
+#define kMaxWatchedRequests		8
+
+/*
+ * Recovery statistics. These are cleared by SCSIWatchdogResetStatistics.
+ * Recovery latency is measured from the deadline to the completion of the
+ * late request.
+ */
+struct SCSIWatchdogStatistics {
+	unsigned long		lateRequests;			/* Requests past deadline		*/
+	unsigned long		abortCommands;			/* SCSIAbortCommand issued		*/
+	unsigned long		deviceResets;			/* SCSIResetDevice issued		*/
+	unsigned long		busResets;				/* SCSIResetBus issued			*/
+	unsigned long		queueReleases;			/* SCSIReleaseQ issued			*/
+	unsigned long		lastRecoveryTicks;		/* Latest recovery latency		*/
+	unsigned long		maxRecoveryTicks;		/* Worst recovery latency		*/
+};
+typedef struct SCSIWatchdogStatistics SCSIWatchdogStatistics;
+
+struct WatchEntry {
+	SCSIExecIOPB		*execIOPBPtr;			/* NULL if entry is free		*/
+	unsigned long		deadlineTicks;			/* Start recovery after this	*/
+	unsigned long		nextStepTicks;			/* Try next step after this		*/
+	unsigned short		state;					/* kWatchWaiting, etc.			*/
+};
+typedef struct WatchEntry WatchEntry;
+
+/*
+ * If simulateHang is TRUE, every request is treated as if it had hung: its
+ * deadline expires immediately and recovery starts at once. This is only
+ * useful for testing the recovery sequence.
+ */
+typedef struct SCSIWatchdog SCSIWatchdog, *SCSIWatchdogPtr;
+struct SCSIWatchdog {
+	WatchEntry			table[kMaxWatchedRequests];
+	SCSIWatchdogStatistics	statistics;
+	Boolean				simulateHang;			/* For testing					*/
+};
+
+/*
+ * Usage:
+ *		void						SCSIWatchdogInit(
+ *				SCSIWatchdogPtr			watchdogPtr
+ *			);
+ *	Clear the watchdog table and statistics.
+ *
+ *		Boolean						SCSIWatchdogStart(
+ *				SCSIWatchdogPtr			watchdogPtr,
+ *				SCSIExecIOPB			*execIOPBPtr
+ *			);
+ *	Start watching a request. Call this just before SCSIAction. The deadline
+ *	is computed from the command opcode and the scsiTimeout field. Returns
+ *	FALSE if the watchdog table is full: the request will then be limited
+ *	only by the SIM's scsiTimeout.
+ *
+ *		void						SCSIWatchdogPoll(
+ *				SCSIWatchdogPtr			watchdogPtr,
+ *				SCSIExecIOPB			*execIOPBPtr
+ *			);
+ *	Call this repeatedly while execIOPBPtr->scsiResult is scsiRequestInProgress.
+ *	If the request is late, this performs the next recovery step. It must not
+ *	be called from a completion routine or at interrupt level.
+ *
+ *		void						SCSIWatchdogIdle(
+ *				SCSIWatchdogPtr			watchdogPtr
+ *			);
+ *	Poll every request that is being watched.
+ *
+ *		OSErr						SCSIWatchdogFinish(
+ *				SCSIWatchdogPtr			watchdogPtr,
+ *				SCSIExecIOPB			*execIOPBPtr,
+ *				OSErr					status
+ *			);
+ *	Stop watching a request, release the SIM queue if the request froze it,
+ *	and return the final status. If the watchdog aborted the request, this
+ *	returns scsiCommandTimeout.
+ *
+ *		unsigned long				SCSIWatchdogDeadline(
+ *				const SCSI_CommandPtr	scsiCommand,
+ *				unsigned long			completionTimeout
+ *			);
+ *	Return the deadline (in Ticks) for this command. This is the shorter of
+ *	completionTimeout and the per-opcode limit (if any).
+ */
+void						SCSIWatchdogInit(
+		SCSIWatchdogPtr			watchdogPtr
+	);
+Boolean						SCSIWatchdogStart(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+void						SCSIWatchdogPoll(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+void						SCSIWatchdogIdle(
+		SCSIWatchdogPtr			watchdogPtr
+	);
+OSErr						SCSIWatchdogFinish(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		OSErr					status
+	);
+unsigned long				SCSIWatchdogDeadline(
+		const SCSI_CommandPtr	scsiCommand,
+		unsigned long			completionTimeout
+	);
+void						SCSIWatchdogGetStatistics(
+		SCSIWatchdogPtr			watchdogPtr,
+		SCSIWatchdogStatistics	*statistics
+	);
+void						SCSIWatchdogResetStatistics(
+		SCSIWatchdogPtr			watchdogPtr
+	);
+
+#endif /* __SCSIWatchdog__ */
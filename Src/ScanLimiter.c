@@ -0,0 +1,105 @@
+/*									ScanLimiter.c								*/
+/*
+ * ScanLimiter.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Pace the probes of a bus scan. See ScanLimiter.h for the policy.
+ */
+#include "SCSISimpleSample.h"
+
+/*
+ * One probe's worth of credit. Credit is counted in probes times 60 so that
+ * it can be accumulated one Tick at a time without rounding.
+ */
+#define kProbeCredit			60L
+
+void
+ScanLimiterInit(
+		ScanLimiterPtr			limiterPtr,
+		unsigned short			probesPerSecond,
+		unsigned short			maxConcurrentProbes,
+		BusDispatcherPtr		dispatcherPtr
+	)
+{
+		CLEAR(*limiterPtr);
+		limiterPtr->probesPerSecond = probesPerSecond;
+		limiterPtr->maxConcurrentProbes = maxConcurrentProbes;
+		limiterPtr->dispatcherPtr = dispatcherPtr;
+		limiterPtr->yieldToIO = (dispatcherPtr != NULL);
+		limiterPtr->maxYieldTicks = kScanMaxYieldTicks;
+		limiterPtr->credit = kProbeCredit;			/* The first probe is free	*/
+		limiterPtr->lastTicks = TickCount();
+}
+
+Boolean
+ScanLimiterTryStart(
+		ScanLimiterPtr			limiterPtr
+	)
+{
+		unsigned long			now;
+		unsigned long			maxCredit;
+#define LIMIT (*limiterPtr)
+
+		now = TickCount();
+		if (LIMIT.waitStartTicks == 0)
+			LIMIT.waitStartTicks = now;
+		if (LIMIT.maxConcurrentProbes != 0
+		 && LIMIT.probesInFlight >= LIMIT.maxConcurrentProbes)
+			return (FALSE);
+		if (LIMIT.probesPerSecond != 0) {
+			/*
+			 * Add the credit earned since the last call, up to one second's
+			 * budget (which, as probesPerSecond is at least one, is always
+			 * enough for one probe).
+			 */
+			LIMIT.credit += (now - LIMIT.lastTicks) * LIMIT.probesPerSecond;
+			maxCredit = kProbeCredit * LIMIT.probesPerSecond;
+			if (LIMIT.credit > maxCredit)
+				LIMIT.credit = maxCredit;
+			LIMIT.lastTicks = now;
+			if (LIMIT.credit < kProbeCredit)
+				return (FALSE);
+		}
+		if (LIMIT.yieldToIO
+		 && LIMIT.dispatcherPtr != NULL
+		 && BusDispatcherBusy(LIMIT.dispatcherPtr)) {
+			if (LIMIT.yieldStartTicks == 0)
+				LIMIT.yieldStartTicks = now;
+			if (LIMIT.maxYieldTicks == 0
+			 || now - LIMIT.yieldStartTicks < LIMIT.maxYieldTicks)
+				return (FALSE);
+			++LIMIT.statistics.forcedProbes;
+		}
+		LIMIT.yieldStartTicks = 0;
+		LIMIT.statistics.waitTicks += now - LIMIT.waitStartTicks;
+		LIMIT.waitStartTicks = 0;
+		if (LIMIT.probesPerSecond != 0)
+			LIMIT.credit -= kProbeCredit;
+		++LIMIT.probesInFlight;
+		++LIMIT.statistics.probes;
+		return (TRUE);
+#undef LIMIT
+}
+
+void
+ScanLimiterWait(
+		ScanLimiterPtr			limiterPtr
+	)
+{
+		while (ScanLimiterTryStart(limiterPtr) == FALSE) {
+			if (limiterPtr->dispatcherPtr != NULL)
+				(void) BusDispatcherPoll(limiterPtr->dispatcherPtr);
+			else {
+				SystemTask();
+			}
+		}
+}
+
+void
+ScanLimiterProbeDone(
+		ScanLimiterPtr			limiterPtr
+	)
+{
+		if (limiterPtr->probesInFlight != 0)
+			--limiterPtr->probesInFlight;
+}
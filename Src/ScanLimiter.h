@@ -0,0 +1,99 @@
+/*									ScanLimiter.h								*/
+/*
+ * ScanLimiter.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Limit the cost of a bus scan. A scan probes every target, and probing a
+ * missing target holds the bus until the selection times out (250 msec), so
+ * an unrestrained scan can stall the other devices on the bus for seconds.
+ * A scan limiter, one per bus, decides when the next probe may start:
+ *	-- The probe budget is a rate (probes per second). Credit accumulates
+ *	   with Ticks, up to one second's budget, and each probe uses one
+ *	   probe's worth.
+ *	-- At most maxConcurrentProbes probes may be outstanding at once.
+ *	-- If yieldToIO is set, no probe starts while the bus dispatcher has
+ *	   production (foreground) requests queued or in flight, unless the
+ *	   scan has already waited maxYieldTicks: a continuously busy bus is
+ *	   still scanned, slowly.
+ */
+#ifndef __ScanLimiter__
+#define __ScanLimiter__
+#include "MacSCSICommand.h"
+#include "BusDispatcher.h"				/* For BusDispatcherPtr			*/
+
+/*
+ * The default budget for a throttled scan.
+ */
+#define kScanProbesPerSecond	10
+#define kScanConcurrentProbes	1
+#define kScanMaxYieldTicks		60L
+
+struct ScanLimiterStatistics {
+	unsigned long		probes;					/* Probes started				*/
+	unsigned long		forcedProbes;			/* Started after maxYieldTicks	*/
+	unsigned long		waitTicks;				/* Probes spent waiting			*/
+};
+typedef struct ScanLimiterStatistics ScanLimiterStatistics;
+
+typedef struct ScanLimiter ScanLimiter, *ScanLimiterPtr;
+struct ScanLimiter {
+	unsigned short		probesPerSecond;		/* -> Budget, 0 = no limit		*/
+	unsigned short		maxConcurrentProbes;	/* -> 0 = no limit				*/
+	Boolean				yieldToIO;				/* -> Wait for production I/O	*/
+	unsigned long		maxYieldTicks;			/* -> Longest wait, 0 = forever	*/
+	BusDispatcherPtr	dispatcherPtr;			/* -> Production I/O (or NULL)	*/
+	unsigned short		probesInFlight;			/* Started, not complete		*/
+	unsigned long		credit;					/* Probes times 60				*/
+	unsigned long		lastTicks;				/* When credit was updated		*/
+	unsigned long		waitStartTicks;			/* 0 if no probe is waiting		*/
+	unsigned long		yieldStartTicks;		/* 0 if not waiting for I/O		*/
+	ScanLimiterStatistics	statistics;
+};
+
+/*
+ * Usage:
+ *		void						ScanLimiterInit(
+ *				ScanLimiterPtr			limiterPtr,
+ *				unsigned short			probesPerSecond,
+ *				unsigned short			maxConcurrentProbes,
+ *				BusDispatcherPtr		dispatcherPtr
+ *			);
+ *	Initialize a limiter. If dispatcherPtr is not NULL, the scan yields to
+ *	its foreground requests (for at most kScanMaxYieldTicks). Zero for the
+ *	rate or the concurrency means "no limit": ScanLimiterInit(p, 0, 0, NULL)
+ *	creates a limiter that never delays a probe.
+ *
+ *		Boolean						ScanLimiterTryStart(
+ *				ScanLimiterPtr			limiterPtr
+ *			);
+ *	Returns TRUE if a probe may start now, and counts it as started. The
+ *	caller must call ScanLimiterProbeDone when the probe completes.
+ *
+ *		void						ScanLimiterWait(
+ *				ScanLimiterPtr			limiterPtr
+ *			);
+ *	Wait until a probe may start, then count it as started. While waiting,
+ *	this polls the dispatcher (if any) or calls SystemTask.
+ *
+ *		void						ScanLimiterProbeDone(
+ *				ScanLimiterPtr			limiterPtr
+ *			);
+ *	A probe has completed.
+ */
+void						ScanLimiterInit(
+		ScanLimiterPtr			limiterPtr,
+		unsigned short			probesPerSecond,
+		unsigned short			maxConcurrentProbes,
+		BusDispatcherPtr		dispatcherPtr
+	);
+Boolean						ScanLimiterTryStart(
+		ScanLimiterPtr			limiterPtr
+	);
+void						ScanLimiterWait(
+		ScanLimiterPtr			limiterPtr
+	);
+void						ScanLimiterProbeDone(
+		ScanLimiterPtr			limiterPtr
+	);
+
+#endif /* __ScanLimiter__ */
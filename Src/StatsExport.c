@@ -0,0 +1,857 @@
+/*									StatsExport.c								*/
+/*
+ * StatsExport.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Count commands and scans, and export the counters. See StatsExport.h for
+ * the files. Each line (or, in the CSV file, each field) is formatted in a
+ * Str255 and collected in a buffer that is written kStatsBufferSize bytes at
+ * a time. If a write fails, the error is remembered and the rest of the file
+ * is discarded; the old file is not replaced.
+ *
+ * A probe of a missing device (as List SCSI Devices makes for every empty
+ * target) is counted only in its bus's noDevice counter: it does not take a
+ * slot in the device table.
+ */
+#include "SCSISimpleSample.h"
+
+#define kLinefeed				0x0A			/* '\n' is a return in MPW C	*/
+#define kUsecPerSecond			1000000L
+#define kMaxNameLength			31				/* HFS							*/
+#define kInfiniteBucket			kStatsLatencyBuckets	/* Column and label		*/
+
+enum {
+	kPrometheusFormat = 0,
+	kCSVFormat
+};
+
+/*
+ * The counters that every device has. The first kBusCounters are also kept
+ * for each bus. The names are exported after "scsi_" for a device and after
+ * "scsi_bus_" for a bus, and are the CSV column names.
+ */
+enum {
+	kCommandsCounter = 0,
+	kReadBytesCounter,
+	kWrittenBytesCounter,
+	kErrorsCounter,
+	kBusCounters,
+	kCheckConditionsCounter = kBusCounters,
+	kRetriedCounter,
+	kBusyRetriesCounter,
+	kDeviceCounters
+};
+static char						*gCounterName[kDeviceCounters] = {
+		"\pcommands_total",
+		"\pread_bytes_total",
+		"\pwritten_bytes_total",
+		"\perrors_total",
+		"\pcheck_conditions_total",
+		"\pretried_commands_total",
+		"\pbusy_retries_total"
+	};
+static char						*gCounterHelp[kDeviceCounters] = {
+		"\pSCSI commands completed.",
+		"\pBytes transferred from the device.",
+		"\pBytes transferred to the device.",
+		"\pCommands that failed.",
+		"\pCommands that returned Check Condition.",
+		"\pCommands that were retried because the device was busy.",
+		"\pBusy retries."
+	};
+/*
+ * The latency histogram's upper bounds, in microseconds and as exported (in
+ * seconds). Slower commands are counted only in the +Inf bucket.
+ */
+static unsigned long			gLatencyBound[kStatsLatencyBuckets] = {
+		250L, 500L, 1000L, 2500L, 5000L, 10000L, 25000L,
+		50000L, 100000L, 250000L, 500000L, 1000000L, 2500000L, 5000000L
+	};
+static char						*gLatencyLabel[kStatsLatencyBuckets + 1] = {
+		"\p0.00025", "\p0.0005", "\p0.001", "\p0.0025", "\p0.005",
+		"\p0.01", "\p0.025", "\p0.05", "\p0.1", "\p0.25", "\p0.5",
+		"\p1", "\p2.5", "\p5", "\p+Inf"
+	};
+
+static StatsDevicePtr			FindDevice(
+		StatsExportPtr			statsPtr,
+		DeviceIdent				scsiDevice
+	);
+static Boolean					IsNoDevice(
+		OSErr					status
+	);
+static unsigned long			DeviceCounter(
+		const StatsDevice		*devicePtr,
+		short					counter
+	);
+static unsigned long			BusCounter(
+		const StatsBus			*busPtr,
+		short					counter
+	);
+static OSErr					ExportFiles(
+		StatsExportPtr			statsPtr
+	);
+static OSErr					ExportFile(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		fileName,
+		short					format
+	);
+static void						WritePrometheus(
+		StatsExportPtr			statsPtr
+	);
+static void						WriteCSV(
+		StatsExportPtr			statsPtr
+	);
+static void						PutFamily(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		prefix,
+		ConstStr255Param		name,
+		ConstStr255Param		help,
+		ConstStr255Param		type
+	);
+static void						PutText(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		text
+	);
+static void						PutLine(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		text
+	);
+static void						PutField(
+		StatsExportPtr			statsPtr,
+		unsigned long			value
+	);
+static void						PutEmptyFields(
+		StatsExportPtr			statsPtr,
+		short					count
+	);
+static void						FlushBuffer(
+		StatsExportPtr			statsPtr
+	);
+static void						AppendDeviceLabels(
+		StringPtr				result,
+		const StatsDevice		*devicePtr
+	);
+static void						AppendSeconds(
+		StringPtr				result,
+		unsigned long			seconds,
+		unsigned long			microseconds
+	);
+static void						MakeFileName(
+		StringPtr				result,
+		ConstStr255Param		fileName,
+		ConstStr255Param		suffix
+	);
+
+OSErr
+StatsExportStart(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		OSType					creator,
+		unsigned long			intervalTicks
+	)
+{
+		OSErr					status;
+
+		CLEAR(*statsPtr);
+		if (fileName[0] == 0 || fileName[0] > kMaxNameLength)
+			return (bdNamErr);
+		statsPtr->bufferPtr = NewPtr(kStatsBufferSize);
+		if (statsPtr->bufferPtr == NULL)
+			return (memFullErr);
+		pstrcpy(statsPtr->fileName, fileName);
+		MakeFileName(statsPtr->csvName, fileName, "\p.csv");
+		MakeFileName(statsPtr->tempName, fileName, "\p.tmp");
+		statsPtr->vRefNum = vRefNum;
+		statsPtr->creator = creator;
+		statsPtr->intervalTicks = intervalTicks;
+		statsPtr->lastDevice = kStatsNoDevice;
+		status = ExportFiles(statsPtr);
+		if (status != noErr) {
+			DisposePtr(statsPtr->bufferPtr);
+			CLEAR(*statsPtr);
+			return (status);
+		}
+		statsPtr->active = TRUE;
+		return (noErr);
+}
+
+OSErr
+StatsExportStop(
+		StatsExportPtr			statsPtr
+	)
+{
+		OSErr					status;
+
+		if (statsPtr->active == FALSE)
+			return (noErr);
+		status = ExportFiles(statsPtr);
+		statsPtr->active = FALSE;
+		DisposePtr(statsPtr->bufferPtr);
+		statsPtr->bufferPtr = NULL;
+		return (status);
+}
+
+OSErr
+StatsExportIdle(
+		StatsExportPtr			statsPtr
+	)
+{
+		OSErr					status;
+
+		if (statsPtr->active == FALSE || TickCount() < statsPtr->nextTicks)
+			return (noErr);
+		status = ExportFiles(statsPtr);
+		if (status != noErr) {
+			statsPtr->active = FALSE;
+			DisposePtr(statsPtr->bufferPtr);
+			statsPtr->bufferPtr = NULL;
+		}
+		return (status);
+}
+
+void
+StatsExportRecord(
+		StatsExportPtr			statsPtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		const UnsignedWide		*issuedTime
+	)
+{
+		register StatsDevicePtr	devicePtr;
+		register StatsBus		*busPtr;
+		register short			i;
+		unsigned long			latency;
+		UnsignedWide			now;
+#define SCB	(*scsiCmdBlockPtr)
+
+		if (statsPtr->active == FALSE)
+			return;
+		Microseconds(&now);
+		latency = now.lo - issuedTime->lo;
+		if (SCB.scsiDevice.bus >= kStatsMaxBuses) {
+			++statsPtr->otherCommands;
+			return;
+		}
+		busPtr = &statsPtr->bus[SCB.scsiDevice.bus];
+		if (IsNoDevice(SCB.status)) {
+			++busPtr->noDevice;
+			return;
+		}
+		devicePtr = FindDevice(statsPtr, SCB.scsiDevice);
+		if (devicePtr == NULL) {
+			++statsPtr->otherCommands;
+			return;
+		}
+		++devicePtr->commands;
+		++busPtr->commands;
+		if (SCB.writeToDevice) {
+			devicePtr->writtenBytes += SCB.actualTransferCount;
+			busPtr->writtenBytes += SCB.actualTransferCount;
+		}
+		else {
+			devicePtr->readBytes += SCB.actualTransferCount;
+			busPtr->readBytes += SCB.actualTransferCount;
+		}
+		if (SCB.status != noErr) {
+			++devicePtr->errors;
+			++busPtr->errors;
+		}
+		if (SCB.status == statusErr) {
+			++devicePtr->checkConditions;
+			++devicePtr->senseKey[SCB.sense.senseKey & kScsiSenseKeyMask];
+		}
+		if (SCB.busyRetries != 0) {
+			++devicePtr->retried;
+			devicePtr->busyRetries += SCB.busyRetries;
+		}
+		devicePtr->latencySeconds += latency / kUsecPerSecond;
+		devicePtr->latencyMicroseconds += latency % kUsecPerSecond;
+		if (devicePtr->latencyMicroseconds >= kUsecPerSecond) {
+			devicePtr->latencyMicroseconds -= kUsecPerSecond;
+			++devicePtr->latencySeconds;
+		}
+		for (i = 0; i < kStatsLatencyBuckets && latency > gLatencyBound[i]; i++)
+			;
+		if (i < kStatsLatencyBuckets)
+			++devicePtr->latencyBucket[i];
+#undef SCB
+}
+
+void
+StatsExportScan(
+		StatsExportPtr			statsPtr,
+		unsigned short			bus,
+		unsigned long			scanTicks
+	)
+{
+		register StatsBus		*busPtr;
+		unsigned long			scanMsec;
+
+		if (statsPtr->active == FALSE || bus >= kStatsMaxBuses)
+			return;
+		busPtr = &statsPtr->bus[bus];
+		scanMsec = (scanTicks * 50L) / 3L;			/* 1000 / 60			*/
+		++busPtr->scans;
+		busPtr->scanMsec += scanMsec;
+		busPtr->lastScanMsec = scanMsec;
+}
+
+/*
+ * Return the device's counters, adding it to the table if it is new. Commands
+ * usually come in runs to one device, so the last device is checked first.
+ */
+static StatsDevicePtr
+FindDevice(
+		StatsExportPtr			statsPtr,
+		DeviceIdent				scsiDevice
+	)
+{
+		register StatsDevicePtr	devicePtr;
+		register unsigned short	i;
+
+		if (statsPtr->lastDevice != kStatsNoDevice) {
+			devicePtr = &statsPtr->device[statsPtr->lastDevice];
+			if (devicePtr->bus == scsiDevice.bus
+			 && devicePtr->targetID == scsiDevice.targetID
+			 && devicePtr->LUN == scsiDevice.LUN)
+				return (devicePtr);
+		}
+		for (i = 0; i < statsPtr->deviceCount; i++) {
+			devicePtr = &statsPtr->device[i];
+			if (devicePtr->bus == scsiDevice.bus
+			 && devicePtr->targetID == scsiDevice.targetID
+			 && devicePtr->LUN == scsiDevice.LUN) {
+				statsPtr->lastDevice = i;
+				return (devicePtr);
+			}
+		}
+		if (statsPtr->deviceCount == kStatsMaxDevices)
+			return (NULL);
+		i = statsPtr->deviceCount++;
+		devicePtr = &statsPtr->device[i];
+		devicePtr->bus = scsiDevice.bus;
+		devicePtr->targetID = scsiDevice.targetID;
+		devicePtr->LUN = scsiDevice.LUN;
+		statsPtr->lastDevice = i;
+		return (devicePtr);
+}
+
+/*
+ * These all mean "no such device" (as in CheckSCSICommandStatus).
+ */
+static Boolean
+IsNoDevice(
+		OSErr					status
+	)
+{
+		switch (status) {
+		case scsiDeviceNotThere:
+		case scsiSelectTimeout:
+		case scsiBusInvalid:
+		case scsiTIDInvalid:
+			return (TRUE);
+		default:
+			return (FALSE);
+		}
+}
+
+static unsigned long
+DeviceCounter(
+		const StatsDevice		*devicePtr,
+		short					counter
+	)
+{
+		switch (counter) {
+		case kCommandsCounter:			return (devicePtr->commands);
+		case kReadBytesCounter:			return (devicePtr->readBytes);
+		case kWrittenBytesCounter:		return (devicePtr->writtenBytes);
+		case kErrorsCounter:			return (devicePtr->errors);
+		case kCheckConditionsCounter:	return (devicePtr->checkConditions);
+		case kRetriedCounter:			return (devicePtr->retried);
+		case kBusyRetriesCounter:		return (devicePtr->busyRetries);
+		default:						return (0);
+		}
+}
+
+static unsigned long
+BusCounter(
+		const StatsBus			*busPtr,
+		short					counter
+	)
+{
+		switch (counter) {
+		case kCommandsCounter:			return (busPtr->commands);
+		case kReadBytesCounter:			return (busPtr->readBytes);
+		case kWrittenBytesCounter:		return (busPtr->writtenBytes);
+		case kErrorsCounter:			return (busPtr->errors);
+		default:						return (0);
+		}
+}
+
+/*
+ * Write both files, and set the time of the next export.
+ */
+static OSErr
+ExportFiles(
+		StatsExportPtr			statsPtr
+	)
+{
+		OSErr					status;
+
+		status = ExportFile(statsPtr, statsPtr->fileName, kPrometheusFormat);
+		if (status == noErr)
+			status = ExportFile(statsPtr, statsPtr->csvName, kCSVFormat);
+		if (status == noErr)
+			++statsPtr->exports;
+		statsPtr->nextTicks = TickCount() + statsPtr->intervalTicks;
+		return (status);
+}
+
+/*
+ * Write one file under the temporary name, then exchange it with the file
+ * (or, the first time, rename it). After the exchange, the temporary file
+ * holds the old counters, and is deleted. A volume that can't exchange files
+ * (some file servers) returns paramErr: there, the old file is deleted first,
+ * and a reader may briefly find no file.
+ */
+static OSErr
+ExportFile(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		fileName,
+		short					format
+	)
+{
+		FSSpec					tempSpec;
+		FSSpec					fileSpec;
+		OSErr					status;
+
+		status = FSMakeFSSpec(
+					statsPtr->vRefNum, 0L, statsPtr->tempName, &tempSpec);
+		if (status == fnfErr)
+			status = FSpCreate(&tempSpec,
+						statsPtr->creator, kStatsFileType, smSystemScript);
+		if (status == noErr)
+			status = FSpOpenDF(&tempSpec, fsRdWrPerm, &statsPtr->refNum);
+		if (status != noErr)
+			return (status);
+		statsPtr->writeStatus = SetEOF(statsPtr->refNum, 0L);
+		statsPtr->bufferCount = 0;
+		if (format == kPrometheusFormat)
+			WritePrometheus(statsPtr);
+		else {
+			WriteCSV(statsPtr);
+		}
+		FlushBuffer(statsPtr);
+		status = FSClose(statsPtr->refNum);
+		if (statsPtr->writeStatus != noErr)
+			status = statsPtr->writeStatus;
+		if (status != noErr)
+			return (status);
+		status = FSMakeFSSpec(statsPtr->vRefNum, 0L, fileName, &fileSpec);
+		if (status == fnfErr)						/* The first export		*/
+			return (FSpRename(&tempSpec, fileName));
+		if (status == noErr)
+			status = FSpExchangeFiles(&tempSpec, &fileSpec);
+		if (status == noErr)
+			status = FSpDelete(&tempSpec);
+		else if (status == paramErr) {
+			status = FSpDelete(&fileSpec);
+			if (status == noErr)
+				status = FSpRename(&tempSpec, fileName);
+		}
+		return (status);
+}
+
+/*
+ * The Prometheus text exposition format: each metric family is introduced by
+ * its HELP and TYPE lines, and all of its samples follow.
+ */
+static void
+WritePrometheus(
+		StatsExportPtr			statsPtr
+	)
+{
+		register StatsDevicePtr	devicePtr;
+		register StatsBus		*busPtr;
+		register short			i;
+		register short			j;
+		short					counter;
+		unsigned long			cumulative;
+		Str255					work;
+
+		for (counter = 0; counter < kDeviceCounters; counter++) {
+			PutFamily(statsPtr, "\pscsi_", gCounterName[counter],
+				gCounterHelp[counter], "\pcounter");
+			for (i = 0; i < statsPtr->deviceCount; i++) {
+				devicePtr = &statsPtr->device[i];
+				pstrcpy(work, "\pscsi_");
+				pstrcat(work, gCounterName[counter]);
+				AppendDeviceLabels(work, devicePtr);
+				pstrcat(work, "\p} ");
+				AppendUnsigned(work, DeviceCounter(devicePtr, counter));
+				PutLine(statsPtr, work);
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_", "\psense_keys_total",
+			"\pCheck Conditions, by sense key.", "\pcounter");
+		for (i = 0; i < statsPtr->deviceCount; i++) {
+			devicePtr = &statsPtr->device[i];
+			for (j = 0; j < kStatsSenseKeys; j++) {
+				if (devicePtr->senseKey[j] != 0) {
+					pstrcpy(work, "\pscsi_sense_keys_total");
+					AppendDeviceLabels(work, devicePtr);
+					pstrcat(work, "\p,key=\"");
+					AppendUnsigned(work, j);
+					pstrcat(work, "\p\"} ");
+					AppendUnsigned(work, devicePtr->senseKey[j]);
+					PutLine(statsPtr, work);
+				}
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_", "\pcommand_latency_seconds",
+			"\pTime from issuing a command to its completion.", "\phistogram");
+		for (i = 0; i < statsPtr->deviceCount; i++) {
+			devicePtr = &statsPtr->device[i];
+			cumulative = 0;
+			for (j = 0; j <= kInfiniteBucket; j++) {
+				if (j < kInfiniteBucket)
+					cumulative += devicePtr->latencyBucket[j];
+				else {
+					cumulative = devicePtr->commands;
+				}
+				pstrcpy(work, "\pscsi_command_latency_seconds_bucket");
+				AppendDeviceLabels(work, devicePtr);
+				pstrcat(work, "\p,le=\"");
+				pstrcat(work, gLatencyLabel[j]);
+				pstrcat(work, "\p\"} ");
+				AppendUnsigned(work, cumulative);
+				PutLine(statsPtr, work);
+			}
+			pstrcpy(work, "\pscsi_command_latency_seconds_sum");
+			AppendDeviceLabels(work, devicePtr);
+			pstrcat(work, "\p} ");
+			AppendSeconds(work,
+				devicePtr->latencySeconds, devicePtr->latencyMicroseconds);
+			PutLine(statsPtr, work);
+			pstrcpy(work, "\pscsi_command_latency_seconds_count");
+			AppendDeviceLabels(work, devicePtr);
+			pstrcat(work, "\p} ");
+			AppendUnsigned(work, devicePtr->commands);
+			PutLine(statsPtr, work);
+		}
+		/*
+		 * The buses. A bus is exported once it has a command or a scan.
+		 */
+		for (counter = 0; counter <= kBusCounters; counter++) {
+			if (counter < kBusCounters)
+				PutFamily(statsPtr, "\pscsi_bus_", gCounterName[counter],
+					gCounterHelp[counter], "\pcounter");
+			else {
+				PutFamily(statsPtr, "\pscsi_bus_", "\pno_device_total",
+					"\pCommands to a missing device, such as scan probes.",
+					"\pcounter");
+			}
+			for (i = 0; i < kStatsMaxBuses; i++) {
+				busPtr = &statsPtr->bus[i];
+				if (busPtr->commands == 0
+				 && busPtr->noDevice == 0
+				 && busPtr->scans == 0)
+					continue;
+				pstrcpy(work, "\pscsi_bus_");
+				pstrcat(work, (counter < kBusCounters)
+					? gCounterName[counter]
+					: "\pno_device_total");
+				pstrcat(work, "\p{bus=\"");
+				AppendUnsigned(work, i);
+				pstrcat(work, "\p\"} ");
+				AppendUnsigned(work, (counter < kBusCounters)
+					? BusCounter(busPtr, counter)
+					: busPtr->noDevice);
+				PutLine(statsPtr, work);
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_bus_", "\pscans_total",
+			"\pScans of the bus by List SCSI Devices.", "\pcounter");
+		for (i = 0; i < kStatsMaxBuses; i++) {
+			if (statsPtr->bus[i].scans != 0) {
+				pstrcpy(work, "\pscsi_bus_scans_total{bus=\"");
+				AppendUnsigned(work, i);
+				pstrcat(work, "\p\"} ");
+				AppendUnsigned(work, statsPtr->bus[i].scans);
+				PutLine(statsPtr, work);
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_bus_", "\pscan_seconds_total",
+			"\pTime spent scanning the bus.", "\pcounter");
+		for (i = 0; i < kStatsMaxBuses; i++) {
+			busPtr = &statsPtr->bus[i];
+			if (busPtr->scans != 0) {
+				pstrcpy(work, "\pscsi_bus_scan_seconds_total{bus=\"");
+				AppendUnsigned(work, i);
+				pstrcat(work, "\p\"} ");
+				AppendSeconds(work, busPtr->scanMsec / 1000L,
+					(busPtr->scanMsec % 1000L) * 1000L);
+				PutLine(statsPtr, work);
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_bus_", "\plast_scan_seconds",
+			"\pThe time taken by the last scan of the bus.", "\pgauge");
+		for (i = 0; i < kStatsMaxBuses; i++) {
+			busPtr = &statsPtr->bus[i];
+			if (busPtr->scans != 0) {
+				pstrcpy(work, "\pscsi_bus_last_scan_seconds{bus=\"");
+				AppendUnsigned(work, i);
+				pstrcat(work, "\p\"} ");
+				AppendSeconds(work, busPtr->lastScanMsec / 1000L,
+					(busPtr->lastScanMsec % 1000L) * 1000L);
+				PutLine(statsPtr, work);
+			}
+		}
+		PutFamily(statsPtr, "\pscsi_", "\puntracked_commands_total",
+			"\pCommands to devices or buses that did not fit in the tables.",
+			"\pcounter");
+		pstrcpy(work, "\pscsi_untracked_commands_total ");
+		AppendUnsigned(work, statsPtr->otherCommands);
+		PutLine(statsPtr, work);
+}
+
+/*
+ * One line per device and per bus. Each has every column: those that don't
+ * apply are empty. The latency columns are cumulative, as in the Prometheus
+ * histogram.
+ */
+static void
+WriteCSV(
+		StatsExportPtr			statsPtr
+	)
+{
+		register StatsDevicePtr	devicePtr;
+		register StatsBus		*busPtr;
+		register short			i;
+		register short			j;
+		unsigned long			cumulative;
+		Str255					work;
+
+		PutText(statsPtr, "\pscope,bus,target,lun");
+		for (i = 0; i < kDeviceCounters; i++) {
+			pstrcpy(work, "\p,");
+			pstrcat(work, gCounterName[i]);
+			PutText(statsPtr, work);
+		}
+		PutText(statsPtr, "\p,latency_seconds_sum");
+		for (i = 0; i <= kInfiniteBucket; i++) {
+			pstrcpy(work, "\p,latency_le_");
+			pstrcat(work, gLatencyLabel[i]);
+			PutText(statsPtr, work);
+		}
+		for (i = 0; i < kStatsSenseKeys; i++) {
+			pstrcpy(work, "\p,sense_key_");
+			AppendUnsigned(work, i);
+			PutText(statsPtr, work);
+		}
+		PutText(statsPtr, "\p,no_device_total,scans_total");
+		PutLine(statsPtr, "\p,scan_seconds_total,last_scan_seconds");
+		for (i = 0; i < statsPtr->deviceCount; i++) {
+			devicePtr = &statsPtr->device[i];
+			PutText(statsPtr, "\pdevice");
+			PutField(statsPtr, devicePtr->bus);
+			PutField(statsPtr, devicePtr->targetID);
+			PutField(statsPtr, devicePtr->LUN);
+			for (j = 0; j < kDeviceCounters; j++)
+				PutField(statsPtr, DeviceCounter(devicePtr, j));
+			pstrcpy(work, "\p,");
+			AppendSeconds(work,
+				devicePtr->latencySeconds, devicePtr->latencyMicroseconds);
+			PutText(statsPtr, work);
+			cumulative = 0;
+			for (j = 0; j < kInfiniteBucket; j++) {
+				cumulative += devicePtr->latencyBucket[j];
+				PutField(statsPtr, cumulative);
+			}
+			PutField(statsPtr, devicePtr->commands);
+			for (j = 0; j < kStatsSenseKeys; j++)
+				PutField(statsPtr, devicePtr->senseKey[j]);
+			PutEmptyFields(statsPtr, 4);
+			PutLine(statsPtr, "\p");
+		}
+		for (i = 0; i < kStatsMaxBuses; i++) {
+			busPtr = &statsPtr->bus[i];
+			if (busPtr->commands == 0
+			 && busPtr->noDevice == 0
+			 && busPtr->scans == 0)
+				continue;
+			PutText(statsPtr, "\pbus");
+			PutField(statsPtr, i);
+			PutEmptyFields(statsPtr, 2);
+			for (j = 0; j < kBusCounters; j++)
+				PutField(statsPtr, BusCounter(busPtr, j));
+			PutEmptyFields(statsPtr,
+				(kDeviceCounters - kBusCounters) + 1
+					+ (kInfiniteBucket + 1) + kStatsSenseKeys);
+			PutField(statsPtr, busPtr->noDevice);
+			PutField(statsPtr, busPtr->scans);
+			pstrcpy(work, "\p,");
+			AppendSeconds(work,
+				busPtr->scanMsec / 1000L, (busPtr->scanMsec % 1000L) * 1000L);
+			pstrcat(work, "\p,");
+			AppendSeconds(work, busPtr->lastScanMsec / 1000L,
+				(busPtr->lastScanMsec % 1000L) * 1000L);
+			PutLine(statsPtr, work);
+		}
+}
+
+/*
+ * Write a metric family's HELP and TYPE lines.
+ */
+static void
+PutFamily(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		prefix,
+		ConstStr255Param		name,
+		ConstStr255Param		help,
+		ConstStr255Param		type
+	)
+{
+		Str255					work;
+
+		pstrcpy(work, "\p# HELP ");
+		pstrcat(work, prefix);
+		pstrcat(work, name);
+		pstrcat(work, "\p ");
+		pstrcat(work, help);
+		PutLine(statsPtr, work);
+		pstrcpy(work, "\p# TYPE ");
+		pstrcat(work, prefix);
+		pstrcat(work, name);
+		pstrcat(work, "\p ");
+		pstrcat(work, type);
+		PutLine(statsPtr, work);
+}
+
+static void
+PutText(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		text
+	)
+{
+		if (statsPtr->bufferCount + text[0] + 1	/* + linefeed	*/
+				> kStatsBufferSize)
+			FlushBuffer(statsPtr);
+		BlockMove(
+			&text[1], statsPtr->bufferPtr + statsPtr->bufferCount, text[0]);
+		statsPtr->bufferCount += text[0];
+}
+
+static void
+PutLine(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		text
+	)
+{
+		PutText(statsPtr, text);
+		statsPtr->bufferPtr[statsPtr->bufferCount++] = kLinefeed;
+}
+
+/*
+ * Write ",value".
+ */
+static void
+PutField(
+		StatsExportPtr			statsPtr,
+		unsigned long			value
+	)
+{
+		Str255					work;
+
+		pstrcpy(work, "\p,");
+		AppendUnsigned(work, value);
+		PutText(statsPtr, work);
+}
+
+static void
+PutEmptyFields(
+		StatsExportPtr			statsPtr,
+		short					count
+	)
+{
+		for (; count > 0; --count)
+			PutText(statsPtr, "\p,");
+}
+
+static void
+FlushBuffer(
+		StatsExportPtr			statsPtr
+	)
+{
+		long					count;
+
+		if (statsPtr->writeStatus == noErr && statsPtr->bufferCount != 0) {
+			count = statsPtr->bufferCount;
+			statsPtr->writeStatus = FSWrite(
+						statsPtr->refNum, &count, statsPtr->bufferPtr);
+		}
+		statsPtr->bufferCount = 0;
+}
+
+/*
+ * Append {bus="0",target="3",lun="0" (without the closing brace, so that
+ * more labels may follow).
+ */
+static void
+AppendDeviceLabels(
+		StringPtr				result,
+		const StatsDevice		*devicePtr
+	)
+{
+		pstrcat(result, "\p{bus=\"");
+		AppendUnsigned(result, devicePtr->bus);
+		pstrcat(result, "\p\",target=\"");
+		AppendUnsigned(result, devicePtr->targetID);
+		pstrcat(result, "\p\",lun=\"");
+		AppendUnsigned(result, devicePtr->LUN);
+		pstrcat(result, "\p\"");
+}
+
+/*
+ * Append seconds.microseconds, such as 12.000250.
+ */
+static void
+AppendSeconds(
+		StringPtr				result,
+		unsigned long			seconds,
+		unsigned long			microseconds
+	)
+{
+		AppendUnsigned(result, seconds);
+		AppendChar(result, '.');
+		AppendUnsignedLeadingZeros(result, microseconds, 6, 0);
+}
+
+/*
+ * Make a file name from the Prometheus file name: remove ".prom" (if it is
+ * there), shorten the rest so that the suffix fits, and add the suffix.
+ */
+static void
+MakeFileName(
+		StringPtr				result,
+		ConstStr255Param		fileName,
+		ConstStr255Param		suffix
+	)
+{
+		short					length;
+
+		length = fileName[0];
+		if (length > 5
+		 && fileName[length - 4] == '.'
+		 && fileName[length - 3] == 'p'
+		 && fileName[length - 2] == 'r'
+		 && fileName[length - 1] == 'o'
+		 && fileName[length] == 'm')
+			length -= 5;
+		if (length > kMaxNameLength - suffix[0])
+			length = kMaxNameLength - suffix[0];
+		BlockMove(&fileName[1], &result[1], length);
+		result[0] = length;
+		pstrcat(result, suffix);
+}
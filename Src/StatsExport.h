@@ -0,0 +1,140 @@
+/*									StatsExport.h								*/
+/*
+ * StatsExport.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Statistics export. While an export is active, DoSCSICommandWithSense counts
+ * every command it executes, by device and by bus: the commands, the bytes
+ * read and written, the errors, Check Conditions (by sense key), and Busy
+ * retries, and a histogram of the latency. List SCSI Devices adds the time it
+ * took to scan each bus. Every intervalTicks, the counters are written to two
+ * text files in the folder that the user chose:
+ *	-- fileName, in the Prometheus text exposition format, for a collector
+ *	   that reads a folder of ".prom" files (such as node_exporter's textfile
+ *	   collector, on a shared volume).
+ *	-- The same name, ending in ".csv" rather than ".prom", with one line
+ *	   per device and per bus, for a spreadsheet.
+ * Each file is written under a temporary name (ending in ".tmp", which the
+ * collector ignores) and then exchanged with the old file, so a reader sees
+ * the old counters or the new ones, never a partly written file. Lines end
+ * with a linefeed, not the Macintosh return, as the collector expects.
+ *
+ * The counters start at zero when the export starts, and are unsigned longs:
+ * a collector treats a counter that wraps as one that was reset. A device
+ * or bus that does not fit in the tables is counted in otherCommands only.
+ *
+ * These functions use the File Manager, and are called at task level only.
+ */
+#ifndef __StatsExport__
+#define __StatsExport__
+#include <Files.h>
+#include <Timer.h>
+#include "MacSCSICommand.h"
+
+#define kStatsFileType			'TEXT'
+#define kStatsMaxDevices		32
+#define kStatsMaxBuses			8
+#define kStatsLatencyBuckets	14				/* See gLatencyBound			*/
+#define kStatsSenseKeys			16
+#define kStatsIntervalTicks		(60L * 15L)
+#define kStatsBufferSize		2048
+#define kStatsNoDevice			0xFFFF
+
+struct StatsDevice {
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		LUN;
+	unsigned char		reserved;
+	unsigned long		commands;
+	unsigned long		readBytes;
+	unsigned long		writtenBytes;
+	unsigned long		errors;					/* status != noErr				*/
+	unsigned long		checkConditions;		/* status == statusErr			*/
+	unsigned long		retried;				/* Commands with Busy retries	*/
+	unsigned long		busyRetries;
+	unsigned long		latencySeconds;			/* The sum of the latencies		*/
+	unsigned long		latencyMicroseconds;	/* ... is less than a second	*/
+	unsigned long		latencyBucket[kStatsLatencyBuckets];	/* Not cumulative	*/
+	unsigned long		senseKey[kStatsSenseKeys];
+};
+typedef struct StatsDevice StatsDevice, *StatsDevicePtr;
+
+struct StatsBus {
+	unsigned long		commands;
+	unsigned long		readBytes;
+	unsigned long		writtenBytes;
+	unsigned long		errors;
+	unsigned long		noDevice;				/* Commands to missing devices	*/
+	unsigned long		scans;					/* By List SCSI Devices			*/
+	unsigned long		scanMsec;				/* Total						*/
+	unsigned long		lastScanMsec;
+};
+typedef struct StatsBus StatsBus;
+
+struct StatsExport {
+	Boolean				active;					/* Counting and exporting		*/
+	short				vRefNum;
+	Str63				fileName;				/* The Prometheus file			*/
+	Str63				csvName;
+	Str63				tempName;
+	OSType				creator;
+	unsigned long		intervalTicks;
+	unsigned long		nextTicks;				/* When to export next			*/
+	unsigned long		exports;				/* Written so far				*/
+	unsigned long		otherCommands;			/* Not in the tables (overflow)	*/
+	unsigned short		lastDevice;				/* Or kStatsNoDevice			*/
+	unsigned short		deviceCount;
+	StatsDevice			device[kStatsMaxDevices];
+	StatsBus			bus[kStatsMaxBuses];
+	short				refNum;					/* While a file is written		*/
+	OSErr				writeStatus;
+	long				bufferCount;
+	Ptr					bufferPtr;				/* kStatsBufferSize bytes		*/
+};
+typedef struct StatsExport StatsExport, *StatsExportPtr;
+
+/*
+ * Clear the counters and start exporting to fileName (in the folder vRefNum)
+ * every intervalTicks. The files are written once before this returns, so
+ * that an unwritable folder is reported at once.
+ */
+OSErr						StatsExportStart(
+		StatsExportPtr			statsPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		OSType					creator,
+		unsigned long			intervalTicks
+	);
+/*
+ * Write the files a last time, and stop.
+ */
+OSErr						StatsExportStop(
+		StatsExportPtr			statsPtr
+	);
+/*
+ * Count a command executed by DoSCSICommandWithSense. issuedTime is the
+ * Microseconds time when it was issued.
+ */
+void						StatsExportRecord(
+		StatsExportPtr			statsPtr,
+		const ScsiCmdBlock		*scsiCmdBlockPtr,
+		const UnsignedWide		*issuedTime
+	);
+/*
+ * Count a scan of a bus that took scanTicks.
+ */
+void						StatsExportScan(
+		StatsExportPtr			statsPtr,
+		unsigned short			bus,
+		unsigned long			scanTicks
+	);
+/*
+ * Called by the event loop on each null event: write the files if the
+ * interval has passed. If they can't be written, the export stops and the
+ * error is returned.
+ */
+OSErr						StatsExportIdle(
+		StatsExportPtr			statsPtr
+	);
+
+#endif /* __StatsExport__ */
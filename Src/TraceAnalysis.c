@@ -0,0 +1,390 @@
+/*									TraceAnalysis.c								*/
+/*
+ * TraceAnalysis.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Analyze a command trace. See TraceAnalysis.h.
+ */
+#include "SCSISimpleSample.h"
+
+static OSErr					FirstPass(
+		TraceAnalysisPtr		analysisPtr,
+		TraceReaderPtr			readerPtr
+	);
+static OSErr					SecondPass(
+		TraceAnalysisPtr		analysisPtr,
+		TraceReaderPtr			readerPtr
+	);
+static short					FindGroup(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr,
+		Boolean					create
+	);
+static void						CountSense(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr
+	);
+static void						CountSlot(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr
+	);
+static void						KeepOutlier(
+		TraceAnalysisPtr		analysisPtr,
+		unsigned long			record,
+		unsigned long			latency,
+		short					group
+	);
+static short					LatencyBin(
+		unsigned long			latency
+	);
+static unsigned long			BinLatency(
+		short					bin
+	);
+
+OSErr
+TraceAnalyze(
+		TraceAnalysisPtr		analysisPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum
+	)
+{
+		TraceReader				reader;
+		OSErr					status;
+
+		CLEAR(*analysisPtr);
+		analysisPtr->slotMsec = kAnalysisSlotMsec;
+		status = CommandTraceOpen(&reader, fileName, vRefNum);
+		if (status == noErr) {
+			status = FirstPass(analysisPtr, &reader);
+			if (status == noErr)
+				status = CommandTraceQuery(&reader, NULL, 0L, 0xFFFFFFFF);
+			if (status == noErr)
+				status = SecondPass(analysisPtr, &reader);
+			CommandTraceClose(&reader);
+		}
+		return (status);
+}
+
+unsigned long
+TraceAnalysisPercentile(
+		const AnalysisGroup		*groupPtr,
+		unsigned short			perMille
+	)
+{
+		register short			bin;
+		unsigned long			target;
+		unsigned long			count;
+
+		if (groupPtr->commands == 0)
+			return (0);
+		/*
+		 * The commands that must not be exceeded: split the product so that
+		 * a long trace doesn't overflow.
+		 */
+		target = (groupPtr->commands / 1000L) * perMille
+			+ ((groupPtr->commands % 1000L) * perMille + 999L) / 1000L;
+		if (target == 0)
+			target = 1;
+		count = 0;
+		for (bin = 0; bin < kAnalysisBins - 1; bin++) {
+			count += groupPtr->histogram[bin];
+			if (count >= target)
+				break;
+		}
+		return (BinLatency(bin));
+}
+
+unsigned long
+TraceAnalysisAverage(
+		const AnalysisGroup		*groupPtr
+	)
+{
+		register short			i;
+		unsigned long			hi;
+		unsigned long			lo;
+		unsigned long			remainder;
+		unsigned long			quotient;
+
+		if (groupPtr->commands == 0)
+			return (0);
+		/*
+		 * Long division of the 64-bit total, a bit at a time. The average is
+		 * less than 2^32, so the high word is less than the divisor.
+		 */
+		hi = groupPtr->totalLatency.hi;
+		lo = groupPtr->totalLatency.lo;
+		remainder = hi % groupPtr->commands;
+		quotient = 0;
+		for (i = 0; i < 32; i++) {
+			if ((remainder & 0x80000000) != 0) {
+				remainder = (remainder << 1) | (lo >> 31);
+				remainder -= groupPtr->commands;		/* Wraps to the result	*/
+				quotient = (quotient << 1) | 1;
+			}
+			else {
+				remainder = (remainder << 1) | (lo >> 31);
+				quotient <<= 1;
+				if (remainder >= groupPtr->commands) {
+					remainder -= groupPtr->commands;
+					quotient |= 1;
+				}
+			}
+			lo <<= 1;
+		}
+		return (quotient);
+}
+
+/*
+ * Count every record.
+ */
+static OSErr
+FirstPass(
+		TraceAnalysisPtr		analysisPtr,
+		TraceReaderPtr			readerPtr
+	)
+{
+		register TraceRecordPtr		recordPtr;
+		register AnalysisGroupPtr	groupPtr;
+		register short			i;
+		TraceRecordPtr			nextPtr;
+		OSErr					status;
+
+		while ((status = CommandTraceNext(readerPtr, &nextPtr)) == noErr) {
+			recordPtr = nextPtr;
+			++analysisPtr->records;
+			CountSlot(analysisPtr, recordPtr);
+			if (recordPtr->status == statusErr)
+				CountSense(analysisPtr, recordPtr);
+			i = FindGroup(analysisPtr, recordPtr, TRUE);
+			if (i < 0) {
+				++analysisPtr->otherRecords;
+				continue;
+			}
+			groupPtr = &analysisPtr->group[i];
+			++groupPtr->commands;
+			groupPtr->bytes += recordPtr->actualTransferCount;
+			if (recordPtr->status != noErr)
+				++groupPtr->failed;
+			if (recordPtr->status == statusErr)
+				++groupPtr->checkConditions;
+			if (recordPtr->busyRetries != 0) {
+				++groupPtr->retried;
+				groupPtr->busyRetries += recordPtr->busyRetries;
+			}
+			groupPtr->totalLatency.lo += recordPtr->latency;
+			if (groupPtr->totalLatency.lo < recordPtr->latency)
+				++groupPtr->totalLatency.hi;			/* Carry				*/
+			if (recordPtr->latency > groupPtr->maxLatency)
+				groupPtr->maxLatency = recordPtr->latency;
+			++groupPtr->histogram[LatencyBin(recordPtr->latency)];
+		}
+		return ((status == eofErr) ? noErr : status);
+}
+
+/*
+ * Find the outliers, now that the percentiles are known.
+ */
+static OSErr
+SecondPass(
+		TraceAnalysisPtr		analysisPtr,
+		TraceReaderPtr			readerPtr
+	)
+{
+		register AnalysisGroupPtr	groupPtr;
+		register short			i;
+		TraceRecordPtr			recordPtr;
+		unsigned long			record;
+		OSErr					status;
+
+		for (i = 0; i < analysisPtr->groupCount; i++) {
+			groupPtr = &analysisPtr->group[i];
+			groupPtr->median = TraceAnalysisPercentile(groupPtr, 500);
+			groupPtr->outlierLatency = TraceAnalysisPercentile(groupPtr, 990);
+			if (groupPtr->outlierLatency
+					 < groupPtr->median * kAnalysisOutlierFactor)
+				groupPtr->outlierLatency =
+					groupPtr->median * kAnalysisOutlierFactor;
+		}
+		for (record = 0;
+				(status = CommandTraceNext(readerPtr, &recordPtr)) == noErr;
+				record++) {
+			i = FindGroup(analysisPtr, recordPtr, FALSE);
+			if (i >= 0
+			 && recordPtr->latency
+					> analysisPtr->group[i].outlierLatency) {
+				++analysisPtr->outliers;
+				KeepOutlier(analysisPtr, record, recordPtr->latency, i);
+			}
+		}
+		return ((status == eofErr) ? noErr : status);
+}
+
+/*
+ * Return the index of the record's group, adding it if create is TRUE, or -1
+ * if there is none.
+ */
+static short
+FindGroup(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr,
+		Boolean					create
+	)
+{
+		register AnalysisGroupPtr	groupPtr;
+		register short			i;
+
+		for (i = 0; i < analysisPtr->groupCount; i++) {
+			groupPtr = &analysisPtr->group[i];
+			if (groupPtr->opcode == recordPtr->cdb[0]
+			 && groupPtr->targetID == recordPtr->targetID
+			 && groupPtr->bus == recordPtr->bus
+			 && groupPtr->LUN == recordPtr->LUN)
+				return (i);
+		}
+		if (create == FALSE || analysisPtr->groupCount >= kAnalysisMaxGroups)
+			return (-1);
+		groupPtr = &analysisPtr->group[analysisPtr->groupCount];
+		groupPtr->bus = recordPtr->bus;
+		groupPtr->targetID = recordPtr->targetID;
+		groupPtr->LUN = recordPtr->LUN;
+		groupPtr->opcode = recordPtr->cdb[0];
+		return (analysisPtr->groupCount++);
+}
+
+static void
+CountSense(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr
+	)
+{
+		register short			i;
+
+		for (i = 0; i < analysisPtr->senseCount; i++) {
+			if (analysisPtr->sense[i].senseKey == recordPtr->senseKey
+			 && analysisPtr->sense[i].senseCode == recordPtr->senseCode
+			 && analysisPtr->sense[i].senseQualifier
+					== recordPtr->senseQualifier)
+				break;
+		}
+		if (i >= kAnalysisMaxSense) {
+			++analysisPtr->otherSense;
+			return;
+		}
+		if (i == analysisPtr->senseCount) {
+			analysisPtr->sense[i].senseKey = recordPtr->senseKey;
+			analysisPtr->sense[i].senseCode = recordPtr->senseCode;
+			analysisPtr->sense[i].senseQualifier = recordPtr->senseQualifier;
+			++analysisPtr->senseCount;
+		}
+		++analysisPtr->sense[i].count;
+}
+
+/*
+ * Count the record in the time slot when it completed. If it is after the
+ * last slot, double the width of the slots, combining each pair.
+ */
+static void
+CountSlot(
+		TraceAnalysisPtr		analysisPtr,
+		const TraceRecord		*recordPtr
+	)
+{
+		register short			i;
+		unsigned long			msec;
+		unsigned long			slot;
+
+		msec = TraceCompletedMsec(recordPtr);
+		if (msec < analysisPtr->lastMsec)
+			msec = analysisPtr->lastMsec;
+		analysisPtr->lastMsec = msec;
+		while (msec / analysisPtr->slotMsec >= kAnalysisSlots) {
+			analysisPtr->slotMsec *= 2;
+			for (i = 0; i < kAnalysisSlots / 2; i++) {
+				analysisPtr->slot[i].commands =
+					analysisPtr->slot[i * 2].commands
+						+ analysisPtr->slot[i * 2 + 1].commands;
+				analysisPtr->slot[i].bytes =
+					analysisPtr->slot[i * 2].bytes
+						+ analysisPtr->slot[i * 2 + 1].bytes;
+			}
+			for (; i < kAnalysisSlots; i++) {
+				analysisPtr->slot[i].commands = 0;
+				analysisPtr->slot[i].bytes = 0;
+			}
+			analysisPtr->slotCount = (analysisPtr->slotCount + 1) / 2;
+		}
+		slot = msec / analysisPtr->slotMsec;
+		if (analysisPtr->slotCount <= slot)
+			analysisPtr->slotCount = slot + 1;
+		++analysisPtr->slot[slot].commands;
+		analysisPtr->slot[slot].bytes += recordPtr->actualTransferCount;
+}
+
+/*
+ * Keep the outliers that are slowest compared with their group's median,
+ * slowest first.
+ */
+static void
+KeepOutlier(
+		TraceAnalysisPtr		analysisPtr,
+		unsigned long			record,
+		unsigned long			latency,
+		short					group
+	)
+{
+		register AnalysisOutlier	*outlierPtr;
+		register short			i;
+		unsigned long			ratio;
+
+		ratio = latency / (analysisPtr->group[group].median + 1);
+		for (i = analysisPtr->outlierCount; i > 0; --i) {
+			outlierPtr = &analysisPtr->outlier[i - 1];
+			if (outlierPtr->latency
+					/ (analysisPtr->group[outlierPtr->group].median + 1)
+					>= ratio)
+				break;
+		}
+		if (i >= kAnalysisMaxOutliers)
+			return;
+		if (analysisPtr->outlierCount < kAnalysisMaxOutliers)
+			++analysisPtr->outlierCount;
+		BlockMove(&analysisPtr->outlier[i], &analysisPtr->outlier[i + 1],
+			(analysisPtr->outlierCount - i - 1) * sizeof (AnalysisOutlier));
+		outlierPtr = &analysisPtr->outlier[i];
+		outlierPtr->record = record;
+		outlierPtr->latency = latency;
+		outlierPtr->group = group;
+}
+
+/*
+ * Latencies below 8 usec have a bin each. Above, each power of two has four
+ * bins: 8-9, 10-11, 12-13, 14-15, then 16-19, 20-23, and so on.
+ */
+static short
+LatencyBin(
+		unsigned long			latency
+	)
+{
+		register short			octave;
+
+		if (latency < 4)
+			return (latency);
+		for (octave = 2;
+				octave < 31 && (latency >> (octave + 1)) != 0;
+				octave++)
+			;
+		return ((octave - 1) * 4 + ((latency >> (octave - 2)) & 3));
+}
+
+/*
+ * Return the lowest latency in a bin.
+ */
+static unsigned long
+BinLatency(
+		short					bin
+	)
+{
+		if (bin < 4)
+			return (bin);
+		return ((4L + (bin & 3)) << (bin / 4 - 1));
+}
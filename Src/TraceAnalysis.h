@@ -0,0 +1,118 @@
+/*									TraceAnalysis.h								*/
+/*
+ * TraceAnalysis.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Analyze a command trace (see CommandTrace.h). TraceAnalyze reads the trace
+ * twice, a block at a time, and keeps only counters, so a trace of any length
+ * is analyzed in a fixed amount of memory:
+ *	-- For each device and command (opcode), the number of commands, bytes,
+ *	   failures, Check Conditions, and Busy retries, and a histogram of the
+ *	   latency, from which the percentiles are computed. The histogram has
+ *	   four bins per power of two, so a percentile is rounded down by at most
+ *	   a quarter.
+ *	-- The number of each sense key, additional sense code, and qualifier.
+ *	-- The commands and bytes in each of kAnalysisSlots time slots. As in the
+ *	   trace index, the slots double in width when the trace outgrows them.
+ * The second pass finds the outliers: commands slower than both their
+ * group's 99th percentile and kAnalysisOutlierFactor times its median. The
+ * slowest of these (compared with the median) are kept.
+ */
+#ifndef __TraceAnalysis__
+#define __TraceAnalysis__
+#include "CommandTrace.h"
+
+#define kAnalysisBins			124				/* See LatencyBin			*/
+#define kAnalysisMaxGroups		64
+#define kAnalysisMaxSense		24
+#define kAnalysisSlots			16
+#define kAnalysisSlotMsec		1000L			/* Before the first doubling	*/
+#define kAnalysisMaxOutliers	8
+#define kAnalysisOutlierFactor	10
+
+/*
+ * The commands with one opcode for one device.
+ */
+struct AnalysisGroup {
+	unsigned char		bus;
+	unsigned char		targetID;
+	unsigned char		LUN;
+	unsigned char		opcode;
+	unsigned long		commands;
+	unsigned long		bytes;					/* Transferred					*/
+	unsigned long		failed;					/* status != noErr				*/
+	unsigned long		checkConditions;		/* status == statusErr			*/
+	unsigned long		retried;				/* Commands with Busy retries	*/
+	unsigned long		busyRetries;
+	UnsignedWide		totalLatency;			/* Microseconds					*/
+	unsigned long		maxLatency;
+	unsigned long		median;					/* Set after the first pass		*/
+	unsigned long		outlierLatency;			/* Outliers are slower			*/
+	unsigned long		histogram[kAnalysisBins];
+};
+typedef struct AnalysisGroup AnalysisGroup, *AnalysisGroupPtr;
+
+struct AnalysisSense {
+	unsigned char		senseKey;
+	unsigned char		senseCode;
+	unsigned char		senseQualifier;
+	unsigned char		reserved;
+	unsigned long		count;
+};
+typedef struct AnalysisSense AnalysisSense;
+
+struct AnalysisSlot {
+	unsigned long		commands;
+	unsigned long		bytes;
+};
+typedef struct AnalysisSlot AnalysisSlot;
+
+struct AnalysisOutlier {
+	unsigned long		record;					/* In the trace, from 0			*/
+	unsigned long		latency;
+	unsigned short		group;					/* Index in group[]				*/
+};
+typedef struct AnalysisOutlier AnalysisOutlier;
+
+struct TraceAnalysis {
+	unsigned long		records;
+	unsigned long		lastMsec;				/* Latest completion			*/
+	unsigned long		otherRecords;			/* Not in a group (overflow)	*/
+	unsigned short		groupCount;
+	AnalysisGroup		group[kAnalysisMaxGroups];
+	unsigned long		otherSense;				/* Not in sense[] (overflow)	*/
+	unsigned short		senseCount;
+	AnalysisSense		sense[kAnalysisMaxSense];
+	unsigned long		slotMsec;				/* Width of a time slot			*/
+	unsigned short		slotCount;
+	AnalysisSlot		slot[kAnalysisSlots];
+	unsigned long		outliers;				/* Found in the second pass		*/
+	unsigned short		outlierCount;			/* Kept in outlier[]			*/
+	AnalysisOutlier		outlier[kAnalysisMaxOutliers];	/* Slowest first		*/
+};
+typedef struct TraceAnalysis TraceAnalysis, *TraceAnalysisPtr;
+
+/*
+ * Analyze the trace file. TraceAnalysis is large: allocate it in the heap.
+ */
+OSErr						TraceAnalyze(
+		TraceAnalysisPtr		analysisPtr,
+		ConstStr255Param		fileName,
+		short					vRefNum
+	);
+/*
+ * Return the latency (in microseconds) that perMille thousandths of a group's
+ * commands did not exceed: 500 for the median, 990 for the 99th percentile.
+ */
+unsigned long				TraceAnalysisPercentile(
+		const AnalysisGroup		*groupPtr,
+		unsigned short			perMille
+	);
+/*
+ * Return the average latency of a group, in microseconds.
+ */
+unsigned long				TraceAnalysisAverage(
+		const AnalysisGroup		*groupPtr
+	);
+
+#endif /* __TraceAnalysis__ */
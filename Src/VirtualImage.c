@@ -0,0 +1,175 @@
+/*									VirtualImage.c								*/
+/*
+ * VirtualImage.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * Attach disk image files to the virtual SCSI bus. See VirtualImage.h. These
+ * functions are called at task level only: the device model itself is
+ * VirtualDiskCommand.
+ */
+#include <Files.h>
+#include "SCSISimpleSample.h"
+
+/*
+ * The latency models: latency (msec), full-stroke seek (msec), and transfer
+ * rate (bytes per msec).
+ */
+struct ImageLatencyModel {
+	unsigned long		latency;
+	unsigned long		fullStrokeSeek;
+	unsigned long		transferRate;
+};
+typedef struct ImageLatencyModel ImageLatencyModel;
+
+static const ImageLatencyModel	gImageLatencyModel[] = {
+	{ 0L,	0L,		0L },						/* kImageModelInstant			*/
+	{ 2L,	0L,		5000L },					/* kImageModelRAMDisk			*/
+	{ 25L,	20L,	2000L }						/* kImageModelHardDisk			*/
+};
+#define kImageLatencyModels	\
+		(sizeof gImageLatencyModel / sizeof gImageLatencyModel[0])
+
+struct VirtualImage {
+	Boolean				attached;
+	short				refNum;					/* The image file				*/
+};
+typedef struct VirtualImage VirtualImage;
+
+static VirtualImage				gVirtualImage[kVirtualMaxTarget];
+
+OSErr
+VirtualImageAttach(
+		unsigned short			targetID,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		unsigned short			latencyModel
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		const ImageLatencyModel	*modelPtr;
+		OSErr					status;
+		short					refNum;
+		Boolean					readOnly;
+		long					count;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr == NULL || latencyModel >= kImageLatencyModels)
+			return (paramErr);
+		if (targetPtr->commandProc != NULL)
+			return (scsiTIDInvalid);				/* Target is in use		*/
+		readOnly = FALSE;
+		status = HOpen(vRefNum, 0L, fileName, fsRdWrPerm, &refNum);
+		if (status == permErr || status == wrPermErr
+		 || status == vLckdErr || status == afpAccessDenied) {
+			readOnly = TRUE;
+			status = HOpen(vRefNum, 0L, fileName, fsRdPerm, &refNum);
+		}
+		if (status != noErr)
+			return (status);
+		status = GetEOF(refNum, &count);
+		if (status == noErr && count < kVirtualBlockLength)
+			status = eofErr;
+		if (status == noErr) {
+			status = VirtualSIMSetTarget(
+						targetID, VirtualDiskCommand, kScsiDevTypeDirect,
+						count / kVirtualBlockLength, 0L, TRUE);
+		}
+		/*
+		 * Read the image (whole blocks only: a partial last block is ignored)
+		 * before setting the latency model. The target exists already, but
+		 * nothing knows about it yet.
+		 */
+		if (status == noErr) {
+			count = targetPtr->blockCount * kVirtualBlockLength;
+			status = SetFPos(refNum, fsFromStart, 0L);
+			if (status == noErr)
+				status = FSRead(refNum, &count, targetPtr->storage);
+			if (status != noErr)
+				(void) VirtualSIMSetTarget(targetID, NULL, 0, 0L, 0L, FALSE);
+		}
+		if (status != noErr) {
+			(void) FSClose(refNum);
+			return (status);
+		}
+		modelPtr = &gImageLatencyModel[latencyModel];
+		targetPtr->latency = modelPtr->latency;
+		targetPtr->fullStrokeSeek = modelPtr->fullStrokeSeek;
+		targetPtr->transferRate = modelPtr->transferRate;
+		targetPtr->readOnly = readOnly;
+		gVirtualImage[targetID].attached = TRUE;
+		gVirtualImage[targetID].refNum = refNum;
+		return (noErr);
+}
+
+/*
+ * The modified flag is cleared before the image is written: a write that
+ * arrives while we are writing sets it again.
+ */
+OSErr
+VirtualImageFlush(
+		unsigned short			targetID
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		OSErr					status;
+		long					count;
+
+		if (VirtualImageAttached(targetID) == FALSE)
+			return (paramErr);
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr->modified == FALSE)
+			return (noErr);
+		targetPtr->modified = FALSE;
+		count = targetPtr->blockCount * kVirtualBlockLength;
+		status = SetFPos(gVirtualImage[targetID].refNum, fsFromStart, 0L);
+		if (status == noErr)
+			status = FSWrite(
+						gVirtualImage[targetID].refNum,
+						&count, targetPtr->storage);
+		if (status != noErr)
+			targetPtr->modified = TRUE;
+		return (status);
+}
+
+/*
+ * The target is removed even if the image can't be written.
+ */
+OSErr
+VirtualImageDetach(
+		unsigned short			targetID
+	)
+{
+		OSErr					status;
+		OSErr					closeStatus;
+
+		if (VirtualImageAttached(targetID) == FALSE)
+			return (paramErr);
+		status = VirtualImageFlush(targetID);
+		(void) VirtualSIMSetTarget(targetID, NULL, 0, 0L, 0L, FALSE);
+		closeStatus = FSClose(gVirtualImage[targetID].refNum);
+		if (status == noErr)
+			status = closeStatus;
+		gVirtualImage[targetID].attached = FALSE;
+		return (status);
+}
+
+void
+VirtualImageDetachAll(void)
+{
+		register unsigned short	targetID;
+
+		for (targetID = 0; targetID < kVirtualMaxTarget; targetID++) {
+			if (gVirtualImage[targetID].attached)
+				(void) VirtualImageDetach(targetID);
+		}
+}
+
+Boolean
+VirtualImageAttached(
+		unsigned short			targetID
+	)
+{
+		return (targetID < kVirtualMaxTarget
+			 && gVirtualImage[targetID].attached
+			 && VirtualSIMGetTarget(targetID) != NULL);
+}
@@ -0,0 +1,67 @@
+/*									VirtualImage.h								*/
+/*
+ * VirtualImage.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * Disk images on the virtual SCSI bus. A disk image file (any file: its
+ * length is taken as the capacity, in 512-byte blocks) is attached as a
+ * direct-access target, so that the block commands (Read Block Zero, the
+ * benchmarks, and so on) can be run against real data without SCSI hardware.
+ *
+ * The device model runs at interrupt level, where it can't call the File
+ * Manager, so the image is read into the target's media storage (in the
+ * System heap) when it is attached, and written back when it is flushed or
+ * detached, if it was changed. The data phase of a Read or Write copies
+ * directly between the image and the caller's buffer. An image that can't be
+ * opened for writing is attached write-protected: writes fail with Data
+ * Protect, and Mode Sense reports it.
+ *
+ * The latency model sets the target's latency, seek, and transfer rate (see
+ * VirtualTarget): the defaults match the virtual bus's RAM disk and seeking
+ * disk.
+ */
+#ifndef __VirtualImage__
+#define __VirtualImage__
+#include "VirtualSIM.h"
+
+enum {
+	kImageModelInstant = 0,				/* No latency at all				*/
+	kImageModelRAMDisk,					/* As virtual target 0				*/
+	kImageModelHardDisk					/* As virtual target 3				*/
+};
+
+/*
+ * Attach the image file as targetID, which must be free. Returns eofErr if
+ * the file is shorter than one block, or memFullErr if the System heap can't
+ * hold it.
+ */
+OSErr						VirtualImageAttach(
+		unsigned short			targetID,
+		ConstStr255Param		fileName,
+		short					vRefNum,
+		unsigned short			latencyModel		/* kImageModelInstant...	*/
+	);
+/*
+ * Write the image back to its file, if it was changed.
+ */
+OSErr						VirtualImageFlush(
+		unsigned short			targetID
+	);
+/*
+ * Flush the image, close its file, and remove the target.
+ */
+OSErr						VirtualImageDetach(
+		unsigned short			targetID
+	);
+/*
+ * Detach every image. This must be called before the virtual bus is removed.
+ */
+void						VirtualImageDetachAll(void);
+/*
+ * Return TRUE if an image is attached as targetID.
+ */
+Boolean						VirtualImageAttached(
+		unsigned short			targetID
+	);
+
+#endif /* __VirtualImage__ */
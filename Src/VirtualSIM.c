@@ -0,0 +1,2131 @@
+/*									VirtualSIM.c								*/
+/*
+ * VirtualSIM.c
+ * Copyright  1994 Apple Computer Inc. All Rights Reserved.
+ *
+ * A software SIM (SCSI Interface Module) for SCSI Manager 4.3. It registers
+ * a virtual bus with SCSIRegisterBus and executes requests to that bus in
+ * memory. See VirtualSIM.h for the public interface.
+ *
+ * The XPT calls VirtualSIMAction for every request to our bus. ExecIO
+ * requests are executed at once (data is copied when the request is issued)
+ * but their completion is delayed by the target's latency, using a Time
+ * Manager task. The bus is modelled very simply:
+ *	-- A target that disconnects releases the bus while it works, so requests
+ *	   to other targets proceed in parallel. Reselecting the initiator when
+ *	   the target is ready costs kVirtualReselectTime, both in latency and
+ *	   in bus time.
+ *	-- A target that does not disconnect holds the bus for its entire latency,
+ *	   and requests that arrive while the bus is held wait for it. A target
+ *	   does not disconnect if the request has scsiDontDisconnect set, or if it
+ *	   was selected without Attention (it was not sent an Identify message,
+ *	   so it was not given permission to disconnect).
+ * The bus is timed in milliseconds, using the Microseconds clock.
+ *
+ * The SIM routines are called by the XPT and the Time Manager, possibly at
+ * interrupt level. They must not move memory, and they do not use application
+ * globals: all of their state is in the SIM static area that the XPT allocates
+ * for us (VirtualSIMGlobals). Because this is application code, however, it
+ * must be held in physical memory if virtual memory is running. As in
+ * AsyncSCSI.c, the held code extends from VirtualSIMInit to NextFunction.
+ *
+ * Note: the Time Manager task finds its request record by recovering the task
+ * pointer from register A1. This is 68000-specific.
+ */
+#include <Memory.h>
+#include <Events.h>
+#include <Errors.h>
+#include <Timer.h>
+#include <Types.h>
+#include <Gestalt.h>
+#include "VirtualSIM.h"
+#include "CoreMacros.h"
+
+/*
+ * This is the number of requests that may be outstanding on the virtual bus.
+ * If all request records are in use, further requests complete at once.
+ */
+#define kMaxVirtualRequests		16
+#define kVirtualSenseLength		18				/* Fixed-format sense data		*/
+#define kVirtualSelectTimeout	250L			/* Default selection timeout	*/
+#define kVirtualReselectTime	2L				/* Msec to reconnect			*/
+#define kVirtualStatusTime		1L				/* Msec to return status only	*/
+/*
+ * The tape drive's buffer hides gaps of up to kVirtualStreamSlack msec between
+ * transfers. After a longer gap, the drive has stopped: the next transfer waits
+ * kVirtualReposition msec while it backs up and comes up to speed.
+ */
+#define kVirtualStreamSlack		10L
+#define kVirtualReposition		120L
+
+enum {
+	kRequestFree = 0,
+	kRequestTimed,								/* Waiting for Time Manager		*/
+	kRequestHung,								/* Target is "hung"				*/
+	kRequestFrozen								/* Waiting for SCSIReleaseQ		*/
+};
+
+typedef struct VirtualSIMGlobals VirtualSIMGlobals, *VirtualSIMGlobalsPtr;
+/*
+ * The Time Manager task must be the first field: the timer task converts
+ * the task pointer to a request pointer.
+ */
+struct VirtualRequest {
+	TMTask					tmTask;				/* Delays the completion		*/
+	VirtualSIMGlobalsPtr	globalsPtr;			/* SIM static variables			*/
+	SCSIExecIOPB			*execIOPBPtr;		/* The request					*/
+	OSErr					result;				/* Final scsiResult				*/
+	unsigned short			state;				/* kRequestFree, etc.			*/
+};
+typedef struct VirtualRequest VirtualRequest, *VirtualRequestPtr;
+
+struct VirtualSIMGlobals {
+	MakeCallbackProc		makeCallback;		/* Completes requests			*/
+	unsigned short			busID;				/* Our bus number				*/
+	unsigned long			busFreeMsec;		/* Bus is held until this time	*/
+	VirtualTarget			target[kVirtualMaxTarget];
+	VirtualRequest			request[kMaxVirtualRequests];
+};
+
+/*
+ * These are used only by the application-level functions (install, remove,
+ * and configure), never by the SIM routines.
+ */
+static SIMInitInfo				gSIMInitInfo;
+static VirtualSIMGlobalsPtr		gVirtualSIMGlobals;		/* NULL if not installed	*/
+static unsigned long			gVirtualSIMCodeSize;	/* Non-zero if held			*/
+
+Boolean							AsyncSCSIPresent(void);
+static void						NextFunction(void);		/* For HoldMemory size	*/
+static Boolean					IsVirtualMemoryRunning(void);
+static OSErr					VirtualSIMInit(
+		Ptr						SIMinfoPtr
+	);
+static void						VirtualSIMAction(
+		void					*scsiPB,
+		Ptr						SIMGlobals
+	);
+static long						VirtualSIMInterruptPoll(
+		Ptr						SIMGlobals
+	);
+static Boolean					ExecuteIO(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+static void						SelectTimeout(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	);
+static VirtualFaultPtr			NextFault(
+		VirtualTargetPtr		targetPtr
+	);
+static unsigned long			NowMsec(void);
+static unsigned long			ReserveBus(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		unsigned long			startDelay,
+		unsigned long			busTime
+	);
+static void						QueueRequest(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		unsigned short			state,
+		OSErr					result,
+		unsigned long			delay
+	);
+static pascal void				VirtualTimerTask(void);
+static void						CompleteRequest(
+		VirtualRequestPtr		requestPtr,
+		OSErr					result
+	);
+static void						CompleteMatchingRequests(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		short					targetID,
+		OSErr					result
+	);
+static void						FinishPB(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		void					*scsiPB,
+		OSErr					result
+	);
+static unsigned char			RequestSenseCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	);
+static void						DecodeTransfer(
+		const SCSI_Command		*scsiCommand,
+		unsigned long			*logicalBlock,
+		unsigned long			*blockCount
+	);
+static void						BuildInquiry(
+		VirtualTargetPtr		targetPtr,
+		const char				*product,
+		Boolean					removable,
+		SCSI_Inquiry_Data		*inquiryPtr
+	);
+static void						StoreTOCEntry(
+		unsigned char			*entryPtr,
+		unsigned char			track,
+		unsigned long			logicalBlock,
+		Boolean					msf
+	);
+static void						ModelSeek(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			logicalBlock,
+		unsigned long			blockCount,
+		unsigned long			capacity
+	);
+static void						LoadMedia(
+		VirtualTargetPtr		targetPtr,
+		Boolean					attention
+	);
+static Boolean					RemovableReady(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			opcode,
+		Boolean					needsMedia
+	);
+static Boolean					RemoveMedia(
+		VirtualTargetPtr		targetPtr
+	);
+static unsigned long			TapeRecords(
+		VirtualTargetPtr		targetPtr,
+		Boolean					*filemarkPtr
+	);
+static unsigned char			TapeStopped(
+		VirtualTargetPtr		targetPtr,
+		Boolean					filemark,
+		unsigned long			residue
+	);
+static void						TapeTruncate(
+		VirtualTargetPtr		targetPtr
+	);
+static unsigned char			TapeSpace(
+		VirtualTargetPtr		targetPtr,
+		unsigned short			code,
+		long					count
+	);
+static void						TapeSense(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseQualifier,
+		unsigned long			residue
+	);
+static void						TapeStream(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			byteCount
+	);
+static void						TapeWind(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			newPosition
+	);
+static void						CopyVendorString(
+		char					*dst,
+		const char				*src,
+		short					length
+	);
+/*
+ * GetA1 returns the Time Manager task pointer (passed in register A1).
+ */
+pascal long						GetA1(void) = 0x2E89;	/* MOVE.L A1,(SP)	*/
+
+/*
+ * Install the virtual bus.
+ */
+OSErr
+VirtualSIMInstall(void)
+{
+		OSErr					status;
+		register short			i;
+		VirtualRequestPtr		requestPtr;
+
+		if (gVirtualSIMGlobals != NULL)
+			return (noErr);
+		if (AsyncSCSIPresent() == FALSE)
+			return (unimpErr);
+		/*
+		 * The SIM code is called at interrupt level: hold it if virtual
+		 * memory is running. (The SIM static area is allocated by the XPT
+		 * in the System heap, which is always held.)
+		 */
+		status = noErr;
+		gVirtualSIMCodeSize = 0;
+		if (IsVirtualMemoryRunning()) {
+			gVirtualSIMCodeSize =
+				(unsigned long) NextFunction - (unsigned long) VirtualSIMInit;
+			status = HoldMemory(VirtualSIMInit, gVirtualSIMCodeSize);
+			if (status != noErr) {
+				gVirtualSIMCodeSize = 0;
+				return (status);
+			}
+		}
+		CLEAR(gSIMInitInfo);
+		gSIMInitInfo.staticSize = sizeof (VirtualSIMGlobals);
+		gSIMInitInfo.SIMInit = VirtualSIMInit;
+		gSIMInitInfo.SIMAction = VirtualSIMAction;
+		gSIMInitInfo.SIMInterruptPoll = VirtualSIMInterruptPoll;
+		gSIMInitInfo.ioPBSize = sizeof (SCSIExecIOPB);
+		gSIMInitInfo.oldCallCapable = FALSE;
+		status = SCSIRegisterBus(&gSIMInitInfo);
+		if (status != noErr) {
+			if (gVirtualSIMCodeSize != 0)
+				(void) UnholdMemory(VirtualSIMInit, gVirtualSIMCodeSize);
+			gVirtualSIMCodeSize = 0;
+			return (status);
+		}
+		gVirtualSIMGlobals = (VirtualSIMGlobalsPtr) gSIMInitInfo.SIMstaticPtr;
+		gVirtualSIMGlobals->busID = gSIMInitInfo.busID;
+		gVirtualSIMGlobals->makeCallback = gSIMInitInfo.MakeCallback;
+		/*
+		 * Install the Time Manager tasks. They are primed for each request.
+		 */
+		for (i = 0; i < kMaxVirtualRequests; i++) {
+			requestPtr = &gVirtualSIMGlobals->request[i];
+			requestPtr->globalsPtr = gVirtualSIMGlobals;
+			requestPtr->tmTask.tmAddr = (ProcPtr) VirtualTimerTask;
+			InsTime((QElemPtr) &requestPtr->tmTask);
+		}
+		/*
+		 * The default population: a small, fast, RAM disk, and a larger, slow,
+		 * disk without media storage that models seek time. Both disconnect
+		 * (unless they are told not to), although it only pays for the slow
+		 * disk.
+		 */
+		status = VirtualSIMSetTarget(
+					0, VirtualDiskCommand, kScsiDevTypeDirect,
+					512L, 2L, TRUE
+				);
+		if (status == noErr)
+			status = VirtualSIMSetTarget(
+					3, VirtualDiskCommand, kScsiDevTypeDirect,
+					0L, 25L, TRUE
+				);
+		if (status == noErr) {
+			gVirtualSIMGlobals->target[0].transferRate = 5000L;	/* 5 MB/sec	*/
+			gVirtualSIMGlobals->target[3].blockCount = 80000L;
+			gVirtualSIMGlobals->target[3].fullStrokeSeek = 20L;
+			gVirtualSIMGlobals->target[3].transferRate = 2000L;	/* 2 MB/sec	*/
+		}
+		if (status != noErr)
+			VirtualSIMRemove();
+		return (status);
+}
+
+/*
+ * Complete all outstanding requests and remove the virtual bus.
+ */
+void
+VirtualSIMRemove(void)
+{
+		register short			i;
+		SCSI_PB					deregisterPB;
+
+		if (gVirtualSIMGlobals == NULL)
+			return;
+		CompleteMatchingRequests(
+			gVirtualSIMGlobals, NULL, -1, scsiSCSIBusReset);
+		for (i = 0; i < kMaxVirtualRequests; i++)
+			RmvTime((QElemPtr) &gVirtualSIMGlobals->request[i].tmTask);
+		for (i = 0; i < kVirtualMaxTarget; i++)
+			(void) VirtualSIMSetTarget(i, NULL, 0, 0L, 0L, FALSE);
+		CLEAR(deregisterPB);
+		deregisterPB.scsiPBLength = sizeof deregisterPB;
+		deregisterPB.scsiDevice.bus = gVirtualSIMGlobals->busID;
+		(void) SCSIDeregisterBus(&deregisterPB);
+		gVirtualSIMGlobals = NULL;
+		if (gVirtualSIMCodeSize != 0)
+			(void) UnholdMemory(VirtualSIMInit, gVirtualSIMCodeSize);
+		gVirtualSIMCodeSize = 0;
+}
+
+Boolean
+VirtualSIMBusID(
+		unsigned short			*busID
+	)
+{
+		if (gVirtualSIMGlobals != NULL)
+			*busID = gVirtualSIMGlobals->busID;
+		return (gVirtualSIMGlobals != NULL);
+}
+
+/*
+ * Configure (or remove) a target.
+ */
+OSErr
+VirtualSIMSetTarget(
+		unsigned short			targetID,
+		VirtualCommandProc		commandProc,
+		unsigned char			deviceType,
+		unsigned long			blockCount,
+		unsigned long			latency,			/* msec					*/
+		Boolean					disconnects
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		OSErr						status;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr == NULL)
+			return (paramErr);
+		if (targetPtr->storage != NULL)
+			DisposePtr(targetPtr->storage);
+		CLEAR(*targetPtr);
+		status = noErr;
+		if (commandProc != NULL) {
+			if (blockCount != 0) {
+				targetPtr->storage =
+					NewPtrSysClear(blockCount * kVirtualBlockLength);
+				if (targetPtr->storage == NULL)
+					status = memFullErr;
+			}
+			if (status == noErr) {
+				targetPtr->deviceType = deviceType;
+				targetPtr->blockCount = blockCount;
+				targetPtr->latency = latency;
+				targetPtr->disconnects = disconnects;
+				/*
+				 * Set commandProc last: the target does not exist until then.
+				 */
+				targetPtr->commandProc = commandProc;
+			}
+		}
+		return (status);
+}
+
+VirtualTargetPtr
+VirtualSIMGetTarget(
+		unsigned short			targetID
+	)
+{
+		if (gVirtualSIMGlobals == NULL || targetID >= kVirtualMaxTarget)
+			return (NULL);
+		return (&gVirtualSIMGlobals->target[targetID]);
+}
+
+void
+VirtualSIMInjectError(
+		unsigned short			targetID,
+		unsigned short			count,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseCode
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr != NULL) {
+			targetPtr->injectSenseKey = senseKey;
+			targetPtr->injectSenseCode = additionalSenseCode;
+			targetPtr->injectCount = count;
+		}
+}
+
+OSErr
+VirtualSIMAddFault(
+		unsigned short			targetID,
+		const VirtualFault		*faultPtr
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		register VirtualFaultPtr	rulePtr;
+		register short			i;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr == NULL || targetPtr->commandProc == NULL)
+			return (paramErr);
+		for (i = 0; i < kVirtualMaxFaults; i++) {
+			rulePtr = &targetPtr->fault[i];
+			if (rulePtr->kind == kVirtualFaultNone) {
+				rulePtr->probability = faultPtr->probability;
+				rulePtr->period = faultPtr->period;
+				rulePtr->burst = faultPtr->burst;
+				rulePtr->limit = faultPtr->limit;
+				rulePtr->delay = faultPtr->delay;
+				rulePtr->injected = 0;
+				rulePtr->sequence = 0;
+				rulePtr->stormLeft = 0;
+				/*
+				 * Set kind last: the SIM ignores the rule until then.
+				 */
+				rulePtr->kind = faultPtr->kind;
+				return (noErr);
+			}
+		}
+		return (paramErr);
+}
+
+void
+VirtualSIMClearFaults(
+		unsigned short			targetID,
+		unsigned long			seed
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		register short			i;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr != NULL) {
+			for (i = 0; i < kVirtualMaxFaults; i++)
+				targetPtr->fault[i].kind = kVirtualFaultNone;
+			targetPtr->faultSeed = seed;
+			targetPtr->faults = 0;
+		}
+}
+
+void
+VirtualSIMHangTarget(
+		unsigned short			targetID,
+		Boolean					hung
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr != NULL)
+			targetPtr->hung = hung;
+}
+
+OSErr
+VirtualSIMSetMedia(
+		unsigned short			targetID,
+		Boolean					present
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+
+		targetPtr = VirtualSIMGetTarget(targetID);
+		if (targetPtr == NULL || targetPtr->commandProc == NULL)
+			return (paramErr);
+		if (present) {
+			if (targetPtr->mediaPresent == FALSE)
+				LoadMedia(targetPtr, TRUE);
+		}
+		else if (targetPtr->mediaPresent && RemoveMedia(targetPtr) == FALSE)
+			return (fBsyErr);
+		return (noErr);
+}
+
+/*
+ * The SIM routines start here. Everything from here to NextFunction is held
+ * in physical memory while the bus is installed.
+ */
+static OSErr
+VirtualSIMInit(
+		Ptr						SIMinfoPtr
+	)
+{
+		SIMInitInfo				*infoPtr;
+		VirtualSIMGlobalsPtr	globalsPtr;
+
+		infoPtr = (SIMInitInfo *) SIMinfoPtr;
+		globalsPtr = (VirtualSIMGlobalsPtr) infoPtr->SIMstaticPtr;
+		CLEAR(*globalsPtr);
+		globalsPtr->busID = infoPtr->busID;
+		globalsPtr->makeCallback = infoPtr->MakeCallback;
+		return (noErr);
+}
+
+/*
+ * The XPT calls this for every request to the virtual bus.
+ */
+static void
+VirtualSIMAction(
+		void					*scsiPB,
+		Ptr						SIMGlobals
+	)
+{
+		VirtualSIMGlobalsPtr	globalsPtr;
+		SCSIHdr					*hdrPtr;
+		SCSIBusInquiryPB		*inquiryPtr;
+		SCSIAbortCommandPB		*abortPtr;
+		SCSIExecIOPB			*execIOPBPtr;
+		Boolean					linkOK;
+		OSErr					result;
+
+		globalsPtr = (VirtualSIMGlobalsPtr) SIMGlobals;
+		hdrPtr = (SCSIHdr *) scsiPB;
+		result = noErr;
+		switch (hdrPtr->scsiFunctionCode) {
+		case SCSIExecIO:
+			/*
+			 * A linked command chain is passed as one request: its parameter
+			 * blocks are chained through scsiCommandLink. If a command fails,
+			 * the link is broken and the rest of the chain is not executed.
+			 */
+			execIOPBPtr = (SCSIExecIOPB *) scsiPB;
+			linkOK = TRUE;
+			while (execIOPBPtr != NULL) {
+				if (linkOK)
+					linkOK = ExecuteIO(globalsPtr, execIOPBPtr);
+				else {
+					FinishPB(globalsPtr, execIOPBPtr, scsiRequestAborted);
+				}
+				if ((execIOPBPtr->scsiFlags & scsiCDBLinked) == 0)
+					break;
+				execIOPBPtr = (SCSIExecIOPB *) execIOPBPtr->scsiCommandLink;
+			}
+			return;							/* ExecuteIO completes the PB	*/
+		case SCSIBusInquiry:
+			inquiryPtr = (SCSIBusInquiryPB *) scsiPB;
+			inquiryPtr->scsiEngineCount = 0;
+			inquiryPtr->scsiMaxTransferType = 1;
+			inquiryPtr->scsiDataTypes = scsiBusDataBuffer;
+			inquiryPtr->scsiIOpbSize = sizeof (SCSIExecIOPB);
+			inquiryPtr->scsiMaxIOpbSize = sizeof (SCSIExecIOPB);
+			inquiryPtr->scsiFeatureFlags = scsiBusInternal;
+			inquiryPtr->scsiVersionNumber = 1;
+			inquiryPtr->scsiHBAInquiry = scsiBusLinkedCDB;
+			inquiryPtr->scsiInitiatorID = kVirtualInitiatorID;
+			inquiryPtr->scsiFlagsSupported = 0xFFFFFFFFL;
+			inquiryPtr->scsiIOFlagsSupported = 0xFFFF;
+			inquiryPtr->scsiWeirdStuff = scsiTargetDrivenSDTRSafe;
+			inquiryPtr->scsiMaxTarget = kVirtualMaxTarget;
+			inquiryPtr->scsiMaxLUN = 7;
+			CopyVendorString(
+				inquiryPtr->scsiSIMVendor, "Sample", vendorIDLength);
+			CopyVendorString(
+				inquiryPtr->scsiHBAVendor, "Sample", vendorIDLength);
+			CopyVendorString(
+				inquiryPtr->scsiControllerFamily, "Virtual", vendorIDLength);
+			CopyVendorString(
+				inquiryPtr->scsiControllerType, "VirtualSIM", vendorIDLength);
+			CopyVendorString(inquiryPtr->scsiSIMversion, "1.0", 4);
+			CopyVendorString(inquiryPtr->scsiHBAversion, "1.0", 4);
+			break;
+		case SCSIAbortCommand:
+			abortPtr = (SCSIAbortCommandPB *) scsiPB;
+			result = scsiUnableToAbort;
+			if (abortPtr->scsiIOptr != NULL) {
+				/*
+				 * CompleteMatchingRequests doesn't tell us whether it found
+				 * the request, so check whether the request was completed.
+				 */
+				CompleteMatchingRequests(
+					globalsPtr, abortPtr->scsiIOptr, -1, scsiRequestAborted);
+				if (abortPtr->scsiIOptr->scsiResult != scsiRequestInProgress)
+					result = noErr;
+			}
+			break;
+		case SCSIResetDevice:
+			if (hdrPtr->scsiDevice.targetID < kVirtualMaxTarget) {
+				globalsPtr->target[hdrPtr->scsiDevice.targetID].hung = FALSE;
+				globalsPtr->target[hdrPtr->scsiDevice.targetID].frozen = FALSE;
+				CompleteMatchingRequests(
+					globalsPtr, NULL, hdrPtr->scsiDevice.targetID, scsiBDRsent);
+			}
+			break;
+		case SCSIResetBus:
+			CompleteMatchingRequests(globalsPtr, NULL, -1, scsiSCSIBusReset);
+			break;
+		case SCSIReleaseQ:
+			if (hdrPtr->scsiDevice.targetID < kVirtualMaxTarget) {
+				register short			i;
+				VirtualRequestPtr		requestPtr;
+
+				globalsPtr->target[hdrPtr->scsiDevice.targetID].frozen = FALSE;
+				/*
+				 * Restart requests that were waiting for the queue release.
+				 */
+				for (i = 0; i < kMaxVirtualRequests; i++) {
+					requestPtr = &globalsPtr->request[i];
+					if (requestPtr->state == kRequestFrozen
+					 && requestPtr->execIOPBPtr->scsiDevice.targetID
+							== hdrPtr->scsiDevice.targetID) {
+						requestPtr->state = kRequestFree;
+						(void) ExecuteIO(globalsPtr, requestPtr->execIOPBPtr);
+					}
+				}
+			}
+			break;
+		default:
+			result = scsiFunctionNotAvailable;
+			break;
+		}
+		FinishPB(globalsPtr, scsiPB, result);
+}
+
+/*
+ * We have no hardware, hence no interrupts to poll.
+ */
+static long
+VirtualSIMInterruptPoll(
+		Ptr						SIMGlobals
+	)
+{
+		return (0);
+}
+
+/*
+ * Execute one SCSIExecIO request. Returns TRUE if the command completed
+ * successfully: if it is linked, the next command in the chain may start.
+ */
+static Boolean
+ExecuteIO(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		register VirtualTargetPtr	targetPtr;
+		SCSI_Command			scsiCommand;
+		register unsigned char	*cdbPtr;
+		register short			i;
+		Ptr						dataPtr;
+		unsigned long			dataLength;
+		unsigned long			actualCount;
+		unsigned char			statusByte;
+		OSErr					result;
+		unsigned long			delay;
+		unsigned long			transferTime;
+		Boolean					disconnect;
+		register VirtualFaultPtr	faultPtr;
+#define PB						(*execIOPBPtr)
+
+		PB.scsiResultFlags = 0;
+		PB.scsiSCSIstatus = kScsiStatusGood;
+		PB.scsiDataResidual = 0;
+		if (PB.scsiDevice.targetID >= kVirtualMaxTarget
+		 || globalsPtr->target[PB.scsiDevice.targetID].commandProc == NULL) {
+			SelectTimeout(globalsPtr, execIOPBPtr);
+			return (FALSE);
+		}
+		targetPtr = &globalsPtr->target[PB.scsiDevice.targetID];
+		if (targetPtr->frozen) {
+			QueueRequest(globalsPtr, execIOPBPtr, kRequestFrozen, noErr, 0);
+			return (FALSE);
+		}
+		if (targetPtr->hung) {
+			QueueRequest(globalsPtr, execIOPBPtr, kRequestHung, noErr, 0);
+			return (FALSE);
+		}
+		if (PB.scsiCDBLength == 0 || PB.scsiCDBLength > sizeof scsiCommand) {
+			FinishPB(globalsPtr, execIOPBPtr, scsiCDBLengthInvalid);
+			return (FALSE);
+		}
+		CLEAR(scsiCommand);
+		cdbPtr = ((PB.scsiFlags & scsiCDBIsPointer) != 0)
+				? PB.scsiCDB.cdbPtr
+				: PB.scsiCDB.cdbBytes;
+		for (i = 0; i < PB.scsiCDBLength; i++)
+			scsiCommand.scsi[i] = cdbPtr[i];
+		dataPtr = NULL;
+		dataLength = 0;
+		if ((PB.scsiFlags & scsiDirectionMask) != scsiDirectionNone) {
+			if (PB.scsiDataType != scsiDataBuffer) {
+				FinishPB(globalsPtr, execIOPBPtr, scsiDataTypeInvalid);
+				return (FALSE);
+			}
+			dataPtr = (Ptr) PB.scsiDataPtr;
+			dataLength = PB.scsiDataLength;
+		}
+		/*
+		 * Apply the target's fault rules. Faults that prevent the command
+		 * from executing complete the request here; the others are handled
+		 * with the command.
+		 */
+		faultPtr = NULL;
+		if (scsiCommand.scsi[0] != kScsiCmdRequestSense
+		 && PB.scsiDevice.LUN == 0
+		 && targetPtr->injectCount == 0)
+			faultPtr = NextFault(targetPtr);
+		if (faultPtr != NULL) {
+			delay = faultPtr->delay;
+			switch (faultPtr->kind) {
+			case kVirtualFaultSelectTimeout:
+				SelectTimeout(globalsPtr, execIOPBPtr);
+				return (FALSE);
+			case kVirtualFaultTimeout:
+				/*
+				 * The target holds on to the bus, as a hung target would.
+				 */
+				if (delay == 0)
+					QueueRequest(
+						globalsPtr, execIOPBPtr, kRequestHung, noErr, 0);
+				else {
+					delay += ReserveBus(globalsPtr, 0L, delay);
+					QueueRequest(
+						globalsPtr, execIOPBPtr, kRequestTimed,
+						scsiCommandTimeout, delay);
+				}
+				return (FALSE);
+			case kVirtualFaultBusy:
+			case kVirtualFaultQueueFull:
+			case kVirtualFaultPhaseError:
+				/*
+				 * The target goes to the status phase (or to a phase that we
+				 * don't expect) as soon as it is selected.
+				 */
+				if (faultPtr->kind == kVirtualFaultPhaseError)
+					result = scsiSequenceFailed;
+				else {
+					PB.scsiSCSIstatus = (faultPtr->kind == kVirtualFaultBusy)
+								? kScsiStatusBusy
+								: kScsiStatusQueueFull;
+					result = scsiNonZeroStatus;
+				}
+				PB.scsiDataResidual = dataLength;
+				if ((PB.scsiFlags & scsiSIMQNoFreeze) == 0) {
+					PB.scsiResultFlags |= scsiSIMQFrozen;
+					targetPtr->frozen = TRUE;
+				}
+				delay += kVirtualStatusTime + ReserveBus(
+						globalsPtr, faultPtr->delay, kVirtualStatusTime);
+				QueueRequest(
+					globalsPtr, execIOPBPtr, kRequestTimed, result, delay);
+				return (FALSE);
+			default:								/* With the command		*/
+				break;
+			}
+		}
+		/*
+		 * Execute the command. Request Sense and error injection are handled
+		 * here, for all device models.
+		 */
+		++targetPtr->commands;
+		actualCount = 0;
+		if (scsiCommand.scsi[0] == kScsiCmdRequestSense) {
+			statusByte = RequestSenseCommand(
+						targetPtr, &scsiCommand,
+						dataPtr, dataLength, &actualCount);
+		}
+		else if (PB.scsiDevice.LUN != 0) {
+			/*
+			 * Our targets have only one logical unit.
+			 */
+			if (scsiCommand.scsi[0] == kScsiCmdInquiry && dataLength > 0) {
+				dataPtr[0] = kScsiDevTypeMissing;
+				actualCount = 1;
+				statusByte = kScsiStatusGood;
+			}
+			else {
+				VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x25, 0);
+				statusByte = kScsiStatusCheckCondition;
+			}
+		}
+		else if (targetPtr->injectCount != 0) {
+			--targetPtr->injectCount;
+			VirtualSIMSetSense(targetPtr,
+				targetPtr->injectSenseKey, targetPtr->injectSenseCode, 0);
+			statusByte = kScsiStatusCheckCondition;
+		}
+		else if (faultPtr != NULL && faultPtr->kind != kVirtualFaultUnderrun) {
+			if (faultPtr->kind == kVirtualFaultUnitAttention)
+				VirtualSIMSetSense(targetPtr, kScsiSenseUnitAtn, 0x29, 0);
+			else {
+				VirtualSIMSetSense(targetPtr, kScsiSenseMediumErr, 0x11, 0);
+			}
+			targetPtr->modelDelay = faultPtr->delay;
+			statusByte = kScsiStatusCheckCondition;
+		}
+		else {
+			targetPtr->modelDelay = 0;
+			statusByte = (*targetPtr->commandProc)(
+						targetPtr, &scsiCommand,
+						dataPtr, dataLength, &actualCount);
+			if (faultPtr != NULL) {					/* Under-run			*/
+				actualCount /= 2;
+				targetPtr->modelDelay += faultPtr->delay;
+			}
+		}
+		/*
+		 * A linked command that succeeds returns Intermediate status.
+		 */
+		if (statusByte == kScsiStatusGood
+		 && (PB.scsiFlags & scsiCDBLinked) != 0
+		 && (scsiCommand.scsi[PB.scsiCDBLength - 1] & kScsiControlLink) != 0)
+			statusByte = kScsiStatusIntermediate;
+		/*
+		 * Set the result fields as a hardware SIM would.
+		 */
+		targetPtr->bytesTransferred += actualCount;
+		PB.scsiSCSIstatus = statusByte;
+		PB.scsiDataResidual = dataLength - actualCount;
+		result = noErr;
+		if (statusByte == kScsiStatusCheckCondition) {
+			++targetPtr->checkConditions;
+			result = scsiNonZeroStatus;
+			if ((PB.scsiFlags & scsiDisableAutosense) == 0
+			 && PB.scsiSensePtr != NULL
+			 && targetPtr->senseValid) {
+				i = (PB.scsiSenseLength < kVirtualSenseLength)
+					? PB.scsiSenseLength
+					: kVirtualSenseLength;
+				BlockMove((Ptr) &targetPtr->sense, (Ptr) PB.scsiSensePtr, i);
+				PB.scsiSenseResidual = PB.scsiSenseLength - i;
+				PB.scsiResultFlags |= scsiAutosenseValid;
+				targetPtr->senseValid = FALSE;
+			}
+		}
+		else if (statusByte != kScsiStatusGood
+			  && statusByte != kScsiStatusIntermediate)
+			result = scsiNonZeroStatus;
+		else if (PB.scsiDataResidual != 0)
+			result = scsiDataRunError;
+		if (result != noErr && (PB.scsiFlags & scsiSIMQNoFreeze) == 0) {
+			PB.scsiResultFlags |= scsiSIMQFrozen;
+			targetPtr->frozen = TRUE;
+		}
+		/*
+		 * Compute the delay. If the target does not disconnect, it holds the
+		 * bus for the entire command. If it does, it releases the bus while
+		 * it works, and needs it again only to reselect and transfer the data.
+		 * Either way, the request must wait until the bus is free when it
+		 * needs it, and other requests must wait for it.
+		 */
+		delay = targetPtr->latency + targetPtr->modelDelay;
+		targetPtr->modelDelay = 0;
+		transferTime = 0;
+		if (targetPtr->transferRate != 0)
+			transferTime = actualCount / targetPtr->transferRate;
+		disconnect =
+				targetPtr->disconnects
+				&& (PB.scsiFlags & scsiDontDisconnect) == 0
+				&& (PB.scsiIOFlags & scsiDisableSelectWAtn) == 0;
+		if (disconnect == FALSE) {
+			delay += transferTime;
+			delay += ReserveBus(globalsPtr, 0L, delay);
+		}
+		else {
+			/*
+			 * The target reselects us for the data transfer.
+			 */
+			transferTime += kVirtualReselectTime;
+			delay += transferTime + ReserveBus(globalsPtr, delay, transferTime);
+		}
+		if (delay == 0)
+			FinishPB(globalsPtr, execIOPBPtr, result);
+		else {
+			QueueRequest(globalsPtr, execIOPBPtr, kRequestTimed, result, delay);
+		}
+		return (result == noErr);
+#undef PB
+}
+
+/*
+ * Selecting a missing target times out. The bus stays in the selection phase
+ * until then, so nothing else can use it: this is what makes a bus scan
+ * expensive.
+ */
+static void
+SelectTimeout(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr
+	)
+{
+		unsigned long			delay;
+
+		delay = (execIOPBPtr->scsiSelectTimeout != 0)
+				? execIOPBPtr->scsiSelectTimeout
+				: kVirtualSelectTimeout;
+		delay += ReserveBus(globalsPtr, 0L, delay);
+		QueueRequest(
+			globalsPtr, execIOPBPtr, kRequestTimed, scsiSelectTimeout, delay);
+}
+
+/*
+ * Return the fault rule that fires for this command, or NULL. Every rule
+ * counts the command, even if an earlier rule fires, so that each schedule
+ * is independent of the others. The random number generator is the usual
+ * linear congruential one: it is cheap, and safe at interrupt level.
+ */
+static VirtualFaultPtr
+NextFault(
+		VirtualTargetPtr		targetPtr
+	)
+{
+		register VirtualFaultPtr	rulePtr;
+		VirtualFaultPtr			firedPtr;
+		register short			i;
+		unsigned short			burst;
+		Boolean					fires;
+
+		firedPtr = NULL;
+		for (i = 0; i < kVirtualMaxFaults; i++) {
+			rulePtr = &targetPtr->fault[i];
+			if (rulePtr->kind == kVirtualFaultNone
+			 || (rulePtr->limit != 0 && rulePtr->injected >= rulePtr->limit))
+				continue;
+			burst = (rulePtr->burst == 0) ? 1 : rulePtr->burst;
+			if (rulePtr->period != 0)
+				fires = (rulePtr->sequence % rulePtr->period) < burst;
+			else if (rulePtr->stormLeft != 0) {
+				--rulePtr->stormLeft;
+				fires = TRUE;
+			}
+			else {
+				targetPtr->faultSeed =
+					targetPtr->faultSeed * 1103515245L + 12345L;
+				fires = ((targetPtr->faultSeed >> 16) & 0x7FFF) % 1000
+						< rulePtr->probability;
+				if (fires)
+					rulePtr->stormLeft = burst - 1;
+			}
+			++rulePtr->sequence;
+			if (fires && firedPtr == NULL) {
+				++rulePtr->injected;
+				++targetPtr->faults;
+				firedPtr = rulePtr;
+			}
+		}
+		return (firedPtr);
+}
+
+/*
+ * Return the time in milliseconds. Ticks are too coarse to model a bus:
+ * a fast device's command is a fraction of a Tick. 2^32 microseconds is
+ * 4294967.296 msec; the fraction is ignored.
+ */
+static unsigned long
+NowMsec(void)
+{
+		UnsignedWide			microseconds;
+
+		Microseconds(&microseconds);
+		return (microseconds.hi * 4294967L + microseconds.lo / 1000L);
+}
+
+/*
+ * Reserve the bus for busTime msec, starting startDelay msec from now, or
+ * when the bus is next free if that is later. Returns the additional wait
+ * (in msec).
+ */
+static unsigned long
+ReserveBus(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		unsigned long			startDelay,
+		unsigned long			busTime
+	)
+{
+		unsigned long			startMsec;
+		unsigned long			wait;
+
+		if (busTime == 0)
+			return (0);
+		startMsec = NowMsec() + startDelay;
+		wait = 0;
+		if (globalsPtr->busFreeMsec > startMsec) {
+			wait = globalsPtr->busFreeMsec - startMsec;
+			startMsec = globalsPtr->busFreeMsec;
+		}
+		globalsPtr->busFreeMsec = startMsec + busTime;
+		return (wait);
+}
+
+/*
+ * Remember an outstanding request. If it is timed, start its Time Manager
+ * task. If there are no free request records, the request completes at once.
+ */
+static void
+QueueRequest(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		unsigned short			state,
+		OSErr					result,
+		unsigned long			delay
+	)
+{
+		register short			i;
+		register VirtualRequestPtr	requestPtr;
+
+		for (i = 0; i < kMaxVirtualRequests; i++) {
+			requestPtr = &globalsPtr->request[i];
+			if (requestPtr->state == kRequestFree) {
+				requestPtr->execIOPBPtr = execIOPBPtr;
+				requestPtr->result = result;
+				requestPtr->state = state;
+				if (state == kRequestTimed)
+					PrimeTime((QElemPtr) &requestPtr->tmTask, (long) delay);
+				return;
+			}
+		}
+		FinishPB(globalsPtr, execIOPBPtr,
+			(state == kRequestTimed) ? result : scsiBusy);
+}
+
+/*
+ * Called by the Time Manager when a request's latency has elapsed.
+ */
+static pascal void
+VirtualTimerTask(void)
+{
+		register VirtualRequestPtr	requestPtr;
+
+		requestPtr = (VirtualRequestPtr) GetA1();
+		if (requestPtr->state == kRequestTimed)
+			CompleteRequest(requestPtr, requestPtr->result);
+}
+
+static void
+CompleteRequest(
+		VirtualRequestPtr		requestPtr,
+		OSErr					result
+	)
+{
+		SCSIExecIOPB			*execIOPBPtr;
+
+		execIOPBPtr = requestPtr->execIOPBPtr;
+		requestPtr->execIOPBPtr = NULL;
+		requestPtr->state = kRequestFree;
+		FinishPB(requestPtr->globalsPtr, execIOPBPtr, result);
+}
+
+/*
+ * Complete outstanding requests with the given result. If execIOPBPtr is not
+ * NULL, only that request is completed; if targetID is not -1, only requests
+ * to that target; otherwise, all requests. Pending Time Manager tasks are
+ * cancelled by removing and re-installing them.
+ */
+static void
+CompleteMatchingRequests(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		SCSIExecIOPB			*execIOPBPtr,
+		short					targetID,
+		OSErr					result
+	)
+{
+		register short			i;
+		register VirtualRequestPtr	requestPtr;
+
+		for (i = 0; i < kMaxVirtualRequests; i++) {
+			requestPtr = &globalsPtr->request[i];
+			if (requestPtr->state != kRequestFree
+			 && (execIOPBPtr == NULL || requestPtr->execIOPBPtr == execIOPBPtr)
+			 && (targetID < 0
+			  || requestPtr->execIOPBPtr->scsiDevice.targetID == targetID)) {
+				if (requestPtr->state == kRequestTimed) {
+					RmvTime((QElemPtr) &requestPtr->tmTask);
+					InsTime((QElemPtr) &requestPtr->tmTask);
+				}
+				CompleteRequest(requestPtr, result);
+			}
+		}
+		if (result == scsiSCSIBusReset) {
+			for (i = 0; i < kVirtualMaxTarget; i++) {
+				globalsPtr->target[i].hung = FALSE;
+				globalsPtr->target[i].frozen = FALSE;
+			}
+			globalsPtr->busFreeMsec = 0;
+		}
+}
+
+/*
+ * Store the final result and call the completion routine (through the XPT).
+ * scsiResult is stored last: AsyncSCSI polls it.
+ */
+static void
+FinishPB(
+		VirtualSIMGlobalsPtr	globalsPtr,
+		void					*scsiPB,
+		OSErr					result
+	)
+{
+		((SCSIHdr *) scsiPB)->scsiResult = result;
+		if (globalsPtr->makeCallback != NULL)
+			(*globalsPtr->makeCallback)(scsiPB);
+}
+
+/*
+ * Return the target's pending sense data (or "no sense" if there is none).
+ */
+static unsigned char
+RequestSenseCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	)
+{
+		unsigned long			length;
+
+		if (targetPtr->senseValid == FALSE)
+			VirtualSIMSetSense(targetPtr, kScsiSenseNone, 0, 0);
+		length = scsiCommand->scsi6.len;
+		if (length > kVirtualSenseLength)
+			length = kVirtualSenseLength;
+		if (length > dataLength)
+			length = dataLength;
+		BlockMove((Ptr) &targetPtr->sense, dataPtr, length);
+		*actualCount = length;
+		targetPtr->senseValid = FALSE;
+		return (kScsiStatusGood);
+}
+
+void
+VirtualSIMSetSense(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseCode,
+		unsigned char			additionalSenseQualifier
+	)
+{
+		CLEAR(targetPtr->sense);
+		targetPtr->sense.errorCode = kScsiSenseCurrentErr;
+		targetPtr->sense.senseKey = senseKey;
+		targetPtr->sense.additionalSenseLength = kVirtualSenseLength - 8;
+		targetPtr->sense.additionalSenseCode = additionalSenseCode;
+		targetPtr->sense.additionalSenseQualifier = additionalSenseQualifier;
+		targetPtr->senseValid = TRUE;
+}
+
+/*
+ * The direct-access device model. If the target has no storage, reads
+ * return zeros and writes are discarded. If it is read-only, writes fail with
+ * Data Protect (Write Protected); otherwise, they set its modified flag.
+ */
+unsigned char
+VirtualDiskCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	)
+{
+		unsigned long			logicalBlock;
+		unsigned long			blockCount;
+		unsigned long			length;
+		register unsigned char	*replyPtr;
+		SCSI_Inquiry_Data		inquiry;
+		SCSI_Capacity_Data		capacity;
+		unsigned char			modeSense[12];
+		unsigned char			opcode;
+
+		opcode = scsiCommand->scsi[0];
+		*actualCount = 0;
+		replyPtr = NULL;
+		length = 0;
+		switch (opcode) {
+		case kScsiCmdTestUnitReady:
+		case kScsiCmdStartStopUnit:
+		case kScsiCmdPreventAllowRemoval:
+		case kScsiCmdSynchronizeCache:
+		case kScsiCmdVerify:
+		case kScsiCmdSeek6:
+		case kScsiCmdSeek10:
+		case kScsiCmdRezeroUnit:
+			return (kScsiStatusGood);
+		case kScsiCmdInquiry:
+			BuildInquiry(targetPtr, "VIRTUAL DISK", FALSE, &inquiry);
+			replyPtr = (unsigned char *) &inquiry;
+			length = 36;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdReadCapacity:
+			logicalBlock = targetPtr->blockCount - 1;
+			capacity.lbn4 = logicalBlock >> 24;
+			capacity.lbn3 = logicalBlock >> 16;
+			capacity.lbn2 = logicalBlock >> 8;
+			capacity.lbn1 = logicalBlock;
+			capacity.len4 = 0;
+			capacity.len3 = 0;
+			capacity.len2 = kVirtualBlockLength >> 8;
+			capacity.len1 = kVirtualBlockLength & 0xFF;
+			replyPtr = (unsigned char *) &capacity;
+			length = sizeof capacity;
+			break;
+		case kScsiCmdModeSense6:
+			/*
+			 * Return the header and one block descriptor (no pages).
+			 */
+			CLEAR(modeSense);
+			modeSense[0] = sizeof modeSense - 1;
+			if (targetPtr->readOnly)
+				modeSense[2] = 0x80;					/* Write protected		*/
+			modeSense[3] = 8;
+			modeSense[5] = targetPtr->blockCount >> 16;
+			modeSense[6] = targetPtr->blockCount >> 8;
+			modeSense[7] = targetPtr->blockCount;
+			modeSense[10] = kVirtualBlockLength >> 8;
+			modeSense[11] = kVirtualBlockLength & 0xFF;
+			replyPtr = modeSense;
+			length = sizeof modeSense;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdRead6:
+		case kScsiCmdWrite6:
+		case kScsiCmdRead10:
+		case kScsiCmdWrite10:
+			DecodeTransfer(scsiCommand, &logicalBlock, &blockCount);
+			if (logicalBlock >= targetPtr->blockCount
+			 || blockCount > targetPtr->blockCount - logicalBlock) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x21, 0);
+				return (kScsiStatusCheckCondition);
+			}
+			if (targetPtr->readOnly
+			 && (opcode == kScsiCmdWrite6 || opcode == kScsiCmdWrite10)) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseDataProtect, 0x27, 0);
+				return (kScsiStatusCheckCondition);
+			}
+			ModelSeek(
+				targetPtr, logicalBlock, blockCount, targetPtr->blockCount);
+			length = blockCount * kVirtualBlockLength;
+			if (length > dataLength)
+				length = dataLength;
+			if (opcode == kScsiCmdRead6 || opcode == kScsiCmdRead10) {
+				if (targetPtr->storage != NULL) {
+					BlockMove(
+						targetPtr->storage + logicalBlock * kVirtualBlockLength,
+						dataPtr,
+						length
+					);
+				}
+				else {
+					for (logicalBlock = 0;
+							logicalBlock < length;
+							logicalBlock++)
+						dataPtr[logicalBlock] = 0;
+				}
+			}
+			else if (targetPtr->storage != NULL) {
+				BlockMove(
+					dataPtr,
+					targetPtr->storage + logicalBlock * kVirtualBlockLength,
+					length
+				);
+				targetPtr->modified = TRUE;
+			}
+			*actualCount = length;
+			return (kScsiStatusGood);
+		default:
+			VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x20, 0);
+			return (kScsiStatusCheckCondition);
+		}
+		/*
+		 * Return a reply (Inquiry, Read Capacity, and Mode Sense).
+		 */
+		if (length > dataLength)
+			length = dataLength;
+		if (length > 0)
+			BlockMove((Ptr) replyPtr, dataPtr, length);
+		*actualCount = length;
+		return (kScsiStatusGood);
+}
+
+/*
+ * The CD-ROM device model. The capacity, in kVirtualCDBlockLength sectors,
+ * is a quarter of the target's blockCount. Without media, every command but
+ * Inquiry and the tray commands fails with Not Ready (Medium Not Present).
+ */
+unsigned char
+VirtualCDROMCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	)
+{
+		unsigned long			logicalBlock;
+		unsigned long			blockCount;
+		unsigned long			capacity;
+		unsigned long			length;
+		register unsigned char	*replyPtr;
+		SCSI_Inquiry_Data		inquiry;
+		SCSI_Capacity_Data		capacityData;
+		unsigned char			reply[20];
+		unsigned char			opcode;
+
+		opcode = scsiCommand->scsi[0];
+		*actualCount = 0;
+		if (RemovableReady(
+				targetPtr,
+				opcode,
+				opcode != kScsiCmdInquiry
+				 && opcode != kScsiCmdStartStopUnit
+				 && opcode != kScsiCmdPreventAllowRemoval) == FALSE)
+			return (kScsiStatusCheckCondition);
+		capacity = (targetPtr->blockCount * kVirtualBlockLength)
+				/ kVirtualCDBlockLength;
+		replyPtr = reply;
+		length = 0;
+		switch (opcode) {
+		case kScsiCmdTestUnitReady:
+		case kScsiCmdVerify:
+		case kScsiCmdSeek6:
+		case kScsiCmdSeek10:
+		case kScsiCmdRezeroUnit:
+			return (kScsiStatusGood);
+		case kScsiCmdStartStopUnit:
+			/*
+			 * With LoEj set, Start closes the tray and Stop opens it. The
+			 * spindle itself is not modelled.
+			 */
+			if ((scsiCommand->scsi6.len & 0x02) != 0) {
+				if ((scsiCommand->scsi6.len & 0x01) != 0) {
+					if (targetPtr->mediaPresent == FALSE)
+						LoadMedia(targetPtr, FALSE);
+				}
+				else if (targetPtr->mediaPresent
+						 && RemoveMedia(targetPtr) == FALSE) {
+					VirtualSIMSetSense(
+						targetPtr, kScsiSenseIllegalReq, 0x53, 0x02);
+					return (kScsiStatusCheckCondition);
+				}
+			}
+			return (kScsiStatusGood);
+		case kScsiCmdPreventAllowRemoval:
+			targetPtr->preventRemoval = (scsiCommand->scsi6.len & 0x01) != 0;
+			return (kScsiStatusGood);
+		case kScsiCmdInquiry:
+			BuildInquiry(targetPtr, "VIRTUAL CD-ROM", TRUE, &inquiry);
+			replyPtr = (unsigned char *) &inquiry;
+			length = 36;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdReadCapacity:
+			logicalBlock = capacity - 1;
+			capacityData.lbn4 = logicalBlock >> 24;
+			capacityData.lbn3 = logicalBlock >> 16;
+			capacityData.lbn2 = logicalBlock >> 8;
+			capacityData.lbn1 = logicalBlock;
+			capacityData.len4 = 0;
+			capacityData.len3 = 0;
+			capacityData.len2 = kVirtualCDBlockLength >> 8;
+			capacityData.len1 = kVirtualCDBlockLength & 0xFF;
+			replyPtr = (unsigned char *) &capacityData;
+			length = sizeof capacityData;
+			break;
+		case kScsiCmdModeSense6:
+			/*
+			 * The header (always write protected) and one block descriptor.
+			 */
+			CLEAR(reply);
+			reply[0] = 11;
+			reply[2] = 0x80;
+			reply[3] = 8;
+			reply[5] = capacity >> 16;
+			reply[6] = capacity >> 8;
+			reply[7] = capacity;
+			reply[10] = kVirtualCDBlockLength >> 8;
+			reply[11] = kVirtualCDBlockLength & 0xFF;
+			length = 12;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdReadCDTableOfContents:
+			/*
+			 * The disc has one data track. A starting track after track 1
+			 * returns only the lead-out.
+			 */
+			CLEAR(reply);
+			length = 4;
+			if (scsiCommand->scsi[6] <= 1) {
+				StoreTOCEntry(&reply[length], 1, 0L,
+					(scsiCommand->scsi[1] & 0x02) != 0);
+				length += 8;
+			}
+			StoreTOCEntry(&reply[length], 0xAA, capacity,
+				(scsiCommand->scsi[1] & 0x02) != 0);
+			length += 8;
+			reply[0] = (length - 2) >> 8;
+			reply[1] = (length - 2) & 0xFF;
+			reply[2] = 1;								/* First track			*/
+			reply[3] = 1;								/* Last track			*/
+			blockCount =
+				  (((unsigned long) scsiCommand->scsi10.len2) << 8)
+				| scsiCommand->scsi10.len1;
+			if (length > blockCount)
+				length = blockCount;
+			break;
+		case kScsiCmdRead6:
+		case kScsiCmdRead10:
+			DecodeTransfer(scsiCommand, &logicalBlock, &blockCount);
+			if (logicalBlock >= capacity
+			 || blockCount > capacity - logicalBlock) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x21, 0);
+				return (kScsiStatusCheckCondition);
+			}
+			ModelSeek(targetPtr, logicalBlock, blockCount, capacity);
+			length = blockCount * kVirtualCDBlockLength;
+			if (length > dataLength)
+				length = dataLength;
+			if (targetPtr->storage != NULL) {
+				BlockMove(
+					targetPtr->storage + logicalBlock * kVirtualCDBlockLength,
+					dataPtr,
+					length
+				);
+			}
+			else {
+				for (logicalBlock = 0; logicalBlock < length; logicalBlock++)
+					dataPtr[logicalBlock] = 0;
+			}
+			*actualCount = length;
+			return (kScsiStatusGood);
+		default:								/* Including writes		*/
+			VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x20, 0);
+			return (kScsiStatusCheckCondition);
+		}
+		if (length > dataLength)
+			length = dataLength;
+		if (length > 0)
+			BlockMove((Ptr) replyPtr, dataPtr, length);
+		*actualCount = length;
+		return (kScsiStatusGood);
+}
+
+/*
+ * The sequential-access (tape) device model. The tape is a sequence of
+ * kVirtualBlockLength blocks and filemarks. A filemark occupies a block
+ * position (its storage is unused), and headPosition is the position of
+ * the next block or filemark to be read. Reads and Space stop at a filemark
+ * (leaving the tape after it) or at the end of data; writes end the data at
+ * the current position. Only fixed-length blocks are supported.
+ */
+unsigned char
+VirtualTapeCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	)
+{
+		unsigned long			count;
+		unsigned long			records;
+		unsigned long			length;
+		unsigned long			offset;
+		Boolean					filemark;
+		register unsigned char	*replyPtr;
+		SCSI_Inquiry_Data		inquiry;
+		unsigned char			reply[12];
+		unsigned char			opcode;
+
+		opcode = scsiCommand->scsi[0];
+		*actualCount = 0;
+		if (RemovableReady(
+				targetPtr,
+				opcode,
+				opcode != kScsiCmdInquiry
+				 && opcode != kScsiCmdLoadUnload
+				 && opcode != kScsiCmdPreventAllowRemoval
+				 && opcode != kScsiCmdReadBlockLimits) == FALSE)
+			return (kScsiStatusCheckCondition);
+		/*
+		 * Transfer, filemark, and space counts are three bytes.
+		 */
+		count =
+			  (((unsigned long) scsiCommand->scsi[2]) << 16)
+			| (((unsigned long) scsiCommand->scsi[3]) << 8)
+			| scsiCommand->scsi[4];
+		replyPtr = reply;
+		length = 0;
+		switch (opcode) {
+		case kScsiCmdTestUnitReady:
+			return (kScsiStatusGood);
+		case kScsiCmdPreventAllowRemoval:
+			targetPtr->preventRemoval = (scsiCommand->scsi6.len & 0x01) != 0;
+			return (kScsiStatusGood);
+		case kScsiCmdLoadUnload:
+			/*
+			 * Load rewinds the tape (loading it again if it was unloaded);
+			 * Unload rewinds and ejects it.
+			 */
+			if ((scsiCommand->scsi6.len & 0x01) != 0) {
+				if (targetPtr->mediaPresent == FALSE)
+					LoadMedia(targetPtr, FALSE);
+				else {
+					TapeWind(targetPtr, 0L);
+				}
+			}
+			else if (targetPtr->mediaPresent) {
+				if (RemoveMedia(targetPtr) == FALSE) {
+					VirtualSIMSetSense(
+						targetPtr, kScsiSenseIllegalReq, 0x53, 0x02);
+					return (kScsiStatusCheckCondition);
+				}
+				TapeWind(targetPtr, 0L);
+			}
+			return (kScsiStatusGood);
+		case kScsiCmdRewind:
+			TapeWind(targetPtr, 0L);
+			return (kScsiStatusGood);
+		case kScsiCmdSpace:
+			/*
+			 * The count is a two's complement number: negative counts
+			 * space backward.
+			 */
+			return (TapeSpace(
+						targetPtr,
+						scsiCommand->scsi[1] & 0x07,
+						((count & 0x800000L) != 0)
+							? (long) count - 0x1000000L
+							: (long) count
+					));
+		case kScsiCmdInquiry:
+			BuildInquiry(targetPtr, "VIRTUAL TAPE", TRUE, &inquiry);
+			replyPtr = (unsigned char *) &inquiry;
+			length = 36;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdReadBlockLimits:
+			CLEAR(reply);
+			reply[2] = kVirtualBlockLength >> 8;		/* Maximum				*/
+			reply[3] = kVirtualBlockLength & 0xFF;
+			reply[4] = kVirtualBlockLength >> 8;		/* Minimum				*/
+			reply[5] = kVirtualBlockLength & 0xFF;
+			length = 6;
+			break;
+		case kScsiCmdModeSense6:
+			/*
+			 * The header (buffered mode) and one block descriptor.
+			 */
+			CLEAR(reply);
+			reply[0] = sizeof reply - 1;
+			reply[2] = 0x10;
+			if (targetPtr->readOnly)
+				reply[2] |= 0x80;						/* Write protected		*/
+			reply[3] = 8;
+			reply[10] = kVirtualBlockLength >> 8;
+			reply[11] = kVirtualBlockLength & 0xFF;
+			length = sizeof reply;
+			if (length > scsiCommand->scsi6.len)
+				length = scsiCommand->scsi6.len;
+			break;
+		case kScsiCmdWriteFilemarks:
+			if (targetPtr->readOnly) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseDataProtect, 0x27, 0);
+				return (kScsiStatusCheckCondition);
+			}
+			TapeTruncate(targetPtr);
+			for (records = 0; records < count; records++) {
+				if (targetPtr->filemarkCount >= kVirtualMaxFilemarks
+				 || targetPtr->headPosition >= targetPtr->blockCount) {
+					TapeSense(
+						targetPtr, kScsiSenseVolumeOverflow | kScsiSenseEOM,
+						0x02, count - records);
+					return (kScsiStatusCheckCondition);
+				}
+				targetPtr->filemark[targetPtr->filemarkCount++] =
+					targetPtr->headPosition;
+				targetPtr->endOfData = ++targetPtr->headPosition;
+			}
+			TapeStream(targetPtr, 0L);
+			return (kScsiStatusGood);
+		case kScsiCmdRead6:
+		case kScsiCmdWrite6:
+			if ((scsiCommand->scsi[1] & 0x01) == 0) {		/* Variable length	*/
+				VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x24, 0);
+				return (kScsiStatusCheckCondition);
+			}
+			if (opcode == kScsiCmdWrite6) {
+				if (targetPtr->readOnly) {
+					VirtualSIMSetSense(
+						targetPtr, kScsiSenseDataProtect, 0x27, 0);
+					return (kScsiStatusCheckCondition);
+				}
+				TapeTruncate(targetPtr);
+				records = targetPtr->blockCount - targetPtr->headPosition;
+			}
+			else {
+				records = TapeRecords(targetPtr, &filemark);
+			}
+			if (records > count)
+				records = count;
+			if (records > dataLength / kVirtualBlockLength)
+				records = dataLength / kVirtualBlockLength;
+			length = records * kVirtualBlockLength;
+			if (opcode == kScsiCmdWrite6) {
+				if (targetPtr->storage != NULL) {
+					BlockMove(
+						dataPtr,
+						targetPtr->storage
+							+ targetPtr->headPosition * kVirtualBlockLength,
+						length
+					);
+				}
+				targetPtr->modified = TRUE;
+				targetPtr->endOfData = targetPtr->headPosition + records;
+			}
+			else if (targetPtr->storage != NULL) {
+				BlockMove(
+					targetPtr->storage
+						+ targetPtr->headPosition * kVirtualBlockLength,
+					dataPtr,
+					length
+				);
+			}
+			else {
+				for (offset = 0; offset < length; offset++)
+					dataPtr[offset] = 0;
+			}
+			targetPtr->headPosition += records;
+			*actualCount = length;
+			TapeStream(targetPtr, length);
+			if (records == count)
+				return (kScsiStatusGood);
+			if (opcode == kScsiCmdWrite6) {
+				if (targetPtr->headPosition < targetPtr->blockCount)
+					return (kScsiStatusGood);			/* Short buffer			*/
+				TapeSense(
+					targetPtr, kScsiSenseVolumeOverflow | kScsiSenseEOM,
+					0x02, count - records);
+				return (kScsiStatusCheckCondition);
+			}
+			if (TapeRecords(targetPtr, &filemark) != 0)
+				return (kScsiStatusGood);				/* Short buffer			*/
+			return (TapeStopped(targetPtr, filemark, count - records));
+		default:
+			VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x20, 0);
+			return (kScsiStatusCheckCondition);
+		}
+		if (length > dataLength)
+			length = dataLength;
+		if (length > 0)
+			BlockMove((Ptr) replyPtr, dataPtr, length);
+		*actualCount = length;
+		return (kScsiStatusGood);
+}
+
+/*
+ * Return the logical block and block count of a Read or Write (6 or 10)
+ * command.
+ */
+static void
+DecodeTransfer(
+		const SCSI_Command		*scsiCommand,
+		unsigned long			*logicalBlock,
+		unsigned long			*blockCount
+	)
+{
+		if (scsiCommand->scsi[0] == kScsiCmdRead6
+		 || scsiCommand->scsi[0] == kScsiCmdWrite6) {
+			*logicalBlock =
+				  (((unsigned long) scsiCommand->scsi6.lbn3 & 0x1F) << 16)
+				| (((unsigned long) scsiCommand->scsi6.lbn2) << 8)
+				| scsiCommand->scsi6.lbn1;
+			*blockCount = scsiCommand->scsi6.len;
+			if (*blockCount == 0)
+				*blockCount = 256;
+		}
+		else {
+			*logicalBlock =
+				  (((unsigned long) scsiCommand->scsi10.lbn4) << 24)
+				| (((unsigned long) scsiCommand->scsi10.lbn3) << 16)
+				| (((unsigned long) scsiCommand->scsi10.lbn2) << 8)
+				| scsiCommand->scsi10.lbn1;
+			*blockCount =
+				  (((unsigned long) scsiCommand->scsi10.len2) << 8)
+				| scsiCommand->scsi10.len1;
+		}
+}
+
+static void
+BuildInquiry(
+		VirtualTargetPtr		targetPtr,
+		const char				*product,
+		Boolean					removable,
+		SCSI_Inquiry_Data		*inquiryPtr
+	)
+{
+		CLEAR(*inquiryPtr);
+		inquiryPtr->devType = targetPtr->deviceType;
+		if (removable)
+			inquiryPtr->devTypeMod = kScsiInquiryRMB;
+		inquiryPtr->version = 2;						/* SCSI-2				*/
+		inquiryPtr->format = 2;
+		inquiryPtr->length = 31;
+		inquiryPtr->flags = kScsiInquiryLinked;
+		CopyVendorString(
+			(char *) inquiryPtr->vendor, "SAMPLE", sizeof inquiryPtr->vendor);
+		CopyVendorString(
+			(char *) inquiryPtr->product, product, sizeof inquiryPtr->product);
+		CopyVendorString(
+			(char *) inquiryPtr->revision, "1.0", sizeof inquiryPtr->revision);
+}
+
+/*
+ * Seek model: a fixed settle time plus a time proportional to the distance
+ * the head moves. capacity is in the same units as logicalBlock.
+ */
+static void
+ModelSeek(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			logicalBlock,
+		unsigned long			blockCount,
+		unsigned long			capacity
+	)
+{
+		unsigned long			distance;
+
+		if (targetPtr->fullStrokeSeek != 0
+		 && logicalBlock != targetPtr->headPosition) {
+			distance = (logicalBlock > targetPtr->headPosition)
+				? logicalBlock - targetPtr->headPosition
+				: targetPtr->headPosition - logicalBlock;
+			targetPtr->modelDelay =
+				2L + (distance * targetPtr->fullStrokeSeek) / capacity;
+		}
+		targetPtr->headPosition = logicalBlock + blockCount;
+}
+
+/*
+ * Store one eight-byte table of contents entry for a data track, with its
+ * address as a logical block or (if msf is TRUE) as minutes, seconds, and
+ * frames. Track 1 starts two seconds into the disc.
+ */
+static void
+StoreTOCEntry(
+		unsigned char			*entryPtr,
+		unsigned char			track,
+		unsigned long			logicalBlock,
+		Boolean					msf
+	)
+{
+		entryPtr[1] = 0x14;							/* ADR 1, data track	*/
+		entryPtr[2] = track;
+		if (msf) {
+			logicalBlock += 150;						/* 75 frames per second	*/
+			entryPtr[5] = logicalBlock / (60L * 75L);
+			entryPtr[6] = (logicalBlock / 75L) % 60L;
+			entryPtr[7] = logicalBlock % 75L;
+		}
+		else {
+			entryPtr[4] = logicalBlock >> 24;
+			entryPtr[5] = logicalBlock >> 16;
+			entryPtr[6] = logicalBlock >> 8;
+			entryPtr[7] = logicalBlock;
+		}
+}
+
+/*
+ * Load the media. The target is not ready until its loadTime has elapsed.
+ * If attention is TRUE (the media was inserted by hand, rather than loaded
+ * by a command), it reports Unit Attention first.
+ */
+static void
+LoadMedia(
+		VirtualTargetPtr		targetPtr,
+		Boolean					attention
+	)
+{
+		targetPtr->mediaPresent = TRUE;
+		targetPtr->mediaChanged = attention;
+		targetPtr->readyMsec = NowMsec() + targetPtr->loadTime;
+		targetPtr->headPosition = 0;
+		targetPtr->streamMsec = 0;
+}
+
+/*
+ * Eject the media. Returns FALSE if the host has prevented its removal.
+ */
+static Boolean
+RemoveMedia(
+		VirtualTargetPtr		targetPtr
+	)
+{
+		if (targetPtr->preventRemoval)
+			return (FALSE);
+		targetPtr->mediaPresent = FALSE;
+		targetPtr->mediaChanged = FALSE;
+		return (TRUE);
+}
+
+/*
+ * Check a removable media target before it executes a command. A pending
+ * Unit Attention is reported to any command but Inquiry (and to Inquiry, too,
+ * if the target models one of the older devices that do so). If the command
+ * needs the media, the target is Not Ready if there is none, or if it is
+ * still becoming ready. Returns FALSE, with the sense data stored, if the
+ * command fails.
+ */
+static Boolean
+RemovableReady(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			opcode,
+		Boolean					needsMedia
+	)
+{
+		if (targetPtr->mediaChanged
+		 && (opcode != kScsiCmdInquiry || targetPtr->inquiryAttention)) {
+			targetPtr->mediaChanged = FALSE;
+			VirtualSIMSetSense(targetPtr, kScsiSenseUnitAtn, 0x28, 0);
+			return (FALSE);
+		}
+		if (needsMedia) {
+			if (targetPtr->mediaPresent == FALSE) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseNotReady, 0x3A, 0);
+				return (FALSE);
+			}
+			if (NowMsec() < targetPtr->readyMsec) {
+				VirtualSIMSetSense(targetPtr, kScsiSenseNotReady, 0x04, 0x01);
+				return (FALSE);
+			}
+		}
+		return (TRUE);
+}
+
+/*
+ * Return the number of data blocks between the tape position and the next
+ * filemark or the end of data. *filemarkPtr is TRUE if a filemark is next.
+ */
+static unsigned long
+TapeRecords(
+		VirtualTargetPtr		targetPtr,
+		Boolean					*filemarkPtr
+	)
+{
+		unsigned long			limit;
+		register short			i;
+
+		limit = targetPtr->endOfData;
+		*filemarkPtr = FALSE;
+		for (i = 0; i < targetPtr->filemarkCount; i++) {
+			if (targetPtr->filemark[i] >= targetPtr->headPosition) {
+				if (targetPtr->filemark[i] < limit) {
+					limit = targetPtr->filemark[i];
+					*filemarkPtr = TRUE;
+				}
+				break;
+			}
+		}
+		return (limit - targetPtr->headPosition);
+}
+
+/*
+ * A read or a forward space stopped short of its count, at a filemark (the
+ * tape is left after it) or at the end of data. residue is the count that
+ * remains.
+ */
+static unsigned char
+TapeStopped(
+		VirtualTargetPtr		targetPtr,
+		Boolean					filemark,
+		unsigned long			residue
+	)
+{
+		if (filemark) {
+			++targetPtr->headPosition;
+			TapeSense(
+				targetPtr, kScsiSenseNone | kScsiSenseFileMark, 0x01, residue);
+		}
+		else {
+			TapeSense(targetPtr, kScsiSenseBlankCheck, 0x05, residue);
+		}
+		return (kScsiStatusCheckCondition);
+}
+
+/*
+ * Writing ends the data at the tape position: filemarks after it are lost.
+ */
+static void
+TapeTruncate(
+		VirtualTargetPtr		targetPtr
+	)
+{
+		while (targetPtr->filemarkCount != 0
+			&& targetPtr->filemark[targetPtr->filemarkCount - 1]
+				>= targetPtr->headPosition)
+			--targetPtr->filemarkCount;
+		targetPtr->endOfData = targetPtr->headPosition;
+}
+
+/*
+ * Space over count blocks (code 0) or filemarks (code 1), backward if count
+ * is negative, or to the end of data (code 3). Spacing over blocks stops at
+ * a filemark. Spacing backward over filemarks leaves the tape before the
+ * last one passed; spacing backward stops at the beginning of the tape.
+ */
+static unsigned char
+TapeSpace(
+		VirtualTargetPtr		targetPtr,
+		unsigned short			code,
+		long					count
+	)
+{
+		unsigned long			position;
+		unsigned long			distance;
+		unsigned long			records;
+		Boolean					filemark;
+		register short			i;
+
+		position = targetPtr->headPosition;
+		distance = (count < 0) ? -count : count;
+		switch (code) {
+		case 0:											/* Blocks				*/
+			if (count >= 0) {
+				records = TapeRecords(targetPtr, &filemark);
+				if (records > distance)
+					records = distance;
+				TapeWind(targetPtr, position + records);
+				if (records < distance)
+					return (TapeStopped(
+						targetPtr, filemark, distance - records));
+				break;
+			}
+			for (i = targetPtr->filemarkCount - 1; i >= 0; --i) {
+				if (targetPtr->filemark[i] < position)
+					break;
+			}
+			records = position - ((i >= 0) ? targetPtr->filemark[i] + 1 : 0L);
+			if (records >= distance) {
+				TapeWind(targetPtr, position - distance);
+				break;
+			}
+			if (i >= 0) {							/* Stop before it		*/
+				TapeWind(targetPtr, targetPtr->filemark[i]);
+				TapeSense(
+					targetPtr, kScsiSenseNone | kScsiSenseFileMark,
+					0x01, distance - records);
+			}
+			else {
+				TapeWind(targetPtr, 0L);
+				TapeSense(
+					targetPtr, kScsiSenseNone | kScsiSenseEOM,
+					0x04, distance - records);
+			}
+			return (kScsiStatusCheckCondition);
+		case 1:											/* Filemarks			*/
+			if (count >= 0) {
+				for (i = 0;
+						i < targetPtr->filemarkCount && distance != 0;
+						i++) {
+					if (targetPtr->filemark[i] >= position) {
+						position = targetPtr->filemark[i] + 1;
+						--distance;
+					}
+				}
+				if (distance != 0) {
+					TapeWind(targetPtr, targetPtr->endOfData);
+					TapeSense(targetPtr, kScsiSenseBlankCheck, 0x05, distance);
+					return (kScsiStatusCheckCondition);
+				}
+			}
+			else {
+				for (i = targetPtr->filemarkCount - 1;
+						i >= 0 && distance != 0;
+						--i) {
+					if (targetPtr->filemark[i] < position) {
+						position = targetPtr->filemark[i];
+						--distance;
+					}
+				}
+				if (distance != 0) {
+					TapeWind(targetPtr, 0L);
+					TapeSense(
+						targetPtr, kScsiSenseNone | kScsiSenseEOM,
+						0x04, distance);
+					return (kScsiStatusCheckCondition);
+				}
+			}
+			TapeWind(targetPtr, position);
+			break;
+		case 3:											/* End of data			*/
+			TapeWind(targetPtr, targetPtr->endOfData);
+			break;
+		default:
+			VirtualSIMSetSense(targetPtr, kScsiSenseIllegalReq, 0x24, 0);
+			return (kScsiStatusCheckCondition);
+		}
+		return (kScsiStatusGood);
+}
+
+/*
+ * Store tape sense data: the additional sense code is zero, the sense key
+ * byte may include the Filemark, EOM, or ILI bits, and the information
+ * field holds the residue.
+ */
+static void
+TapeSense(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseQualifier,
+		unsigned long			residue
+	)
+{
+		VirtualSIMSetSense(targetPtr, senseKey, 0, additionalSenseQualifier);
+		targetPtr->sense.errorCode |= kScsiSenseHasLBN;		/* Info is valid	*/
+		targetPtr->sense.info[0] = residue >> 24;
+		targetPtr->sense.info[1] = residue >> 16;
+		targetPtr->sense.info[2] = residue >> 8;
+		targetPtr->sense.info[3] = residue;
+}
+
+/*
+ * The streaming model, for a transfer of byteCount bytes. If the previous
+ * transfer has not finished, this one waits for it. If it finished more than
+ * kVirtualStreamSlack msec ago (or the tape was stopped), the drive must
+ * reposition first. Remember when this transfer will finish.
+ */
+static void
+TapeStream(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			byteCount
+	)
+{
+		unsigned long			now;
+
+		now = NowMsec();
+		if (targetPtr->streamMsec != 0 && now < targetPtr->streamMsec)
+			targetPtr->modelDelay += targetPtr->streamMsec - now;
+		else if (targetPtr->streamMsec == 0
+			  || now > targetPtr->streamMsec + kVirtualStreamSlack) {
+			targetPtr->modelDelay += kVirtualReposition;
+			++targetPtr->repositions;
+		}
+		targetPtr->streamMsec =
+			now + targetPtr->latency + targetPtr->modelDelay;
+		if (targetPtr->transferRate != 0)
+			targetPtr->streamMsec += byteCount / targetPtr->transferRate;
+}
+
+/*
+ * Move the tape to a new position at high speed, without reading: winding
+ * the whole tape takes fullStrokeSeek msec. The tape stops there.
+ */
+static void
+TapeWind(
+		VirtualTargetPtr		targetPtr,
+		unsigned long			newPosition
+	)
+{
+		unsigned long			distance;
+
+		distance = (newPosition > targetPtr->headPosition)
+			? newPosition - targetPtr->headPosition
+			: targetPtr->headPosition - newPosition;
+		if (targetPtr->blockCount != 0)
+			targetPtr->modelDelay +=
+				(distance * targetPtr->fullStrokeSeek) / targetPtr->blockCount;
+		targetPtr->headPosition = newPosition;
+		targetPtr->streamMsec = 0;
+}
+
+/*
+ * Copy a C string into a fixed-length, blank-padded, field.
+ */
+static void
+CopyVendorString(
+		char					*dst,
+		const char				*src,
+		short					length
+	)
+{
+		register short			i;
+
+		for (i = 0; i < length && src[i] != '\0'; i++)
+			dst[i] = src[i];
+		for (; i < length; i++)
+			dst[i] = ' ';
+}
+
+static void NextFunction(void) { }	/* Dummy function for VirtualSIM size	*/
+
+static Boolean
+IsVirtualMemoryRunning(void)
+{
+		OSErr						status;
+		long						response;
+
+		status = Gestalt(gestaltVMAttr, &response);
+		/*
+		 * VM is active iff Gestalt succeeded and the response is appropriate.
+		 */
+		return (status == noErr && ((response & (1 << gestaltVMPresent)) != 0));
+}
@@ -0,0 +1,282 @@
+/*									VirtualSIM.h								*/
+/*
+ * VirtualSIM.h
+ * Copyright  1994 Apple Computer Inc. All rights reserved.
+ *
+ * The virtual SIM is a software SCSI interface module that registers a bus
+ * with SCSI Manager 4.3 (using SCSIRegisterBus) and implements its targets
+ * in memory. Requests to the virtual bus pass through the normal XPT path, so
+ * AsyncSCSI, DoListSCSIDevices, and the other commands in this sample can be
+ * exercised (and timed) without SCSI hardware. Each virtual target has its
+ * own latency, disconnect behavior, and error injection settings, and can
+ * be told to "hang" so that the watchdog recovery sequence can be tested.
+ * Besides the disk model, there are models for a CD-ROM player and a tape
+ * drive, whose removable media can be ejected and inserted (VirtualSIMSetMedia)
+ * so that the not-ready and unit attention paths can be exercised.
+ * Besides the one-shot error injection, each target may have a few fault
+ * rules (VirtualSIMAddFault) that make it return Busy, Queue Full, and so on,
+ * at random or on a schedule, so that the error paths can be timed.
+ */
+#ifndef __VirtualSIM__
+#define __VirtualSIM__
+#include "MacSCSICommand.h"
+
+#define kVirtualMaxTarget		7				/* Targets 0 .. 6 (7 is us)		*/
+#define kVirtualInitiatorID		7
+#define kVirtualBlockLength		512
+#define kVirtualCDBlockLength	2048			/* CD-ROM sector				*/
+#define kVirtualMaxFilemarks	16				/* Per tape						*/
+#define kVirtualMaxFaults		4				/* Fault rules per target		*/
+
+/*
+ * Fault kinds (see VirtualFault):
+ *	kVirtualFaultBusy			The target returns Busy status at once, without
+ *								executing the command.
+ *	kVirtualFaultQueueFull		The same, with Queue Full status.
+ *	kVirtualFaultUnitAttention	Check Condition, Unit Attention (Power On or
+ *								Reset), after the target's latency.
+ *	kVirtualFaultMediumError	Check Condition, Medium Error (Unrecovered
+ *								Read Error), after the target's latency.
+ *	kVirtualFaultTimeout		The command never completes: the SIM times it
+ *								out (scsiCommandTimeout) after the rule's
+ *								delay or, if that is zero, it is outstanding
+ *								until it is aborted (by the watchdog).
+ *	kVirtualFaultSelectTimeout	The target does not answer selection.
+ *	kVirtualFaultPhaseError		The target goes to an unexpected bus phase
+ *								(scsiSequenceFailed).
+ *	kVirtualFaultUnderrun		The command executes, but only half its data
+ *								is transferred (scsiDataRunError).
+ * The rule's delay is added to the command's latency: for example, the time
+ * a disk spends retrying before it reports a medium error.
+ */
+enum {
+	kVirtualFaultNone = 0,
+	kVirtualFaultBusy,
+	kVirtualFaultQueueFull,
+	kVirtualFaultUnitAttention,
+	kVirtualFaultMediumError,
+	kVirtualFaultTimeout,
+	kVirtualFaultSelectTimeout,
+	kVirtualFaultPhaseError,
+	kVirtualFaultUnderrun
+};
+
+/*
+ * A fault rule. If period is non-zero, the rule is a schedule: of every
+ * period commands, the first burst fail. Otherwise, each command fails with
+ * the given probability and, when one does, so do the next burst - 1 (an
+ * error storm). Request Sense, and commands to other logical units, never
+ * fail. If a target has several rules, the first that fires is used.
+ */
+struct VirtualFault {
+	unsigned short		kind;					/* kVirtualFaultBusy, etc.		*/
+	unsigned short		probability;			/* Per 1000 commands			*/
+	unsigned short		period;					/* Schedule, 0 = random			*/
+	unsigned short		burst;					/* Failures in a row (0 = 1)	*/
+	unsigned long		limit;					/* Stop after this many, 0 = no	*/
+	unsigned long		delay;					/* Added latency (msec)			*/
+	unsigned long		injected;				/* <- Faults injected			*/
+	unsigned long		sequence;				/* Used by the SIM				*/
+	unsigned short		stormLeft;				/* Used by the SIM				*/
+};
+typedef struct VirtualFault VirtualFault, *VirtualFaultPtr;
+
+typedef struct VirtualTarget VirtualTarget, *VirtualTargetPtr;
+/*
+ * A device model executes one command. It stores data for Data In commands
+ * in dataPtr (at most dataLength bytes), or takes data for Data Out commands
+ * from dataPtr, and sets *actualCount to the number of bytes transferred.
+ * It returns the status phase byte. If it returns Check Condition, it must
+ * have stored the sense data in targetPtr->sense. It may add to the command's
+ * latency by setting targetPtr->modelDelay (for example, to model a seek).
+ * Device models are called from the SIM action routine, and may be called at
+ * interrupt level: they must not move memory.
+ */
+typedef unsigned char (*VirtualCommandProc)(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	);
+
+struct VirtualTarget {
+	VirtualCommandProc	commandProc;			/* NULL if no device here		*/
+	unsigned char		deviceType;				/* Inquiry device type			*/
+	Boolean				disconnects;			/* Can disconnect				*/
+	Boolean				hung;					/* TRUE: never complete			*/
+	Boolean				frozen;					/* SIM queue is frozen			*/
+	unsigned long		latency;				/* Command latency (msec)		*/
+	unsigned long		blockCount;				/* Capacity (blocks)			*/
+	Ptr					storage;				/* Media data (may be NULL)		*/
+	Boolean				readOnly;				/* Media is write-protected		*/
+	Boolean				modified;				/* Written since last cleared	*/
+	unsigned short		injectCount;			/* Fail this many commands		*/
+	unsigned char		injectSenseKey;			/* with this sense key			*/
+	unsigned char		injectSenseCode;		/* and additional sense code	*/
+	Boolean				senseValid;				/* sense has unreported data	*/
+	SCSI_Sense_Data		sense;					/* For Request Sense			*/
+	unsigned long		commands;				/* Commands executed			*/
+	unsigned long		bytesTransferred;		/* Data phase bytes				*/
+	unsigned long		checkConditions;		/* Check Condition returned		*/
+	unsigned long		fullStrokeSeek;			/* Seek model (msec), 0 = none	*/
+	unsigned long		headPosition;			/* Block after last transfer	*/
+	unsigned long		modelDelay;				/* Set by model (msec)			*/
+	unsigned long		transferRate;			/* Bytes per msec, 0 = instant	*/
+	/*
+	 * These are used by the removable media (CD-ROM and tape) models.
+	 */
+	Boolean				mediaPresent;			/* Media is loaded				*/
+	Boolean				mediaChanged;			/* Unit Attention is pending	*/
+	Boolean				preventRemoval;			/* Prevent Medium Removal		*/
+	Boolean				inquiryAttention;		/* Inquiry reports it, too		*/
+	unsigned long		loadTime;				/* Becoming ready (msec)		*/
+	unsigned long		readyMsec;				/* Not ready until this time	*/
+	unsigned long		endOfData;				/* Tape: block after the last	*/
+	unsigned long		streamMsec;				/* Tape: when transfers end		*/
+	unsigned long		repositions;			/* Tape: stopped and restarted	*/
+	unsigned short		filemarkCount;
+	unsigned long		filemark[kVirtualMaxFilemarks];	/* Tape: ascending		*/
+	/*
+	 * Fault injection (VirtualSIMAddFault).
+	 */
+	VirtualFault		fault[kVirtualMaxFaults];	/* kind 0 = unused			*/
+	unsigned long		faultSeed;				/* Random number generator		*/
+	unsigned long		faults;					/* Faults injected				*/
+};
+
+/*
+ * Install the virtual bus with its default population (a fast RAM disk and a
+ * slow, seeking, disk, both of which disconnect). Returns noErr if
+ * already installed, unimpErr if SCSI Manager 4.3 is not present.
+ */
+OSErr						VirtualSIMInstall(void);
+/*
+ * Complete any outstanding requests and remove the virtual bus. This must be
+ * called before the application quits.
+ */
+void						VirtualSIMRemove(void);
+/*
+ * Return TRUE (and the bus number) if the virtual bus is installed.
+ */
+Boolean						VirtualSIMBusID(
+		unsigned short			*busID
+	);
+/*
+ * Configure a target. commandProc NULL removes the target. If blockCount is
+ * non-zero, the target's media is allocated in the System heap (and it holds
+ * zeros). Returns memFullErr if the media could not be allocated.
+ */
+OSErr						VirtualSIMSetTarget(
+		unsigned short			targetID,
+		VirtualCommandProc		commandProc,
+		unsigned char			deviceType,
+		unsigned long			blockCount,
+		unsigned long			latency,			/* msec					*/
+		Boolean					disconnects
+	);
+/*
+ * Return the target record (NULL if the bus isn't installed or the target
+ * ID is invalid). Tests may examine or change its fields.
+ */
+VirtualTargetPtr			VirtualSIMGetTarget(
+		unsigned short			targetID
+	);
+/*
+ * Make the next count commands to this target fail with Check Condition.
+ */
+void						VirtualSIMInjectError(
+		unsigned short			targetID,
+		unsigned short			count,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseCode
+	);
+/*
+ * Add a fault rule to a target. Only the rule's parameters are used: its
+ * statistics start from zero. Returns paramErr if there is no such target,
+ * or if it has kVirtualMaxFaults rules already.
+ */
+OSErr						VirtualSIMAddFault(
+		unsigned short			targetID,
+		const VirtualFault		*faultPtr
+	);
+/*
+ * Remove all of a target's fault rules, and restart its random number
+ * generator from seed, so that a run can be repeated exactly.
+ */
+void						VirtualSIMClearFaults(
+		unsigned short			targetID,
+		unsigned long			seed
+	);
+/*
+ * If hung is TRUE, the target accepts commands, but never completes them:
+ * they remain outstanding until they are aborted or the device or bus is
+ * reset. Resets clear the hung state.
+ */
+void						VirtualSIMHangTarget(
+		unsigned short			targetID,
+		Boolean					hung
+	);
+/*
+ * Insert (present TRUE) or eject the media of a removable media target. The
+ * same media (its storage) is re-inserted: use VirtualSIMGetTarget to change
+ * its contents while it is ejected. Inserting the media makes the target
+ * report Unit Attention (Medium Changed) once, and Not Ready (Becoming
+ * Ready) until its loadTime has elapsed; a tape is rewound. Returns fBsyErr
+ * if the host has prevented removal, paramErr if there is no such target.
+ */
+OSErr						VirtualSIMSetMedia(
+		unsigned short			targetID,
+		Boolean					present
+	);
+/*
+ * Store sense data in the target record. Device models call this before
+ * returning Check Condition.
+ */
+void						VirtualSIMSetSense(
+		VirtualTargetPtr		targetPtr,
+		unsigned char			senseKey,
+		unsigned char			additionalSenseCode,
+		unsigned char			additionalSenseQualifier
+	);
+/*
+ * The direct-access (disk) model. This is also a useful starting point for
+ * other device models.
+ */
+unsigned char				VirtualDiskCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	);
+/*
+ * The CD-ROM model: read-only media of kVirtualCDBlockLength sectors (the
+ * target's blockCount is in kVirtualBlockLength units, as for a disk), a
+ * single data track in the table of contents, and a tray that Start/Stop
+ * Unit can open and close. Seeks are modelled as for the disk.
+ */
+unsigned char				VirtualCDROMCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	);
+/*
+ * The sequential-access (tape) model: fixed kVirtualBlockLength blocks,
+ * filemarks, end of data, and end of medium (the target's blockCount). The
+ * tape streams at the target's transferRate as long as the host keeps up:
+ * if it does not, the drive must stop and reposition before the next
+ * transfer. Spacing and rewinding take time in proportion to the distance,
+ * fullStrokeSeek being the time to wind the whole tape.
+ */
+unsigned char				VirtualTapeCommand(
+		VirtualTargetPtr		targetPtr,
+		const SCSI_Command		*scsiCommand,
+		Ptr						dataPtr,
+		unsigned long			dataLength,
+		unsigned long			*actualCount
+	);
+
+#endif /* __VirtualSIM__ */